@@ -0,0 +1,487 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <ctime>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sdglib/workspace/WorkSpace.hpp>
+#include <sdglib/factories/KMerFactory.hpp>
+#include <sdglib/indexers/NKmerIndex.hpp>
+#include <sdglib/indexers/SatKmerIndex.hpp>
+#include <sdglib/indexers/UniqueKmerIndex.hpp>
+#include <sdglib/batch_counter/BatchKmersCounter.hpp>
+#include <sdglib/processors/GraphMaker.hpp>
+#include <sdglib/datastores/ReadSequenceBuffer.hpp>
+#include <sdglib/utilities/omp_safe.hpp>
+#include "cxxopts/cxxopts.hpp"
+
+const std::string program_name("sdg-bench");
+
+/**
+ * @brief A graph with a paired and a long reads datastore on its own WorkSpace, with the inputs the benchmarks share
+ */
+struct BenchDataset {
+    std::string name;
+    std::string workdir;
+    WorkSpace ws;
+    std::vector<std::string> paired_fastqs;
+    std::vector<std::string> reads;     //paired read sequences
+    std::vector<uint64_t> read_kmers;   //sorted distinct canonical 31-mers seen 3 or more times in the paired reads
+    uint64_t read_bases = 0;
+    uint64_t graph_bases = 0;
+};
+
+/**
+ * @brief A timed operation on a dataset. setup() is run before every repetition and not timed, run() returns how many
+ * items it processed, which gives the throughput.
+ */
+struct Benchmark {
+    std::string name;
+    std::string unit;
+    std::function<void(BenchDataset &)> setup;
+    std::function<uint64_t(BenchDataset &)> run;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string dataset;
+    int threads;
+    std::string unit;
+    uint64_t items;
+    std::vector<double> times; //seconds, one per repetition
+
+    double median() const {
+        auto t = times;
+        std::sort(t.begin(), t.end());
+        return t[t.size() / 2];
+    }
+};
+
+static std::string random_sequence(std::mt19937_64 &rng, uint64_t size) {
+    std::string s(size, 'A');
+    for (auto &c: s) c = "ACGT"[rng() % 4];
+    return s;
+}
+
+static std::string reverse_complement(std::string s) {
+    std::reverse(s.begin(), s.end());
+    for (auto &c: s) c = (c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : 'A');
+    return s;
+}
+
+static void add_errors(std::mt19937_64 &rng, std::string &s, double rate) {
+    std::uniform_real_distribution<double> u(0, 1);
+    for (auto &c: s) if (u(rng) < rate) c = "ACGT"[(std::string("ACGT").find(c) + 1 + rng() % 3) % 4];
+}
+
+static void write_fastq_record(std::ofstream &f, const std::string &name, const std::string &seq) {
+    f << "@" << name << "\n" << seq << "\n+\n" << std::string(seq.size(), 'I') << "\n";
+}
+
+/**
+ * @brief A random genome with a few repeated segments, split in contigs for the graph, with simulated 2x150bp paired
+ * reads (0.2% errors) and 10Kbp long reads (1% errors) from both strands.
+ */
+static void make_synthetic_dataset(BenchDataset &d, uint64_t genome_size, int paired_coverage, int long_coverage) {
+    std::mt19937_64 rng(42);
+    auto genome = random_sequence(rng, genome_size);
+    for (auto r = 0; r < 20 and genome_size > 20000; ++r) {
+        auto from = rng() % (genome_size - 2000), to = rng() % (genome_size - 2000);
+        std::copy(genome.begin() + from, genome.begin() + from + 2000, genome.begin() + to);
+    }
+    for (uint64_t p = 0; p < genome_size; p += 50000) d.ws.sdg.add_node(genome.substr(p, 50000), NodeStatus::Active);
+
+    const uint64_t read_size = 150, fragment_size = 500;
+    d.paired_fastqs = {d.workdir + "/synthetic_R1.fastq", d.workdir + "/synthetic_R2.fastq"};
+    {
+        std::ofstream r1(d.paired_fastqs[0]), r2(d.paired_fastqs[1]);
+        for (uint64_t i = 0; i < genome_size * paired_coverage / (2 * read_size); ++i) {
+            auto fragment = genome.substr(rng() % (genome_size - fragment_size), fragment_size);
+            if (rng() % 2) fragment = reverse_complement(fragment);
+            auto s1 = fragment.substr(0, read_size), s2 = reverse_complement(fragment.substr(fragment_size - read_size));
+            add_errors(rng, s1, 0.002);
+            add_errors(rng, s2, 0.002);
+            write_fastq_record(r1, "p" + std::to_string(i) + "/1", s1);
+            write_fastq_record(r2, "p" + std::to_string(i) + "/2", s2);
+        }
+    }
+    const uint64_t long_size = std::min((uint64_t) 10000, genome_size / 2);
+    {
+        std::ofstream lr(d.workdir + "/synthetic_long.fastq");
+        for (uint64_t i = 0; i < genome_size * long_coverage / long_size; ++i) {
+            auto s = genome.substr(rng() % (genome_size - long_size), long_size);
+            if (rng() % 2) s = reverse_complement(s);
+            add_errors(rng, s, 0.01);
+            write_fastq_record(lr, "l" + std::to_string(i), s);
+        }
+    }
+    PairedReadsDatastore::build_from_fastq(d.workdir + "/synthetic.prseq", d.paired_fastqs[0], d.paired_fastqs[1], "pe", 0, 250);
+    LongReadsDatastore::build_from_fastq(d.workdir + "/synthetic.loseq", "lr", d.workdir + "/synthetic_long.fastq");
+}
+
+/**
+ * @brief The graph, paired reads and long reads bundled with the tests
+ */
+static void make_bundled_dataset(BenchDataset &d, const std::string &datasets_dir) {
+    d.ws.sdg.load_from_fasta(datasets_dir + "/dbg_test/assembled.fa");
+    d.paired_fastqs = {datasets_dir + "/workspace/pe/pe_R1.fastq", datasets_dir + "/workspace/pe/pe_R2.fastq"};
+    PairedReadsDatastore::build_from_fastq(d.workdir + "/bundled.prseq", d.paired_fastqs[0], d.paired_fastqs[1], "pe", 0, 250);
+    LongReadsDatastore::build_from_fastq(d.workdir + "/bundled.loseq", "lr", datasets_dir + "/workspace/long_reads/long_reads.fastq");
+}
+
+static void load_dataset(BenchDataset &d) {
+    d.ws.add_paired_reads_datastore(d.workdir + "/" + d.name + ".prseq", "pe");
+    d.ws.add_long_reads_datastore(d.workdir + "/" + d.name + ".loseq", "lr");
+    auto &pds = d.ws.paired_reads_datastores[0];
+    ReadSequenceBuffer rsb(pds);
+    for (uint64_t rid = 1; rid <= pds.size(); ++rid) {
+        d.reads.emplace_back(rsb.get_read_sequence(rid));
+        d.read_bases += d.reads.back().size();
+    }
+    for (sgNodeID_t n = 0; n < d.ws.sdg.nodes.size(); ++n) d.graph_bases += d.ws.sdg.get_node_size(n);
+    std::vector<uint64_t> all_kmers;
+    StringKMerFactory skf(31);
+    for (auto &r: d.reads) skf.create_kmers(r, all_kmers);
+    sdglib::sort(all_kmers.begin(), all_kmers.end());
+    for (uint64_t i = 0; i < all_kmers.size();) {
+        auto j = i;
+        while (j < all_kmers.size() and all_kmers[j] == all_kmers[i]) ++j;
+        if (j - i >= 3) d.read_kmers.emplace_back(all_kmers[i]);
+        i = j;
+    }
+}
+
+/**
+ * @brief Looks up every k-mer of every paired read with lookup(kmer), which returns true on a hit
+ */
+template<class LOOKUP>
+static uint64_t lookup_read_kmers(const BenchDataset &d, uint8_t k, LOOKUP lookup) {
+    uint64_t queries = 0, hits = 0;
+#pragma omp parallel reduction(+:queries,hits)
+    {
+        StreamKmerFactory skf(k);
+        std::vector<std::pair<bool, uint64_t>> kmers;
+#pragma omp for schedule(dynamic,1000)
+        for (uint64_t i = 0; i < d.reads.size(); ++i) {
+            kmers.clear();
+            skf.produce_all_kmers(d.reads[i].c_str(), kmers);
+            for (auto &km: kmers) if (lookup(km.second)) ++hits;
+            queries += kmers.size();
+        }
+    }
+    if (hits == 0) sdglib::OutputLog(sdglib::WARN) << "No read k-mers found in the index" << std::endl;
+    return queries;
+}
+
+static uint64_t file_size(const std::string &filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static std::vector<Benchmark> all_benchmarks() {
+    std::vector<Benchmark> b;
+    b.push_back({"kmers/StringKMerFactory_k31", "kmers", nullptr, [](BenchDataset &d) {
+        uint64_t kmers = 0;
+#pragma omp parallel reduction(+:kmers)
+        {
+            StringKMerFactory skf(31);
+            std::vector<uint64_t> rkmers;
+#pragma omp for schedule(dynamic,1000)
+            for (uint64_t i = 0; i < d.reads.size(); ++i) {
+                rkmers.clear();
+                skf.create_kmers(d.reads[i], rkmers);
+                kmers += rkmers.size();
+            }
+        }
+        return kmers;
+    }});
+    b.push_back({"kmers/StreamKmerFactory128_k63", "kmers", nullptr, [](BenchDataset &d) {
+        uint64_t kmers = 0;
+#pragma omp parallel reduction(+:kmers)
+        {
+            StreamKmerFactory128 skf(63);
+            std::vector<__uint128_t> rkmers;
+#pragma omp for schedule(dynamic,1000)
+            for (uint64_t i = 0; i < d.reads.size(); ++i) {
+                rkmers.clear();
+                skf.produce_all_kmers(d.reads[i].c_str(), rkmers);
+                kmers += rkmers.size();
+            }
+        }
+        return kmers;
+    }});
+
+    //indexes are built once per dataset for the lookup benchmarks
+    auto nki = std::make_shared<std::shared_ptr<NKmerIndex>>();
+    auto ski = std::make_shared<std::shared_ptr<SatKmerIndex>>();
+    auto uki = std::make_shared<std::shared_ptr<UniqueKmerIndex>>();
+    auto nki_dataset = std::make_shared<std::string>();
+    auto ski_dataset = std::make_shared<std::string>();
+    auto uki_dataset = std::make_shared<std::string>();
+    b.push_back({"index/NKmerIndex_build_k15", "bases", nullptr, [](BenchDataset &d) {
+        NKmerIndex index(d.ws.sdg, 15, 200);
+        return d.graph_bases;
+    }});
+    b.push_back({"index/NKmerIndex_lookup_k15", "queries", [=](BenchDataset &d) {
+        if (*nki_dataset != d.name) *nki = std::make_shared<NKmerIndex>(d.ws.sdg, 15, 200, 0.01, true);
+        *nki_dataset = d.name;
+    }, [=](BenchDataset &d) {
+        const auto &index = **nki;
+        return lookup_read_kmers(d, 15, [&](uint64_t kmer) {
+            auto it = index.find(kmer);
+            return it != index.end() and it->kmer == kmer;
+        });
+    }});
+    b.push_back({"index/SatKmerIndex_build_k15", "bases", nullptr, [](BenchDataset &d) {
+        SatKmerIndex index(d.ws.sdg, 15, 200);
+        return d.graph_bases;
+    }});
+    b.push_back({"index/SatKmerIndex_lookup_k15", "queries", [=](BenchDataset &d) {
+        if (*ski_dataset != d.name) *ski = std::make_shared<SatKmerIndex>(d.ws.sdg, 15, 200);
+        *ski_dataset = d.name;
+    }, [=](BenchDataset &d) {
+        const auto &index = **ski;
+        return lookup_read_kmers(d, 15, [&](uint64_t kmer) { return index.endCO(kmer) > index.beginCO(kmer); });
+    }});
+    b.push_back({"index/UniqueKmerIndex_build_k31", "bases", nullptr, [](BenchDataset &d) {
+        UniqueKmerIndex index(d.ws.sdg, 31);
+        return d.graph_bases;
+    }});
+    b.push_back({"index/UniqueKmerIndex_lookup_k31", "queries", [=](BenchDataset &d) {
+        if (*uki_dataset != d.name) *uki = std::make_shared<UniqueKmerIndex>(d.ws.sdg, 31);
+        *uki_dataset = d.name;
+    }, [=](BenchDataset &d) {
+        const auto &index = **uki;
+        return lookup_read_kmers(d, 31, [&](uint64_t kmer) { return index.find(kmer) != index.end(); });
+    }});
+
+    b.push_back({"KmerCounter/add_count_k31", "bases", [](BenchDataset &d) {
+        if (d.ws.kmer_counters.empty()) d.ws.add_kmer_counter("bench", 31);
+        auto &kc = d.ws.kmer_counters[0];
+        kc.counts.resize(1);
+        kc.count_names.resize(1);
+        kc.wide_counts.resize(1);
+    }, [](BenchDataset &d) {
+        d.ws.kmer_counters[0].add_count("pe", d.ws.paired_reads_datastores[0]);
+        return d.read_bases;
+    }});
+    b.push_back({"BatchKmersCounter/buildKMerCount_k31", "bases", nullptr, [](BenchDataset &d) {
+        BatchKmersCounter::buildKMerCount(31, d.ws.paired_reads_datastores[0], 2, "", d.workdir, 0);
+        return d.read_bases;
+    }});
+    b.push_back({"PairedReadsMapper/map_reads", "reads", nullptr, [](BenchDataset &d) {
+        auto &pds = d.ws.paired_reads_datastores[0];
+        pds.mapper.remap_all_reads();
+        return pds.size();
+    }});
+    b.push_back({"LongReadsMapper/map_reads", "reads", nullptr, [](BenchDataset &d) {
+        auto &lds = d.ws.long_reads_datastores[0];
+        lds.mapper.map_reads();
+        return lds.size();
+    }});
+    b.push_back({"GraphMaker/unitigs_k31", "kmers", nullptr, [](BenchDataset &d) {
+        WorkSpace scratch;
+        GraphMaker gm(scratch.sdg);
+        gm.new_graph_from_kmerlist_trivial64(d.read_kmers, 31);
+        return d.read_kmers.size();
+    }});
+    b.push_back({"WorkSpace/dump", "bytes", nullptr, [](BenchDataset &d) {
+        auto filename = d.workdir + "/" + d.name + ".sdgws";
+        d.ws.dump_to_disk(filename);
+        return file_size(filename);
+    }});
+    b.push_back({"WorkSpace/load", "bytes", [](BenchDataset &d) {
+        auto filename = d.workdir + "/" + d.name + ".sdgws";
+        if (file_size(filename) == 0) d.ws.dump_to_disk(filename);
+    }, [](BenchDataset &d) {
+        auto filename = d.workdir + "/" + d.name + ".sdgws";
+        WorkSpace loaded(filename);
+        return file_size(filename);
+    }});
+    return b;
+}
+
+static std::string json_string(const std::string &s) {
+    std::string r = "\"";
+    for (auto c: s) {
+        if (c == '"' or c == '\\') r += '\\';
+        r += c;
+    }
+    return r + "\"";
+}
+
+/**
+ * @brief Writes the results with google benchmark's JSON layout: a context object and one entry per benchmark and
+ * thread count, with times in milliseconds
+ */
+static void write_json(const std::string &filename, const std::vector<BenchResult> &results,
+                       const std::map<std::string, std::string> &context) {
+    std::ofstream json(filename);
+    char date_str[32];
+    auto t = std::time(nullptr);
+    std::strftime(date_str, sizeof(date_str), "%Y-%m-%dT%H:%M:%S", std::localtime(&t));
+    json << "{\n  \"context\": {\n";
+    json << "    \"date\": " << json_string(date_str) << ",\n";
+    json << "    \"num_cpus\": " << omp_get_num_procs() << ",\n";
+    json << "    \"git_origin\": " << json_string(GIT_ORIGIN_URL) << ",\n";
+    json << "    \"git_branch\": " << json_string(GIT_BRANCH) << ",\n";
+    json << "    \"git_commit\": " << json_string(GIT_COMMIT_HASH);
+    for (auto &c: context) json << ",\n    " << json_string(c.first) << ": " << json_string(c.second);
+    json << "\n  },\n  \"benchmarks\": [";
+    for (auto i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        auto median = r.median();
+        json << (i ? ",\n" : "\n") << "    {\n";
+        json << "      \"name\": " << json_string(r.dataset + "/" + r.name + "/threads:" + std::to_string(r.threads)) << ",\n";
+        json << "      \"run_name\": " << json_string(r.dataset + "/" + r.name) << ",\n";
+        json << "      \"dataset\": " << json_string(r.dataset) << ",\n";
+        json << "      \"threads\": " << r.threads << ",\n";
+        json << "      \"repetitions\": " << r.times.size() << ",\n";
+        json << "      \"real_time\": " << median * 1000 << ",\n";
+        json << "      \"min_time\": " << *std::min_element(r.times.begin(), r.times.end()) * 1000 << ",\n";
+        json << "      \"max_time\": " << *std::max_element(r.times.begin(), r.times.end()) * 1000 << ",\n";
+        json << "      \"time_unit\": \"ms\",\n";
+        json << "      \"items\": " << r.items << ",\n";
+        json << "      \"item_unit\": " << json_string(r.unit) << ",\n";
+        json << "      \"items_per_second\": " << (median > 0 ? r.items / median : 0) << "\n    }";
+    }
+    json << "\n  ]\n}\n";
+}
+
+int main(int argc, char * argv[]) {
+    std::cout << "Welcome to " << program_name << std::endl << std::endl;
+    std::cout << "Git origin: " << GIT_ORIGIN_URL << " -> " << GIT_BRANCH << std::endl;
+    std::cout << "Git commit: " << GIT_COMMIT_HASH << std::endl << std::endl;
+
+    std::string output, filter, workdir("sdg_bench"), datasets_dir(SDG_BENCH_DATASETS);
+    std::vector<int> threads;
+    uint64_t genome_size = 2000000;
+    int repetitions = 3, paired_coverage = 30, long_coverage = 10;
+    bool no_synthetic = false, no_bundled = false, verbose = false, list = false;
+    try {
+        cxxopts::Options options(program_name, "SDG benchmarks for the core library");
+
+        options.add_options()
+                ("help", "Print help")
+                ("o,output", "JSON output file", cxxopts::value(output))
+                ("f,filter", "only run benchmarks whose dataset/name contains this", cxxopts::value(filter))
+                ("t,threads", "thread count to run with (multi, default: 1 and all available)", cxxopts::value(threads))
+                ("r,repetitions", "repetitions of each benchmark, the median time is reported", cxxopts::value(repetitions))
+                ("w,workdir", "directory for the generated datastores and files", cxxopts::value(workdir))
+                ("list", "list the benchmarks and exit", cxxopts::value(list))
+                ("v,verbose", "show the library's log while benchmarking", cxxopts::value(verbose));
+        options.add_options("Datasets")
+                ("datasets", "directory with the bundled test datasets", cxxopts::value(datasets_dir))
+                ("genome_size", "synthetic genome size", cxxopts::value(genome_size))
+                ("paired_coverage", "synthetic paired reads coverage", cxxopts::value(paired_coverage))
+                ("long_coverage", "synthetic long reads coverage", cxxopts::value(long_coverage))
+                ("no_synthetic", "skip the synthetic dataset", cxxopts::value(no_synthetic))
+                ("no_bundled", "skip the bundled dataset", cxxopts::value(no_bundled));
+
+        auto result(options.parse(argc, argv));
+
+        if (result.count("help")) {
+            std::cout << options.help({"", "Datasets"}) << std::endl;
+            exit(0);
+        }
+        if (repetitions < 1) throw cxxopts::OptionException(" please specify at least one repetition");
+        if (genome_size < 20000) throw cxxopts::OptionException(" please specify a genome size of at least 20000");
+    } catch (const cxxopts::OptionException &e) {
+        std::cout << "Error parsing options: " << e.what() << std::endl << std::endl
+                  << "Use option --help to check command line arguments." << std::endl;
+        exit(1);
+    }
+
+    auto benchmarks = all_benchmarks();
+    if (list) {
+        for (auto &b: benchmarks) std::cout << b.name << " (" << b.unit << ")" << std::endl;
+        exit(0);
+    }
+    if (threads.empty()) {
+        threads.emplace_back(1);
+        if (omp_get_max_threads() > 1) threads.emplace_back(omp_get_max_threads());
+    }
+    mkdir(workdir.c_str(), 0755);
+
+    //the library logs to std::cout, which is muted while building datasets and benchmarking
+    std::ofstream null_output("/dev/null");
+    auto cout_buffer = std::cout.rdbuf();
+    std::vector<std::unique_ptr<BenchDataset>> datasets;
+    if (not no_synthetic) {
+        std::cout << "Generating synthetic dataset: " << genome_size << "bp genome, " << paired_coverage
+                  << "x paired reads, " << long_coverage << "x long reads" << std::endl;
+        datasets.emplace_back(new BenchDataset());
+        datasets.back()->name = "synthetic";
+        datasets.back()->workdir = workdir;
+        if (not verbose) std::cout.rdbuf(null_output.rdbuf());
+        make_synthetic_dataset(*datasets.back(), genome_size, paired_coverage, long_coverage);
+        std::cout.rdbuf(cout_buffer);
+    }
+    if (not no_bundled) {
+        std::cout << "Loading bundled dataset from " << datasets_dir << std::endl;
+        datasets.emplace_back(new BenchDataset());
+        datasets.back()->name = "bundled";
+        datasets.back()->workdir = workdir;
+        if (not verbose) std::cout.rdbuf(null_output.rdbuf());
+        make_bundled_dataset(*datasets.back(), datasets_dir);
+        std::cout.rdbuf(cout_buffer);
+    }
+    for (auto &d: datasets) {
+        if (not verbose) std::cout.rdbuf(null_output.rdbuf());
+        load_dataset(*d);
+        std::cout.rdbuf(cout_buffer);
+        std::cout << d->name << ": " << d->ws.sdg.nodes.size() - 1 << " nodes, " << d->graph_bases << "bp graph, "
+                  << d->reads.size() << " paired reads, " << d->ws.long_reads_datastores[0].size() << " long reads"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::vector<BenchResult> results;
+    std::cout << std::left << std::setw(52) << "Benchmark" << std::right << std::setw(8) << "Threads" << std::setw(14)
+              << "Time (ms)" << std::setw(18) << "Items/s" << std::endl;
+    std::cout << std::string(92, '-') << std::endl;
+    for (auto &d: datasets) {
+        for (auto &b: benchmarks) {
+            auto full_name = d->name + "/" + b.name;
+            if (not filter.empty() and full_name.find(filter) == std::string::npos) continue;
+            for (auto t: threads) {
+                omp_set_num_threads(t);
+                BenchResult r{b.name, d->name, t, b.unit, 0, {}};
+                for (auto rep = 0; rep < repetitions; ++rep) {
+                    if (not verbose) std::cout.rdbuf(null_output.rdbuf());
+                    if (b.setup) b.setup(*d);
+                    auto start = std::chrono::steady_clock::now();
+                    r.items = b.run(*d);
+                    auto end = std::chrono::steady_clock::now();
+                    std::cout.rdbuf(cout_buffer);
+                    r.times.emplace_back(std::chrono::duration<double>(end - start).count());
+                }
+                auto median = r.median();
+                std::cout << std::left << std::setw(52) << full_name << std::right << std::setw(8) << t
+                          << std::setw(14) << std::fixed << std::setprecision(2) << median * 1000
+                          << std::setw(18) << std::setprecision(0) << (median > 0 ? r.items / median : 0) << " "
+                          << b.unit << std::endl;
+                results.emplace_back(r);
+            }
+        }
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+    if (not output.empty()) {
+        std::map<std::string, std::string> context;
+        context["genome_size"] = std::to_string(genome_size);
+        context["paired_coverage"] = std::to_string(paired_coverage);
+        context["long_coverage"] = std::to_string(long_coverage);
+        context["repetitions"] = std::to_string(repetitions);
+        write_json(output, results, context);
+        std::cout << std::endl << "Results written to " << output << std::endl;
+    }
+    return 0;
+}
@@ -19,6 +19,7 @@
 #include <sdglib/processors/Strider.hpp>
 #include <sdglib/processors/CountFilter.hpp>
 #include <sdglib/batch_counter/BatchKmersCounter.hpp>
+#include <sdglib/utilities/Metrics.hpp>
 
 namespace py = pybind11;
 using namespace py::literals;
@@ -83,13 +84,10 @@ PYBIND11_MODULE(SDGpython, m) {
             .def_readonly("id",&Support::id)
             ;
     py::class_<Node>(m, "Node", "A node in a Sequence Distance Graph")
-            .def(py::init<const std::string &>(),"","sequence"_a,py::return_value_policy::take_ownership)
-            .def_readonly("sequence", &Node::sequence)
-            .def("is_canonical", &Node::is_canonical)
             .def_readonly("status", &Node::status)
             .def("__repr__",
                  [](const Node &n) {
-                     return "<Node with " + std::to_string(n.sequence.size()) + " bp>";
+                     return std::string(n.status==NodeStatus::Deleted ? "<Node (deleted)>" : "<Node>");
                  })
         //.def_readonly("support", &Node::support)
             ;
@@ -167,6 +165,7 @@ PYBIND11_MODULE(SDGpython, m) {
 
     py::class_<SequenceDistanceGraph,DistanceGraph>(m, "SequenceDistanceGraph", "A Sequence Distance Graph")
             .def("get_node_size",&SequenceDistanceGraph::get_node_size)
+            .def("get_node_sequence",&SequenceDistanceGraph::get_node_sequence)
             .def("add_node",py::overload_cast<std::string>(&SequenceDistanceGraph::add_node))
             .def("remove_node",&SequenceDistanceGraph::remove_node)
             .def("join_all_unitigs",&SequenceDistanceGraph::join_all_unitigs)
@@ -228,25 +227,43 @@ PYBIND11_MODULE(SDGpython, m) {
             })
             ;
 
+    py::class_<NodeCoverageSummary>(m, "NodeCoverageSummary", "Coverage summary of a node's graph-unique k-mers on a count")
+            .def_readonly("q25",&NodeCoverageSummary::q25)
+            .def_readonly("median",&NodeCoverageSummary::median)
+            .def_readonly("q75",&NodeCoverageSummary::q75)
+            .def_readonly("kmers",&NodeCoverageSummary::kmers)
+            .def_readonly("unique_kmers",&NodeCoverageSummary::unique_kmers)
+            ;
+
     py::class_<KmerCounter>(m, "KmerCounters", "A kmer counter container")
             .def("list_names",&KmerCounter::list_names)
             .def("project_count",py::overload_cast<const std::string &, const std::string & >(&KmerCounter::project_count))
             .def("set_kci_peak",&KmerCounter::set_kci_peak)
             .def("kci",&KmerCounter::kci,"node"_a)
-            .def("add_count",py::overload_cast<const std::string &, const std::vector<std::string> &,bool>(&KmerCounter::add_count),"name"_a,"input_files"_a,"fastq"_a=true)
-            .def("add_count",py::overload_cast<const std::string &, const PairedReadsDatastore &>(&KmerCounter::add_count),"name"_a,"datastore"_a)
-            .def("add_count",py::overload_cast<const std::string &, const LinkedReadsDatastore &>(&KmerCounter::add_count),"name"_a,"datastore"_a)
-            .def("add_count",py::overload_cast<const std::string &, const LongReadsDatastore &>(&KmerCounter::add_count),"name"_a,"datastore"_a)
+            .def("add_count",py::overload_cast<const std::string &, const std::vector<std::string> &,bool,bool>(&KmerCounter::add_count),"name"_a,"input_files"_a,"fastq"_a=true,"wide"_a=false)
+            .def("add_count",py::overload_cast<const std::string &, const PairedReadsDatastore &,bool>(&KmerCounter::add_count),"name"_a,"datastore"_a,"wide"_a=false)
+            .def("add_count",py::overload_cast<const std::string &, const LinkedReadsDatastore &,bool>(&KmerCounter::add_count),"name"_a,"datastore"_a,"wide"_a=false)
+            .def("add_count",py::overload_cast<const std::string &, const LongReadsDatastore &,bool>(&KmerCounter::add_count),"name"_a,"datastore"_a,"wide"_a=false)
+            .def("get_count",&KmerCounter::get_count,"count_idx"_a,"kmer_idx"_a)
             .def("count_spectra",&KmerCounter::count_spectra,"name"_a,"max_freq"_a=1000,"unique_in_graph"_a=false,"present_in_graph"_a=true)
             .def("update_graph_counts",&KmerCounter::update_graph_counts)
+            .def("update_index",&KmerCounter::update_index)
+            .def("kmers_pending_recount",&KmerCounter::kmers_pending_recount,"count_name"_a)
+            .def("recount_new_kmers",py::overload_cast<const std::string &, const PairedReadsDatastore &,bool>(&KmerCounter::recount_new_kmers),"count_name"_a,"datastore"_a,"wide"_a=false)
+            .def("recount_new_kmers",py::overload_cast<const std::string &, const LinkedReadsDatastore &,bool>(&KmerCounter::recount_new_kmers),"count_name"_a,"datastore"_a,"wide"_a=false)
+            .def("recount_new_kmers",py::overload_cast<const std::string &, const LongReadsDatastore &,bool>(&KmerCounter::recount_new_kmers),"count_name"_a,"datastore"_a,"wide"_a=false)
             .def("compute_all_kcis",&KmerCounter::compute_all_kcis)
+            .def("compute_node_summaries",&KmerCounter::compute_node_summaries,"coverage_track"_a=false)
+            .def("node_summary",&KmerCounter::node_summary,"count_idx"_a,"node"_a,py::return_value_policy::copy)
+            .def("project_node_count",py::overload_cast<const std::string &, int64_t>(&KmerCounter::project_node_count),"count_name"_a,"node"_a)
             .def("dump_cache",&KmerCounter::dump_cache,"filename"_a)
             .def("load_cache",&KmerCounter::load_cache,"filename"_a)
             ;
 
     py::class_<WorkSpace>(m, "WorkSpace", "A full SDG WorkSpace")
-            .def(py::init<const std::string &>(),"filename"_a="",py::return_value_policy::take_ownership)
+            .def(py::init<const std::string &, bool>(),"filename"_a="","lazy"_a=true,py::return_value_policy::take_ownership)
             .def_readonly("sdg",&WorkSpace::sdg)
+            .def_readwrite("index_cache_dir",&WorkSpace::index_cache_dir)
             .def("add_long_reads_datastore",&WorkSpace::add_long_reads_datastore,"datastore"_a,"name"_a="",py::return_value_policy::reference)
             .def("add_paired_reads_datastore",&WorkSpace::add_paired_reads_datastore,"datastore"_a,"name"_a="",py::return_value_policy::reference)
             .def("add_linked_reads_datastore",&WorkSpace::add_linked_reads_datastore,"datastore"_a,"name"_a="",py::return_value_policy::reference)
@@ -261,7 +278,33 @@ PYBIND11_MODULE(SDGpython, m) {
             .def("list_kmer_counters",&WorkSpace::list_kmer_counters)
             .def("list_distance_graphs",&WorkSpace::list_distance_graphs)
             .def("dump",&WorkSpace::dump_to_disk,"filename"_a)
+            .def("checkpoint",&WorkSpace::checkpoint,"filename"_a)
+            .def("compact",&WorkSpace::compact,"filename"_a)
+            .def("load_all",&WorkSpace::load_all)
             .def("ls",&WorkSpace::ls,"level"_a=0,"recursive"_a=true)
+            .def_readonly("journal",&WorkSpace::journal)
+            .def("memory_usage",&WorkSpace::memory_usage)
+            .def("journal_metrics",&WorkSpace::journal_metrics,"detail"_a="",py::return_value_policy::reference)
+            ;
+
+    py::class_<JournalOperation>(m,"JournalOperation","An operation recorded in the WorkSpace journal")
+            .def_readonly("name",&JournalOperation::name)
+            .def_readonly("tool",&JournalOperation::tool)
+            .def_readonly("detail",&JournalOperation::detail)
+            .def_property_readonly("entries",[](const JournalOperation &op){
+                std::vector<std::string> entries;
+                for (auto &e:op.entries) entries.emplace_back(e.detail);
+                return entries;
+            })
+            ;
+
+    py::class_<sdglib::StageMetrics>(m,"StageMetrics","Accumulated cost of a named stage")
+            .def_readonly("calls",&sdglib::StageMetrics::calls)
+            .def_readonly("wall_seconds",&sdglib::StageMetrics::wall_seconds)
+            .def_readonly("cpu_seconds",&sdglib::StageMetrics::cpu_seconds)
+            .def_readonly("thread_seconds",&sdglib::StageMetrics::thread_seconds)
+            .def_readonly("items",&sdglib::StageMetrics::items)
+            .def_readonly("peak_rss_kb",&sdglib::StageMetrics::peak_rss_kb)
             ;
 
     py::class_<PerfectMatch>(m,"PerfectMatch", "A perfect match between a read and a node")
@@ -312,6 +355,7 @@ PYBIND11_MODULE(SDGpython, m) {
             .def("load",&LongReadsRecruiter::load,"filename"_a)
             .def("map_old",&LongReadsRecruiter::perfect_mappings,"hit_size"_a=21,"first_read"_a=1,"last_read"_a=0)
             .def("map",&LongReadsRecruiter::map,"hit_size"_a=21,"first_read"_a=1,"last_read"_a=0)
+            .def("map_to_file",&LongReadsRecruiter::map_to_file,"filename"_a,"hit_size"_a=21,"memory_budget"_a=1ULL<<30)
             .def("recruit",&LongReadsRecruiter::recruit_reads,"hit_size"_a=21,"hit_count"_a=1,"first_read"_a=1,"last_read"_a=0)
             .def("recruit_threads",&LongReadsRecruiter::recruit_threads)
             .def("thread_reads",&LongReadsRecruiter::thread_reads,"end_size"_a=500,"end_matches"_a=2)
@@ -354,8 +398,8 @@ PYBIND11_MODULE(SDGpython, m) {
 
     py::class_<GraphMaker>(m,"GraphMaker","DBG construccion")
             .def(py::init<SequenceDistanceGraph &>(),py::return_value_policy::take_ownership)
-            .def("new_graph_from_paired_datastore",&GraphMaker::new_graph_from_paired_datastore)
-            .def("new_graph_from_long_datastore",&GraphMaker::new_graph_from_long_datastore)
+            .def("new_graph_from_paired_datastore",&GraphMaker::new_graph_from_paired_datastore,"ds"_a,"k"_a,"min_coverage"_a,"num_batches"_a,"max_memory"_a=MinimizerKmersCounter::default_max_memory)
+            .def("new_graph_from_long_datastore",&GraphMaker::new_graph_from_long_datastore,"ds"_a,"k"_a,"min_coverage"_a,"num_batches"_a,"max_memory"_a=MinimizerKmersCounter::default_max_memory)
             ;
 
     py::class_<GraphContigger>(m,"GraphContigger","Paired end contigger")
@@ -418,7 +462,13 @@ PYBIND11_MODULE(SDGpython, m) {
     py::class_<CountFilter>(m,"CountFilter","CountFilter")
             .def(py::init<std::string, std::string , int , std::vector<std::string>, std::vector<int>>(),"kcname"_a, "filter_count_name"_a, "filter_count_max"_a, "value_count_names"_a, "value_count_mins"_a)
             .def("get_pattern",&CountFilter::get_pattern,"nv"_a);
+    m.def("metrics_stages",[](){return sdglib::metrics().stages();});
+    m.def("metrics_counters",[](){return sdglib::metrics().counters();});
+    m.def("metrics_gauges",[](){return sdglib::metrics().gauges();});
+    m.def("metrics_report",[](){return sdglib::metrics().report();});
+    m.def("metrics_clear",[](){sdglib::metrics().clear();});
+    m.def("peak_rss_kb",&sdglib::peak_rss_kb);
     m.def("str_to_kmers",&sdglib::str_to_kmers,py::return_value_policy::take_ownership);
     m.def("str_rc",&sdglib::str_rc,py::return_value_policy::take_ownership);
-    m.def("count_kmers_as_graph_nodes",&BatchKmersCounter::countKmersToGraphNodes,py::return_value_policy::take_ownership,"sdg"_a,"peds"_a,"k"_a,"min_coverage"_a, "max_coverage"_a, "num_batches"_a);
+    m.def("count_kmers_as_graph_nodes",&BatchKmersCounter::countKmersToGraphNodes,py::return_value_policy::take_ownership,"sdg"_a,"peds"_a,"k"_a,"min_coverage"_a, "max_coverage"_a, "num_batches"_a, "max_memory"_a=MinimizerKmersCounter::default_max_memory);
 }
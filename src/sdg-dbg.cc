@@ -34,6 +34,7 @@ int main(int argc, char * argv[]) {
     int min_coverage = 5, k = 63, num_batches(0);
     sdglib::OutputLogLevel = sdglib::LogLevels::INFO;
     int tip_size=200;
+    double max_memory=8;
     try {
         cxxopts::Options options("sdg-dbg", "create a DBG graph from a short-read datastore, and populate KCI");
 
@@ -41,6 +42,7 @@ int main(int argc, char * argv[]) {
                 ("help", "Print help")
                 ("p,paired_datastore", "input paired read datastore", cxxopts::value<std::string>(pr_file))
                 ("b,disk_batches", "number of disk batches to use", cxxopts::value(num_batches))
+                ("max_memory", "memory budget for k-mer counting, in GB", cxxopts::value(max_memory)->default_value("8"))
                 //("l,linked_datastore", "input linked read datastore", cxxopts::value<std::string>(lr_filename))
                 //("map_in_memory", "use map-in-memory implementation (deprecated, for test only)", cxxopts::value(map_in_memory);
                 ("o,output", "output file prefix", cxxopts::value<std::string>(output_prefix));
@@ -78,7 +80,7 @@ int main(int argc, char * argv[]) {
     op.addEntry("Origin datastore: " + pr_file);
     ws.add_paired_reads_datastore(pr_file,"dbg_reads");
 
-    auto kmer_list = BatchKmersCounter::countKmersToList(ws.paired_reads_datastores.back(), k, min_coverage, num_batches);
+    auto kmer_list = BatchKmersCounter::countKmersToList(ws.paired_reads_datastores.back(), k, min_coverage, num_batches, max_memory * (1ULL << 30));
     gm2.new_graph_from_kmerlist_trivial128(kmer_list,k);
 
     sdglib::OutputLog() << "DONE! " << ws.sdg.count_active_nodes() << " nodes in graph" << std::endl;
@@ -89,6 +91,7 @@ int main(int argc, char * argv[]) {
     }
     ws.add_kmer_counter("main", 31).add_count("PE",ws.paired_reads_datastores[0]);
     ws.sdg.write_to_gfa1(output_prefix + "_DBG.gfa");
+    ws.journal_metrics("sdg-dbg");
     ws.dump_to_disk(output_prefix + ".sdgws");
 }
 
@@ -28,6 +28,7 @@ void add_kmer_count(int argc, char **argv) {
     std::string ds_filename;
     std::string counts_filename;
     std::string name;
+    bool wide=false;
     try {
         cxxopts::Options options(program_name + " add", "SDG add a KmerCount to a KmerCounter file");
 
@@ -38,6 +39,7 @@ void add_kmer_count(int argc, char **argv) {
                 ("d,datastore", "input datastore", cxxopts::value(ds_filename))
                 ("k", "kmer length", cxxopts::value(k)->default_value("31"))
                 ("o,output", "output counts prefix", cxxopts::value(output))
+                ("wide", "count up to 2^32-1 rather than saturating at 65535", cxxopts::value(wide))
                 ("h,help", "Print help");
         auto newargc=argc-1;
         auto newargv=&argv[1];
@@ -71,17 +73,17 @@ void add_kmer_count(int argc, char **argv) {
     WorkSpace ws;
     KmerCounter kc(ws, counts_filename);
     if (!fastq_files.empty()) {
-        kc.add_count(name, fastq_files);
+        kc.add_count(name, fastq_files, true, wide);
     }
     if (!ds_filename.empty()) {
         if (ds_filename.substr(ds_filename.find('.') + 1) == "prseq") {
-            kc.add_count(name, PairedReadsDatastore(ws, ds_filename));
+            kc.add_count(name, PairedReadsDatastore(ws, ds_filename), wide);
         }
         if (ds_filename.substr(ds_filename.find('.') + 1) == "lrseq") {
-            kc.add_count(name, LinkedReadsDatastore(ws, ds_filename));
+            kc.add_count(name, LinkedReadsDatastore(ws, ds_filename), wide);
         }
         if (ds_filename.substr(ds_filename.find('.') + 1) == "loseq") {
-            kc.add_count(name, LongReadsDatastore(ws, ds_filename));
+            kc.add_count(name, LongReadsDatastore(ws, ds_filename), wide);
         }
     }
     sdglib::OutputLog(sdglib::INFO) << "Writing " << output << ".sdgkc" << std::endl;
@@ -99,6 +101,7 @@ void make_kmer_counts(int argc, char **argv) {
     std::string ds_filename;
     std::string counts_filename;
     std::string name;
+    bool wide=false;
     try {
         cxxopts::Options options(program_name + " make",
                 "SDG make KmerCounter\n"
@@ -113,6 +116,7 @@ void make_kmer_counts(int argc, char **argv) {
                 ("d,datastore", "input datastore", cxxopts::value(ds_filename))
                 ("n,name", "KmerCounter name", cxxopts::value(name))
                 ("o,output", "output counts prefix", cxxopts::value(output))
+                ("wide", "count up to 2^32-1 rather than saturating at 65535", cxxopts::value(wide))
                 ("h,help", "Print help");
         auto newargc=argc-1;
         auto newargv=&argv[1];
@@ -156,17 +160,17 @@ void make_kmer_counts(int argc, char **argv) {
         }
         KmerCounter kc(ws, name, k);
         if (!fastq_files.empty()) {
-            kc.add_count(name, fastq_files);
+            kc.add_count(name, fastq_files, true, wide);
         }
         if (!ds_filename.empty()) {
             if (ds_filename.substr(ds_filename.find('.') + 1) == "prseq") {
-                kc.add_count(name, PairedReadsDatastore(ws, ds_filename));
+                kc.add_count(name, PairedReadsDatastore(ws, ds_filename), wide);
             }
             if (ds_filename.substr(ds_filename.find('.') + 1) == "lrseq") {
-                kc.add_count(name, LinkedReadsDatastore(ws, ds_filename));
+                kc.add_count(name, LinkedReadsDatastore(ws, ds_filename), wide);
             }
             if (ds_filename.substr(ds_filename.find('.') + 1) == "loseq") {
-                kc.add_count(name, LongReadsDatastore(ws, ds_filename));
+                kc.add_count(name, LongReadsDatastore(ws, ds_filename), wide);
             }
         }
         std::ofstream output_file(output+".sdgkc");
@@ -175,17 +179,17 @@ void make_kmer_counts(int argc, char **argv) {
         WorkSpace ws;
         KmerCounter kc(ws, counts_filename);
         if (!fastq_files.empty()) {
-            kc.add_count(name, fastq_files);
+            kc.add_count(name, fastq_files, true, wide);
         }
         if (!ds_filename.empty()) {
             if (ds_filename.substr(ds_filename.find('.') + 1) == "prseq") {
-                kc.add_count(name, PairedReadsDatastore(ws, ds_filename));
+                kc.add_count(name, PairedReadsDatastore(ws, ds_filename), wide);
             }
             if (ds_filename.substr(ds_filename.find('.') + 1) == "lrseq") {
-                kc.add_count(name, LinkedReadsDatastore(ws, ds_filename));
+                kc.add_count(name, LinkedReadsDatastore(ws, ds_filename), wide);
             }
             if (ds_filename.substr(ds_filename.find('.') + 1) == "loseq") {
-                kc.add_count(name, LongReadsDatastore(ws, ds_filename));
+                kc.add_count(name, LongReadsDatastore(ws, ds_filename), wide);
             }
         }
         std::ofstream output_file(output+".sdgkc");
@@ -10,10 +10,13 @@ int main(int argc, char * argv[]) {
     std::cout << "Git commit: " << GIT_COMMIT_HASH << std::endl<<std::endl;
     std::cout << "Executed command:"<<std::endl;
     bool sat_kmer_index=false;
+    bool prefix_bucket_index=false;
     unsigned int long_reads_k=15;
     bool use63mers=false,best_nodes=false;
     bool skip_paired=false,skip_linked=false,skip_long=false;
     unsigned int max_filter=200;
+    bool long_store=false;
+    double max_memory=4;
     for (auto i=0;i<argc;i++) std::cout<<argv[i]<<" ";
     std::cout<<std::endl<<std::endl;
 
@@ -29,7 +32,10 @@ int main(int argc, char * argv[]) {
                 ("o,output", "output file prefix", cxxopts::value<std::string>(output_prefix))
                 ("k","long read indexing/mapping kmer size", cxxopts::value(long_reads_k)->default_value("15"))
                 ("s,use_sat-index", "Use saturated small-k index", cxxopts::value(sat_kmer_index)->default_value("false")->implicit_value("true"))
+                ("use_prefix-buckets", "Use a prefix-bucket directory for k-mer index lookups", cxxopts::value(prefix_bucket_index)->default_value("false")->implicit_value("true"))
                 ("b,best_nodes_only", "Map long reads to best nodes only", cxxopts::value(best_nodes))
+                ("long_store", "map long reads to resumable on-disk stores (<output>_<datastore>.lrstore) instead of the workspace", cxxopts::value(long_store)->default_value("false")->implicit_value("true"))
+                ("max_memory", "memory budget for long read mapping results with --long_store, in GB", cxxopts::value(max_memory)->default_value("4"))
                 ("m,max_kmer_repeat", "maximum number of times a kmer appears (LongReadMapper)", cxxopts::value(max_filter)->default_value("200"))
                 ("use_63-mers", "mapping based on 63-mers", cxxopts::value<bool>(use63mers))
                 ("skip_paired", "skip paired read mapping", cxxopts::value<bool>(skip_paired))
@@ -101,15 +107,23 @@ int main(int argc, char * argv[]) {
         for (auto &ds: ws.long_reads_datastores) {
             sdglib::OutputLog() << "Mapping reads from long reads library..." << std::endl;
             ds.mapper.sat_kmer_index = sat_kmer_index;
+            ds.mapper.prefix_bucket_index = prefix_bucket_index;
             ds.mapper.k = long_reads_k;
             ds.mapper.max_index_freq = max_filter;
-            if (not best_nodes) ds.mapper.map_reads();
-            else ds.mapper.map_reads_to_best_nodes();
-            op.addEntry("reads from " + ds.filename + " re-mapped to current graph");
+            if (long_store) {
+                auto store_filename = output_prefix + "_" + ds.name + ".lrstore";
+                ds.mapper.map_reads_to_store(store_filename, max_memory * (1ULL << 30));
+                op.addEntry("reads from " + ds.filename + " mapped to current graph into " + store_filename);
+            } else {
+                if (not best_nodes) ds.mapper.map_reads();
+                else ds.mapper.map_reads_to_best_nodes();
+                op.addEntry("reads from " + ds.filename + " re-mapped to current graph");
+            }
             sdglib::OutputLog() << "Mapping reads from long reads library DONE." << std::endl;
         }
     }
     op.addEntry("sdg-mapper run finished");
+    ws.journal_metrics("sdg-mapper");
     ws.dump_to_disk(output_prefix+".sdgws");
     sdglib::OutputLog()<<"Mapping reads DONE."<<std::endl;
     return 0;
@@ -10,7 +10,8 @@ enum class WorkspaceFunctions{
     STATUS,
     DUMP,
     ADD_DS,
-    ADD_COUNTER
+    ADD_COUNTER,
+    COMPACT
 };
 struct WorkspaceFunctionMap : public std::map<std::string, WorkspaceFunctions>
 {
@@ -21,6 +22,7 @@ struct WorkspaceFunctionMap : public std::map<std::string, WorkspaceFunctions>
         operator[]("dump") = WorkspaceFunctions::DUMP;
         operator[]("add_ds") = WorkspaceFunctions::ADD_DS;
         operator[]("add_counter") = WorkspaceFunctions::ADD_COUNTER;
+        operator[]("compact") = WorkspaceFunctions::COMPACT;
     };
 };
 
@@ -297,6 +299,39 @@ void add_counter(int argc, char **argv) {
 
 }
 
+void compact_workspace(int argc, char **argv){
+    std::string filename;
+    try {
+
+        cxxopts::Options options("sdg-workspace compact", "SDG workspace compaction, folds checkpoints back into a single copy of each section");
+
+        options.add_options()
+                ("help", "Print help")
+                ("w,workspace", "workspace filename", cxxopts::value<std::string>(filename));
+
+        auto newargc=argc-1;
+        auto newargv=&argv[1];
+        auto result=options.parse(newargc,newargv);
+        if (result.count("help")) {
+            std::cout << options.help({""}) << std::endl;
+            exit(0);
+        }
+
+        if (result.count("workspace")==0) {
+            throw cxxopts::OptionException(" please specify workspace file");
+        }
+
+
+    } catch (const cxxopts::OptionException &e) {
+        std::cout << "Error parsing options: " << e.what() << std::endl << std::endl
+                  << "Use option --help to check command line arguments." << std::endl;
+        exit(1);
+    }
+    //sections are copied as they are, only the graph needs to be loaded to apply its deltas
+    WorkSpace w(filename, true);
+    w.compact(filename);
+}
+
 int main(int argc, char * argv[]) {
     std::cout << "sdg-workspace"<<std::endl<<std::endl;
     std::cout << "Git origin: " << GIT_ORIGIN_URL << " -> "  << GIT_BRANCH << std::endl;
@@ -332,6 +367,9 @@ int main(int argc, char * argv[]) {
         case WorkspaceFunctions::ADD_COUNTER:
             add_counter(argc, argv);
             break;
+        case WorkspaceFunctions::COMPACT:
+            compact_workspace(argc, argv);
+            break;
         default:
             std::cout << "Invalid option specified." << std::endl;
             std::cout<<"Please specify one of the following functions: ";
@@ -10,7 +10,7 @@ typedef uint16_t sdgVersion_t;
 typedef uint16_t sdgMagic_t;
 
 static const sdgMagic_t SDG_MAGIC = 0x05D6;
-static const sdgVersion_t SDG_VN = 0x0003;
+static const sdgVersion_t SDG_VN = 0x0007;
 
 enum SDG_FILETYPE : uint16_t{
     WS_FT,
@@ -24,6 +24,12 @@ enum SDG_FILETYPE : uint16_t{
     LongMap_FT,
     HLAP_FT,
     HLAF_FT,
+    UKI_FT,
+    U63I_FT,
+    NKI_FT,
+    NKI128_FT,
+    SKI_FT,
+    LongMapStore_FT,
     NUM_TYPES
 };
 #endif //BSG_VERSIONING_HPP
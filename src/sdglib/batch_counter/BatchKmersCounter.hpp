@@ -9,6 +9,7 @@
 #include <sdglib/datastores/PairedReadsDatastore.hpp>
 #include <numeric>
 #include <sdglib/datastores/ReadSequenceBuffer.hpp>
+#include <sdglib/batch_counter/MinimizerKmersCounter.hpp>
 
 typedef struct __attribute__((__packed__)) KMerNodeFreq_s {
     __uint128_t kdata;
@@ -49,35 +50,30 @@ public:
     size_t size=0;
 };
 
+/**
+ * Counts k-mers from the reads in a datastore (k up to 63) through a MinimizerKmersCounter, tmpdir is used for its
+ * bucket files and max_memory (in bytes) bounds the memory used counting them.
+ */
 class BatchKmersCounter {
-
-    static std::shared_ptr<KmerList> kmerCountOMP( uint8_t K, PairedReadsDatastore const& reads,
-                                            uint64_t gfrom, uint64_t gto, uint64_t batch_size=0);
-
-    static std::shared_ptr<KmerList> kmerCountOMP( uint8_t K, LongReadsDatastore const& reads,
-                                            uint64_t gfrom, uint64_t gto, uint64_t batch_size=0);
-
-
-    static std::shared_ptr<KmerList> kmerCountOMPDiskBased( uint8_t K, PairedReadsDatastore const& reads, unsigned minCount,
-                                                     std::string tmpdir, std::string workdir, unsigned char disk_batches=8);
-
-    static std::shared_ptr<KmerList> kmerCountOMPDiskBased( uint8_t K, LongReadsDatastore const& reads, unsigned minCount,
-                                                     std::string tmpdir, std::string workdir, unsigned char disk_batches=8);
-
 public:
     static std::shared_ptr<KmerList> buildKMerCount( uint8_t K, PairedReadsDatastore const& reads, unsigned minCount,
                                               std::string workdir, std::string tmpdir,
-                                              unsigned char disk_batches );
+                                              unsigned char disk_batches,
+                                              uint64_t max_memory = MinimizerKmersCounter::default_max_memory );
 
     static std::shared_ptr<KmerList> buildKMerCount( uint8_t K, LongReadsDatastore const& reads, unsigned minCount,
                                                      std::string workdir, std::string tmpdir,
-                                                     unsigned char disk_batches );
+                                                     unsigned char disk_batches,
+                                                     uint64_t max_memory = MinimizerKmersCounter::default_max_memory );
 
-    static std::vector<__uint128_t> countKmersToList(const PairedReadsDatastore &ds, int k, int min_coverage, int num_batches);
+    static std::vector<__uint128_t> countKmersToList(const PairedReadsDatastore &ds, int k, int min_coverage, int num_batches,
+                                                     uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
 
-    static std::vector<__uint128_t> countKmersToList(const LongReadsDatastore &ds, int k, int min_coverage, int num_batches);
+    static std::vector<__uint128_t> countKmersToList(const LongReadsDatastore &ds, int k, int min_coverage, int num_batches,
+                                                     uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
 
-    static void countKmersToGraphNodes(SequenceDistanceGraph &sdg, const PairedReadsDatastore &ds, int k, int min_coverage, int max_coverage, int num_batches);
+    static void countKmersToGraphNodes(SequenceDistanceGraph &sdg, const PairedReadsDatastore &ds, int k, int min_coverage, int max_coverage, int num_batches,
+                                       uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
 
 };
 
@@ -0,0 +1,358 @@
+#include "MinimizerKmersCounter.hpp"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <unistd.h>
+#include <sdglib/datastores/PairedReadsDatastore.hpp>
+#include <sdglib/datastores/LongReadsDatastore.hpp>
+#include <sdglib/datastores/ReadSequenceBuffer.hpp>
+#include <sdglib/utilities/packing_helpers.hpp>
+#include <sdglib/utilities/OutputLog.hpp>
+#include <sdglib/utilities/omp_safe.hpp>
+#include <sdglib/utilities/Metrics.hpp>
+
+//Minimizers are ranked by a hash of the canonical m-mer, so poly-A and other low complexity m-mers don't take over
+static inline uint64_t minimizer_hash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * Calls emit(bucket, first, length) for every super-k-mer in codes[0,len) (2-bit codes, 4 for N). A super-k-mer is a
+ * maximal run of consecutive k-mers with the same minimizer, its bucket only depends on the minimizer's canonical
+ * m-mer, so a k-mer and its reverse complement always go to the same bucket.
+ */
+template<class EMITTER>
+static void split_superkmers(const uint8_t *codes, uint64_t len, uint8_t k, uint8_t m, uint32_t buckets,
+                             std::vector<uint64_t> &hashes, std::vector<uint64_t> &window, EMITTER emit) {
+    const uint64_t mmask = (1ULL << (2 * m)) - 1;
+    const uint64_t w = k - m + 1; //m-mers per k-mer
+    uint64_t s = 0;
+    while (s < len) {
+        //find the next stretch without Ns
+        while (s < len and codes[s] > 3) ++s;
+        uint64_t e = s;
+        while (e < len and codes[e] < 4) ++e;
+        if (e - s >= k) {
+            //hashes of the canonical m-mers starting at s...e-m
+            hashes.resize(e - s - m + 1);
+            uint64_t fw = 0, rc = 0;
+            for (uint64_t p = s; p < e; ++p) {
+                fw = ((fw << 2) | codes[p]) & mmask;
+                rc = (rc >> 2) | ((uint64_t) (3 - codes[p]) << (2 * (m - 1)));
+                if (p + 1 >= s + m) hashes[p + 1 - m - s] = minimizer_hash(std::min(fw, rc));
+            }
+            //sliding window minimum, window holds candidate positions with increasing hashes
+            window.clear();
+            uint64_t head = 0, sk_start = 0, sk_min = 0;
+            for (uint64_t j = 0; j < hashes.size(); ++j) {
+                while (window.size() > head and hashes[window.back()] > hashes[j]) window.pop_back();
+                window.push_back(j);
+                if (j + 1 < w) continue;
+                uint64_t kpos = j + 1 - w; //k-mer starting at s+kpos, covering m-mers kpos..j
+                while (window[head] < kpos) ++head;
+                if (kpos == 0) sk_min = window[head];
+                else if (window[head] != sk_min) {
+                    emit(hashes[sk_min] % buckets, s + sk_start, kpos - sk_start + k - 1);
+                    sk_start = kpos;
+                    sk_min = window[head];
+                }
+            }
+            emit(hashes[sk_min] % buckets, s + sk_start, e - s - sk_start);
+        }
+        s = e;
+    }
+}
+
+/**
+ * LSD radix sort of keys on their lowest key_bits bits, 8 bits per pass, using tmp as scratch space.
+ * Passes where all keys share the digit are skipped.
+ */
+template<typename KEY>
+static void radix_sort(std::vector<KEY> &keys, std::vector<KEY> &tmp, uint32_t key_bits) {
+    if (keys.size() < 2) return;
+    tmp.resize(keys.size());
+    uint64_t offsets[256];
+    for (uint32_t shift = 0; shift < key_bits; shift += 8) {
+        std::fill(offsets, offsets + 256, 0);
+        for (const auto &x: keys) ++offsets[(uint8_t) (x >> shift)];
+        if (offsets[(uint8_t) (keys[0] >> shift)] == keys.size()) continue;
+        uint64_t total = 0;
+        for (auto &o: offsets) {
+            auto c = o;
+            o = total;
+            total += c;
+        }
+        for (const auto &x: keys) tmp[offsets[(uint8_t) (x >> shift)]++] = x;
+        keys.swap(tmp);
+    }
+}
+
+//Spreads the k-mers of a bucket that doesn't fit in memory across its parts
+static inline uint64_t kmer_hash(uint64_t x) {
+    return minimizer_hash(x);
+}
+
+static inline uint64_t kmer_hash(__uint128_t x) {
+    return minimizer_hash((uint64_t) x ^ minimizer_hash((uint64_t) (x >> 64)));
+}
+
+/**
+ * Streams the super-k-mers in a bucket file, calling add(key) with each of their canonical k-mers.
+ * Returns false if the file can't be read or ends in a truncated record.
+ */
+template<typename KEY, class ADDER>
+static bool for_each_bucket_kmer(const std::string &filename, uint8_t k, ADDER add) {
+    const KEY mask = (((KEY) 1) << (2 * k)) - 1;
+    const uint32_t rc_shift = 2 * (k - 1);
+    auto f = fopen(filename.c_str(), "rb");
+    if (f == nullptr) return false;
+    std::vector<uint8_t> data(1 << 16);
+    uint64_t filled = 0;
+    while (true) {
+        auto read = fread(data.data() + filled, 1, data.size() - filled, f);
+        filled += read;
+        uint64_t p = 0;
+        for (; p < filled and p + 1 + sdglib::packed_2bit_size(data[p]) <= filled; p += 1 + sdglib::packed_2bit_size(data[p])) {
+            KEY fw = 0, rc = 0;
+            for (uint64_t i = 0; i < data[p]; ++i) {
+                KEY c = (data[p + 1 + i / 4] >> (2 * (i % 4))) & 3;
+                fw = ((fw << 2) | c) & mask;
+                rc = (rc >> 2) | ((3 - c) << rc_shift);
+                if (i + 1 >= k) add(std::min(fw, rc));
+            }
+        }
+        if (read == 0) {
+            bool ok = (p == filled and not ferror(f));
+            fclose(f);
+            return ok;
+        }
+        std::copy(data.begin() + p, data.begin() + filled, data.begin());
+        filled -= p;
+    }
+}
+
+const uint64_t MinimizerKmersCounter::default_max_memory;
+
+MinimizerKmersCounter::MinimizerKmersCounter(uint8_t _k, const std::string &_tmpdir, uint64_t _max_memory,
+                                             uint32_t _bucket_count, uint8_t _m) :
+        k(_k), m(std::min(_m, (uint8_t) (_k - 1))), tmpdir(_tmpdir), max_memory(_max_memory) {
+    if (k < 2 or k > 63) throw std::runtime_error("MinimizerKmersCounter supports k from 2 to 63");
+    if (m > 31) m = 31;
+    //bucket names are unique to this counter, so counters sharing a tmpdir don't remove each other's buckets
+    static std::atomic<uint64_t> instances(0);
+    bucket_prefix = tmpdir + "/sdg_kmer_bucket_" + std::to_string(getpid()) + "_" + std::to_string(instances++) + "_";
+    if (_bucket_count > 0) set_bucket_count(_bucket_count);
+}
+
+MinimizerKmersCounter::~MinimizerKmersCounter() {
+    for (uint32_t b = 0; b < bucket_count; ++b) {
+        std::remove(bucket_filename(b).c_str());
+        std::remove(results_filename(b).c_str());
+    }
+}
+
+void MinimizerKmersCounter::set_bucket_count(uint32_t _bucket_count) {
+    bucket_count = _bucket_count;
+    bucket_kmers.assign(bucket_count, 0);
+    bucket_locks = std::vector<std::mutex>(bucket_count);
+    for (uint32_t b = 0; b < bucket_count; ++b) std::remove(bucket_filename(b).c_str());
+}
+
+std::string MinimizerKmersCounter::bucket_filename(uint32_t bucket) const {
+    return bucket_prefix + std::to_string(bucket);
+}
+
+std::string MinimizerKmersCounter::results_filename(uint32_t bucket) const {
+    return bucket_prefix + std::to_string(bucket) + "_counts";
+}
+
+//Called from parallel regions, where throwing would terminate, so failures are recorded in failed_file
+void MinimizerKmersCounter::record_failure(const std::string &filename) {
+#pragma omp critical(minimizer_failures)
+    if (failed_file.empty()) failed_file = filename;
+}
+
+void MinimizerKmersCounter::flush_bucket(uint32_t bucket, std::vector<uint8_t> &buffer) {
+    {
+        std::lock_guard<std::mutex> lock(bucket_locks[bucket]);
+        auto f = fopen(bucket_filename(bucket).c_str(), "ab");
+        bool ok = (f != nullptr and fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size());
+        if (f != nullptr and fclose(f) != 0) ok = false;
+        if (not ok) record_failure(bucket_filename(bucket));
+    }
+    buffer.clear();
+}
+
+void MinimizerKmersCounter::add_reads(const PairedReadsDatastore &ds) {
+    add_reads_from(ds, ds.size() * ds.readsize);
+}
+
+void MinimizerKmersCounter::add_reads(const LongReadsDatastore &ds) {
+    uint64_t total_bases = 0;
+    for (auto &r: ds.read_to_fileRecord) total_bases += r.record_size;
+    add_reads_from(ds, total_bases);
+}
+
+template<class DS>
+void MinimizerKmersCounter::add_reads_from(const DS &ds, uint64_t total_bases) {
+    SDG_SCOPED_TIMER(timer, "MinimizerKmersCounter::add_reads");
+    SDG_TIMER_ITEMS(timer, ds.size());
+    auto threads = (uint64_t) omp_get_max_threads();
+    if (bucket_count == 0) {
+        //each thread holds a bucket's k-mers twice (keys and radix scratch), leaving room for 4x skew between buckets
+        uint64_t thread_memory = std::max((uint64_t) 1, max_memory / threads);
+        uint64_t key_size = (k <= 31 ? sizeof(uint64_t) : sizeof(__uint128_t));
+        set_bucket_count(std::min((uint64_t) 16384, std::max((uint64_t) 64, total_bases * 2 * key_size * 4 / thread_memory + 1)));
+    }
+    //per-thread bucket buffers take at most a quarter of the budget
+    flush_size = std::max((uint64_t) 4096, std::min((uint64_t) 1 << 16, max_memory / (4 * threads * bucket_count)));
+    sdglib::OutputLog() << "Binning super-" << (int) k << "-mers from " << ds.size() << " reads into " << bucket_count
+                        << " buckets" << std::endl;
+    ds.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
+    failed_file.clear();
+    uint64_t superkmers = 0;
+#pragma omp parallel reduction(+:superkmers)
+    {
+        ReadSequenceBuffer rsb(ds);
+        std::vector<uint8_t> codes;
+        std::vector<uint64_t> hashes, window;
+        std::vector<std::vector<uint8_t>> buffers(bucket_count);
+        std::vector<uint64_t> local_kmers(bucket_count);
+#pragma omp for schedule(dynamic,10000)
+        for (uint64_t rid = 1; rid <= ds.size(); ++rid) {
+            auto seq = rsb.get_read_sequence(rid);
+            auto len = strlen(seq);
+            if (len < k) continue;
+            codes.resize(len);
+            sdglib::encode_2bit(seq, len, codes.data());
+            split_superkmers(codes.data(), len, k, m, bucket_count, hashes, window, [&](uint32_t b, uint64_t first, uint64_t size) {
+                //super-k-mers are at most 2k-m bases, so their length fits in a byte
+                auto &buffer = buffers[b];
+                auto pos = buffer.size();
+                buffer.resize(pos + 1 + sdglib::packed_2bit_size(size), 0);
+                buffer[pos] = size;
+                for (uint64_t i = 0; i < size; ++i) buffer[pos + 1 + i / 4] |= codes[first + i] << (2 * (i % 4));
+                if (buffer.size() >= flush_size) flush_bucket(b, buffer);
+                local_kmers[b] += size - k + 1;
+                ++superkmers;
+            });
+        }
+        for (uint32_t b = 0; b < bucket_count; ++b) if (not buffers[b].empty()) flush_bucket(b, buffers[b]);
+#pragma omp critical(minimizer_bucket_kmers)
+        for (uint32_t b = 0; b < bucket_count; ++b) bucket_kmers[b] += local_kmers[b];
+    }
+    if (not failed_file.empty()) throw std::runtime_error("Error writing to " + failed_file);
+    sdglib::OutputLog() << superkmers << " super-k-mers binned" << std::endl;
+    SDG_COUNTER_ADD("MinimizerKmersCounter::add_reads/superkmers", superkmers);
+}
+
+template<typename KEY>
+void MinimizerKmersCounter::count_buckets(uint32_t min_count, uint32_t max_count, const BucketOutput &output) {
+    //keys and radix scratch, plus the k-mer and count passed to output
+    const uint64_t kmer_memory = 2 * sizeof(KEY) + sizeof(__uint128_t) + sizeof(uint32_t);
+    const uint64_t thread_memory = std::max((uint64_t) 1, max_memory / omp_get_max_threads());
+    histogram.assign(256, 0);
+    uint64_t total_kmers = 0, split_buckets = 0;
+    failed_file.clear();
+#pragma omp parallel reduction(+:total_kmers,split_buckets)
+    {
+        std::vector<KEY> keys, tmp;
+        std::vector<__uint128_t> kmers;
+        std::vector<uint32_t> counts;
+        std::vector<uint64_t> local_histogram(256);
+        std::vector<FILE *> part_files;
+        //sorts the keys, collapses them into counts and passes the ones in range to output
+        auto count_keys = [&](uint32_t b) {
+            total_kmers += keys.size();
+            radix_sort(keys, tmp, 2 * k);
+            kmers.clear();
+            counts.clear();
+            for (uint64_t i = 0; i < keys.size();) {
+                uint64_t j = i + 1;
+                while (j < keys.size() and keys[j] == keys[i]) ++j;
+                auto c = (uint32_t) std::min(j - i, (uint64_t) UINT32_MAX);
+                ++local_histogram[std::min(c, (uint32_t) 255)];
+                if (c >= min_count and c <= max_count) {
+                    kmers.emplace_back(keys[i]);
+                    counts.emplace_back(c);
+                }
+                i = j;
+            }
+            output(b, kmers, counts);
+        };
+#pragma omp for schedule(dynamic,1)
+        for (uint32_t b = 0; b < bucket_count; ++b) {
+            if (bucket_kmers[b] == 0) continue;
+            auto filename = bucket_filename(b);
+            //a bucket over the thread's share of memory is split by k-mer hash into parts, counted one at a time
+            uint64_t parts = std::min((uint64_t) 512, (bucket_kmers[b] * kmer_memory + thread_memory - 1) / thread_memory);
+            keys.clear();
+            if (parts <= 1) {
+                keys.reserve(bucket_kmers[b]);
+                bool ok = for_each_bucket_kmer<KEY>(filename, k, [&](KEY key) { keys.push_back(key); });
+                std::remove(filename.c_str());
+                if (not ok) record_failure(filename);
+                else count_keys(b);
+                continue;
+            }
+            ++split_buckets;
+            part_files.assign(parts, nullptr);
+            bool ok = true;
+            for (uint64_t p = 0; p < parts; ++p) {
+                part_files[p] = fopen((filename + "_" + std::to_string(p)).c_str(), "wb");
+                if (part_files[p] == nullptr) ok = false;
+            }
+            if (ok) ok = for_each_bucket_kmer<KEY>(filename, k, [&](KEY key) {
+                fwrite(&key, sizeof(KEY), 1, part_files[kmer_hash(key) % parts]);
+            });
+            std::remove(filename.c_str());
+            for (auto &f: part_files) if (f != nullptr and (ferror(f) or fclose(f) != 0)) ok = false;
+            for (uint64_t p = 0; p < parts; ++p) {
+                auto part_filename = filename + "_" + std::to_string(p);
+                if (ok) {
+                    auto f = fopen(part_filename.c_str(), "rb");
+                    if (f != nullptr) {
+                        fseek(f, 0, SEEK_END);
+                        keys.resize(ftell(f) / sizeof(KEY));
+                        fseek(f, 0, SEEK_SET);
+                        if (fread(keys.data(), sizeof(KEY), keys.size(), f) != keys.size()) ok = false;
+                        fclose(f);
+                    } else ok = false;
+                    if (ok) count_keys(b);
+                }
+                std::remove(part_filename.c_str());
+            }
+            if (not ok) record_failure(filename);
+        }
+#pragma omp critical(minimizer_counts)
+        for (auto i = 0; i < 256; ++i) histogram[i] += local_histogram[i];
+    }
+    bucket_kmers.assign(bucket_count, 0);
+    if (not failed_file.empty()) throw std::runtime_error("Error reading " + failed_file);
+    sdglib::OutputLog() << total_kmers << " " << (int) k << "-mers counted";
+    if (split_buckets > 0) sdglib::OutputLog(false) << ", " << split_buckets << " buckets split to fit in memory";
+    sdglib::OutputLog(false) << std::endl;
+}
+
+void MinimizerKmersCounter::count_buckets(uint32_t min_count, uint32_t max_count, const BucketOutput &output) {
+    SDG_SCOPED_TIMER(timer, "MinimizerKmersCounter::count");
+    if (k <= 31) count_buckets<uint64_t>(min_count, max_count, output);
+    else count_buckets<__uint128_t>(min_count, max_count, output);
+    uint64_t distinct = 0;
+    for (auto &h: histogram) distinct += h;
+    SDG_TIMER_ITEMS(timer, distinct);
+}
+
+void MinimizerKmersCounter::count(uint32_t min_count) {
+    kmer_counts.clear();
+    count_to<std::pair<__uint128_t, uint32_t>>(min_count, UINT32_MAX,
+            [](__uint128_t kmer, uint32_t c) { return std::make_pair(kmer, c); },
+            [&](uint64_t n) { kmer_counts.resize(n); return kmer_counts.data(); });
+}
@@ -0,0 +1,135 @@
+#ifndef BSG_MINIMIZERKMERSCOUNTER_HPP
+#define BSG_MINIMIZERKMERSCOUNTER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
+#include <sdglib/utilities/omp_safe.hpp>
+#include <sdglib/utilities/OutputLog.hpp>
+
+class PairedReadsDatastore;
+class LongReadsDatastore;
+
+/**
+ * @brief Disk-based counter for canonical k-mers (k up to 63), partitioned by minimizer.
+ *
+ * add_reads() makes a single streaming pass over a datastore, cutting each read into super-k-mers (runs of consecutive
+ * k-mers sharing the same minimizer) which are appended, 2-bit packed, to one of bucket_count files chosen by their
+ * minimizer. Every occurrence of a k-mer lands in the same bucket, so count() processes the buckets independently
+ * and in parallel: the bucket's k-mers are sorted with an LSD radix sort on 64-bit (k<=31) or 128-bit keys and
+ * collapsed into counts.
+ *
+ * Only the buckets being counted are held in memory. Unless given, the number of buckets is chosen on the first
+ * add_reads() so each thread's bucket fits in its share of max_memory, buckets that still don't fit (skewed
+ * minimizers, or more reads added later) are split by k-mer hash when counted.
+ */
+class MinimizerKmersCounter {
+public:
+    static const uint64_t default_max_memory = 8ULL << 30;
+
+    /**
+     * @param k k-mer size, up to 63
+     * @param tmpdir directory for the bucket files
+     * @param max_memory memory budget for counting, in bytes
+     * @param bucket_count number of buckets, 0 to choose it from max_memory and the size of the first datastore
+     * @param m minimizer size, smaller than k
+     */
+    explicit MinimizerKmersCounter(uint8_t k, const std::string &tmpdir = ".", uint64_t max_memory = default_max_memory,
+                                   uint32_t bucket_count = 0, uint8_t m = 11);
+
+    ~MinimizerKmersCounter();
+
+    void add_reads(const PairedReadsDatastore &ds);
+
+    void add_reads(const LongReadsDatastore &ds);
+
+    /**
+     * @brief Counts all buckets, keeping the k-mers seen at least min_count times in kmer_counts, sorted by k-mer.
+     * Bucket files are removed as they are counted.
+     */
+    void count(uint32_t min_count = 1);
+
+    /**
+     * @brief Counts all buckets straight into a caller's container of T, sorted.
+     *
+     * Each bucket's k-mers seen between min_count and max_count times are converted with convert(kmer, count) and
+     * written to a results file next to the bucket. Once all are counted, allocate(n) must return room for the n
+     * results, which are read into it and sorted in place, so the results are only held in memory once.
+     */
+    template<class T, class CONVERT, class ALLOCATE>
+    void count_to(uint32_t min_count, uint32_t max_count, CONVERT convert, ALLOCATE allocate) {
+        std::vector<uint64_t> results(bucket_count);
+        count_buckets(min_count, max_count, [&](uint32_t b, const std::vector<__uint128_t> &kmers, const std::vector<uint32_t> &counts) {
+            auto f = fopen(results_filename(b).c_str(), "ab");
+            bool ok = (f != nullptr);
+            T buffer[1024];
+            for (uint64_t i = 0; ok and i < kmers.size(); i += 1024) {
+                auto n = std::min((uint64_t) 1024, kmers.size() - i);
+                for (uint64_t j = 0; j < n; ++j) buffer[j] = convert(kmers[i + j], counts[i + j]);
+                ok = (fwrite(buffer, sizeof(T), n, f) == n);
+            }
+            if (f != nullptr and fclose(f) != 0) ok = false;
+            if (not ok) record_failure(results_filename(b));
+            results[b] += kmers.size();
+        });
+        uint64_t total = 0;
+        for (auto &r: results) total += r;
+        T *out = allocate(total), *next = out;
+        for (uint32_t b = 0; b < bucket_count; ++b) {
+            if (results[b] == 0) continue;
+            auto f = fopen(results_filename(b).c_str(), "rb");
+            if (f == nullptr or fread(next, sizeof(T), results[b], f) != results[b]) {
+                if (f != nullptr) fclose(f);
+                throw std::runtime_error("Error reading " + results_filename(b));
+            }
+            fclose(f);
+            std::remove(results_filename(b).c_str());
+            next += results[b];
+        }
+        sdglib::sort(out, next);
+        uint64_t distinct = 0;
+        for (auto &h: histogram) distinct += h;
+        sdglib::OutputLog() << total << "/" << distinct << " " << (int) k << "-mers with Freq >= " << min_count << std::endl;
+    }
+
+    std::vector<std::pair<__uint128_t, uint32_t>> kmer_counts; /// Canonical k-mers and their counts (saturated at UINT32_MAX)
+    std::vector<uint64_t> histogram;                           /// Distinct k-mers per count, the last bin has all counts of 255 or more
+
+private:
+    /// Called from parallel regions with each counted bucket (or part of it), its sorted k-mers and their counts
+    typedef std::function<void(uint32_t, const std::vector<__uint128_t> &, const std::vector<uint32_t> &)> BucketOutput;
+
+    template<class DS>
+    void add_reads_from(const DS &ds, uint64_t total_bases);
+
+    void count_buckets(uint32_t min_count, uint32_t max_count, const BucketOutput &output);
+
+    template<typename KEY>
+    void count_buckets(uint32_t min_count, uint32_t max_count, const BucketOutput &output);
+
+    void flush_bucket(uint32_t bucket, std::vector<uint8_t> &buffer);
+
+    void record_failure(const std::string &filename);
+
+    void set_bucket_count(uint32_t _bucket_count);
+
+    std::string bucket_filename(uint32_t bucket) const;
+
+    std::string results_filename(uint32_t bucket) const;
+
+    uint8_t k, m;
+    std::string tmpdir;
+    std::string bucket_prefix;
+    std::string failed_file; /// First file that couldn't be written or read in a parallel region
+    uint64_t max_memory;
+    uint32_t bucket_count = 0;
+    uint64_t flush_size = 0;
+    std::vector<uint64_t> bucket_kmers;   /// k-mers binned into each bucket and not yet counted
+    std::vector<std::mutex> bucket_locks; /// Serialises appends to each bucket file
+};
+
+#endif //BSG_MINIMIZERKMERSCOUNTER_HPP
@@ -6,80 +6,214 @@
 #define BSG_BLOOMFILTER_HPP
 
 #include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <cmath>
+#include <new>
+#include <memory>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
 
+/**
+ * @brief Minimal allocator returning 64-byte aligned memory, so every BloomFilter block sits in a single cache line.
+ */
+template <typename T>
+struct CacheLineAllocator {
+    typedef T value_type;
+    CacheLineAllocator() = default;
+    template <typename U> CacheLineAllocator(const CacheLineAllocator<U> &) {}
+    T *allocate(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, n * sizeof(T)) != 0) throw std::bad_alloc();
+        return (T *) p;
+    }
+    void deallocate(T *p, size_t) { free(p); }
+    template <typename U> bool operator==(const CacheLineAllocator<U> &) const { return true; }
+    template <typename U> bool operator!=(const CacheLineAllocator<U> &) const { return false; }
+};
+
+/**
+ * @brief Register-blocked Bloom filter.
+ *
+ * Each element is mixed into a single 64-bit hash. The top bits choose one 512-bit (64-byte) block and the low bits
+ * generate all the bit positions within that block, so add() and contains() touch a single cache line.
+ * add() is lock-free (atomic OR on 64-bit words) and can be called from many threads at once.
+ */
 class BloomFilter {
-    uint64_t estimated_size;
-    uint32_t numHashes;
-    short dataSz = sizeof(data[0])*8;
-    std::vector<unsigned char> data;
 public:
+    static const uint64_t block_words = 8;
+    static const uint64_t block_bits = 64 * block_words;
+
     BloomFilter(){}
-    BloomFilter(uint64_t estimated_size, uint32_t num_hashes=1) :
-    estimated_size(estimated_size),
-    numHashes(num_hashes),
-    data((estimated_size + 7)/dataSz)
-    {}
-
-    void add(const std::vector<uint64_t> &element_hashes) {
-        for (const auto& element : element_hashes) {
-            auto vector_position(element % estimated_size);
-            auto array_position(vector_position / dataSz);
-            auto bit_push((7 - vector_position % dataSz));
-            auto byte_position_value(1 << bit_push);
-#pragma omp atomic
-            data[array_position] |= byte_position_value;
-        }
+
+    /**
+     * @brief Creates a filter sized for expected_elements distinct elements at a target false positive rate.
+     * @param expected_elements number of distinct elements that will be added
+     * @param fp_rate target false positive rate once all elements are added
+     */
+    explicit BloomFilter(uint64_t expected_elements, double fp_rate=0.01) {
+        if (expected_elements == 0) expected_elements = 1;
+        if (fp_rate <= 0 or fp_rate >= 1) fp_rate = 0.01;
+        //Classic sizing, blocking makes the filter a bit less even so it gets 20% extra space
+        double bits_per_element = -std::log(fp_rate) / (std::log(2) * std::log(2)) * 1.2;
+        numHashes = std::max(1, std::min(16, (int) std::round(bits_per_element / 1.2 * std::log(2))));
+        uint64_t total_bits = std::ceil(bits_per_element * expected_elements);
+        numBlocks = (total_bits + block_bits - 1) / block_bits;
+        data.resize(numBlocks * block_words, 0);
     }
 
-    void add(const uint64_t &element) {
-        auto vector_position(element % estimated_size);
-        auto array_position(vector_position / dataSz);
-        auto bit_push((7 - vector_position % dataSz));
-        auto byte_position_value(1 << bit_push);
-#pragma omp atomic
-        data[array_position] |= byte_position_value;
-    }
-
-    bool contains(const std::vector<uint64_t> &element_hashes) const {
-        for (const auto& element : element_hashes) {
-            auto vector_position(element % estimated_size);
-            auto array_position(vector_position / dataSz);
-            auto bit_push((7 - vector_position % dataSz));
-            auto byte_position_value(1 << bit_push);
-            auto result(data[array_position] & byte_position_value);
-            if (data[array_position] & byte_position_value != 0)
-                return false;
-        }
+    void add(const std::vector<uint64_t> &elements) {
+        for (const auto &element : elements) add(element);
+    }
+
+    void add(const uint64_t element) { add_hash(mix(element)); }
+
+    void add(const __uint128_t element) { add_hash(mix(element)); }
+
+    /**
+     * @brief true if all elements are (probably) in the filter
+     */
+    bool contains(const std::vector<uint64_t> &elements) const {
+        for (const auto &element : elements) if (not contains(element)) return false;
         return true;
     }
 
-    bool contains(const uint64_t &element) const {
-        auto vector_position(element % estimated_size);
-        auto array_position(vector_position / dataSz);
-        auto bit_push((7 - vector_position % dataSz));
-        auto byte_position_value(1 << bit_push);
-        auto val(data[array_position]);
-        auto result(val & byte_position_value);
-        return ( result != 0);
+    bool contains(const uint64_t element) const { return contains_hash(mix(element)); }
+
+    bool contains(const __uint128_t element) const { return contains_hash(mix(element)); }
+
+    /**
+     * @brief Batched lookup, result[i] is set to contains(elements[i].second).
+     * Blocks are prefetched a few elements ahead so the cache misses overlap instead of happening one at a time.
+     */
+    template <typename KT>
+    void contains(const std::vector<std::pair<bool, KT>> &elements, std::vector<bool> &result) const {
+        static const uint64_t lookahead = 8;
+        result.resize(elements.size());
+        if (numBlocks == 0) {
+            std::fill(result.begin(), result.end(), false);
+            return;
+        }
+        auto bits = words();
+        uint64_t hashes[lookahead];
+        auto n = elements.size();
+        for (uint64_t i = 0; i < lookahead and i < n; ++i) {
+            hashes[i] = mix(elements[i].second);
+            __builtin_prefetch(&bits[block_of(hashes[i]) * block_words]);
+        }
+        for (uint64_t i = 0; i < n; ++i) {
+            auto h = hashes[i % lookahead];
+            if (i + lookahead < n) {
+                hashes[i % lookahead] = mix(elements[i + lookahead].second);
+                __builtin_prefetch(&bits[block_of(hashes[i % lookahead]) * block_words]);
+            }
+            result[i] = contains_hash(h);
+        }
     }
 
     uint64_t number_bits_set() const {
-        static const unsigned char setBits[] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
         uint64_t total = 0;
+        auto bits = words();
 #pragma omp parallel for reduction(+:total)
-        for(uint64_t index = 0; index < data.size(); index++) {
-            unsigned char current_char = data[index];
-            total += setBits[current_char&0x0f]; //Count bottom 4bits
-            total += setBits[current_char>>4];  // Count top 4bits
+        for(uint64_t index = 0; index < numBlocks * block_words; index++) {
+            total += __builtin_popcountll(bits[index]);
         }
         return total;
     }
 
+    uint64_t size_in_bits() const { return numBlocks * block_bits; }
+
+    uint32_t number_of_hashes() const { return numHashes; }
+
     double false_positive_rate() const {
-        return pow(double(number_bits_set())/double(estimated_size), numHashes);
+        if (numBlocks == 0) return 1;
+        return pow(double(number_bits_set())/double(size_in_bits()), numHashes);
+    }
+
+    void write(std::ofstream &output_file) const {
+        output_file.write((const char *) &numHashes, sizeof(numHashes));
+        sdglib::write_aligned_flat_vector(output_file, words(), numBlocks * block_words);
+    }
+
+    void read(std::ifstream &input_file) {
+        mapping.reset();
+        mapped_data = nullptr;
+        input_file.read((char *) &numHashes, sizeof(numHashes));
+        sdglib::read_aligned_flat_vector(input_file, data);
+        numBlocks = data.size() / block_words;
+    }
+
+    /**
+     * @brief Uses the filter bits in place from a mapping of the same file, the filter can not be added to after this.
+     */
+    void read_mapped(std::ifstream &input_file, const std::shared_ptr<sdglib::MemoryMappedFile> &_mapping) {
+        std::vector<uint64_t, CacheLineAllocator<uint64_t>>().swap(data);
+        input_file.read((char *) &numHashes, sizeof(numHashes));
+        uint64_t count;
+        mapped_data = sdglib::map_aligned_flat_vector<uint64_t>(input_file, *_mapping, count);
+        numBlocks = count / block_words;
+        mapping = _mapping;
     }
+
+private:
+    static uint64_t mix(uint64_t x) {
+        //murmur3 64-bit finalizer
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t mix(__uint128_t x) {
+        return mix((uint64_t) x ^ mix((uint64_t) (x >> 64)));
+    }
+
+    uint64_t block_of(uint64_t h) const {
+        return (uint64_t) (((__uint128_t) (h >> 32) * numBlocks) >> 32);
+    }
+
+    //Builds the per-word masks for the numHashes positions, taken by double hashing from the hash's low 32 bits
+    void block_masks(uint64_t h, uint64_t masks[block_words]) const {
+        for (uint64_t w = 0; w < block_words; ++w) masks[w] = 0;
+        uint32_t h1 = h & 0xFFFF;
+        uint32_t h2 = ((h >> 16) & 0xFFFF) | 1;
+        for (uint32_t i = 0; i < numHashes; ++i) {
+            auto bit = (h1 + i * h2) % block_bits;
+            masks[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    const uint64_t *words() const { return mapped_data != nullptr ? mapped_data : data.data(); }
+
+    void add_hash(uint64_t h) {
+        if (numBlocks == 0) return;
+        if (mapped_data != nullptr) throw std::runtime_error("Can't add elements to a memory mapped BloomFilter");
+        auto block = &data[block_of(h) * block_words];
+        uint64_t masks[block_words];
+        block_masks(h, masks);
+        for (uint64_t w = 0; w < block_words; ++w) {
+            if (masks[w] and (block[w] & masks[w]) != masks[w]) __atomic_fetch_or(&block[w], masks[w], __ATOMIC_RELAXED);
+        }
+    }
+
+    bool contains_hash(uint64_t h) const {
+        if (numBlocks == 0) return false;
+        auto block = words() + block_of(h) * block_words;
+        uint64_t masks[block_words];
+        block_masks(h, masks);
+        for (uint64_t w = 0; w < block_words; ++w) {
+            if ((block[w] & masks[w]) != masks[w]) return false;
+        }
+        return true;
+    }
+
+    uint64_t numBlocks = 0;
+    uint32_t numHashes = 1;
+    std::vector<uint64_t, CacheLineAllocator<uint64_t>> data;
+    std::shared_ptr<sdglib::MemoryMappedFile> mapping;
+    const uint64_t *mapped_data = nullptr;
 };
 
 
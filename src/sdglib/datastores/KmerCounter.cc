@@ -5,6 +5,9 @@
 #include "KmerCounter.hpp"
 #include <sdglib/workspace/WorkSpace.hpp>
 #include <sstream>
+#include <atomic>
+#include <limits>
+#include <sdglib/utilities/Metrics.hpp>
 
 KmerCounter::KmerCounter(const WorkSpace &_ws, std::ifstream &infile): ws(_ws) {
     read(infile);
@@ -18,24 +21,33 @@ std::string KmerCounter::ls(int level, bool recursive) const {
     for (auto i=0;i<counts.size();++i) {
         uint64_t total=0;
         for (auto &c:counts[i]) total+=c;
+        for (auto &w:wide_counts[i]) total+=w.second-UINT16_MAX;
         ss << spacer << "    "<<count_names[i]<<": "<<total<<" total "<<std::to_string(k)<<"-mers"<< std::endl;
     }
     return ss.str();
 }
 
 void KmerCounter::index_sdg() {
+    SDG_SCOPED_TIMER(timer, "KmerCounter::index_sdg");
     //add all k-mers from SDG
     counts.clear();
     count_names.clear();
+    kindex.clear();
+    node_summaries.clear();
+    track_offsets.clear();
+    track_kidx.clear();
+    node_hashes.clear();
+    pending_kidx.clear();
     uint64_t t=0;
-    for(auto &n:ws.sdg.nodes) if (n.sequence.size()>=k) t+=n.sequence.size()+1-k;
+    const auto &nodes=ws.sdg.node_sequences;
+    for (sgNodeID_t n=0;n<nodes.size();++n) if (nodes.node_size(n)>=k) t+=nodes.node_size(n)+1-k;
     kindex.reserve(t);
     if (count_mode==Canonical) {
         StringKMerFactory skf(k);
-        for (auto &n:ws.sdg.nodes) if (n.sequence.size() >= k) skf.create_kmers(n.sequence, kindex);
+        for (sgNodeID_t n=0;n<nodes.size();++n) if (nodes.node_size(n) >= k) skf.create_kmers(nodes, n, kindex);
     } else if (count_mode==NonCanonical) {
         StringKMerFactoryNC skf(k);
-        for (auto &n:ws.sdg.nodes) if (n.sequence.size() >= k) skf.create_kmers(n.sequence, kindex);
+        for (sgNodeID_t n=0;n<nodes.size();++n) if (nodes.node_size(n) >= k) skf.create_kmers(nodes, n, kindex);
     }
     //sort
     std::sort(kindex.begin(),kindex.end());
@@ -55,181 +67,319 @@ void KmerCounter::index_sdg() {
         while(++ri<kindex.end() and *ri==*wi) ++(c.back());
     }
     kindex.resize(c.size());
+    wide_counts.assign(1, {});
+    build_prefix_buckets();
 }
 
+void KmerCounter::build_prefix_buckets() {
+    //Around 4 distinct k-mers per bucket, capped to keep the directory at 4^12 entries
+    prefix_bases = 1;
+    while (prefix_bases < k and prefix_bases < 12 and (1ULL << (2 * (prefix_bases + 1))) * 4 <= kindex.size()) ++prefix_bases;
+    uint64_t buckets = 1ULL << (2 * prefix_bases);
+    auto shift = 2 * (k - prefix_bases);
+    prefix_offsets.resize(buckets + 1);
+#pragma omp parallel for
+    for (uint64_t p = 0; p < buckets; ++p) {
+        prefix_offsets[p] = std::lower_bound(kindex.cbegin(), kindex.cend(), ((uint64_t) p) << shift) - kindex.cbegin();
+    }
+    prefix_offsets[buckets] = kindex.size();
+}
+
+/** Lock-free increment of a count shared between threads, saturating at the maximum value of T **/
+template<typename T>
+inline void saturating_increment(T &c) {
+    auto v = __atomic_load_n(&c, __ATOMIC_RELAXED);
+    while (v < std::numeric_limits<T>::max() and
+           not __atomic_compare_exchange_n(&c, &v, (T) (v + 1), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/** Lock-free decrement of a count shared between threads, saturated counts are left as they are **/
+template<typename T>
+inline void saturating_decrement(T &c) {
+    auto v = __atomic_load_n(&c, __ATOMIC_RELAXED);
+    while (v > 0 and v < std::numeric_limits<T>::max() and
+           not __atomic_compare_exchange_n(&c, &v, (T) (v - 1), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/** Hash of a node's sequence, to find the nodes that changed since the index was last updated **/
+static inline uint64_t node_sequence_hash(const SequenceDistanceGraph &sg, sgNodeID_t n) {
+    if (sg.nodes[n].status == NodeStatus::Deleted) return 0;
+    return sg.node_sequences.hash(n);
+}
+
+/**
+ * Accumulates k-mer hits into a new count from all threads, without critical sections. Wide counts are accumulated
+ * into a temporary 32-bit vector, then kept as the saturated 16-bit count plus the list of k-mers over UINT16_MAX.
+ */
+class CountAccumulator {
+public:
+    CountAccumulator(std::vector<uint16_t> &_counts, bool _wide) : counts(_counts), wide(_wide) {
+        if (wide) counts32.resize(counts.size());
+    }
+
+    void add(uint64_t kidx) {
+        if (wide) saturating_increment(counts32[kidx]);
+        else saturating_increment(counts[kidx]);
+    }
+
+    void finish(std::vector<std::pair<uint64_t,uint32_t>> &overflow) {
+        if (not wide) return;
+#pragma omp parallel for schedule(static,100000)
+        for (uint64_t i = 0; i < counts.size(); ++i) counts[i] = std::min(counts32[i], (uint32_t) UINT16_MAX);
+        for (uint64_t i = 0; i < counts32.size(); ++i) if (counts32[i] > UINT16_MAX) overflow.emplace_back(i, counts32[i]);
+        std::vector<uint32_t>().swap(counts32);
+    }
+
+private:
+    std::vector<uint16_t> &counts;
+    std::vector<uint32_t> counts32;
+    bool wide;
+};
+
+/** Read and k-mer totals shared by the counting threads, which add their local totals every few thousand reads **/
+class CountProgress {
+public:
+    void add(uint64_t &thread_present, uint64_t &thread_absent, uint64_t &thread_rp) {
+        present += thread_present;
+        absent += thread_absent;
+        auto prev_rp = rp.fetch_add(thread_rp);
+        if (prev_rp / 100000 != (prev_rp + thread_rp) / 100000)
+            sdglib::OutputLog(sdglib::INFO) << prev_rp + thread_rp << " reads processed " << present << " / "
+                                            << present + absent << " kmers found" << std::endl;
+        thread_present = thread_absent = thread_rp = 0;
+    }
+
+    void log() const {
+        sdglib::OutputLog(sdglib::INFO) << rp << " reads processed " << present << " / " << present + absent
+                                        << " kmers found" << std::endl;
+    }
+
+    uint64_t reads() const { return rp; }
+
+private:
+    std::atomic<uint64_t> present{0}, absent{0}, rp{0};
+};
+
 void KmerCounter::update_graph_counts() {
     for (auto &c:counts[0])c=0;
 
 
     uint64_t not_found=0;
 
-    if (count_mode==Canonical) {
 #pragma omp parallel
-        {
-            std::vector<uint64_t> nkmers;
-            std::vector<int64_t> nkmerspos;
-            StringKMerFactory skf(k);
-#pragma omp for schedule(static,1000) reduction(+:not_found)
-            for (sgNodeID_t nid=0;nid<ws.sdg.nodes.size();++nid) {
-                const auto &n=ws.sdg.nodes[nid];
-                if (n.sequence.size() >= k) {
-                    nkmers.clear();
-                    skf.create_kmers(n.sequence, nkmers);
-                    nkmerspos.clear();
-                    nkmerspos.resize(nkmers.size());
-                    for (uint64_t i=0;i<nkmers.size();++i) {
-                        auto &kmer=nkmers[i];
-                        auto kidx = std::lower_bound(kindex.begin(), kindex.end(), kmer);
-                        if (kidx == kindex.end() or *kidx != kmer) {
-                            ++not_found;
-                            nkmerspos[i]=-1;
-                        }
-                        else {
-                            nkmerspos[i]=kidx - kindex.begin();
-                            //++counts[0][kidx - kindex.begin()];
-                        }
-                    }
-#pragma omp critical
-                    for (auto &p:nkmerspos) {
-                        if (p!=-1) ++counts[0][p];
-                    }
-                }
-            }
-        }
-    } else if (count_mode==NonCanonical) {
+    {
         std::vector<uint64_t> nkmers;
-        StringKMerFactoryNC skf(k);
-        for (auto &n:ws.sdg.nodes) {
-            nkmers.clear();
-            if (n.sequence.size() >= k) {
-                skf.create_kmers(n.sequence, nkmers);
+        StringKMerFactory skf(k);
+        StringKMerFactoryNC skfnc(k);
+#pragma omp for schedule(dynamic,1000) reduction(+:not_found)
+        for (sgNodeID_t nid=0;nid<ws.sdg.nodes.size();++nid) {
+            if (ws.sdg.get_node_size(nid) >= k) {
+                nkmers.clear();
+                if (count_mode==Canonical) skf.create_kmers(ws.sdg.node_sequences, nid, nkmers);
+                else if (count_mode==NonCanonical) skfnc.create_kmers(ws.sdg.node_sequences, nid, nkmers);
                 for (auto &kmer:nkmers) {
-                    auto kidx=std::lower_bound(kindex.begin(), kindex.end(), kmer);
-                    if (kidx==kindex.end() or *kidx!=kmer) ++not_found;
-                    else ++counts[0][kidx-kindex.begin()];
+                    auto kidx=find_kmer(kmer);
+                    if (kidx==-1) ++not_found;
+                    else saturating_increment(counts[0][kidx]);
                 }
             }
         }
     }
     if (not_found) sdglib::OutputLog()<<"WARNING: "<<not_found<<" kmers not in index when updating graph counts"<<std::endl;
-    //clear kci cache, as it will be invalid since we don't know if the same k-mers are unique in the graph!
+    //clear kci cache and node summaries, as they will be invalid since we don't know if the same k-mers are unique in the graph!
+    kci_cache.clear();
+    node_summaries.clear();
+    track_offsets.clear();
+    track_kidx.clear();
+    node_hashes.clear();
+}
+
+uint64_t KmerCounter::update_index() {
+    SDG_SCOPED_TIMER(timer, "KmerCounter::update_index");
+    const auto &nodes=ws.sdg.nodes;
+    //without node state all nodes are changed, and the graph count is computed from scratch
+    bool full = (node_hashes.empty() or track_offsets.size()!=node_hashes.size()+1);
+    std::vector<uint64_t> new_hashes(nodes.size());
+#pragma omp parallel for schedule(dynamic,1000)
+    for (sgNodeID_t n=0;n<nodes.size();++n) new_hashes[n]=node_sequence_hash(ws.sdg,n);
+    std::vector<sgNodeID_t> changed;
+    for (sgNodeID_t n=0;n<nodes.size();++n)
+        if (full or n>=node_hashes.size() or node_hashes[n]!=new_hashes[n]) changed.emplace_back(n);
+    sdglib::OutputLog()<<"Updating index of KmerCounter "<<name<<": "<<changed.size()<<" / "<<nodes.size()<<" nodes changed"<<std::endl;
+
+    //remove the k-mers of changed nodes from the graph count
+    if (full) std::fill(counts[0].begin(),counts[0].end(),0);
+    else {
+#pragma omp parallel for schedule(dynamic,1000)
+        for (uint64_t ci=0;ci<changed.size();++ci) {
+            auto n=changed[ci];
+            if (n+1>=track_offsets.size()) continue;
+            for (auto i=track_offsets[n];i<track_offsets[n+1];++i)
+                if (track_kidx[i]!=-1) saturating_decrement(counts[0][track_kidx[i]]);
+        }
+    }
+
+    //k-mers of changed nodes, and the ones not in the index yet
+    std::vector<std::vector<uint64_t>> changed_kmers(changed.size());
+    std::vector<uint64_t> new_kmers;
+#pragma omp parallel
+    {
+        std::vector<uint64_t> local_new;
+        StringKMerFactory skf(k);
+        StringKMerFactoryNC skfnc(k);
+#pragma omp for schedule(dynamic,1000)
+        for (uint64_t ci=0;ci<changed.size();++ci) {
+            auto n=changed[ci];
+            if (nodes[n].status==NodeStatus::Deleted or ws.sdg.get_node_size(n)<k) continue;
+            if (count_mode==Canonical) skf.create_kmers(ws.sdg.node_sequences,n,changed_kmers[ci]);
+            else if (count_mode==NonCanonical) skfnc.create_kmers(ws.sdg.node_sequences,n,changed_kmers[ci]);
+            for (auto &kmer:changed_kmers[ci]) if (find_kmer(kmer)==-1) local_new.emplace_back(kmer);
+        }
+#pragma omp critical(kmer_counter_new_kmers)
+        new_kmers.insert(new_kmers.end(),local_new.begin(),local_new.end());
+    }
+    std::sort(new_kmers.begin(),new_kmers.end());
+    new_kmers.erase(std::unique(new_kmers.begin(),new_kmers.end()),new_kmers.end());
+
+    //merge the new k-mers into the index, and move every index-based structure to the new positions
+    std::vector<uint64_t> new_kidx;
+    if (not new_kmers.empty()) {
+        std::vector<uint64_t> old_to_new(kindex.size());
+        std::vector<uint64_t> merged;
+        merged.reserve(kindex.size()+new_kmers.size());
+        new_kidx.reserve(new_kmers.size());
+        uint64_t oi=0,ni=0;
+        while (oi<kindex.size() or ni<new_kmers.size()) {
+            if (ni==new_kmers.size() or (oi<kindex.size() and kindex[oi]<new_kmers[ni])) {
+                old_to_new[oi]=merged.size();
+                merged.emplace_back(kindex[oi++]);
+            } else {
+                new_kidx.emplace_back(merged.size());
+                merged.emplace_back(new_kmers[ni++]);
+            }
+        }
+        for (auto &c:counts) {
+            std::vector<uint16_t> nc(merged.size(),0);
+#pragma omp parallel for schedule(static,100000)
+            for (uint64_t i=0;i<c.size();++i) nc[old_to_new[i]]=c[i];
+            c.swap(nc);
+        }
+        for (auto &w:wide_counts) for (auto &kc:w) kc.first=old_to_new[kc.first];
+        if (not full) {
+#pragma omp parallel for schedule(static,100000)
+            for (uint64_t i=0;i<track_kidx.size();++i) if (track_kidx[i]!=-1) track_kidx[i]=old_to_new[track_kidx[i]];
+        }
+        for (auto &p:pending_kidx) for (auto &kidx:p) kidx=old_to_new[kidx];
+        kindex.swap(merged);
+        build_prefix_buckets();
+    }
+    //read counts of the new k-mers are pending until recounted
+    pending_kidx.resize(counts.size());
+    for (auto ci=1;ci<counts.size();++ci) {
+        std::vector<uint64_t> p;
+        p.reserve(pending_kidx[ci].size()+new_kidx.size());
+        std::merge(pending_kidx[ci].begin(),pending_kidx[ci].end(),new_kidx.begin(),new_kidx.end(),std::back_inserter(p));
+        pending_kidx[ci].swap(p);
+    }
+
+    //add the k-mers of changed nodes to the graph count, and rebuild the coverage track
+    std::vector<std::vector<int64_t>> changed_kidx(changed.size());
+#pragma omp parallel for schedule(dynamic,1000)
+    for (uint64_t ci=0;ci<changed.size();++ci) {
+        changed_kidx[ci].reserve(changed_kmers[ci].size());
+        for (auto &kmer:changed_kmers[ci]) {
+            auto kidx=find_kmer(kmer);
+            changed_kidx[ci].emplace_back(kidx);
+            saturating_increment(counts[0][kidx]);
+        }
+        std::vector<uint64_t>().swap(changed_kmers[ci]);
+    }
+    std::vector<uint64_t> new_offsets(nodes.size()+1,0);
+    std::vector<uint64_t> changed_pos(nodes.size(),UINT64_MAX); //position of each changed node in changed
+    for (uint64_t ci=0;ci<changed.size();++ci) changed_pos[changed[ci]]=ci;
+    for (sgNodeID_t n=0;n<nodes.size();++n)
+        new_offsets[n+1]=new_offsets[n]+(changed_pos[n]!=UINT64_MAX ? changed_kidx[changed_pos[n]].size() : track_offsets[n+1]-track_offsets[n]);
+    std::vector<int64_t> new_track(new_offsets.back());
+#pragma omp parallel for schedule(dynamic,1000)
+    for (sgNodeID_t n=0;n<nodes.size();++n) {
+        if (changed_pos[n]!=UINT64_MAX) std::copy(changed_kidx[changed_pos[n]].begin(),changed_kidx[changed_pos[n]].end(),new_track.begin()+new_offsets[n]);
+        else std::copy(track_kidx.begin()+track_offsets[n],track_kidx.begin()+track_offsets[n+1],new_track.begin()+new_offsets[n]);
+    }
+    track_offsets.swap(new_offsets);
+    track_kidx.swap(new_track);
+    node_hashes.swap(new_hashes);
+
     kci_cache.clear();
+    node_summaries.clear();
+    sdglib::OutputLog()<<new_kmers.size()<<" k-mers added to the index, now "<<kindex.size()<<" k-mers"<<std::endl;
+    SDG_TIMER_ITEMS(timer, changed.size());
+    return new_kmers.size();
 }
 
-void KmerCounter::add_count(const std::string &count_name, const std::vector<std::string> &filenames, bool fastq) {
+void KmerCounter::add_count(const std::string &count_name, const std::vector<std::string> &filenames, bool fastq, bool wide) {
     if (std::find(count_names.cbegin(), count_names.cend(), count_name) != count_names.cend()) {
         throw std::runtime_error(count_name + " already exists, please use a different name");
     }
+    SDG_SCOPED_TIMER(timer, "KmerCounter::add_count");
     count_names.emplace_back(count_name);
     counts.emplace_back(kindex.size());
-    uint64_t present(0), absent(0), rp(0);
-    sdglib::OutputLog(sdglib::INFO)<<"Populating lookup map"<<std::endl;
-    std::unordered_map<uint64_t,uint64_t> kmer_map;
-    kmer_map.reserve(kindex.size());
-    for (uint64_t i=0;i<kindex.size();++i) kmer_map[kindex[i]]=i;
-    sdglib::OutputLog(sdglib::INFO)<<"Map populated with "<<kmer_map.size()<<" entries"<< std::endl;
+    wide_counts.emplace_back();
+    CountAccumulator accumulator(counts.back(), wide);
+    CountProgress progress;
     for (auto filename:filenames) {
         sdglib::OutputLog(sdglib::INFO) << "Counting from file: " << filename << std::endl;
-        FastqReader<FastqRecord> fastqReader({0}, filename);
-        FastaReader<FastaRecord> fastaReader({0}, filename);
-#pragma omp parallel shared(fastqReader)
-        {
+        //decompression runs on its own thread, blocks of records are parsed and counted as they arrive
+        FastxPipeline pipeline({filename}, fastq);
+        pipeline.run<int>([&](const FastxBlock &block, int &) {
             uint64_t thread_present(0), thread_absent(0), thread_rp(0);
-            const size_t local_kmers_size = 2000000;
-            std::vector<uint64_t> found_kmers;
-            found_kmers.reserve(local_kmers_size);
-            FastqRecord read;
-            FastaRecord reada;
-
+            std::string seq;
             std::vector<uint64_t> readkmers;
             StringKMerFactory skf(k);
             StringKMerFactoryNC skfnc(k);
-
-            bool c;
-#pragma omp critical(fastqreader)
-            {
-                if (fastq) c = fastqReader.next_record(read);
-                else c= fastaReader.next_record(reada);
-            }
-            while (c) {
+            uint64_t pos=0;
+            while (block.next_record(0, pos, nullptr, seq)) {
                 readkmers.clear();
                 if (count_mode==Canonical) {
-                    skf.create_kmers((fastq?read.seq:reada.seq),readkmers);
+                    skf.create_kmers(seq,readkmers);
                 } else if (count_mode==NonCanonical) {
-                    skfnc.create_kmers((fastq?read.seq:reada.seq),readkmers);
+                    skfnc.create_kmers(seq,readkmers);
                 }
-
-
-
                 for (auto &rk:readkmers) {
-                    auto findk = kmer_map.find(rk);
-                    if (kmer_map.end() != findk) {
-                        //++thread_counts[findk->second];
-                        found_kmers.emplace_back(findk->second);
-                        if (found_kmers.size() == local_kmers_size) {
-#pragma omp critical(results_merge)
-                            {
-                                auto &arc = counts.back();
-                                for (auto &x:found_kmers) if (arc[x] < UINT16_MAX) ++arc[x];
-                                if (rp / 100000 != (rp + thread_rp) / 100000)
-                                    sdglib::OutputLog(sdglib::INFO) << rp << " reads processed " << present << " / "
-                                                                    << present + absent << " kmers found" << std::endl;
-                                rp += thread_rp;
-                                present += thread_present;
-                                absent += thread_absent;
-                            }
-                            found_kmers.clear();
-                            thread_absent = 0;
-                            thread_present = 0;
-                            thread_rp = 0;
-
-                        }
+                    auto kidx = find_kmer(rk);
+                    if (kidx != -1) {
+                        accumulator.add(kidx);
                         ++thread_present;
                     } else ++thread_absent;
                 }
                 ++thread_rp;
-#pragma omp critical(fastqreader)
-                {
-                    if (fastq) c = fastqReader.next_record(read);
-                    else c= fastaReader.next_record(reada);
-                }
-            }
-#pragma omp critical(results_merge)
-            {
-                auto &arc = counts.back();
-                for (auto &x:found_kmers) if (arc[x] < UINT16_MAX) ++arc[x];
-                rp += thread_rp;
-                present += thread_present;
-                absent += thread_absent;
             }
-        }
-        sdglib::OutputLog(sdglib::INFO) << rp << " reads processed " << present << " / " << present + absent
-                                        << " kmers found" << std::endl;
+            progress.add(thread_present, thread_absent, thread_rp);
+        }, [](const FastxBlock &, int &) {});
+        progress.log();
     }
+    accumulator.finish(wide_counts.back());
+    SDG_TIMER_ITEMS(timer, progress.reads());
     sdglib::OutputLog(sdglib::INFO) << "Done" << std::endl;
 }
 
 /** This template is used to do the counts from the datastores, it is templatised here rather than on the header **/
 template<class T>
-void add_count_to_kds( KmerCounter & kds, const std::string & count_name, const T & datastore) {
+void add_count_to_kds( KmerCounter & kds, const std::string & count_name, const T & datastore, bool wide) {
     if (std::find(kds.count_names.cbegin(), kds.count_names.cend(), count_name) != kds.count_names.cend()) {
         throw std::runtime_error(count_name + " already exists, please use a different name");
     }
+    SDG_SCOPED_TIMER(timer, "KmerCounter::add_count");
     kds.count_names.emplace_back(count_name);
     kds.counts.emplace_back(kds.kindex.size());
-    uint64_t present(0), absent(0), rp(0);
-    sdglib::OutputLog(sdglib::INFO)<<"Populating lookup map"<<std::endl;
-    std::unordered_map<uint64_t,uint64_t> kmer_map;
-    kmer_map.reserve(kds.kindex.size());
-    for (uint64_t i=0;i<kds.kindex.size();++i) kmer_map[kds.kindex[i]]=i;
-    sdglib::OutputLog(sdglib::INFO)<<"Map populated with "<<kmer_map.size()<<" entries, counting from datastore: " << datastore.filename << std::endl;
+    kds.wide_counts.emplace_back();
+    CountAccumulator accumulator(kds.counts.back(), wide);
+    CountProgress progress;
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
+    sdglib::OutputLog(sdglib::INFO)<<"Counting from datastore: " << datastore.filename << std::endl;
 #pragma omp parallel
     {
         ReadSequenceBuffer bpsg(datastore);
         uint64_t thread_present(0), thread_absent(0), thread_rp(0);
-        const size_t local_kmers_size = 2000000;
-        std::vector<uint64_t> found_kmers; // kmer index of found kmers is saved here, increments are done in the critical
-        found_kmers.reserve(local_kmers_size);
         std::vector<uint64_t> readkmers;
         CStringKMerFactory cskf(kds.get_k());
 #pragma omp for schedule(static,10000)
@@ -238,58 +388,104 @@ void add_count_to_kds( KmerCounter & kds, const std::string & count_name, const
             cskf.create_kmers(readkmers, bpsg.get_read_sequence(rid));
 
             for (auto &rk:readkmers) {
-                auto findk = kmer_map.find(rk);
-                if (kmer_map.end() != findk) {
-                    //++thread_counts[findk->second];
-                    found_kmers.emplace_back(findk->second);
-                    if (found_kmers.size() == local_kmers_size) {
-#pragma omp critical(results_merge)
-                        {
-                            auto &arc=kds.counts.back();
-                            for (auto &x:found_kmers) if (arc[x] < UINT16_MAX) ++arc[x];
-                            if (rp / 100000 != (rp + thread_rp) / 100000)
-                                sdglib::OutputLog(sdglib::INFO) << rp << " reads processed " << present << " / "
-                                                                << present + absent << " kmers found" << std::endl;
-                            rp += thread_rp;
-                            present += thread_present;
-                            absent += thread_absent;
-                        }
-                        found_kmers.clear();
-                        thread_absent = 0;
-                        thread_present = 0;
-                        thread_rp = 0;
-
-                    }
+                auto kidx = kds.find_kmer(rk);
+                if (kidx != -1) {
+                    accumulator.add(kidx);
                     ++thread_present;
                 } else ++thread_absent;
             }
-            ++thread_rp;
+            if (++thread_rp == 10000) progress.add(thread_present, thread_absent, thread_rp);
         }
-#pragma omp critical(results_merge)
-        {
-            auto &arc=kds.counts.back();
-            for (auto &x:found_kmers) if (arc[x] < UINT16_MAX) ++arc[x];
-            rp += thread_rp;
-            present += thread_present;
-            absent += thread_absent;
+        progress.add(thread_present, thread_absent, thread_rp);
+    }
+    accumulator.finish(kds.wide_counts.back());
+    progress.log();
+    SDG_TIMER_ITEMS(timer, progress.reads());
+    sdglib::OutputLog(sdglib::INFO) << "Done" << std::endl;
+}
+
+void KmerCounter::add_count(const std::string & count_name, const PairedReadsDatastore & datastore, bool wide){
+    add_count_to_kds(*this,count_name,datastore,wide);
+}
+void KmerCounter::add_count(const std::string & count_name, const LinkedReadsDatastore & datastore, bool wide){
+    add_count_to_kds(*this,count_name,datastore,wide);
+}
+void KmerCounter::add_count(const std::string & count_name, const LongReadsDatastore & datastore, bool wide){
+    add_count_to_kds(*this,count_name,datastore,wide);
+}
+
+/** Counts the k-mers pending recount on count_name from a datastore, only these k-mers are looked up **/
+template<class T>
+void recount_kmers_from_kds(KmerCounter & kds, const std::string & count_name, const T & datastore, bool wide) {
+    auto cnitr=std::find(kds.count_names.cbegin(), kds.count_names.cend(), count_name);
+    if (cnitr == kds.count_names.cend()) throw std::runtime_error("Couldn't find a count named: "+count_name);
+    auto ci=cnitr-kds.count_names.cbegin();
+    if (ci==0) throw std::runtime_error("The graph count can't be recounted from reads, use update_index()");
+    if (ci>=kds.pending_kidx.size() or kds.pending_kidx[ci].empty()) {
+        sdglib::OutputLog(sdglib::INFO) << "No k-mers pending recount on " << count_name << std::endl;
+        return;
+    }
+    SDG_SCOPED_TIMER(timer, "KmerCounter::recount_new_kmers");
+    auto &pending=kds.pending_kidx[ci];
+    std::vector<uint64_t> pkmers(pending.size());
+    for (uint64_t i=0;i<pending.size();++i) pkmers[i]=kds.kindex[pending[i]];
+    std::vector<uint32_t> pcounts(pending.size());
+    CountProgress progress;
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
+    sdglib::OutputLog(sdglib::INFO)<<"Recounting "<<pending.size()<<" k-mers on "<<count_name<<" from datastore: " << datastore.filename << std::endl;
+#pragma omp parallel
+    {
+        ReadSequenceBuffer bpsg(datastore);
+        uint64_t thread_present(0), thread_absent(0), thread_rp(0);
+        std::vector<uint64_t> readkmers;
+        CStringKMerFactory cskf(kds.get_k());
+#pragma omp for schedule(static,10000)
+        for (uint64_t rid = 1; rid <= datastore.size(); ++rid) {
+            readkmers.clear();
+            cskf.create_kmers(readkmers, bpsg.get_read_sequence(rid));
+
+            for (auto &rk:readkmers) {
+                auto it = std::lower_bound(pkmers.cbegin(), pkmers.cend(), rk);
+                if (it != pkmers.cend() and *it == rk) {
+                    saturating_increment(pcounts[it - pkmers.cbegin()]);
+                    ++thread_present;
+                } else ++thread_absent;
+            }
+            if (++thread_rp == 10000) progress.add(thread_present, thread_absent, thread_rp);
         }
+        progress.add(thread_present, thread_absent, thread_rp);
+    }
+    progress.log();
+    SDG_TIMER_ITEMS(timer, progress.reads());
+    auto &c=kds.counts[ci];
+    auto &w=kds.wide_counts[ci];
+    for (uint64_t i=0;i<pending.size();++i) {
+        c[pending[i]]=std::min(pcounts[i], (uint32_t) UINT16_MAX);
+        if (wide and pcounts[i]>UINT16_MAX) w.emplace_back(pending[i],pcounts[i]);
     }
-    sdglib::OutputLog(sdglib::INFO) << rp << " reads processed " << present << " / " << present + absent
-                                    << " kmers found" << std::endl;
+    std::sort(w.begin(),w.end());
+    std::vector<uint64_t>().swap(pending);
     sdglib::OutputLog(sdglib::INFO) << "Done" << std::endl;
 }
 
-void KmerCounter::add_count(const std::string & count_name, const PairedReadsDatastore & datastore){
-    add_count_to_kds(*this,count_name,datastore);
+void KmerCounter::recount_new_kmers(const std::string & count_name, const PairedReadsDatastore & datastore, bool wide){
+    recount_kmers_from_kds(*this,count_name,datastore,wide);
 }
-void KmerCounter::add_count(const std::string & count_name, const LinkedReadsDatastore & datastore){
-    add_count_to_kds(*this,count_name,datastore);
+void KmerCounter::recount_new_kmers(const std::string & count_name, const LinkedReadsDatastore & datastore, bool wide){
+    recount_kmers_from_kds(*this,count_name,datastore,wide);
 }
-void KmerCounter::add_count(const std::string & count_name, const LongReadsDatastore & datastore){
-    add_count_to_kds(*this,count_name,datastore);
+void KmerCounter::recount_new_kmers(const std::string & count_name, const LongReadsDatastore & datastore, bool wide){
+    recount_kmers_from_kds(*this,count_name,datastore,wide);
+}
+
+uint64_t KmerCounter::kmers_pending_recount(const std::string &count_name) const {
+    auto cnitr=std::find(count_names.cbegin(), count_names.cend(), count_name);
+    if (cnitr == count_names.cend()) throw std::runtime_error("Couldn't find a count named: "+count_name);
+    auto ci=cnitr-count_names.cbegin();
+    return ci<pending_kidx.size() ? pending_kidx[ci].size() : 0;
 }
 
-std::vector<uint16_t> KmerCounter::project_count(const uint16_t count_idx, const std::string &s) {
+std::vector<uint32_t> KmerCounter::project_count(const uint16_t count_idx, const std::string &s) {
     std::vector<uint64_t> skmers;
 
     //StringKMerFactory skf(k);
@@ -301,45 +497,37 @@ std::vector<uint16_t> KmerCounter::project_count(const uint16_t count_idx, const
         StringKMerFactoryNC skf(k);
         skf.create_kmers(s,skmers);
     }
-    std::vector<uint16_t> kcov;
+    std::vector<uint32_t> kcov;
     for (auto &kmer: skmers){
-        auto nk = std::lower_bound(kindex.begin(), kindex.end(), kmer);
-
-        if (nk!=kindex.end() and *nk == kmer) {
-            kcov.push_back(counts[count_idx][nk-kindex.begin()]);
-
-        } else {
-            kcov.push_back(0);
-        }
+        auto kidx = find_kmer(kmer);
+        kcov.push_back(kidx != -1 ? get_count(count_idx,kidx) : 0);
     }
     return kcov;
 }
 
 float KmerCounter::kci(sgNodeID_t node) {
+    if (node_summaries.size()>1 and llabs(node)<node_summaries[1].size()) {
+        const auto &ns=node_summaries[1][llabs(node)];
+        return (ns.unique_kmers>10 ? ns.median/kci_peak_f:-1);
+    }
     try {
         return kci_cache.at(llabs(node));
     }
     catch(const std::out_of_range& oor) {
         std::vector<uint64_t> skmers;
-        auto &s=ws.sdg.nodes[llabs(node)].sequence;
-        //StringKMerFactory skf(k);
-        //skf.create_kmers(s,skmers);
         if (count_mode==Canonical) {
             StringKMerFactory skf(k);
-            skf.create_kmers(s,skmers);
+            skf.create_kmers(ws.sdg.node_sequences,llabs(node),skmers);
         } else if (count_mode==NonCanonical) {
             StringKMerFactoryNC skf(k);
-            skf.create_kmers(s,skmers);
+            skf.create_kmers(ws.sdg.node_sequences,llabs(node),skmers);
         }
         uint64_t totalf=0,count=0;
         std::vector<uint64_t> freqs;
         freqs.reserve(skmers.size());
         for (auto &kmer: skmers){
-            auto nk = std::lower_bound(kindex.begin(), kindex.end(), kmer);
-
-            if (nk!=kindex.end() and *nk == kmer and counts[0][nk-kindex.begin()]==1) {
-                freqs.emplace_back(counts[1][nk-kindex.begin()]);
-            }
+            auto kidx = find_kmer(kmer);
+            if (kidx != -1 and counts[0][kidx]==1) freqs.emplace_back(get_count(1,kidx));
         }
         std::sort(freqs.begin(),freqs.end());
         float nkci=(freqs.size()>10 ? freqs[freqs.size()/2]/ kci_peak_f:-1);
@@ -352,32 +540,123 @@ float KmerCounter::kci(sgNodeID_t node) {
 }
 
 void KmerCounter::compute_all_kcis() {
-#pragma omp parallel for schedule(static,1000)
-    for (sgNodeID_t n=1;n<ws.sdg.nodes.size();++n){
-        if (ws.sdg.nodes[n].status==NodeStatus::Active) kci(n);
+    compute_node_summaries(not track_offsets.empty());
+}
+
+void KmerCounter::compute_node_summaries(bool coverage_track) {
+    const auto &nodes=ws.sdg.nodes;
+    sdglib::OutputLog()<<"Computing coverage summaries for "<<nodes.size()-1<<" nodes on "<<counts.size()<<" counts"<<std::endl;
+    node_summaries.assign(counts.size(),std::vector<NodeCoverageSummary>(nodes.size()));
+    //without a new track the current one is kept, update_index() still needs it and its node hashes
+    if (coverage_track) {
+        std::vector<uint64_t>().swap(track_offsets);
+        std::vector<int64_t>().swap(track_kidx);
     }
+    std::vector<std::vector<int64_t>> node_kidx(coverage_track ? nodes.size() : 0);
+    //every k-mer is looked up once, then all counts are summarised from its index
+#pragma omp parallel
+    {
+        std::vector<uint64_t> nkmers;
+        std::vector<int64_t> kidxs;
+        std::vector<uint32_t> freqs;
+        StringKMerFactory skf(k);
+        StringKMerFactoryNC skfnc(k);
+#pragma omp for schedule(dynamic,1000)
+        for (sgNodeID_t n=1;n<nodes.size();++n) {
+            if (nodes[n].status==NodeStatus::Deleted) continue;
+            nkmers.clear();
+            if (count_mode==Canonical) skf.create_kmers(ws.sdg.node_sequences,n,nkmers);
+            else if (count_mode==NonCanonical) skfnc.create_kmers(ws.sdg.node_sequences,n,nkmers);
+            kidxs.resize(nkmers.size());
+            for (uint64_t i=0;i<nkmers.size();++i) kidxs[i]=find_kmer(nkmers[i]);
+            for (auto ci=0;ci<counts.size();++ci) {
+                freqs.clear();
+                for (auto kidx:kidxs) if (kidx!=-1 and counts[0][kidx]==1) freqs.emplace_back(get_count(ci,kidx));
+                auto &ns=node_summaries[ci][n];
+                ns.kmers=nkmers.size();
+                ns.unique_kmers=freqs.size();
+                if (freqs.empty()) continue;
+                std::sort(freqs.begin(),freqs.end());
+                ns.q25=freqs[freqs.size()/4];
+                ns.median=freqs[freqs.size()/2];
+                ns.q75=freqs[freqs.size()*3/4];
+            }
+            if (coverage_track) node_kidx[n]=kidxs;
+        }
+    }
+    if (coverage_track) {
+        //the graph count only matches a new track if the graph did not change since the last update_index()
+        std::vector<uint64_t> hashes(node_hashes.size()==nodes.size() ? nodes.size() : 0);
+#pragma omp parallel for schedule(dynamic,1000)
+        for (sgNodeID_t n=0;n<hashes.size();++n) hashes[n]=node_sequence_hash(ws.sdg,n);
+        if (hashes!=node_hashes) node_hashes.clear();
+        track_offsets.assign(nodes.size()+1,0);
+        for (sgNodeID_t n=0;n<nodes.size();++n) track_offsets[n+1]=track_offsets[n]+node_kidx[n].size();
+        track_kidx.resize(track_offsets.back());
+#pragma omp parallel for schedule(dynamic,1000)
+        for (sgNodeID_t n=0;n<nodes.size();++n) {
+            std::copy(node_kidx[n].begin(),node_kidx[n].end(),track_kidx.begin()+track_offsets[n]);
+            std::vector<int64_t>().swap(node_kidx[n]);
+        }
+    }
+}
 
+const NodeCoverageSummary &KmerCounter::node_summary(uint16_t count_idx, int64_t node) const {
+    if (count_idx>=node_summaries.size() or llabs(node)>=node_summaries[count_idx].size())
+        throw std::runtime_error("No coverage summary for node "+std::to_string(node)+" on count "+std::to_string(count_idx)+", please run compute_node_summaries()");
+    return node_summaries[count_idx][llabs(node)];
 }
 
-std::vector<uint64_t> KmerCounter::count_spectra(std::string name, uint16_t maxf, bool unique_in_graph, bool present_in_graph) {
-    std::vector<uint64_t> s(maxf+1);
-    auto &cv=get_count_by_name(name);
-    if (unique_in_graph){
-        for (auto i=0;i<counts[0].size();++i){
-            if (counts[0][i]==1)
-                ++s[(cv[i]>maxf ? maxf : cv[i])];
+std::vector<uint32_t> KmerCounter::project_node_count(const std::string &count_name, int64_t node) {
+    auto cnitr=std::find(count_names.begin(),count_names.end(),count_name);
+    if (cnitr!=count_names.end()){
+        return project_node_count(cnitr-count_names.begin(),node);
+    }
+    return {};
+}
+
+std::vector<uint32_t> KmerCounter::project_node_count(uint16_t count_idx, int64_t node) {
+    auto n=llabs(node);
+    //non-canonical k-mers of the reverse complement are not the forward ones reversed
+    if (node<0 and count_mode==NonCanonical) return project_count(count_idx,ws.sdg.get_node_sequence(node));
+    std::vector<uint32_t> kcov;
+    if (n+1>=track_offsets.size()) {
+        //no coverage track, the node's k-mers are rolled from its packed sequence
+        std::vector<uint64_t> nkmers;
+        if (count_mode==Canonical) StringKMerFactory(k).create_kmers(ws.sdg.node_sequences,n,nkmers);
+        else if (count_mode==NonCanonical) StringKMerFactoryNC(k).create_kmers(ws.sdg.node_sequences,n,nkmers);
+        kcov.reserve(nkmers.size());
+        for (auto &kmer: nkmers){
+            auto kidx = find_kmer(kmer);
+            kcov.push_back(kidx != -1 ? get_count(count_idx,kidx) : 0);
+        }
+    }
+    else {
+        kcov.reserve(track_offsets[n+1]-track_offsets[n]);
+        for (auto i=track_offsets[n];i<track_offsets[n+1];++i) {
+            auto kidx=track_kidx[i];
+            kcov.push_back(kidx != -1 ? get_count(count_idx,kidx) : 0);
         }
+    }
+    if (node<0) std::reverse(kcov.begin(),kcov.end());
+    return kcov;
+}
 
-    } else {
-        for (auto i=0;i<counts[0].size();++i){
-            if ((not present_in_graph) or counts[0][i]>0)
-                ++s[(cv[i]>maxf ? maxf : cv[i])];
+std::vector<uint64_t> KmerCounter::count_spectra(std::string name, uint32_t maxf, bool unique_in_graph, bool present_in_graph) {
+    std::vector<uint64_t> s(maxf+1);
+    auto cnitr=std::find(count_names.cbegin(),count_names.cend(),name);
+    if (cnitr==count_names.cend()) throw std::runtime_error("Couldn't find a count named: "+name);
+    auto ci=cnitr-count_names.cbegin();
+    for (uint64_t i=0;i<counts[0].size();++i){
+        if (unique_in_graph ? counts[0][i]==1 : ((not present_in_graph) or counts[0][i]>0)) {
+            auto c=get_count(ci,i);
+            ++s[(c>maxf ? maxf : c)];
         }
     }
     return s;
 }
 
-std::vector<uint16_t> KmerCounter::project_count(const std::string &count_name, const std::string &s) {
+std::vector<uint32_t> KmerCounter::project_count(const std::string &count_name, const std::string &s) {
     auto cnitr=std::find(count_names.begin(),count_names.end(),count_name);
     if (cnitr!=count_names.end()){
         return project_count(cnitr-count_names.begin(),s);
@@ -399,7 +678,26 @@ void KmerCounter::read_counts(std::ifstream &count_file) {
     sdglib::read_stringvector(count_file,count_names);
     sdglib::read_flat_vector(count_file,kindex);
     sdglib::read_flat_vectorvector(count_file,counts);
-
+    //files written before wide counts existed end here
+    if (count_file.peek() != EOF) sdglib::read_flat_vectorvector(count_file,wide_counts);
+    else wide_counts.assign(counts.size(), {});
+    //and these before node summaries existed
+    node_summaries.clear();
+    track_offsets.clear();
+    track_kidx.clear();
+    if (count_file.peek() != EOF) {
+        sdglib::read_flat_vectorvector(count_file,node_summaries);
+        sdglib::read_flat_vector(count_file,track_offsets);
+        sdglib::read_flat_vector(count_file,track_kidx);
+    }
+    //and these before incremental updates existed
+    node_hashes.clear();
+    pending_kidx.clear();
+    if (count_file.peek() != EOF) {
+        sdglib::read_flat_vector(count_file,node_hashes);
+        sdglib::read_flat_vectorvector(count_file,pending_kidx);
+    }
+    build_prefix_buckets();
 }
 
 void KmerCounter::write(std::ofstream &output_file) const {
@@ -420,12 +718,28 @@ void KmerCounter::write_counts(std::ofstream &count_file) const {
     sdglib::write_stringvector(count_file,count_names);
     sdglib::write_flat_vector(count_file,kindex);
     sdglib::write_flat_vectorvector(count_file,counts);
+    sdglib::write_flat_vectorvector(count_file,wide_counts);
+    sdglib::write_flat_vectorvector(count_file,node_summaries);
+    sdglib::write_flat_vector(count_file,track_offsets);
+    sdglib::write_flat_vector(count_file,track_kidx);
+    sdglib::write_flat_vector(count_file,node_hashes);
+    sdglib::write_flat_vectorvector(count_file,pending_kidx);
 }
 
 std::vector<std::string> KmerCounter::list_names() {
     return count_names;
 }
 
+uint64_t KmerCounter::memory_bytes() const {
+    //unordered_map nodes hold the pair and a next pointer, plus a bucket pointer each
+    return sdglib::vector_bytes(kindex) + sdglib::vector_bytes(counts) + sdglib::vector_bytes(wide_counts)
+           + sdglib::vector_bytes(prefix_offsets) + sdglib::vector_bytes(node_summaries)
+           + sdglib::vector_bytes(track_offsets) + sdglib::vector_bytes(track_kidx) + sdglib::vector_bytes(node_hashes)
+           + sdglib::vector_bytes(pending_kidx)
+           + kci_cache.size() * (sizeof(std::pair<int64_t, float>) + sizeof(void *))
+           + kci_cache.bucket_count() * sizeof(void *);
+}
+
 const std::vector<uint16_t> &KmerCounter::get_count_by_name(const std::string &name) const {
     for (int i = 0; i < count_names.size(); i++) {
         if (count_names[i] == name) {
@@ -9,6 +9,8 @@
 #include <tuple>
 #include <fstream>
 #include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 enum KmerCountMode{Canonical,NonCanonical};
 
@@ -17,6 +19,21 @@ class PairedReadsDatastore;
 class LinkedReadsDatastore;
 class LongReadsDatastore;
 
+/**
+ * @brief Summary of a node's coverage on a count, over the node's k-mers that are unique in the graph
+ */
+struct NodeCoverageSummary {
+    uint32_t q25=0;             /// first quartile
+    uint32_t median=0;
+    uint32_t q75=0;             /// third quartile
+    uint32_t kmers=0;           /// k-mers in the node
+    uint32_t unique_kmers=0;    /// k-mers in the node that appear only once in the graph
+
+    bool operator==(const NodeCoverageSummary &o) const {
+        return std::tie(q25, median, q75, kmers, unique_kmers) == std::tie(o.q25, o.median, o.q75, o.kmers, o.unique_kmers);
+    }
+};
+
 /**
  * KmerCounters are containers for the coverage of a set of kmers from a graph or workspace,
  * they provide functionality to count and store an index of the kmers present and
@@ -28,6 +45,10 @@ public:
         index_sdg();
     };
     KmerCounter (const WorkSpace &ws, std::ifstream &infile);
+    /**
+     * @brief An empty KmerCounter, to be filled by read()
+     */
+    explicit KmerCounter (const WorkSpace &_ws):ws(_ws),k(0),count_mode(Canonical){};
     KmerCounter (const WorkSpace &_ws, const std::string &filename):ws(_ws) {
         std::ifstream count_file(filename);
         read_counts(count_file);
@@ -50,40 +71,118 @@ public:
     void update_graph_counts();
 
     bool operator==(const KmerCounter &o) const {
-        return (std::tie(k, kindex, count_names, counts) == std::tie(o.k, o.kindex, o.count_names, o.counts));
+        return (std::tie(k, kindex, count_names, counts, wide_counts) == std::tie(o.k, o.kindex, o.count_names, o.counts, o.wide_counts));
     }
 
+    /**
+     * @brief Copies index, counts and node state from o, which should be on the same workspace.
+     * Read counts are kept, use update_index() to bring the copy up to date with graph changes.
+     */
     KmerCounter& operator=(const KmerCounter &o) {
         if ( &o == this) return *this;
 
+        k = o.k;
+        count_mode = o.count_mode;
+        name = o.name;
+        kindex = o.kindex;
         counts = o.counts;
+        wide_counts = o.wide_counts;
         count_names = o.count_names;
-        index_sdg();
+        kci_peak_f = o.kci_peak_f;
+        kci_cache = o.kci_cache;
+        node_summaries = o.node_summaries;
+        track_offsets = o.track_offsets;
+        track_kidx = o.track_kidx;
+        node_hashes = o.node_hashes;
+        pending_kidx = o.pending_kidx;
+        build_prefix_buckets();
+        return *this;
     }
 
+    /**
+     * @brief Brings the index and the graph count up to date with the graph, only looking at nodes that changed.
+     *
+     * The index becomes a union: k-mers of new or changed nodes are merged in, and k-mers of deleted nodes are kept
+     * with a graph count of 0. Read counts are kept, k-mers new to the index get 0 on every read count until
+     * recount_new_kmers() is run for it. Changed nodes are found from a hash of each node's sequence, the first call
+     * on a counter without node state does a full pass and keeps the coverage track, which is needed to remove the
+     * k-mers of changed nodes from the graph count on later calls.
+     *
+     * Node summaries and the KCI cache are dropped, as uniqueness in the graph can change for any node.
+     * @return number of k-mers added to the index
+     */
+    uint64_t update_index();
+
+    /**
+     * @brief k-mers added by update_index() whose count on count_name has not been recounted yet
+     */
+    uint64_t kmers_pending_recount(const std::string & count_name) const;
+
+    /**
+     * @brief Counts only the k-mers added to the index since count_name was created or last recounted, streaming
+     * the datastore count_name was built from. Counts of all other k-mers are not changed.
+     * @param wide if true, recounted k-mers over UINT16_MAX are added to the wide counts (see get_count())
+     */
+    void recount_new_kmers(const std::string & count_name, const PairedReadsDatastore & datastore, bool wide=false);
+
+    void recount_new_kmers(const std::string & count_name, const LinkedReadsDatastore & datastore, bool wide=false);
+
+    void recount_new_kmers(const std::string & count_name, const LongReadsDatastore & datastore, bool wide=false);
+
     /**
      * @brief Accumulates the kmer count from the provided fastq file to the last available read_counts collection
      * @param filename Path to fastq file
+     * @param wide if true, counts saturate at UINT32_MAX rather than UINT16_MAX (see get_count())
      */
-    void add_count(const std::string & count_name,const std::vector<std::string> &filenames, bool fastq=true);
+    void add_count(const std::string & count_name,const std::vector<std::string> &filenames, bool fastq=true, bool wide=false);
 
     /**
      * @brief Accumulates the kmer count from the provided data-store to the last available read_counts collection
      * @param ds PairedReadsDatastore ds
+     * @param wide if true, counts saturate at UINT32_MAX rather than UINT16_MAX (see get_count())
      */
-    void add_count(const std::string & count_name, const PairedReadsDatastore & datastore);
+    void add_count(const std::string & count_name, const PairedReadsDatastore & datastore, bool wide=false);
 
     /**
      * @brief Accumulates the kmer count from the provided data-store to the last available read_counts collection
      * @param ds LinkedReadsDatastore ds
+     * @param wide if true, counts saturate at UINT32_MAX rather than UINT16_MAX (see get_count())
      */
-    void add_count(const std::string & count_name, const LinkedReadsDatastore & datastore);
+    void add_count(const std::string & count_name, const LinkedReadsDatastore & datastore, bool wide=false);
 
     /**
      * @brief Accumulates the kmer count from the provided data-store to the last available read_counts collection
      * @param ds LongReadsDatastore ds
+     * @param wide if true, counts saturate at UINT32_MAX rather than UINT16_MAX (see get_count())
+     */
+    void add_count(const std::string & count_name, const LongReadsDatastore & datastore, bool wide=false);
+
+    /**
+     * @brief Position of kmer in kindex, using the prefix buckets directory
+     * @param kmer Kmer to find
+     * @return Index of the kmer in kindex and the counts, or -1 if it is not in the index
      */
-    void add_count(const std::string & count_name, const LongReadsDatastore & datastore);
+    int64_t find_kmer(uint64_t kmer) const {
+        if (prefix_bases == 0) return -1;
+        uint64_t p = kmer >> (2 * (k - prefix_bases));
+        if (p + 1 >= prefix_offsets.size()) return -1;
+        auto first = kindex.cbegin() + prefix_offsets[p], last = kindex.cbegin() + prefix_offsets[p + 1];
+        auto it = std::lower_bound(first, last, kmer);
+        return (it != last and *it == kmer) ? it - kindex.cbegin() : -1;
+    }
+
+    /**
+     * @brief Full count for a kmer, including the part over UINT16_MAX for counts added as wide
+     * @param count_idx Index of the count to query
+     * @param kmer_idx Index of the kmer in kindex
+     */
+    uint32_t get_count(uint16_t count_idx, uint64_t kmer_idx) const {
+        auto c = counts[count_idx][kmer_idx];
+        if (c < UINT16_MAX or wide_counts[count_idx].empty()) return c;
+        auto &w = wide_counts[count_idx];
+        auto it = std::lower_bound(w.cbegin(), w.cend(), std::make_pair(kmer_idx, (uint32_t) 0));
+        return (it != w.cend() and it->first == kmer_idx) ? it->second : c;
+    }
 
     /**TODO
      * @brief Accumulates the kmer count from the DG's nodes, allowing to filter by size and connection status
@@ -95,17 +194,17 @@ public:
      * @brief Retrieves the counts for each kmer in sequence s from count_name
      * @param count_name Name of the count to query
      * @param s Sequence to project
-     * @return Vector of kmer counts for each kmer in s
+     * @return Vector of kmer counts for each kmer in s, including wide counts (see get_count())
      */
-    std::vector<uint16_t> project_count(const std::string & count_name, const std::string &s);
+    std::vector<uint32_t> project_count(const std::string & count_name, const std::string &s);
 
     /**
      * @brief Retrieves the counts for each kmer in sequence s from counts[count_idx]
      * @param count_idx Index of the count to query
      * @param s Sequence to project
-     * @return Vector of kmer counts for each kmer in s
+     * @return Vector of kmer counts for each kmer in s, including wide counts (see get_count())
      */
-    std::vector<uint16_t> project_count(const uint16_t count_idx, const std::string &s);
+    std::vector<uint32_t> project_count(const uint16_t count_idx, const std::string &s);
 
     float get_kci_peak() { return kci_peak_f;}
 
@@ -117,11 +216,45 @@ public:
 
     }
 
+    /**
+     * @brief KCI of a node: the median of counts[1] over its graph-unique k-mers, divided by the KCI peak.
+     * -1 for nodes with 10 or fewer graph-unique k-mers. Read from the node summaries if they have been computed.
+     */
     float kci(int64_t node);
 
+    /**
+     * @brief Computes the node summaries, which makes KCIs available for all nodes
+     */
     void compute_all_kcis();
 
-    std::vector<uint64_t> count_spectra(std::string name, uint16_t maxf=1000, bool unique_in_graph=false, bool present_in_graph=true);
+    /**
+     * @brief Computes the coverage summary of every node on every count, in a single parallel pass over the graph.
+     *
+     * The summaries are written with the counts, and are not updated when the graph or the counts change: they are
+     * dropped by update_graph_counts() and update_index(), and have to be recomputed after graph changes or new counts.
+     * @param coverage_track also (re)build the index of every k-mer of each node, so project_node_count() needs no
+     * lookups. If false, a track kept from an earlier call or update_index() is left as it is
+     */
+    void compute_node_summaries(bool coverage_track=false);
+
+    bool has_node_summaries() const { return not node_summaries.empty(); }
+
+    bool has_coverage_track() const { return not track_offsets.empty(); }
+
+    /**
+     * @brief Coverage summary of node on counts[count_idx], compute_node_summaries() must have been called
+     */
+    const NodeCoverageSummary & node_summary(uint16_t count_idx, int64_t node) const;
+
+    /**
+     * @brief Retrieves the counts for each kmer of a node (negative IDs for its reverse complement) from count_name,
+     * as project_count() on the node's sequence, using the coverage track if it has been computed
+     */
+    std::vector<uint32_t> project_node_count(const std::string & count_name, int64_t node);
+
+    std::vector<uint32_t> project_node_count(uint16_t count_idx, int64_t node);
+
+    std::vector<uint64_t> count_spectra(std::string name, uint32_t maxf=1000, bool unique_in_graph=false, bool present_in_graph=true);
 
     void write(std::ofstream & output_file) const;
     void write(std::fstream & output_file) const;
@@ -142,17 +275,35 @@ public:
     const std::vector<uint16_t> & get_count_by_name(const std::string &name) const;
     std::vector<std::string> list_names ();
 
+    /**
+     * @brief Approximate heap bytes used by the index, counts and per-node caches
+     */
+    uint64_t memory_bytes() const;
+
     std::vector<uint64_t> kindex;               /// Ordered list of kmers that contain counts
     std::vector<std::string> count_names;       /// Names of the counts vectors
     std::vector<std::vector<uint16_t>> counts;  /// Count vector, contains an entry per kmer in the kindex
+    std::vector<std::vector<std::pair<uint64_t,uint32_t>>> wide_counts; /// Per count, sorted (kmer index, count) for kmers saturating counts in wide counts
     
     std::string name;   /// Name of the KmerCounter
 
 private:
+    void build_prefix_buckets();
+
+    template<class T>
+    friend void recount_kmers_from_kds(KmerCounter & kds, const std::string & count_name, const T & datastore, bool wide);
+
     const WorkSpace &ws;
     int8_t k;
     KmerCountMode count_mode;
     float kci_peak_f=-1;
     std::unordered_map<int64_t, float> kci_cache;
+    std::vector<uint64_t> prefix_offsets; //prefix_offsets[p] is the first k-mer in kindex with prefix p
+    uint8_t prefix_bases=0;
+    std::vector<std::vector<NodeCoverageSummary>> node_summaries; //per count, per node
+    std::vector<uint64_t> track_offsets;  //the k-mers of node n are track_kidx[track_offsets[n]...track_offsets[n+1]-1]
+    std::vector<int64_t> track_kidx;      //k-mer indexes in kindex, -1 if not in the index
+    std::vector<uint64_t> node_hashes;    //hash of each node's sequence when the track was last built, for update_index()
+    std::vector<std::vector<uint64_t>> pending_kidx; //per count, sorted indexes of k-mers added to the index but not counted
 };
 
@@ -6,6 +6,9 @@
 #include <sdglib/utilities/OutputLog.hpp>
 #include <sdglib/mappers/LinkedReadsMapper.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
+#include <sdglib/readers/FileReader.hpp>
+#include <sdglib/utilities/io_helpers.hpp>
+#include <sdglib/utilities/omp_safe.hpp>
 #include <fstream>
 #include <strings.h>
 #include <cstring>
@@ -13,6 +16,29 @@
 
 const sdgVersion_t LinkedReadsDatastore::min_compat = 0x0003;
 
+namespace {
+    //canonical k-mers of a read, for the tag k-mer sets
+    class TagKmerFactory : public  KMerFactory {
+    public:
+        explicit TagKmerFactory(uint8_t k) : KMerFactory(k){}
+        inline void produce_all_kmers(const char * seq, std::vector<uint64_t> &mers){
+            roll_kmers(seq, strcspn(seq, "\n"), [&](uint64_t fw, uint64_t rc) {
+                mers.emplace_back(rc <= fw ? rc : fw);
+            });
+        }
+    };
+
+    //keeps, in place, one of each k-mer with at least min_count occurrences in the sorted kmers
+    void filter_sorted_kmers(std::vector<uint64_t> &kmers, int min_count) {
+        auto wi=kmers.begin();
+        for (auto ri=kmers.begin(),nri=kmers.begin();ri<kmers.end();ri=nri){
+            while (nri<kmers.end() and *nri==*ri) ++nri;
+            if (nri-ri>=min_count) *(wi++)=*ri;
+        }
+        kmers.resize(wi-kmers.begin());
+    }
+}
+
 std::string LinkedTag_to_seq(LinkedTag tag, uint8_t k) {
     std::string seq;
     seq.reserve(k);
@@ -56,174 +82,83 @@ void LinkedReadsDatastore::build_from_fastq(std::string output_filename, std::st
     //std::cout<<"Memory used by every read's entry:"<< sizeof(LinkedRead)<<std::endl;
     //read each read, put it on the index and on the appropriate tag
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Creating Datastore Index from "<<read1_filename<<" | "<<read2_filename<<std::endl;
-    auto fd1=gzopen(read1_filename.c_str(),"r");
-    if (!fd1) {
-        std::cerr << "Failed to open " << read1_filename <<": " << strerror(errno);
-        throw std::runtime_error("Could not open " + read1_filename);
-    }
-    auto fd2=gzopen(read2_filename.c_str(),"r");
-
-    if (!fd2) {
-        std::cerr << "Failed to open " << read2_filename <<": " << strerror(errno);
-        throw std::runtime_error("Could not open " + read2_filename);
-    }
-    char readbuffer[1000];
-    uint64_t r1offset,r2offset;
     uint64_t tagged_reads=0;
     //first, build an index of tags and offsets
     sdglib::OutputLog()<<"Building tag sorted chunks of "<<chunksize<<" pairs"<<std::endl;
     std::vector<LinkedReadData> readdatav;
     readdatav.reserve(chunksize);
     std::vector<std::ifstream> chunkfiles;
-    std::vector<LinkedReadData> next_in_chunk;
-    LinkedReadData currrent_read;
-    //First, create the chunk files
-    uint64_t pairs=0;
-    while (!gzeof(fd1) and !gzeof(fd2)) {
-        LinkedTag newtag = 0;
-        if (format==LinkedReadsFormat::UCDavis) {
-            //LinkedRead r1,r2;
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '@') {
-                throw std::runtime_error("Please check: " + read1_filename + ", it seems to be missing a header");
-            }
-            //Tag to number from r1's name
-            for (auto i = 1; i < 17; ++i) {
-                newtag <<= 2;
-                if (readbuffer[i] == 'C') newtag += 1;
-                else if (readbuffer[i] == 'G') newtag += 2;
-                else if (readbuffer[i] == 'T') newtag += 3;
-                else if (readbuffer[i] != 'A') {
-                    newtag = 0;
-                    break;
-                }
-            }
-            currrent_read.tag=newtag;
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            currrent_read.seq1=std::string(readbuffer);
-            if (currrent_read.seq1.back()=='\n') currrent_read.seq1.resize(currrent_read.seq1.size()-1);
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '+') {
-                throw std::runtime_error("Please check: " + read1_filename + ", it seems to be desynchronised a header");
-            }
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '@') {
-                throw std::runtime_error("Please check: " + read2_filename + ", it seems to be missing a header");
-            }
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            currrent_read.seq2=std::string(readbuffer);
-            if (currrent_read.seq2.back()=='\n') currrent_read.seq2.resize(currrent_read.seq2.size()-1);
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '+') {
-                throw std::runtime_error("Please check: " + read2_filename + ", it seems to be desynchronised a header");
-            }
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-        }
-        else if (format==LinkedReadsFormat::raw){
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '@') {
-                throw std::runtime_error("Please check: " + read1_filename + ", it seems to be missing a header");
-            }
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            for (auto i = 0; i < 16; ++i) {
-                newtag <<= 2;
-                if (readbuffer[i] == 'C') newtag += 1;
-                else if (readbuffer[i] == 'G') newtag += 2;
-                else if (readbuffer[i] == 'T') newtag += 3;
-                else if (readbuffer[i] != 'A') {
-                    newtag = 0;
-                    break;
-                }
-            }
-            currrent_read.tag=newtag;
-            currrent_read.seq1=std::string(readbuffer + 16 + 7);
-            if (currrent_read.seq1.back()=='\n') currrent_read.seq1.resize(currrent_read.seq1.size()-1);
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '+') {
-                throw std::runtime_error("Please check: " + read1_filename + ", it seems to be desynchronised a header");
-            }
-            if (NULL == gzgets(fd1, readbuffer, 999)) continue;
-
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '@') {
-                throw std::runtime_error("Please check: " + read2_filename + ", it seems to be missing a header");
-            }
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            currrent_read.seq2=std::string(readbuffer);
-            if (currrent_read.seq2.back()=='\n') currrent_read.seq2.resize(currrent_read.seq2.size()-1);
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-            if(!readbuffer[0] == '+') {
-                throw std::runtime_error("Please check: " + read2_filename + ", it seems to be desynchronised a header");
-            }
-            if (NULL == gzgets(fd2, readbuffer, 999)) continue;
-        }
-        if (0 != newtag) tagged_reads += 2;
-        ++pairs;
-        readdatav.push_back(currrent_read);
-        if (readdatav.size()==chunksize){
-            //sort
-            std::sort(readdatav.begin(),readdatav.end());
-            //dump
-            std::ofstream ofile("sorted_chunk_"+std::to_string(chunkfiles.size())+".data");
-            sdglib::OutputLog()<<readdatav.size()<<" pairs dumping on chunk "<<chunkfiles.size()<<std::endl;
-            if (!ofile) {
-                std::cerr << "Failed to open " << ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data") <<": " << strerror(errno);
-                throw std::runtime_error("Could not open " + ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data") );
-
-            }
-
-            sdglib::OutputLog()<<readdatav.size()<<" pairs dumping on chunk "<<chunkfiles.size()<<std::endl;
-            //add file to vector of files
-            char buffer[2*readsize+2];
-            for (auto &r:readdatav){
-                ofile.write((const char * ) &r.tag,sizeof(r.tag));
-                bzero(buffer,2*readsize+2);
-                memcpy(buffer,r.seq1.data(),(r.seq1.size()>readsize ? readsize : r.seq1.size()));
-                memcpy(buffer+readsize+1,r.seq2.data(),(r.seq2.size()>readsize ? readsize : r.seq2.size()));
-                ofile.write(buffer,2*readsize+2);
-            }
-            ofile.close();
-            chunkfiles.emplace_back("sorted_chunk_"+std::to_string(chunkfiles.size())+".data");
-            if (!chunkfiles.back()) {
-                std::cerr << "Failed to open " << ("sorted_chunk_"+std::to_string(chunkfiles.size())+".data") <<": " << strerror(errno);
-                throw std::runtime_error("Could not open " + ("sorted_chunk_"+std::to_string(chunkfiles.size())+".data") );
-            }
-            readdatav.clear();
-            sdglib::OutputLog()<<"dumped!"<<std::endl;
-        }
-    }
-    if (readdatav.size()>0) {
+    auto dump_chunk=[&](){
         //sort
-        std::sort(readdatav.begin(), readdatav.end());
+        std::sort(readdatav.begin(),readdatav.end());
         //dump
-        std::ofstream ofile("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data");
-        sdglib::OutputLog() << readdatav.size() << " pairs dumping on chunk " << chunkfiles.size() << std::endl;
+        std::string chunk_filename("sorted_chunk_"+std::to_string(chunkfiles.size())+".data");
+        std::ofstream ofile(chunk_filename);
         if (!ofile) {
-            std::cerr << "Failed to open " << ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data") <<": " << strerror(errno);
-            throw std::runtime_error("Could not open " + ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data") );
-
+            std::cerr << "Failed to open " << chunk_filename <<": " << strerror(errno);
+            throw std::runtime_error("Could not open " + chunk_filename);
         }
-        sdglib::OutputLog() << readdatav.size() << " pairs dumping on chunk " << chunkfiles.size() << std::endl;
+        sdglib::OutputLog()<<readdatav.size()<<" pairs dumping on chunk "<<chunkfiles.size()<<std::endl;
         //add file to vector of files
-        char buffer[2 * readsize + 2];
-        for (auto &r:readdatav) {
-            ofile.write((const char *) &r.tag, sizeof(r.tag));
-            bzero(buffer, 2 * readsize + 2);
-            memcpy(buffer, r.seq1.data(), (r.seq1.size() > readsize ? readsize : r.seq1.size()));
-            memcpy(buffer + readsize + 1, r.seq2.data(), (r.seq2.size() > readsize ? readsize : r.seq2.size()));
-            ofile.write(buffer, 2 * readsize + 2);
+        std::vector<char> buffer(2*readsize+2);
+        for (auto &r:readdatav){
+            ofile.write((const char * ) &r.tag,sizeof(r.tag));
+            std::fill(buffer.begin(),buffer.end(),0);
+            memcpy(buffer.data(),r.seq1.data(),(r.seq1.size()>readsize ? readsize : r.seq1.size()));
+            memcpy(buffer.data()+readsize+1,r.seq2.data(),(r.seq2.size()>readsize ? readsize : r.seq2.size()));
+            ofile.write(buffer.data(),2*readsize+2);
         }
         ofile.close();
-        chunkfiles.emplace_back("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data");
+        chunkfiles.emplace_back(chunk_filename);
         if (!chunkfiles.back()) {
-            std::cerr << "Failed to open " << ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data") <<": " << strerror(errno);
-            throw std::runtime_error("Could not open " + ("sorted_chunk_" + std::to_string(chunkfiles.size()) + ".data"));
+            std::cerr << "Failed to open " << chunk_filename <<": " << strerror(errno);
+            throw std::runtime_error("Could not open " + chunk_filename);
         }
         readdatav.clear();
-        sdglib::OutputLog() << "dumped!" << std::endl;
-    }
+        sdglib::OutputLog()<<"dumped!"<<std::endl;
+    };
+    //tags are the first 16bp, an invalid tag is 0
+    auto tag_from=[](const std::string &s, uint64_t start){
+        LinkedTag tag=0;
+        if (s.size()<start+16) return tag;
+        for (auto i = start; i < start+16; ++i) {
+            tag <<= 2;
+            if (s[i] == 'C') tag += 1;
+            else if (s[i] == 'G') tag += 2;
+            else if (s[i] == 'T') tag += 3;
+            else if (s[i] != 'A') return (LinkedTag) 0;
+        }
+        return tag;
+    };
+    //blocks of pairs are decompressed on one thread and parsed in parallel, then added to the chunks in order
+    uint64_t pairs=0;
+    FastxPipeline pipeline({read1_filename, read2_filename});
+    pipeline.run<std::vector<LinkedReadData>>([&](const FastxBlock &fb, std::vector<LinkedReadData> &block){
+        block.resize(fb.records);
+        std::string name;
+        uint64_t pos1=0,pos2=0;
+        for (auto &r:block) {
+            fb.next_record(0,pos1,&name,r.seq1);
+            fb.next_record(1,pos2,nullptr,r.seq2);
+            if (format==LinkedReadsFormat::UCDavis) {
+                //Tag to number from r1's name
+                r.tag=tag_from(name,0);
+            }
+            else if (format==LinkedReadsFormat::raw){
+                //Tag and 7bp spacer at the start of r1
+                r.tag=tag_from(r.seq1,0);
+                r.seq1=(r.seq1.size()>16+7 ? r.seq1.substr(16+7) : std::string());
+            }
+        }
+    },[&](const FastxBlock &fb, std::vector<LinkedReadData> &block){
+        for (auto &r:block) {
+            if (0 != r.tag) tagged_reads += 2;
+            ++pairs;
+            readdatav.emplace_back(std::move(r));
+            if (readdatav.size()==chunksize) dump_chunk();
+        }
+    });
+    if (readdatav.size()>0) dump_chunk();
     sdglib::OutputLog() << "performing merge from disk" << std::endl;
     //TODO: save space first for the tag index!!!
     std::ofstream output(output_filename.c_str());
@@ -240,9 +175,13 @@ void LinkedReadsDatastore::build_from_fastq(std::string output_filename, std::st
     sdglib::write_string(output, default_name);
 
     output.write((const char *) &readsize,sizeof(readsize));
+    auto tag_index_offset_pos=output.tellp();
+    uint64_t tag_index_offset=0;
+    output.write((const char *) &tag_index_offset,sizeof(tag_index_offset));
     read_tag.resize(pairs);
     sdglib::OutputLog() << "leaving space for " <<pairs<<" read_tag entries"<< std::endl;
 
+    auto read_tag_pos=output.tellp();
     sdglib::write_flat_vector(output,read_tag);
 
     //multi_way merge of the chunks
@@ -285,11 +224,18 @@ void LinkedReadsDatastore::build_from_fastq(std::string output_filename, std::st
     std::vector<std::vector<ReadMapping>> reads_in_node;
     sdglib::write_flat_vectorvector(output, reads_in_node);
 
+    //tag index at the end, its position goes in the header
+    LinkedTagIndex tag_index;
+    tag_index.build(read_tag);
+    tag_index_offset=output.tellp();
+    tag_index.write(output);
     // Done
 
     //go back to the beginning of the file and write the read_tag part again
-    output.seekp(sizeof(SDG_MAGIC)+sizeof(SDG_VN)+sizeof(type)+sizeof(readsize)+sizeof(uint64_t)+(default_name.size()*sizeof(char)));
-    sdglib::OutputLog() << "writing down " <<pairs<<" read_tag entries"<< std::endl;
+    output.seekp(tag_index_offset_pos);
+    output.write((const char *) &tag_index_offset,sizeof(tag_index_offset));
+    output.seekp(read_tag_pos);
+    sdglib::OutputLog() << "writing down " <<pairs<<" read_tag entries and "<<tag_index.tag_count()<<" tags in the tag index"<< std::endl;
     sdglib::write_flat_vector(output, read_tag);
 
     output.close();
@@ -298,8 +244,6 @@ void LinkedReadsDatastore::build_from_fastq(std::string output_filename, std::st
     for (auto i=0;i<chunkfiles.size();++i) ::unlink(("sorted_chunk_"+std::to_string(i)+".data").c_str());
     //DONE!
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Datastore with "<<(read_tag.size())*2<<" reads, "<<tagged_reads<<" reads with tags"<<std::endl; //and "<<reads_in_tag.size()<<"tags"<<std::endl;
-    gzclose(fd1);
-    gzclose(fd2);
 }
 
 void LinkedReadsDatastore::read(std::ifstream &input_file) {
@@ -307,14 +251,17 @@ void LinkedReadsDatastore::read(std::ifstream &input_file) {
     sdglib::read_string(input_file, filename);
     sdglib::read_string(input_file, name);
 
+    //the name in the workspace may differ from the datastore's default name
+    auto ws_name=name;
     load_index(filename);
+    name=ws_name;
     mapper.read(input_file);
 }
 
 void LinkedReadsDatastore::load_index(std::string _filename){
     uint64_t s;
     filename=_filename;
-    fd=fopen(filename.c_str(),"r");
+    auto fd=fopen(filename.c_str(),"r");
     if (!fd) {
         std::cerr << "Failed to open " << filename <<": " << strerror(errno);
         throw std::runtime_error("Could not open " + filename);
@@ -344,9 +291,21 @@ void LinkedReadsDatastore::load_index(std::string _filename){
     fread( (char *) name.data(), sizeof(char), sname, fd);
 
     fread( &readsize,sizeof(readsize),1,fd);
+    uint64_t tag_index_offset=0;
+    if (version>=0x0007) fread(&tag_index_offset,sizeof(tag_index_offset),1,fd);
     fread(&s,sizeof(s),1,fd); read_tag.resize(s);
     fread(read_tag.data(),sizeof(read_tag[0]),read_tag.size(),fd);
     readpos_offset=ftell(fd);
+    fclose(fd);
+    mapped_file.open(filename);
+    if (tag_index_offset!=0) {
+        std::ifstream index_file(filename, std::ios_base::binary);
+        index_file.seekg(tag_index_offset);
+        tag_index.read(index_file);
+        if (!index_file or tag_index.first_pair.empty() or tag_index.first_pair.back()!=read_tag.size())
+            throw std::runtime_error("Tag index in " + filename + " doesn't match its reads");
+    }
+    else tag_index.build(read_tag); //files from before the tag index
     sdglib::OutputLog()<<"LinkedReadsDatastore open: "<<_filename<<"  max read length: "<<readsize<<" Total reads: " <<size()<<std::endl;
 }
 
@@ -365,7 +324,11 @@ void LinkedReadsDatastore::write_selection(std::ofstream &output_file, const std
     SDG_FILETYPE type(LinkedDS_FT);
     output_file.write((char *) &type, sizeof(type));
 
+    sdglib::write_string(output_file, name);
     output_file.write((char *) &readsize, sizeof(readsize));
+    auto tag_index_offset_pos=output_file.tellp();
+    uint64_t tag_index_offset=0;
+    output_file.write((const char *) &tag_index_offset,sizeof(tag_index_offset));
     //create a vector of read tags (including each tag as many times as reads it contains).
     //std::cout << "creating vector of tags" << std::endl;
     std::vector<LinkedTag> readtags;
@@ -383,33 +346,79 @@ void LinkedReadsDatastore::write_selection(std::ofstream &output_file, const std
     //now for each read in each included tag, just copy the readsize+1 sequence into the file.
     uint64_t totaldata = 0;
     for (auto t:tagSet) {
-        for (auto n = std::lower_bound(read_tag.begin(), read_tag.end(), t) - read_tag.begin(); read_tag[n] == t; ++n) {
-            auto s = get_read_sequence(n * 2 + 1);
-            output_file.write(s.c_str(), readsize + 1);
-            s = get_read_sequence(n * 2 + 2);
-            output_file.write(s.c_str(), readsize + 1);
-            totaldata += 2 * readsize + 2;
+        if (t==0) continue; //not in readtags
+        for (auto rid:get_tag_read_range(t)) {
+            output_file.write(read_sequence_ptr(rid), readsize + 1);
+            totaldata += readsize + 1;
         }
     }
+    LinkedTagIndex selection_index;
+    selection_index.build(readtags);
+    tag_index_offset=output_file.tellp();
+    selection_index.write(output_file);
+    output_file.seekp(tag_index_offset_pos);
+    output_file.write((const char *) &tag_index_offset,sizeof(tag_index_offset));
+    output_file.seekp(0,std::ios_base::end);
 }
 
-std::string LinkedReadsDatastore::get_read_sequence(size_t readID) {
+std::string LinkedReadsDatastore::get_read_sequence(size_t readID) const {
     if (readID==0 or readID>size()) return "";
-    char buffer[readsize+1];
-    size_t read_offset_in_file=readpos_offset+(readsize+1)*(readID-1);
-    fseek(fd,read_offset_in_file,SEEK_SET);
-    fread(buffer,readsize+1,1,fd);
-    return std::string(buffer);
+    auto view=get_read_view(readID);
+    return std::string(view.seq,view.size);
 }
 
 std::vector<uint64_t> LinkedReadsDatastore::get_tag_reads(LinkedTag tag) const {
-    std::vector<uint64_t> rids;
-    rids.reserve(10000);
-    for (auto n=std::lower_bound(read_tag.begin(),read_tag.end(),tag)-read_tag.begin();read_tag[n]==tag;++n) {
-        rids.emplace_back( n * 2 + 1);
-        rids.emplace_back( n * 2 + 2);
+    auto range=get_tag_read_range(tag);
+    return std::vector<uint64_t>(range.begin(),range.end());
+}
+
+ReadIdRange LinkedReadsDatastore::get_tag_read_range(LinkedTag tag) const {
+    auto pairs=tag_index.pair_range(tag);
+    return ReadIdRange(pairs.first*2+1,pairs.second*2+1);
+}
+
+void LinkedTagIndex::build(const std::vector<LinkedTag> &read_tag) {
+    tags.clear();
+    first_pair.clear();
+    for (uint64_t i=0;i<read_tag.size();++i) {
+        if (i>0 and read_tag[i]<read_tag[i-1]) throw std::runtime_error("LinkedTagIndex needs pairs sorted by tag");
+        if (i==0 or read_tag[i]!=read_tag[i-1]) {
+            tags.emplace_back(read_tag[i]);
+            first_pair.emplace_back(i);
+        }
     }
-    return rids;
+    first_pair.emplace_back(read_tag.size());
+    bucket_bits=1;
+    while (bucket_bits<24 and (1ULL<<bucket_bits)<tags.size()) ++bucket_bits;
+    buckets.assign((1ULL<<bucket_bits)+1,0);
+    for (auto t:tags) ++buckets[(t>>(32-bucket_bits))+1];
+    for (uint64_t b=1;b<buckets.size();++b) buckets[b]+=buckets[b-1];
+}
+
+std::pair<uint64_t,uint64_t> LinkedTagIndex::pair_range(LinkedTag tag) const {
+    if (tags.empty()) return {0,0};
+    auto b=tag>>(32-bucket_bits);
+    auto first=tags.begin()+buckets[b],last=tags.begin()+buckets[b+1];
+    auto it=std::lower_bound(first,last,tag);
+    if (it==last or *it!=tag) return {0,0};
+    auto i=it-tags.begin();
+    return {first_pair[i],first_pair[i+1]};
+}
+
+void LinkedTagIndex::write(std::ofstream &output_file) const {
+    output_file.write((const char *) &bucket_bits,sizeof(bucket_bits));
+    sdglib::write_flat_vector(output_file,tags);
+    sdglib::write_flat_vector(output_file,first_pair);
+    sdglib::write_flat_vector(output_file,buckets);
+}
+
+void LinkedTagIndex::read(std::ifstream &input_file) {
+    input_file.read((char *) &bucket_bits,sizeof(bucket_bits));
+    sdglib::read_flat_vector(input_file,tags);
+    sdglib::read_flat_vector(input_file,first_pair);
+    sdglib::read_flat_vector(input_file,buckets);
+    if (bucket_bits<1 or bucket_bits>32 or buckets.size()!=(1ULL<<bucket_bits)+1 or first_pair.size()!=tags.size()+1)
+        throw std::runtime_error("Corrupted tag index");
 }
 
 LinkedTag LinkedReadsDatastore::get_read_tag(size_t readID) {
@@ -445,55 +454,68 @@ void LinkedReadsDatastore::dump_tag_occupancy_histogram(std::string filename) {
 }
 
 std::unordered_set<uint64_t> LinkedReadsDatastore::get_tags_kmers(int k, int min_tag_cov, std::set<LinkedTag> tags, ReadSequenceBuffer & blrsg) {
-    class StreamKmerFactory : public  KMerFactory {
-    public:
-        explicit StreamKmerFactory(uint8_t k) : KMerFactory(k){}
-        inline void produce_all_kmers(const char * seq, std::vector<uint64_t> &mers){
-            // TODO: Adjust for when K is larger than what fits in uint64_t!
-            last_unknown=0;
-            fkmer=0;
-            rkmer=0;
-            auto s=seq;
-            while (*s!='\0' and *s!='\n') {
-                //fkmer: grows from the right (LSB)
-                //rkmer: grows from the left (MSB)
-                fillKBuf(*s, fkmer, rkmer, last_unknown);
-                if (last_unknown >= K) {
-                    if (fkmer <= rkmer) {
-                        // Is fwd
-                        mers.emplace_back(fkmer);
-                    } else {
-                        // Is bwd
-                        mers.emplace_back(rkmer);
-                    }
-                }
-                ++s;
-            }
-        }
-    };
-    StreamKmerFactory skf(k);
+    TagKmerFactory skf(k);
 
     //reserve space by counting reads first, save only the integer, do not merge just count and insert in the set
     std::vector<uint64_t> all_kmers;
-    std::vector<uint64_t> read_ids;
+    uint64_t read_count=0;
+    for (auto t:tags) read_count+=get_tag_read_range(t).size();
+    all_kmers.reserve(read_count*(readsize-k+1));
     for (auto t:tags) {
-        auto reads=get_tag_reads(t);
-        read_ids.insert(read_ids.end(),reads.begin(),reads.end());
-    }
-    all_kmers.reserve(read_ids.size()*(readsize-k+1));
-    for (auto rid:read_ids){
-            skf.produce_all_kmers(blrsg.get_read_sequence(rid),all_kmers);
+        for (auto rid:get_tag_read_range(t)) skf.produce_all_kmers(blrsg.get_read_sequence(rid),all_kmers);
     }
     std::sort(all_kmers.begin(),all_kmers.end());
-    std::unordered_set<uint64_t> kset;
-    auto ri=all_kmers.begin();
-    auto nri=all_kmers.begin();
-    while (ri<all_kmers.end()){
-        while (nri<all_kmers.end() and *nri==*ri) ++nri;
-        if (nri-ri>=min_tag_cov) kset.insert(*ri);
-        ri=nri;
+    filter_sorted_kmers(all_kmers,min_tag_cov);
+    return std::unordered_set<uint64_t>(all_kmers.begin(),all_kmers.end());
+}
+
+std::vector<std::unordered_set<uint64_t>> LinkedReadsDatastore::get_tag_sets_kmers(int k, int min_tag_cov,
+                                                                                   const std::vector<std::set<LinkedTag>> &tag_sets,
+                                                                                   uint64_t max_batch_reads) const {
+    std::vector<std::unordered_set<uint64_t>> kmer_sets(tag_sets.size());
+    TagKmerFactory skf(k);
+    std::vector<LinkedTag> tags;
+    std::vector<uint64_t> tag_kmers_offset;
+    std::vector<uint64_t> tag_kmers;
+    for (uint64_t first_set=0;first_set<tag_sets.size();) {
+        //consecutive sets until their tags have max_batch_reads reads, at least one set per batch
+        std::set<LinkedTag> batch_tags;
+        uint64_t batch_reads=0, last_set=first_set;
+        for (;last_set<tag_sets.size();++last_set) {
+            uint64_t set_reads=0;
+            for (auto t:tag_sets[last_set]) if (batch_tags.count(t)==0) set_reads+=get_tag_read_range(t).size();
+            if (last_set>first_set and batch_reads+set_reads>max_batch_reads) break;
+            batch_tags.insert(tag_sets[last_set].begin(),tag_sets[last_set].end());
+            batch_reads+=set_reads;
+        }
+
+        //every tag of the batch once, in order, which is the order of the reads in the file
+        tags.assign(batch_tags.begin(),batch_tags.end());
+        tag_kmers_offset.assign(tags.size()+1,0);
+        tag_kmers.clear();
+        for (uint64_t i=0;i<tags.size();++i) {
+            for (auto rid:get_tag_read_range(tags[i])) skf.produce_all_kmers(read_sequence_ptr(rid),tag_kmers);
+            tag_kmers_offset[i+1]=tag_kmers.size();
+        }
+
+#pragma omp parallel
+        {
+            std::vector<uint64_t> set_kmers;
+#pragma omp for schedule(dynamic,1)
+            for (uint64_t si=first_set;si<last_set;++si) {
+                set_kmers.clear();
+                for (auto t:tag_sets[si]) {
+                    auto i=std::lower_bound(tags.begin(),tags.end(),t)-tags.begin();
+                    set_kmers.insert(set_kmers.end(),tag_kmers.begin()+tag_kmers_offset[i],tag_kmers.begin()+tag_kmers_offset[i+1]);
+                }
+                std::sort(set_kmers.begin(),set_kmers.end());
+                filter_sorted_kmers(set_kmers,min_tag_cov);
+                kmer_sets[si].insert(set_kmers.begin(),set_kmers.end());
+            }
+        }
+        first_set=last_set;
     }
-    return std::move(kset);
+    return kmer_sets;
 }
 
 std::unordered_set<__uint128_t, int128_hash> LinkedReadsDatastore::get_tags_kmers128(int k, int min_tag_cov, std::set<LinkedTag> tags, ReadSequenceBuffer & blrsg, bool count_tag_cvg) {
@@ -501,51 +523,27 @@ std::unordered_set<__uint128_t, int128_hash> LinkedReadsDatastore::get_tags_kmer
     public:
         explicit StreamKmerFactory128(uint8_t k) : KMerFactory128(k){}
         inline void produce_all_kmers(const char * seq, std::vector<__uint128_t> &mers){
-            // TODO: Adjust for when K is larger than what fits in __uint128_t!
-            last_unknown=0;
-            fkmer=0;
-            rkmer=0;
-            auto s=seq;
-            while (*s!='\0' and *s!='\n') {
-                //fkmer: grows from the right (LSB)
-                //rkmer: grows from the left (MSB)
-                fillKBuf(*s, fkmer, rkmer, last_unknown);
-                if (last_unknown >= K) {
-                    if (fkmer <= rkmer) {
-                        // Is fwd
-                        mers.emplace_back(fkmer);
-                    } else {
-                        // Is bwd
-                        mers.emplace_back(rkmer);
-                    }
-                }
-                ++s;
-            }
+            roll_kmers(seq, strcspn(seq, "\n"), [&](__uint128_t fw, __uint128_t rc) {
+                mers.emplace_back(rc <= fw ? rc : fw);
+            });
         }
     };
     StreamKmerFactory128 skf(k);
 
     //reserve space by counting reads first, save only the integer, do not merge just count and insert in the set
     std::vector<__uint128_t> all_kmers;
-    std::vector<__uint128_t> read_ids;
+    uint64_t read_count=0;
+    for (auto t:tags) read_count+=get_tag_read_range(t).size();
+    all_kmers.reserve(read_count*(readsize-k+1));
     for (auto t:tags) {
-        auto reads=get_tag_reads(t);
-        read_ids.insert(read_ids.end(),reads.begin(),reads.end());
-    }
-    all_kmers.reserve(read_ids.size()*(readsize-k+1));
-    if (count_tag_cvg) {
-        for (auto t:tags) {
-            auto tag_first_idx=all_kmers.size();
-            for (auto rid:get_tag_reads(t)) {
-                skf.produce_all_kmers(blrsg.get_read_sequence(rid), all_kmers);
-            }
+        auto tag_first_idx=all_kmers.size();
+        for (auto rid:get_tag_read_range(t)) {
+            skf.produce_all_kmers(blrsg.get_read_sequence(rid), all_kmers);
+        }
+        if (count_tag_cvg) {
             std::sort(all_kmers.begin()+tag_first_idx,all_kmers.end());
             all_kmers.erase(std::unique(all_kmers.begin()+tag_first_idx,all_kmers.end()),all_kmers.end());
         }
-    } else {
-        for (auto rid:read_ids) {
-            skf.produce_all_kmers(blrsg.get_read_sequence(rid), all_kmers);
-        }
     }
     std::sort(all_kmers.begin(),all_kmers.end());
     std::unordered_set<__uint128_t, int128_hash> kset;
@@ -572,39 +570,6 @@ LinkedReadsDatastore::LinkedReadsDatastore(WorkSpace &ws, std::string read1_file
 LinkedReadsDatastore::LinkedReadsDatastore(WorkSpace &ws) : ws(ws), mapper(ws, *this) {
 }
 
-LinkedReadsDatastore::LinkedReadsDatastore(WorkSpace &ws, std::string filename, std::ifstream &infile) : ws(ws), mapper(ws, *this) {
-    uint64_t s;
-    filename=filename;
-    fd=fopen(filename.c_str(),"r");
-    sdgMagic_t magic;
-    sdgVersion_t version;
-    SDG_FILETYPE type;
-    fread((char *) &magic, sizeof(magic),1,fd);
-    fread((char *) &version, sizeof(version),1,fd);
-    fread((char *) &type, sizeof(type),1,fd);
-
-    if (magic != SDG_MAGIC) {
-        throw std::runtime_error("Magic number not present in " + filename);
-    }
-
-    if (version < min_compat) {
-        throw std::runtime_error("LinkedDS file version: " + std::to_string(version) + " is not compatible with " + std::to_string(min_compat));
-    }
-
-    if (type != LinkedDS_FT) {
-        throw std::runtime_error("File type supplied: " + std::to_string(type) + " is not compatible with LinkedDS_FT");
-    }
-
-    infile.read( (char *) &readsize,sizeof(readsize));
-    infile.read( (char *) &s,sizeof(s));
-    read_tag.resize(s);
-    infile.read( (char *) read_tag.data(),sizeof(read_tag[0])*s);
-    readpos_offset=infile.tellg();
-    fseek(fd,readpos_offset,SEEK_SET);
-    infile.seekg(2*s*(readsize+1),std::ios_base::cur);
-    sdglib::OutputLog()<<"LinkedReadsDatastore open: "<<filename<<"  max read length: "<<readsize<<" Total reads: " <<size()<<std::endl;
-}
-
 LinkedReadsDatastore::LinkedReadsDatastore(WorkSpace &ws, const LinkedReadsDatastore &o) : ws(ws), mapper(ws, *this) {
     mapper.read_to_node = o.mapper.read_to_node;
     mapper.reads_in_node = o.mapper.reads_in_node;
@@ -625,9 +590,8 @@ std::ostream &operator<<(std::ostream &os, const LinkedReadsDatastore &lrds) {
 }
 
 void BufferedTagKmerizer::get_tag_kmers(LinkedTag tag) {
-    auto read_ids=datastore.get_tag_reads(tag);
     //counts.reserve(counts.size()+read_ids.size()*(datastore.readsize-K+1));
-    for (auto rid:read_ids){
+    for (auto rid:datastore.get_tag_read_range(tag)){
         skf.produce_all_kmers(bprsg.get_read_sequence(rid),counts);
     }
 }
@@ -13,11 +13,14 @@
 #include <vector>
 #include <cstddef>
 #include <list>
+#include <iterator>
+#include <cstring>
 #include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
 #include <sdglib/factories/KMerFactory.hpp>
 #include <sdglib/Version.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
 #include <sdglib/mappers/LinkedReadsMapper.hpp>
 #include "ReadSequenceBuffer.hpp"
 
@@ -34,12 +37,65 @@ struct LinkedReadData {
 
 std::string LinkedTag_to_seq(LinkedTag tag, uint8_t k=16);
 
+/**
+ * @brief A contiguous range of read ids, can be iterated without building a vector
+ */
+class ReadIdRange {
+public:
+    class iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef uint64_t value_type;
+        typedef int64_t difference_type;
+        typedef const uint64_t *pointer;
+        typedef uint64_t reference;
+        explicit iterator(uint64_t _rid):rid(_rid){};
+        uint64_t operator*() const { return rid; }
+        iterator &operator++() { ++rid; return *this; }
+        bool operator==(const iterator &o) const { return rid == o.rid; }
+        bool operator!=(const iterator &o) const { return rid != o.rid; }
+    private:
+        uint64_t rid;
+    };
+    ReadIdRange(uint64_t _first, uint64_t _last):first(_first),last(_last){};
+    iterator begin() const { return iterator(first); }
+    iterator end() const { return iterator(last); }
+    uint64_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+    uint64_t first; /// first read id
+    uint64_t last;  /// one past the last read id
+};
+
+/**
+ * @brief Directory from each tag to its range of pairs, for a datastore whose pairs are sorted by tag.
+ *
+ * Tags take the whole 32 bits, too many for a table with every tag, so this keeps the distinct tags with the first
+ * pair of each, and a table of buckets by the top bits of the tags, sized to about one tag per bucket (like the prefix
+ * buckets in NKmerIndex). A lookup only scans its bucket.
+ */
+class LinkedTagIndex {
+public:
+    void build(const std::vector<LinkedTag> &read_tag);
+    /** @brief [first,last) pair indexes (as in read_tag) of the tag, empty if the tag is not present */
+    std::pair<uint64_t,uint64_t> pair_range(LinkedTag tag) const;
+    uint64_t tag_count() const { return tags.size(); }
+    void write(std::ofstream &output_file) const;
+    void read(std::ifstream &input_file);
+
+    std::vector<LinkedTag> tags;            /// distinct tags, sorted
+    std::vector<uint64_t> first_pair;       /// pairs of tags[i] are [first_pair[i],first_pair[i+1])
+    std::vector<uint64_t> buckets;          /// tags with top bits b are tags[buckets[b]...buckets[b+1]-1]
+    uint64_t bucket_bits = 0;
+};
+
 /**
  * LinkedReadsDatastore is a file with reads and 10xTags.
  * Reads are stored sorted by tag, to optimise access when performing tag-based analyses
  * The binary file contains the following data:
  *
  * uint64_t readsize;
+ * uint64_t tag_index_offset; position of the LinkedTagIndex, written after the mapper data (from version 0x0007)
  * uint64_t read_tag.size()=pairs; (tag 0 is for pair (1,2) and 1 for (2,3), etc)
  * bsg10xTag[pairs] contents of rhe read_tag vector, a tag for each read pair.
  * read sequences: as \\0 terminated characters, using 2*readsize+2 for each pair
@@ -49,19 +105,12 @@ std::string LinkedTag_to_seq(LinkedTag tag, uint8_t k=16);
 class LinkedReadsDatastore {
 public:
     LinkedReadsDatastore(WorkSpace &ws, std::string filename);
-    LinkedReadsDatastore(WorkSpace &ws, std::string filename, std::ifstream &infile);
     LinkedReadsDatastore(WorkSpace &ws);
     LinkedReadsDatastore(WorkSpace &ws, std::string read1_filename, std::string read2_filename,
                          std::string output_filename, LinkedReadsFormat format, std::string default_name="",
                          int readsize = 250);
     LinkedReadsDatastore(WorkSpace &ws, const LinkedReadsDatastore &o);
 
-    ~LinkedReadsDatastore(){
-        if (fd) {
-            fclose(fd);
-        }
-    }
-
 
     /**
      * @brief Provides an overview of the information in the LinkedReadsDatastore
@@ -84,12 +133,36 @@ public:
     //void read_index(std::ifstream & input_file);
 
     size_t size() const {return read_tag.size()*2;};
-    std::string get_read_sequence(size_t readID);
+    /**
+     * @brief Returns the sequence of a read. Thread-safe.
+     */
+    std::string get_read_sequence(size_t readID) const;
+    /**
+     * @brief Sequence of a read without copying it, straight from the mapped file. Thread-safe.
+     */
+    ReadSequenceView get_read_view(uint64_t readID) const {
+        auto seq=read_sequence_ptr(readID);
+        return {seq,strnlen(seq,readsize)};
+    }
     size_t get_read_pair(size_t readID) {return (readID%2==1) ? readID+1: readID-1;};
     LinkedTag get_read_tag(size_t readID);
     std::unordered_set<uint64_t> get_tags_kmers(int k, int min_tag_cov, std::set<LinkedTag> tags, ReadSequenceBuffer & blrsg);
     std::unordered_set<__uint128_t, int128_hash> get_tags_kmers128(int k, int min_tag_cov, std::set<LinkedTag> tags, ReadSequenceBuffer & blrsg, bool count_tag_cvg=false);
     std::vector<uint64_t> get_tag_reads(LinkedTag tag) const;
+    /**
+     * @brief Read ids of a tag, as a range with no allocation. Thread-safe.
+     */
+    ReadIdRange get_tag_read_range(LinkedTag tag) const;
+    /**
+     * @brief k-mers in at least min_tag_cov reads of each tag set, as get_tags_kmers() gives for every set.
+     *
+     * Sets are processed in batches of consecutive sets whose tags have up to max_batch_reads reads. Each tag of a
+     * batch is k-merised once, in file order, so the batch's reads are read in a single sequential sweep however many
+     * of its sets share the tag. The batch's sets are then counted in parallel.
+     */
+    std::vector<std::unordered_set<uint64_t>> get_tag_sets_kmers(int k, int min_tag_cov,
+                                                                 const std::vector<std::set<LinkedTag>> &tag_sets,
+                                                                 uint64_t max_batch_reads=1000000) const;
     std::vector<std::pair<LinkedTag, uint32_t>> get_tag_readcount();
     void dump_tag_occupancy_histogram(std::string filename);
     std::string filename; //if store is in single file sdg format these two are the same as the index file.
@@ -99,9 +172,14 @@ public:
     LinkedReadsMapper mapper;
     std::string name;
     std::string default_name;
+
+    sdglib::MemoryMappedFile mapped_file; //read-only mapping of the whole file, records are read straight from here
 private:
+    const char *read_sequence_ptr(uint64_t readID) const {
+        return mapped_file.data()+readpos_offset+(readsize+1)*(readID-1);
+    }
     std::vector<uint32_t> read_tag;
-    FILE * fd=NULL;
+    LinkedTagIndex tag_index;
     static const sdgVersion_t min_compat;
     WorkSpace &ws;
 
@@ -134,26 +212,9 @@ private:
     public:
         explicit StreamKmerFactory(uint8_t k) : KMerFactory(k){}
         inline void produce_all_kmers(const char * seq, std::vector<uint64_t> &mers){
-            // TODO: Adjust for when K is larger than what fits in uint64_t!
-            last_unknown=0;
-            fkmer=0;
-            rkmer=0;
-            auto s=seq;
-            while (*s!='\0' and *s!='\n') {
-                //fkmer: grows from the right (LSB)
-                //rkmer: grows from the left (MSB)
-                fillKBuf(*s, fkmer, rkmer, last_unknown);
-                if (last_unknown >= K) {
-                    if (fkmer <= rkmer) {
-                        // Is fwd
-                        mers.emplace_back(fkmer);
-                    } else {
-                        // Is bwd
-                        mers.emplace_back(rkmer);
-                    }
-                }
-                ++s;
-            }
+            roll_kmers(seq, strcspn(seq, "\n"), [&](uint64_t fw, uint64_t rc) {
+                mers.emplace_back(rc <= fw ? rc : fw);
+            });
         }
     };
 
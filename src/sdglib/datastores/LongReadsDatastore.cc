@@ -40,11 +40,7 @@ LongReadsDatastore::LongReadsDatastore(WorkSpace &ws, const std::string &long_re
     ofs.write((char*) &fPos, sizeof(fPos));         // Dump index
     ofs.flush();                                    // Make sure everything has been written
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Built datastore with "<<size()<<" reads"<<std::endl;
-    fd = open(filename.data(), O_RDONLY);
-    if (!fd) {
-        std::cerr << "Failed to open " << filename << ": " << strerror(errno);
-        throw std::runtime_error("Could not open " + filename);
-    }
+    mapped_file.open(filename);
 
 }
 
@@ -89,17 +85,12 @@ LongReadsDatastore::LongReadsDatastore(WorkSpace &ws, std::string default_name,
         input_file.read(&seq[0], readSize);
         read_to_fileRecord[i].record_size=readSize;
     }
-    fd = open(filename.data(), O_RDONLY);
-    if (!fd) {
-        std::cerr << "Failed to open " << filename << ": " << strerror(errno);
-        throw std::runtime_error("Could not open " + filename);
-    }
+    mapped_file.open(filename);
 
 }
 
 void LongReadsDatastore::load_index(std::string &file) {
     filename = file;
-    fd = open(filename.data(), O_RDONLY);
     std::ifstream input_file(file, std::ios_base::binary);
     if (!input_file) {
         std::cerr << "Failed to open " << file <<": " << strerror(errno);
@@ -136,6 +127,7 @@ void LongReadsDatastore::load_index(std::string &file) {
 
     input_file.seekg(fPos);
     sdglib::read_flat_vector(input_file, read_to_fileRecord);
+    mapped_file.open(filename);
 
     sdglib::OutputLog()<<"LongReadsDatastore open: "<<filename<<" Total reads: " <<size()<<std::endl;
 }
@@ -164,17 +156,23 @@ void LongReadsDatastore::build_from_fastq(const std::string &output_file, const
         std::cerr << "Failed to open input in " << long_read_file << ": " << strerror(errno);
         throw std::runtime_error("Could not open " + long_read_file);
     }
-    FastqReader<FastqRecord> reader({}, long_read_file);
-    FastqRecord rec;
-    while(reader.next_record(rec)) {
-        if (!rec.seq.empty() and (min_size==0 or rec.seq.size()>=min_size)) {
-            uint32_t size = rec.seq.size();
-            auto offset = ofs.tellp();
-            read_to_file_record.emplace_back((off_t)offset,size);
-            ofs.write((char*)rec.seq.c_str(), size+1);//+1 writes the \0
+    //blocks of reads are decompressed on one thread, parsed in parallel, and written in order
+    FastxPipeline pipeline({long_read_file}, FastxChunkReader::is_fastq(long_read_file));
+    pipeline.run<std::vector<std::string>>([&](const FastxBlock &fb, std::vector<std::string> &seqs){
+        seqs.resize(fb.records);
+        uint64_t pos=0;
+        for (auto &seq:seqs) fb.next_record(0,pos,nullptr,seq);
+    },[&](const FastxBlock &fb, std::vector<std::string> &seqs){
+        for (const auto &seq:seqs) {
+            if (!seq.empty() and (min_size==0 or seq.size()>=min_size)) {
+                uint32_t size = seq.size();
+                auto offset = ofs.tellp();
+                read_to_file_record.emplace_back((off_t)offset,size);
+                ofs.write((char*)seq.c_str(), size+1);//+1 writes the \0
+            }
+            ++nReads;
         }
-        ++nReads;
-    }
+    });
     fPos = ofs.tellp();                             // Write position after reads
     sdglib::write_flat_vector(ofs, read_to_file_record);
 
@@ -245,11 +243,6 @@ void LongReadsDatastore::read(std::ifstream &ifs) {
     sdglib::read_string(ifs, name);
 
     load_index(filename);
-    fd = open(filename.data(), O_RDONLY);
-    if (!fd) {
-        std::cerr << "Failed to open " << filename << ": " << strerror(errno);
-        throw std::runtime_error("Could not open " + filename);
-    }
     mapper.read(ifs);
 }
 
@@ -262,29 +255,23 @@ void LongReadsDatastore::write(std::ofstream &output_file) {
 }
 
 std::string LongReadsDatastore::get_read_sequence(size_t readID) const {
-    char buffer[read_to_fileRecord[readID].record_size+1];
-    size_t read_offset_in_file=read_to_fileRecord[readID].offset;
-    ::lseek(fd,read_offset_in_file,SEEK_SET);
-    ::read(fd, buffer,sizeof(buffer));
-    return std::string(buffer);
+    auto view=get_read_view(readID);
+    return std::string(view.seq,view.size);
 }
 
 void LongReadsDatastore::write_selection(std::ofstream &output_file, const std::vector<uint64_t> &read_ids) {
     unsigned long size(read_ids.size());
-    auto rsb=ReadSequenceBuffer(*this);
     output_file.write((const char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
     output_file.write((const char *) &SDG_VN, sizeof(SDG_VN));
     SDG_FILETYPE type(LongDS_FT);
     output_file.write((char *) &type, sizeof(type));
 
     output_file.write((char *) &size, sizeof(size)); // How many reads we will write in the file
-    const char* seq_ptr;
     for (unsigned long long read_id : read_ids) {
-        seq_ptr = rsb.get_read_sequence(read_id);
-        std::string seq(seq_ptr);
-        size=seq.size();
+        auto view = get_read_view(read_id);
+        size=view.size;
         output_file.write((char *) &size,sizeof(size)); // Read length
-        output_file.write(seq.data(),seq.size());       // Read sequence
+        output_file.write(view.seq,view.size);       // Read sequence
     }
 }
 
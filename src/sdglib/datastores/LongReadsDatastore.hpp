@@ -19,6 +19,7 @@
 #include <sys/stat.h>
 #include <limits>
 #include <sdglib/Version.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
 #include <sdglib/mappers/LongReadsMapper.hpp>
 #include "ReadSequenceBuffer.hpp"
 
@@ -42,15 +43,8 @@ class LongReadsDatastore {
     void load_index(std::string &file);
 
     WorkSpace &ws;
-    FILE * fd=NULL;
 public:
     std::vector< ReadPosSize > read_to_fileRecord{ReadPosSize(0,0)};
-
-    ~LongReadsDatastore(){
-        if (fd) {
-            fclose(fd);
-        }
-    }
     explicit LongReadsDatastore(WorkSpace &ws);
     LongReadsDatastore(WorkSpace &ws, std::string default_name, const std::string &filename, std::ifstream &input_file);
 
@@ -95,12 +89,22 @@ public:
     void write_selection(std::ofstream &output_file, const std::vector<uint64_t> &read_ids);
     size_t size() const { return read_to_fileRecord.size()-1; }
 
+    /**
+     * @brief Returns the sequence of a read. Thread-safe.
+     */
     std::string get_read_sequence(size_t readID) const;
+    /**
+     * @brief Sequence of a read without copying it, straight from the mapped file. Thread-safe.
+     */
+    ReadSequenceView get_read_view(uint64_t readID) const {
+        return {mapped_file.data()+read_to_fileRecord[readID].offset,read_to_fileRecord[readID].record_size};
+    }
 
     std::string filename;
     std::string name;
     std::string default_name;
     static const sdgVersion_t min_compat;
 
+    sdglib::MemoryMappedFile mapped_file; //read-only mapping of the whole file, reads are read straight from here
     LongReadsMapper mapper;
 };
@@ -7,12 +7,22 @@
 #include <sdglib/mappers/PairedReadsMapper.hpp>
 #include <sdglib/utilities/OutputLog.hpp>
 #include <sdglib/types/GenericTypes.hpp>
+#include <sdglib/utilities/packing_helpers.hpp>
+#include <sdglib/readers/FileReader.hpp>
 #include <fstream>
 #include <strings.h>
 #include <cstring>
 #include <sstream>
 
 
+/** Pairs of a FASTQ block, already packed as they go in the datastore, with read ids starting at 0 **/
+struct PackedPairsBlock {
+    std::vector<uint8_t> packed;
+    std::vector<uint16_t> read_length;
+    std::vector<PackedNRun> n_runs;
+    uint64_t pairs=0,discarded=0,truncated=0;
+};
+
 void PairedReadsDatastore::print_status() const {
     sdglib::OutputLog()<<"PairedRead Datastore from "<<filename<<" contains "<<size()-1<<" reads."<<std::endl;
     mapper.print_status();
@@ -26,33 +36,16 @@ void PairedReadsDatastore::build_from_fastq(std::string output_filename, std::st
     //std::cout<<"Memory used by every read's entry:"<< sizeof(PairedRead)<<std::endl;
     //read each read, put it on the index and on the appropriate tag
 
+    //read lengths are stored in 15 bits, the top bit flags reads with N runs
+    if (max_readsize>0x7FFF) throw std::runtime_error("PairedReadsDatastore can't store reads longer than 32767bp, max_readsize is "+std::to_string(max_readsize));
     uint64_t _size(0);
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Creating Datastore from "<<read1_filename<<" | "<<read2_filename<<std::endl;
-    auto fd1=gzopen(read1_filename.c_str(),"r");
-    if (!fd1) {
-        std::cerr << "Failed to open " << read1_filename <<": " << strerror(errno);
-        throw std::runtime_error("Could not open " + read1_filename);
-    }
-    auto fd2=gzopen(read2_filename.c_str(),"r");
-    if (!fd2) {
-        std::cerr << "Failed to open " << read2_filename <<": " << strerror(errno);
-        throw std::runtime_error("Could not open " + read2_filename);
-    }
-    char readbuffer[3000];
-    memset(readbuffer, 0, 3000);
-    //first, build an index of tags and offsets
-    sdglib::OutputLog()<<"Reading chunks of "<<chunksize<<" pairs"<<std::endl;
-    std::vector<PairedReadData> readdatav;
-    readdatav.reserve(chunksize);
-    std::vector<std::ifstream> chunkfiles;
-    std::vector<PairedReadData> next_in_chunk;
-    PairedReadData currrent_read;
-    //First, create the chunk files
     uint64_t pairs=0,discarded=0,truncated=0;
     std::ofstream output(output_filename.c_str());
 
     output.write((const char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
-    output.write((const char *) &SDG_VN, sizeof(SDG_VN));
+    sdgVersion_t version(packed_version);
+    output.write((const char *) &version, sizeof(version));
     SDG_FILETYPE type(PairedDS_FT);
     output.write((char *) &type, sizeof(type));
 
@@ -66,77 +59,75 @@ void PairedReadsDatastore::build_from_fastq(std::string output_filename, std::st
 
     auto size_pos=output.tellp();
     output.write((const char *) &_size, sizeof(_size));//just to save the space!
-    while (!gzeof(fd1) and !gzeof(fd2)) {
-
-        if (NULL == gzgets(fd1, readbuffer, 2999)) continue;
-        if(!readbuffer[0] == '@') {
-            throw std::runtime_error("Please check: " + read1_filename + ", it seems to be missing a header");
-        }
-        if (NULL == gzgets(fd1, readbuffer, 2999)) continue;
-        currrent_read.seq1=std::string(readbuffer);
-        if (NULL == gzgets(fd1, readbuffer, 2999)) continue;
-        if(!readbuffer[0] == '+') {
-            throw std::runtime_error("Please check: " + read1_filename + ", it seems to be desynchronised a header");
-        }
-        if (NULL == gzgets(fd1, readbuffer, 2999)) continue;
-        if (currrent_read.seq1.back()=='\n') currrent_read.seq1.resize(currrent_read.seq1.size()-1);
-        else {std::cout<<"READ IS LONGER THAN 2998bp. ABORTING!!!! Get your act together and choose the right datastore."<<std::endl; exit(1);};
-        if (NULL == gzgets(fd2, readbuffer, 2999)) continue;
-        if(!readbuffer[0] == '@') {
-            throw std::runtime_error("Please check: " + read2_filename + ", it seems to be missing a header");
+    uint64_t index_pos(0);
+    output.write((const char *) &index_pos, sizeof(index_pos));//just to save the space!
+
+    //Reads are written 2-bit packed in fixed-size records, lengths and N runs go to an index after the records.
+    //Blocks of pairs are decompressed on one thread, parsed and packed in parallel, and written in order.
+    const auto packed_size=(max_readsize+3)/4;
+    auto pack_read=[&](std::string &seq, PackedPairsBlock &block){
+        if (seq.size()>max_readsize) {
+            ++block.truncated;
+            seq.resize(max_readsize);
         }
-        if (NULL == gzgets(fd2, readbuffer, 2999)) continue;
-        currrent_read.seq2=std::string(readbuffer);
-        if (NULL == gzgets(fd2, readbuffer, 2999)) continue;
-        if(!readbuffer[0] == '+') {
-            throw std::runtime_error("Please check: " + read2_filename + ", it seems to be desynchronised a header");
+        uint16_t len=seq.size();
+        uint64_t rid=block.read_length.size();
+        auto pos=block.packed.size();
+        block.packed.resize(pos+packed_size,0);
+        sdglib::pack_2bit(seq.data(),len,block.packed.data()+pos);
+        for (uint16_t p=0;p<len;++p){
+            if (sdglib::base_to_2bit(seq[p])<4) continue;
+            uint16_t e=p;
+            while (e<len and sdglib::base_to_2bit(seq[e])==4) ++e;
+            block.n_runs.push_back({rid,p,(uint16_t)(e-p)});
+            p=e;
         }
-        if (NULL == gzgets(fd2, readbuffer, 2999)) continue;
-        if (currrent_read.seq2.back()=='\n') currrent_read.seq2.resize(currrent_read.seq2.size()-1);
-        else {std::cout<<"READ IS LONGER THAN 2998bp. ABORTING!!!! Get your act together and choose the right datastore"<<std::endl; exit(1);};
-        if (currrent_read.seq1.size()<min_readsize or currrent_read.seq2.size()<min_readsize) {
-            ++discarded;
-            continue;
-        }
-        if (currrent_read.seq1.size()>max_readsize) {
-            ++truncated;
-            currrent_read.seq1.resize(max_readsize);
-        }
-        if (currrent_read.seq2.size()>max_readsize) {
-            ++truncated;
-            currrent_read.seq2.resize(max_readsize);
-        }
-        ++pairs;
-        readdatav.push_back(currrent_read);
-        if (readdatav.size()==chunksize){
-            //dump
-            char buffer[2*max_readsize+2];
-            bzero(buffer,2*max_readsize+2);
-            for (auto &r:readdatav){
-                bzero(buffer,2*max_readsize+2);
-                memcpy(buffer,r.seq1.data(),(r.seq1.size()>max_readsize ? max_readsize : r.seq1.size()));
-                memcpy(buffer+max_readsize+1,r.seq2.data(),(r.seq2.size()>max_readsize ? max_readsize : r.seq2.size()));
-                output.write(buffer,2*max_readsize+2);
+        if (!block.n_runs.empty() and block.n_runs.back().read_id==rid) len|=0x8000;
+        block.read_length.push_back(len);
+    };
+    std::vector<uint16_t> read_length(1,0);
+    std::vector<PackedNRun> n_runs;
+    uint64_t last_logged=0;
+    sdglib::OutputLog()<<"Reading blocks of pairs, logging every "<<chunksize<<" pairs"<<std::endl;
+    FastxPipeline pipeline({read1_filename, read2_filename});
+    pipeline.run<PackedPairsBlock>([&](const FastxBlock &fb, PackedPairsBlock &block){
+        block.packed.clear();
+        block.read_length.clear();
+        block.n_runs.clear();
+        block.pairs=block.discarded=block.truncated=0;
+        std::string seq1,seq2;
+        uint64_t pos1=0,pos2=0;
+        while (fb.next_record(0,pos1,nullptr,seq1) and fb.next_record(1,pos2,nullptr,seq2)) {
+            if (seq1.size()<min_readsize or seq2.size()<min_readsize) {
+                ++block.discarded;
+                continue;
             }
-            sdglib::OutputLog()<<readdatav.size()<<" pairs dumped..."<<std::endl;
-            readdatav.clear();
+            pack_read(seq1,block);
+            pack_read(seq2,block);
+            ++block.pairs;
         }
-    }
-    if (readdatav.size()>0) {
-        //dump
-        char buffer[2*max_readsize+2];
-        bzero(buffer,2*max_readsize+2);
-        for (auto &r:readdatav){
-            bzero(buffer,2*max_readsize+2);
-            memcpy(buffer,r.seq1.data(),(r.seq1.size()>max_readsize ? max_readsize : r.seq1.size()));
-            memcpy(buffer+max_readsize+1,r.seq2.data(),(r.seq2.size()>max_readsize ? max_readsize : r.seq2.size()));
-            output.write(buffer,2*max_readsize+2);
+    },[&](const FastxBlock &fb, PackedPairsBlock &block){
+        auto first_rid=read_length.size();
+        output.write((const char *) block.packed.data(),block.packed.size());
+        read_length.insert(read_length.end(),block.read_length.begin(),block.read_length.end());
+        for (auto nr:block.n_runs) {
+            nr.read_id+=first_rid;
+            n_runs.push_back(nr);
         }
-        sdglib::OutputLog()<<readdatav.size()<<" pairs dumped..."<<std::endl;
-        readdatav.clear();
-    }
+        pairs+=block.pairs;
+        discarded+=block.discarded;
+        truncated+=block.truncated;
+        if (pairs-last_logged>=chunksize) {
+            sdglib::OutputLog()<<pairs<<" pairs dumped..."<<std::endl;
+            last_logged=pairs;
+        }
+    });
     _size=pairs*2;
 
+    index_pos=output.tellp();
+    sdglib::write_flat_vector(output, read_length);
+    sdglib::write_flat_vector(output, n_runs);
+
     // Write empty mapper data
     output.write((char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
     output.write((char *) &SDG_VN, sizeof(SDG_VN));
@@ -152,14 +143,13 @@ void PairedReadsDatastore::build_from_fastq(std::string output_filename, std::st
 
     output.seekp(size_pos);
     output.write((const char *) &_size, sizeof(_size));
+    output.write((const char *) &index_pos, sizeof(index_pos));
     output.close();
     //DONE!
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<discarded<<" pairs discarded due to short reads"<<std::endl;
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<truncated<<" reads where truncated to "<<max_readsize<<"bp"<<std::endl;
+    sdglib::OutputLog(sdglib::LogLevels::INFO)<<n_runs.size()<<" runs of non-ACGT bases stored"<<std::endl;
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Datastore with "<<_size<<" reads ("<<pairs<<" pairs)"<<std::endl;
-
-    gzclose(fd1);
-    gzclose(fd2);
 }
 
 void PairedReadsDatastore::read(std::ifstream &input_file) {
@@ -167,12 +157,15 @@ void PairedReadsDatastore::read(std::ifstream &input_file) {
     sdglib::read_string(input_file, filename);
     sdglib::read_string(input_file, name);
 
+    //the name in the workspace may differ from the datastore's default name
+    auto ws_name=name;
     load_index();
+    name=ws_name;
     mapper.read(input_file);
 }
 
 void PairedReadsDatastore::load_index(){
-    fd=fopen(filename.c_str(),"r");
+    auto fd=fopen(filename.c_str(),"r");
     if (!fd) {
         std::cerr << "Failed to open " << filename <<": " << strerror(errno);
         throw std::runtime_error("Could not open " + filename);
@@ -209,8 +202,27 @@ void PairedReadsDatastore::load_index(){
     orientation = ort;
 
     fread( &_size,sizeof(_size),1,fd);
-    readpos_offset=ftell(fd);
-    sdglib::OutputLog()<<"PairedReadsDatastore open: "<<filename<<"  max read length: "<<readsize<<" Total reads: " <<size()<<std::endl;
+    packed = (version >= packed_version);
+    if (packed) {
+        uint64_t index_pos;
+        fread( &index_pos,sizeof(index_pos),1,fd);
+        readpos_offset=ftell(fd);
+        std::ifstream index_file(filename, std::ios_base::binary);
+        index_file.seekg(index_pos);
+        sdglib::read_flat_vector(index_file, read_length);
+        sdglib::read_flat_vector(index_file, n_runs);
+        if (!index_file or read_length.size() != _size + 1) {
+            throw std::runtime_error(filename + " has a corrupted read index");
+        }
+    }
+    else {
+        readpos_offset=ftell(fd);
+        read_length.clear();
+        n_runs.clear();
+    }
+    fclose(fd);
+    mapped_file.open(filename);
+    sdglib::OutputLog()<<"PairedReadsDatastore open: "<<filename<<"  max read length: "<<readsize<<" Total reads: " <<size()<<(packed ? " (2-bit packed)":"")<<std::endl;
 }
 
 void PairedReadsDatastore::write(std::ofstream &output_file) {
@@ -236,23 +248,45 @@ void PairedReadsDatastore::write_selection(std::ofstream &output_file, std::vect
     output_file.write((char *) &readsize,sizeof(readsize));
     uint64_t rids_size=read_ids.size();
     output_file.write((char *) &rids_size,sizeof(rids_size));
-    char buffer[2*readsize+2];
-    for (auto i=0;i<read_ids.size()-1;i+=2) {
-        size_t read_offset_in_file = readpos_offset + (readsize + 1) * (read_ids[i] - 1);
-        fseek(fd, read_offset_in_file, SEEK_SET);
-        fread(buffer, 2 * readsize + 2, 1, fd);
-        output_file.write(buffer,2 * readsize + 2);
+    char buffer[readsize+1], decode_buffer[readsize+1];
+    for (auto i=0;i<read_ids.size();++i) {
+        //selections are always written as ASCII records
+        bzero(buffer,readsize+1);
+        if (read_ids[i]!=0 and read_ids[i]<=size()) {
+            auto view=get_read_view(read_ids[i],decode_buffer);
+            memcpy(buffer,view.seq,view.size);
+        }
+        output_file.write(buffer,readsize + 1);
     }
 }
 
-std::string PairedReadsDatastore::get_read_sequence(seqID_t readID) {
+std::string PairedReadsDatastore::get_read_sequence(seqID_t readID) const {
     if (readID==0 or llabs(readID)>size()) return "";
     char buffer[readsize+1];
-    size_t read_offset_in_file=readpos_offset+(readsize+1)*(llabs(readID)-1);
-    fseek(fd,read_offset_in_file,SEEK_SET);
-    fread(buffer,readsize+1,1,fd);
-    if (readID<0) return sdglib::str_rc(buffer);
-    return std::string(buffer);
+    auto view=get_read_view(llabs(readID),buffer);
+    std::string seq(view.seq,view.size);
+    if (readID<0) return sdglib::str_rc(seq);
+    return seq;
+}
+
+ReadSequenceView PairedReadsDatastore::get_read_view(uint64_t readID, char *decode_buffer) const {
+    const char * record=mapped_file.data()+read_offset_in_file(readID);
+    if (not packed) return {record,strnlen(record,readsize)};
+    unpack_read(readID,(const uint8_t *) record,decode_buffer);
+    return {decode_buffer,(uint64_t) (read_length[readID] & 0x7FFF)};
+}
+
+void PairedReadsDatastore::unpack_read(uint64_t readID, const uint8_t *record, char *out) const {
+    uint16_t len=read_length[readID];
+    bool has_n=len & 0x8000;
+    len &= 0x7FFF;
+    sdglib::unpack_2bit(record,len,out);
+    out[len]='\0';
+    if (has_n) {
+        PackedNRun first{readID,0,0};
+        for (auto nr=std::lower_bound(n_runs.begin(),n_runs.end(),first);nr<n_runs.end() and nr->read_id==readID;++nr)
+            memset(out+nr->start,'N',nr->length);
+    }
 }
 
 seqID_t PairedReadsDatastore::get_read_pair(seqID_t readID) const {
@@ -292,26 +326,9 @@ std::unordered_set<__uint128_t, int128_hash> PairedReadsDatastore::get_reads_kme
     public:
         explicit StreamKmerFactory128(uint8_t k) : KMerFactory128(k){}
         inline void produce_all_kmers(const char * seq, std::vector<__uint128_t> &mers){
-            // TODO: Adjust for when K is larger than what fits in __uint128_t!
-            last_unknown=0;
-            fkmer=0;
-            rkmer=0;
-            auto s=seq;
-            while (*s!='\0' and *s!='\n') {
-                //fkmer: grows from the right (LSB)
-                //rkmer: grows from the left (MSB)
-                fillKBuf(*s, fkmer, rkmer, last_unknown);
-                if (last_unknown >= K) {
-                    if (fkmer <= rkmer) {
-                        // Is fwd
-                        mers.emplace_back(fkmer);
-                    } else {
-                        // Is bwd
-                        mers.emplace_back(rkmer);
-                    }
-                }
-                ++s;
-            }
+            roll_kmers(seq, strcspn(seq, "\n"), [&](__uint128_t fw, __uint128_t rc) {
+                mers.emplace_back(rc <= fw ? rc : fw);
+            });
         }
     };
     StreamKmerFactory128 skf(k);
@@ -355,7 +372,6 @@ PairedReadsDatastore::PairedReadsDatastore(WorkSpace &ws) : ws(ws), mapper(ws, *
 PairedReadsDatastore::PairedReadsDatastore(WorkSpace &ws, std::string _filename, std::ifstream &input_file) : ws(ws), mapper(ws, *this) {
     uint64_t s;
     filename=_filename;
-    fd=fopen(filename.c_str(),"r");
     sdgMagic_t magic;
     sdgVersion_t version;
     SDG_FILETYPE type;
@@ -378,7 +394,7 @@ PairedReadsDatastore::PairedReadsDatastore(WorkSpace &ws, std::string _filename,
     input_file.read( (char *) &readsize,sizeof(readsize));
     input_file.read( (char *) &_size,sizeof(_size));
     readpos_offset=input_file.tellg();
-    fseek(fd,readpos_offset,SEEK_SET);
+    mapped_file.open(filename);
     input_file.seekg(_size*(readsize+1),std::ios_base::cur);
     sdglib::OutputLog()<<"PairedReadsDatastore open: "<<_filename<<"  max read length: "<<readsize<<" Total reads: " <<size()<<std::endl;
 
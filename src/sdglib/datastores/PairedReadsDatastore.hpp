@@ -16,15 +16,28 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
+#include <tuple>
 #include <sdglib/factories/KMerFactory.hpp>
 #include <sdglib/mappers/PairedReadsMapper.hpp>
 #include "sdglib/Version.hpp"
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+#include "ReadSequenceBuffer.hpp"
 
 class WorkSpace;
 struct PairedReadData {
     std::string seq1,seq2;
 };
 
+/**
+ * A run of non-ACGT bases inside a read of a packed PairedReadsDatastore. Runs are sorted by read_id and start.
+ */
+struct PackedNRun {
+    uint64_t read_id;
+    uint16_t start;
+    uint16_t length;
+    bool operator<(const PackedNRun &o) const { return std::tie(read_id,start)<std::tie(o.read_id,o.start); }
+};
+
 class PairedReadsDatastore {
 public:
     PairedReadsDatastore(WorkSpace &ws);
@@ -32,12 +45,6 @@ public:
     PairedReadsDatastore(WorkSpace &ws, std::string _filename);
     PairedReadsDatastore(WorkSpace &ws, std::string read1_filename,std::string read2_filename, std::string output_filename, std::string default_name="", int min_readsize=0, int max_readsize=250, int fs=0, int orientation=0);
 
-    ~PairedReadsDatastore(){
-        if (fd) {
-            fclose(fd);
-        }
-    }
-
     /**
      * @brief Provides an overview of the information in the PairedReadsDatastore
      * @param level Base indentation level to use on the result
@@ -56,7 +63,35 @@ public:
     void read(std::ifstream & input_file);
     void load_index();
     uint64_t size()const;
-    std::string get_read_sequence(seqID_t readID);
+    /**
+     * @brief Returns the sequence of a read, negative ids return the reverse complement. Thread-safe.
+     */
+    std::string get_read_sequence(seqID_t readID) const;
+
+    /**
+     * @brief Forward sequence of a read without copying it, straight from the mapped file. Thread-safe.
+     * @param readID positive id of the read
+     * @param decode_buffer space for readsize+1 chars, packed reads are decoded here, so the view is valid until it is reused
+     */
+    ReadSequenceView get_read_view(uint64_t readID, char * decode_buffer) const;
+
+    /**
+     * @brief Size in bytes of each read's fixed-size record in the file (readsize+1 for ASCII, readsize/4 rounded up when packed)
+     */
+    uint64_t record_size() const { return (packed ? (readsize+3)/4 : readsize+1); }
+
+    /**
+     * @brief Position of a read's record in the file, records are fixed-size so this is O(1) for both formats
+     */
+    uint64_t read_offset_in_file(uint64_t readID) const { return readpos_offset + record_size() * (readID - 1); }
+
+    /**
+     * @brief Decodes a packed record into a '\0'-terminated sequence, restoring the read length and N runs.
+     * @param readID positive id of the read the record belongs to
+     * @param record pointer to the record_size() bytes of the read in the file
+     * @param out buffer with space for at least readsize+1 chars
+     */
+    void unpack_read(uint64_t readID, const uint8_t * record, char * out) const;
     seqID_t get_read_pair(seqID_t readID) const;
     std::unordered_set<__uint128_t, int128_hash> get_all_kmers128(int k, int min_tag_cov);
     std::unordered_set<__uint128_t, int128_hash> get_reads_kmers128(int k, int min_tag_cov, std::vector<uint64_t> reads);
@@ -72,10 +107,16 @@ public:
     PairedReadsMapper mapper;
     std::string name;
     std::string default_name;
+
+    bool packed=false; //true if reads are stored 2-bit packed (version >= packed_version)
+    std::vector<uint16_t> read_length; //only for packed files, top bit set if the read has N runs
+    std::vector<PackedNRun> n_runs;
+    static const sdgVersion_t packed_version = 0x0004;
+
+    sdglib::MemoryMappedFile mapped_file; //read-only mapping of the whole file, records are read straight from here
 private:
     //TODO: save size
     uint64_t _size;
-    FILE * fd=NULL;
     static const sdgVersion_t min_compat = 0x0003;
 
     WorkSpace &ws;
@@ -6,15 +6,28 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 class PairedReadsDatastore;
 class LinkedReadsDatastore;
 class LongReadsDatastore;
 
 /**
- * This class accesses the sequence of the reads of a datastore through an internal buffer.
- * It can be contructed with any kind of read datastore and will return a pointer a its internal buffer containing the
- * read's sequence.
+ * @brief A read's sequence where it is stored, size chars starting at seq (also '\0'-terminated).
+ */
+struct ReadSequenceView {
+    const char * seq;
+    uint64_t size;
+};
+
+/**
+ * This class accesses the sequence of the reads of a datastore through the datastore's memory mapping.
+ * It can be contructed with any kind of read datastore and will return a pointer to the read's '\0'-terminated
+ * sequence, straight into the mapped file, so there are no copies or system calls per read.
+ * Packed paired datastores are decoded into an internal buffer, so the returned pointer is only valid until the next
+ * call. Use one ReadSequenceBuffer per thread.
+ *
+ * _bufsize and _chunk_size are not used anymore, they are kept so existing callers don't need changing.
  */
 
 
@@ -24,14 +37,11 @@ public:
     explicit ReadSequenceBuffer(const LongReadsDatastore &_ds, size_t _bufsize = (1024*1024*30ul), size_t _chunk_size = (1024*1024*4ul));
     explicit ReadSequenceBuffer(const LinkedReadsDatastore &_ds, size_t _bufsize = (1024*1024*30ul), size_t _chunk_size = (1024*1024*4ul));
     const char * get_read_sequence(uint64_t readID);
-    ~ReadSequenceBuffer();
+    ReadSequenceView get_read_view(uint64_t readID);
     ReadSequenceBuffer& operator=(const ReadSequenceBuffer&) = delete;
 private:
     const PairedReadsDatastore * paired_datastore= nullptr;
     const LinkedReadsDatastore * linked_datastore= nullptr;
     const LongReadsDatastore * long_datastore= nullptr;
-    char * buffer= nullptr;
-    size_t bufsize,chunk_size;
-    size_t buffer_offset;
-    int fd;
-};
\ No newline at end of file
+    std::vector<char> decode_buffer;
+};
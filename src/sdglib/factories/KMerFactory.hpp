@@ -11,6 +11,9 @@
 #include <sdglib/readers/FileReader.hpp>
 #include <sdglib/types/KmerTypes.hpp>
 #include <array>
+#include <cstring>
+#include <sdglib/utilities/packing_helpers.hpp>
+#include <sdglib/graph/PackedNodeSequences.hpp>
 
 #define unlikely(x)     __builtin_expect((x),0)
 
@@ -33,6 +36,34 @@ public:
         }
     }
 
+    /**
+     * @brief Calls emit(fw, rc) for every k-mer without Ns in seq[0,len), fw is the k-mer and rc its reverse complement.
+     * The sequence is 2-bit encoded in bulk first (see sdglib::encode_2bit), so the rolling loop has no per-base table
+     * lookups or branches. Produces the same k-mers as calling fillKBuf() on every base.
+     */
+    template <typename EMITTER>
+    inline void roll_kmers(const char *seq, uint64_t len, EMITTER emit) {
+        if (codes.size() < len) codes.resize(len);
+        sdglib::encode_2bit(seq, len, codes.data());
+        uint64_t fw = 0, rc = 0;
+        int64_t valid = 0;
+        for (uint64_t p = 0; p < len; ++p) {
+            auto c = codes[p];
+            fw = ((fw << 2) | (c & 3)) & KMER_MASK;
+            rc = (rc >> 2) | (((uint64_t) (3 - (c & 3))) << KMER_FIRSTOFFSET);
+            valid = c < 4 ? valid + 1 : 0;
+            if (valid >= K) emit(fw, rc);
+        }
+    }
+
+    /**
+     * @brief As roll_kmers() on the forward strand of node n, read in place from its 2-bit codes in nodes.
+     */
+    template <typename EMITTER>
+    inline void roll_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, EMITTER emit) {
+        nodes.roll_kmers<uint64_t>(n, K, [&](uint64_t fw, uint64_t rc, uint64_t) { emit(fw, rc); });
+    }
+
 protected:
     explicit KMerFactory(uint8_t k) : K(k), KMER_FIRSTOFFSET((uint64_t) (K - 1) * 2),
                                       KMER_MASK((((uint64_t) 1) << (K * 2)) - 1) {
@@ -56,6 +87,7 @@ private:
     const uint64_t KMER_FIRSTOFFSET;
     std::array<char,256> b2f={4};
     std::array<char,256> b2r={4};
+    std::vector<uint8_t> codes;
 };
 
 class KMerFactory128 {
@@ -77,6 +109,34 @@ public:
         }
     }
 
+    /**
+     * @brief Calls emit(fw, rc) for every k-mer without Ns in seq[0,len), fw is the k-mer and rc its reverse complement.
+     * The sequence is 2-bit encoded in bulk first (see sdglib::encode_2bit), so the rolling loop has no per-base table
+     * lookups or branches. Produces the same k-mers as calling fillKBuf() on every base.
+     */
+    template <typename EMITTER>
+    inline void roll_kmers(const char *seq, uint64_t len, EMITTER emit) {
+        if (codes.size() < len) codes.resize(len);
+        sdglib::encode_2bit(seq, len, codes.data());
+        __uint128_t fw = 0, rc = 0;
+        int64_t valid = 0;
+        for (uint64_t p = 0; p < len; ++p) {
+            auto c = codes[p];
+            fw = ((fw << 2) | (c & 3)) & KMER_MASK;
+            rc = (rc >> 2) | (((__uint128_t) (3 - (c & 3))) << KMER_FIRSTOFFSET);
+            valid = c < 4 ? valid + 1 : 0;
+            if (valid >= K) emit(fw, rc);
+        }
+    }
+
+    /**
+     * @brief As roll_kmers() on the forward strand of node n, read in place from its 2-bit codes in nodes.
+     */
+    template <typename EMITTER>
+    inline void roll_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, EMITTER emit) {
+        nodes.roll_kmers<__uint128_t>(n, K, [&](__uint128_t fw, __uint128_t rc, uint64_t) { emit(fw, rc); });
+    }
+
 protected:
     explicit KMerFactory128(uint8_t k) : K(k), KMER_FIRSTOFFSET((__uint128_t) (K - 1) * 2),
                                       KMER_MASK((((__uint128_t) 1) << (K * 2)) - 1) {
@@ -100,6 +160,7 @@ private:
     const __uint128_t KMER_FIRSTOFFSET;
     std::array<char,256> b2f={4};
     std::array<char,256> b2r={4};
+    std::vector<uint8_t> codes;
 };
 
 
@@ -115,50 +176,36 @@ public:
 
     // TODO: Adjust for when K is larger than what fits in uint64_t!
     const bool create_kmers(const std::string &s, std::vector<std::pair<bool, uint64_t>> &mers) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
         mers.reserve(mers.size()+s.size());
-        while (p < s.size()) {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(true, fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(false, rkmer);
-                }
-            }
-        }
+        roll_kmers(s.data(), s.size(), [&](uint64_t fw, uint64_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
         return false;
     }
 
     const bool create_kmers(const std::string &s, std::vector<uint64_t> &mers) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
         mers.reserve(mers.size()+s.size());
-        while (p < s.size()) {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer);
-                }
-            }
-        }
+        roll_kmers(s.data(), s.size(), [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
+        return false;
+    }
+
+    const bool create_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<std::pair<bool, uint64_t>> &mers) {
+        mers.reserve(mers.size()+nodes.node_size(n));
+        roll_kmers(nodes, n, [&](uint64_t fw, uint64_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
+        return false;
+    }
+
+    const bool create_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<uint64_t> &mers) {
+        mers.reserve(mers.size()+nodes.node_size(n));
+        roll_kmers(nodes, n, [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
         return false;
     }
 };
@@ -175,50 +222,28 @@ public:
 
     // TODO: Adjust for when K is larger than what fits in __uint128_t!
     const bool create_kmers(const std::string &s, std::vector<std::pair<bool, __uint128_t>> &mers) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        __uint128_t p(0);
         mers.reserve(mers.size()+s.size());
-        while (p < s.size()) {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(true, fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(false, rkmer);
-                }
-            }
-        }
+        roll_kmers(s.data(), s.size(), [&](__uint128_t fw, __uint128_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
         return false;
     }
 
     const bool create_kmers(const std::string &s, std::vector<__uint128_t> &mers) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        __uint128_t p(0);
         mers.reserve(mers.size()+s.size());
-        while (p < s.size()) {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer);
-                }
-            }
-        }
+        roll_kmers(s.data(), s.size(), [&](__uint128_t fw, __uint128_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
+        return false;
+    }
+
+    const bool create_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<std::pair<bool, __uint128_t>> &mers) {
+        mers.reserve(mers.size()+nodes.node_size(n));
+        roll_kmers(nodes, n, [&](__uint128_t fw, __uint128_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
         return false;
     }
 };
@@ -269,6 +294,19 @@ public:
         }
         return false;
     }
+
+    //the string versions emit each window's reverse complement (fillKBuf gets fkmer and rkmer swapped), so do these
+    const bool create_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<std::pair<bool, uint64_t>> &mers) {
+        mers.reserve(mers.size()+nodes.node_size(n));
+        roll_kmers(nodes, n, [&](uint64_t fw, uint64_t rc) { mers.emplace_back(true, rc); });
+        return false;
+    }
+
+    const bool create_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<uint64_t> &mers) {
+        mers.reserve(mers.size()+nodes.node_size(n));
+        roll_kmers(nodes, n, [&](uint64_t fw, uint64_t rc) { mers.emplace_back(rc); });
+        return false;
+    }
 };
 
 
@@ -277,49 +315,22 @@ public:
     explicit StreamKmerFactory(uint8_t k) : KMerFactory(k) {}
 
     inline void produce_all_kmers(const char * seq, std::vector<std::pair<bool, uint64_t>> &mers){
-        // TODO: Adjust for when K is larger than what fits in uint64_t!
-        last_unknown=0;
-        fkmer=0;
-        rkmer=0;
-        auto s=seq;
-        while (*s!='\0' and *s!='\n') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(*s, fkmer, rkmer, last_unknown);
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(true,fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(false,rkmer);
-                }
-            }
-            ++s;
-        }
+        roll_kmers(seq, strcspn(seq, "\n"), [&](uint64_t fw, uint64_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
     }
 
     inline void produce_all_kmers(const char * seq, std::vector<uint64_t> &mers){
-        // TODO: Adjust for when K is larger than what fits in uint64_t!
-        last_unknown=0;
-        fkmer=0;
-        rkmer=0;
-        auto s=seq;
-        while (*s!='\0' and *s!='\n') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(*s, fkmer, rkmer, last_unknown);
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer);
-                }
-            }
-            ++s;
-        }
+        roll_kmers(seq, strcspn(seq, "\n"), [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
+    }
+
+    inline void produce_all_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<uint64_t> &mers){
+        roll_kmers(nodes, n, [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
     }
 
 };
@@ -328,48 +339,15 @@ class StreamKmerFactory128 : public  KMerFactory128 {
 public:
     explicit StreamKmerFactory128(uint8_t k) : KMerFactory128(k){}
     inline void produce_all_kmers(const char * seq, std::vector<std::pair<bool, __uint128_t>> &mers){
-        // TODO: Adjust for when K is larger than what fits in uint64_t!
-        last_unknown=0;
-        fkmer=0;
-        rkmer=0;
-        auto s=seq;
-        while (*s!='\0' and *s!='\n') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(*s, fkmer, rkmer, last_unknown);
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(true,fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(false,rkmer);
-                }
-            }
-            ++s;
-        }
+        roll_kmers(seq, strcspn(seq, "\n"), [&](__uint128_t fw, __uint128_t rc) {
+            if (rc <= fw) mers.emplace_back(true, rc);
+            else mers.emplace_back(false, fw);
+        });
     }
     inline void produce_all_kmers(const char * seq, std::vector<__uint128_t> &mers){
-        // TODO: Adjust for when K is larger than what fits in __uint128_t!
-        last_unknown=0;
-        fkmer=0;
-        rkmer=0;
-        auto s=seq;
-        while (*s!='\0' and *s!='\n') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(*s, fkmer, rkmer, last_unknown);
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer);
-                }
-            }
-            ++s;
-        }
+        roll_kmers(seq, strcspn(seq, "\n"), [&](__uint128_t fw, __uint128_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
     }
 };
 
@@ -388,67 +366,20 @@ public:
 
     // TODO: Adjust for when K is larger than what fits in uint64_t!
     const void create_kmercounts(std::vector<KmerCount> &mers, const char * s) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
-        while (s[p]!='\0') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer,1);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer,1);
-                }
-            }
-        }
+        roll_kmers(s, strlen(s), [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw, 1);
+        });
     }
     const void create_kmers(std::vector<uint64_t> &mers, const char * s) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
-        while (s[p]!='\0') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer);
-                }
-            }
-        }
+        roll_kmers(s, strlen(s), [&](uint64_t fw, uint64_t rc) {
+            mers.emplace_back(rc <= fw ? rc : fw);
+        });
     }
     const void create_kmers_direction(std::vector<std::pair<uint64_t,bool>> &mers, const char * s) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
-        while (s[p]!='\0') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer,false);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer,true);
-                }
-            }
-        }
+        roll_kmers(s, strlen(s), [&](uint64_t fw, uint64_t rc) {
+            if (rc <= fw) mers.emplace_back(rc, false);
+            else mers.emplace_back(fw, true);
+        });
     }
 };
 
@@ -466,25 +397,10 @@ public:
     }
 
     const void create_kmers_direction(std::vector<std::pair<__uint128_t,bool>> &mers, const char * s) {
-        fkmer=0;
-        rkmer=0;
-        last_unknown=0;
-        uint64_t p(0);
-        while (s[p]!='\0') {
-            //fkmer: grows from the right (LSB)
-            //rkmer: grows from the left (MSB)
-            fillKBuf(s[p], fkmer, rkmer, last_unknown);
-            p++;
-            if (last_unknown >= K) {
-                if (fkmer <= rkmer) {
-                    // Is fwd
-                    mers.emplace_back(fkmer,false);
-                } else {
-                    // Is bwd
-                    mers.emplace_back(rkmer,true);
-                }
-            }
-        }
+        roll_kmers(s, strlen(s), [&](__uint128_t fw, __uint128_t rc) {
+            if (rc <= fw) mers.emplace_back(rc, false);
+            else mers.emplace_back(fw, true);
+        });
     }
 };
 
@@ -48,6 +48,23 @@ public:
         return false;
     }
 
+    /**
+     * @brief As next_element() for the sequence of node n, whose k-mers are rolled in place from nodes.
+     */
+    void node_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<std::pair<uint64_t,graphStrandPos>> &mers) {
+        nodes.roll_kmers<uint64_t>(n, K, [&](uint64_t fw, uint64_t rc, uint64_t p) {
+            graphStrandPos pos;
+            pos.pos=p;
+            if (rc <= fw) {
+                pos.node=n;
+                mers.emplace_back(rc, pos);
+            } else {
+                pos.node=-n;
+                mers.emplace_back(fw, pos);
+            }
+        });
+    }
+
 private:
     FastaRecord currentRecord;
     uint64_t bases;
@@ -93,6 +110,23 @@ public:
         return false;
     }
 
+    /**
+     * @brief As next_element() for the sequence of node n, whose k-mers are rolled in place from nodes.
+     */
+    void node_kmers(const PackedNodeSequences &nodes, sgNodeID_t n, std::vector<std::pair<__uint128_t,graphStrandPos>> &mers) {
+        nodes.roll_kmers<__uint128_t>(n, K, [&](__uint128_t fw, __uint128_t rc, uint64_t p) {
+            graphStrandPos pos;
+            pos.pos=p;
+            if (rc <= fw) {
+                pos.node=n;
+                mers.emplace_back(rc, pos);
+            } else {
+                pos.node=-n;
+                mers.emplace_back(fw, pos);
+            }
+        });
+    }
+
 private:
     FastaRecord currentRecord;
     uint64_t bases;
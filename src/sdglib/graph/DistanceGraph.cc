@@ -194,7 +194,9 @@ void DistanceGraph::report_connectivity() {
 }
 
 
-std::vector<std::vector<sgNodeID_t>> DistanceGraph::get_all_lines(uint16_t min_nodes, uint64_t min_total_size) const {
+//Shared by DistanceGraph and DistanceGraphCSR, fw_links(n) returns the forward links of n as a vector or a span
+template <typename FWLINKS>
+static std::vector<std::vector<sgNodeID_t>> collect_all_lines(const SequenceDistanceGraph & sdg, const FWLINKS & get_fw_links, uint16_t min_nodes, uint64_t min_total_size) {
     std::vector<std::vector<sgNodeID_t>> unitigs;
     std::vector<bool> used(sdg.nodes.size(),false);
 
@@ -207,7 +209,7 @@ std::vector<std::vector<sgNodeID_t>> DistanceGraph::get_all_lines(uint16_t min_n
         for (auto pass=0; pass<2; ++pass) {
             //walk til a "non-unitig" junction
             for (auto fn = get_fw_links(path.back()); fn.size() == 1; fn = get_fw_links(path.back())) {
-                if (used[llabs(fn[0].dest)]!=true and get_bw_links(fn[0].dest).size() == 1) {
+                if (used[llabs(fn[0].dest)]!=true and get_fw_links(-fn[0].dest).size() == 1) {
                     path.emplace_back(fn[0].dest);
                     used[llabs(fn[0].dest)] = true;
                 } else break;
@@ -218,20 +220,26 @@ std::vector<std::vector<sgNodeID_t>> DistanceGraph::get_all_lines(uint16_t min_n
         }
         if (path.size()<min_nodes) continue;
         uint64_t total_size=0;
-        for (auto n:path) total_size+=sdg.nodes[llabs(n)].sequence.size();
+        for (auto n:path) total_size+=sdg.get_node_size(llabs(n));
         if (total_size<min_total_size) continue;
         unitigs.push_back(path);
     }
     return unitigs;
 }
 
+std::vector<std::vector<sgNodeID_t>> DistanceGraph::get_all_lines(uint16_t min_nodes, uint64_t min_total_size) const {
+    //walking the lines looks up every node's links a few times, freezing them first avoids copying link vectors
+    return DistanceGraphCSR(*this).get_all_lines(min_nodes, min_total_size);
+}
+
 std::unordered_set<sgNodeID_t> DistanceGraph::get_connected_nodes() const {
     std::unordered_set<sgNodeID_t> r;
     for (auto n=1;n<links.size();++n) if (!links[n].empty()) r.insert(n);
     return std::move(r);
 }
 
-std::vector<SequenceDistanceGraphPath> DistanceGraph::find_all_paths_between(sgNodeID_t from,sgNodeID_t to, int64_t max_size, int max_nodes, bool abort_on_loops) const {
+template <typename FWLINKS>
+static std::vector<SequenceDistanceGraphPath> collect_all_paths_between(SequenceDistanceGraph & sdg, const FWLINKS & get_fw_links, sgNodeID_t from,sgNodeID_t to, int64_t max_size, int max_nodes, bool abort_on_loops) {
     typedef struct T {
         int64_t prev;
         sgNodeID_t node;
@@ -249,8 +257,8 @@ std::vector<SequenceDistanceGraphPath> DistanceGraph::find_all_paths_between(sgN
         if (fl.dest==to and final_paths.empty()) {
             final_paths.emplace_back(sdg,pp);
         }
-        else if (sdg.nodes[llabs(fl.dest)].sequence.size()<=max_size) {
-            node_entries.emplace_back(-1, fl.dest, 1, sdg.nodes[llabs(fl.dest)].sequence.size());
+        else if (sdg.get_node_size(llabs(fl.dest))<=max_size) {
+            node_entries.emplace_back(-1, fl.dest, 1, sdg.get_node_size(llabs(fl.dest)));
         }
     }
 
@@ -281,7 +289,7 @@ std::vector<SequenceDistanceGraphPath> DistanceGraph::find_all_paths_between(sgN
                 final_paths.emplace_back(sdg,pp);
             }
             else {
-                uint64_t new_size=current_entry.partial_size+fl.dist+sdg.nodes[llabs(fl.dest)].sequence.size();
+                uint64_t new_size=current_entry.partial_size+fl.dist+sdg.get_node_size(llabs(fl.dest));
                 if (new_size<=max_size and current_entry.node_count<=max_nodes) {
                     node_entries.emplace_back(current_index, fl.dest, current_entry.node_count+1, new_size);
                 }
@@ -305,6 +313,10 @@ std::vector<SequenceDistanceGraphPath> DistanceGraph::find_all_paths_between(sgN
     return final_paths;
 }
 
+std::vector<SequenceDistanceGraphPath> DistanceGraph::find_all_paths_between(sgNodeID_t from,sgNodeID_t to, int64_t max_size, int max_nodes, bool abort_on_loops) const {
+    return collect_all_paths_between(sdg, [this](sgNodeID_t n) { return get_fw_links(n); }, from, to, max_size, max_nodes, abort_on_loops);
+}
+
 void DistanceGraph::dump_to_text(std::string filename) {
     std::ofstream of(filename);
     for (auto &lv:links) for (auto &l:lv){
@@ -332,7 +344,7 @@ std::vector<std::pair<sgNodeID_t,sgNodeID_t>> DistanceGraph::find_bubbles(uint32
     for (n1=1;n1<sdg.nodes.size();++n1){
         if (used[n1]) continue;
         //get "topologically correct" bubble: prev -> [n1 | n2] -> next
-        s1=sdg.nodes[n1].sequence.size();
+        s1=sdg.get_node_size(n1);
         if (s1<min_size or s1>max_size) continue;
 
         auto fwl=get_fw_links(n1);
@@ -350,7 +362,7 @@ std::vector<std::pair<sgNodeID_t,sgNodeID_t>> DistanceGraph::find_bubbles(uint32
         else n2=parlp[1].dest;
 
         if (n2!=-parln[0].dest and n2!=-parln[1].dest) continue;
-        s2=sdg.nodes[llabs(n2)].sequence.size();
+        s2=sdg.get_node_size(llabs(n2));
         if (s2<min_size or s2>max_size) continue;
 
         used[n1]=true;
@@ -364,7 +376,7 @@ std::vector<std::pair<sgNodeID_t,sgNodeID_t>> DistanceGraph::find_bubbles(uint32
 std::vector<sgNodeID_t> DistanceGraph::find_tips(uint32_t min_size, uint32_t max_size) const {
     std::vector<sgNodeID_t> r;
     for (auto &l:links){
-        if (l.size()==1 and sdg.nodes[llabs(l[0].source)].sequence.size()>=min_size and sdg.nodes[llabs(l[0].source)].sequence.size()<=max_size){
+        if (l.size()==1 and sdg.get_node_size(llabs(l[0].source))>=min_size and sdg.get_node_size(llabs(l[0].source))<=max_size){
             for (auto &ol:links[llabs(l[0].dest)]){
                 if (ol.source==l[0].dest and ol.dest!=l[0].source){
                     r.emplace_back(l[0].source);
@@ -448,8 +460,8 @@ void DistanceGraph::write_to_gfa1(std::string filename, const std::vector<sgNode
     for (sgNodeID_t i=1;i<sdg.nodes.size();++i){
         if (sdg.nodes[i].status==NodeStatus::Deleted) continue;
         if (!output_nodes.empty() and output_nodes.count(i)==0 and output_nodes.count(-i)==0) continue;
-        fastaf<<">seq"<<i<<std::endl<<sdg.nodes[i].sequence<<std::endl;
-        gfaf<<"S\tseq"<<i<<"\t*\tLN:i:"<<sdg.nodes[i].sequence.size()<<"\tUR:Z:"<<fasta_filename
+        fastaf<<">seq"<<i<<std::endl<<sdg.get_node_sequence(i)<<std::endl;
+        gfaf<<"S\tseq"<<i<<"\t*\tLN:i:"<<sdg.get_node_size(i)<<"\tUR:Z:"<<fasta_filename
             <<(depths.empty() or std::isnan(depths[i])?"":"\tDP:f:"+std::to_string(depths[i]))<<std::endl;
     }
 
@@ -517,8 +529,8 @@ void DistanceGraph::write_to_gfa2(std::string filename, const std::vector<sgNode
     for (sgNodeID_t i=1;i<sdg.nodes.size();++i){
         if (sdg.nodes[i].status==NodeStatus::Deleted) continue;
         if (!output_nodes.empty() and output_nodes.count(i)==0 and output_nodes.count(-i)==0) continue;
-        fastaf<<">seq"<<i<<std::endl<<sdg.nodes[i].sequence<<std::endl;
-        gfaf<<"S\tseq"<<i<<"\t*\tLN:i:"<<sdg.nodes[i].sequence.size()<<"\tUR:Z:"<<fasta_filename
+        fastaf<<">seq"<<i<<std::endl<<sdg.get_node_sequence(i)<<std::endl;
+        gfaf<<"S\tseq"<<i<<"\t*\tLN:i:"<<sdg.get_node_size(i)<<"\tUR:Z:"<<fasta_filename
             <<(depths.empty() or std::isnan(depths[i])?"":"\tDP:f:"+std::to_string(depths[i]))<<std::endl;
     }
 
@@ -531,8 +543,8 @@ void DistanceGraph::write_to_gfa2(std::string filename, const std::vector<sgNode
                                         output_nodes.count(l.dest) > 0 or output_nodes.count(-l.dest) > 0)) {
                 if (l.dist < 0) {
                     gfaf << "E\tedge_" << edge_counter++ << "\t";
-                    const auto source_size(sdg.nodes[std::abs(l.source)].sequence.size());
-                    const auto dest_size(sdg.nodes[std::abs(l.dest)].sequence.size());
+                    const auto source_size(sdg.get_node_size(std::abs(l.source)));
+                    const auto dest_size(sdg.get_node_size(std::abs(l.dest)));
                     if (l.source > 0) gfaf << "seq" << l.source << "-\t";
                     else gfaf << "seq" << -l.source << "+\t";
 
@@ -621,10 +633,15 @@ std::vector<TangleView> DistanceGraph::get_all_tangleviews(int fsize, float fmin
 //    std::cout<<"Tangles of size < "<<fsize<<" with "<<fmin_kci<<" < KCI < "<<fmax_kci<<" disconnected: "<<include_disconnected<<std::endl;
     std::vector<TangleView> tangles;
     std::vector<bool> used(sdg.nodes.size());
+    //KCIs of most nodes will be needed, computing them all at once is faster
+    if ((fmin_kci>=0 or fmax_kci>=0) and not sdg.ws.kmer_counters.empty()) {
+        auto &kc=sdg.ws.loaded(sdg.ws.kmer_counters[0]);
+        if (not kc.has_node_summaries()) kc.compute_node_summaries();
+    }
     for (auto nid=0;nid<sdg.nodes.size();++nid) {
         if (used[nid]) continue;
         auto &n=sdg.nodes[nid];
-        if (n.status==NodeStatus::Deleted or n.sequence.size()>=fsize) continue;
+        if (n.status==NodeStatus::Deleted or sdg.get_node_size(nid)>=fsize) continue;
         auto nv=get_nodeview(nid);
         if (fmin_kci>=0 and nv.kci()<fmin_kci) continue;
         if (fmax_kci>=0 and nv.kci()>fmax_kci) continue;
@@ -724,9 +741,11 @@ std::vector<uint64_t> DistanceGraph::nstats(std::vector<uint64_t> sizes, std::ve
 std::string DistanceGraph::stats_by_kci() {
 
 //    // Check the kci peak value is not -1
-    if (sdg.ws.kmer_counters[0].get_kci_peak() < 0){
+    auto &kc=sdg.ws.loaded(sdg.ws.kmer_counters[0]);
+    if (kc.get_kci_peak() < 0){
         return "KCI peak not set!";
     }
+    if (not kc.has_node_summaries()) kc.compute_node_summaries();
 
     std::vector<uint64_t> nokci_sizes;
     std::vector<uint64_t> kci0_sizes;
@@ -803,4 +822,49 @@ std::string DistanceGraph::stats_by_kci() {
     std::sprintf(buffer+std::strlen(buffer),"| All   | %13lld | %8lld | %7lld | %10lld | %10lld | %10lld |\n", std::accumulate(all_sizes.begin(), all_sizes.end(), (uint64_t) 0), all_sizes.size(), all_tips, all_stats[0], all_stats[1], all_stats[2]);
     std::sprintf(buffer+std::strlen(buffer)," -----------------------------------------------------------------------------------\n");
     return std::string(buffer);
-}
\ No newline at end of file
+}
+DistanceGraphCSR::DistanceGraphCSR(const DistanceGraph &dg) : sdg(dg.sdg) {
+    if (dg.links.size() > INT32_MAX) throw std::runtime_error("Too many nodes to create a DistanceGraphCSR");
+    //links[n] only has links with source n or -n, so each node fills its own two slots
+    offsets.assign(2 * dg.links.size() + 1, 0);
+#pragma omp parallel for
+    for (uint64_t n = 0; n < dg.links.size(); ++n) {
+        for (const auto &l: dg.links[n]) ++offsets[slot(l.source) + 1];
+    }
+    for (uint64_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+    links.resize(offsets.back());
+    supports.resize(offsets.back());
+#pragma omp parallel for
+    for (uint64_t n = 0; n < dg.links.size(); ++n) {
+        auto next_fw = offsets[2 * n];
+        auto next_bw = offsets[2 * n + 1];
+        for (const auto &l: dg.links[n]) {
+            auto &i = (l.source < 0 ? next_bw : next_fw);
+            links[i].dest = l.dest;
+            links[i].dist = l.dist;
+            supports[i] = l.support;
+            ++i;
+        }
+    }
+}
+
+void DistanceGraphCSR::thaw(DistanceGraph &dg) const {
+    dg.links.clear();
+    dg.links.resize((offsets.size() - 1) / 2);
+#pragma omp parallel for
+    for (sgNodeID_t n = 0; n < dg.links.size(); ++n) {
+        for (auto end: {n, -n}) {
+            if (end == -n and n == 0) continue;
+            for (auto i = offsets[slot(end)]; i < offsets[slot(end) + 1]; ++i)
+                dg.links[n].emplace_back(end, links[i].dest, links[i].dist, supports[i]);
+        }
+    }
+}
+
+std::vector<std::vector<sgNodeID_t>> DistanceGraphCSR::get_all_lines(uint16_t min_nodes, uint64_t min_total_size) const {
+    return collect_all_lines(sdg, [this](sgNodeID_t n) { return get_fw_links(n); }, min_nodes, min_total_size);
+}
+
+std::vector<SequenceDistanceGraphPath> DistanceGraphCSR::find_all_paths_between(sgNodeID_t from,sgNodeID_t to, int64_t max_size, int max_nodes, bool abort_on_loops) const {
+    return collect_all_paths_between(sdg, [this](sgNodeID_t n) { return get_fw_links(n); }, from, to, max_size, max_nodes, abort_on_loops);
+}
@@ -263,4 +263,91 @@ public:
     std::string name="SDG";
 
 };
+
+/**
+ * @brief A link as stored in a DistanceGraphCSR, its source is the node end the link is listed for.
+ */
+struct CSRLink {
+    int32_t dest;
+    int32_t dist;
+};
+
+/**
+ * @brief Read-only view of a contiguous range of elements (as C++20's std::span), it does not own the elements.
+ */
+template <typename T>
+class ConstSpan {
+public:
+    ConstSpan(const T * _data, uint64_t _count) : data_(_data), count(_count) {};
+    const T * begin() const { return data_; }
+    const T * end() const { return data_ + count; }
+    uint64_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T & operator[](uint64_t i) const { return data_[i]; }
+private:
+    const T * data_;
+    uint64_t count;
+};
+
+/**
+ * @brief Frozen compressed sparse row (CSR) copy of the links of a DistanceGraph.
+ *
+ * The links of each node end are stored contiguously with 32-bit destinations and distances (8 bytes rather than the
+ * 40 of a Link), their Support is kept in a separate array. Lookups return spans into these arrays instead of copying
+ * vectors, so traversals read the links from a few flat arrays.
+ *
+ * The CSR can't be modified: links are changed on a DistanceGraph, which can then be frozen again. thaw() writes the
+ * links back into a DistanceGraph.
+ */
+class DistanceGraphCSR {
+public:
+    explicit DistanceGraphCSR(const DistanceGraph &dg);
+
+    /**
+     * @brief Replaces the links of dg with the links in this CSR
+     */
+    void thaw(DistanceGraph &dg) const;
+
+    /**
+     * @brief Links forward from node n, as DistanceGraph::get_fw_links() but without copying
+     */
+    ConstSpan<CSRLink> get_fw_links(sgNodeID_t n) const {
+        auto s = slot(-n);
+        if (s + 1 >= offsets.size()) return {nullptr, 0};
+        return {links.data() + offsets[s], offsets[s + 1] - offsets[s]};
+    }
+
+    ConstSpan<CSRLink> get_bw_links(sgNodeID_t n) const { return get_fw_links(-n); }
+
+    /**
+     * @param l a link from a span returned by this CSR
+     */
+    const Support & get_support(const CSRLink &l) const { return supports[&l - links.data()]; }
+
+    /**
+     * @brief Recreates the full Link for l, a link from a span returned by get_fw_links(n)
+     */
+    Link get_link(sgNodeID_t n, const CSRLink &l) const { return Link(-n, l.dest, l.dist, get_support(l)); }
+
+    uint64_t link_count() const { return links.size(); }
+
+    /**
+     * @brief Same as DistanceGraph::get_all_lines()
+     */
+    std::vector<std::vector<sgNodeID_t>> get_all_lines(uint16_t min_nodes, uint64_t min_total_size=0) const;
+
+    /**
+     * @brief Same as DistanceGraph::find_all_paths_between()
+     */
+    std::vector<SequenceDistanceGraphPath> find_all_paths_between(sgNodeID_t from,sgNodeID_t to, int64_t max_size, int max_nodes=20, bool abort_on_loops=true) const;
+
+    SequenceDistanceGraph & sdg;
+
+private:
+    static uint64_t slot(sgNodeID_t end) { return 2 * (end > 0 ? end : -end) + (end < 0 ? 1 : 0); }
+
+    std::vector<uint64_t> offsets; //links with source end e are [offsets[slot(e)], offsets[slot(e)+1])
+    std::vector<CSRLink> links;
+    std::vector<Support> supports;
+};
 #endif //BSG_DISTANCEGRAPH_HPP
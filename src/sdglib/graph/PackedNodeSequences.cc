@@ -0,0 +1,237 @@
+#include "PackedNodeSequences.hpp"
+#include <sdglib/utilities/packing_helpers.hpp>
+#include <sdglib/utilities/omp_safe.hpp>
+#include <algorithm>
+#include <cstring>
+
+//Records the runs of seq, which starts at start in the arena
+static void find_runs(const std::string &seq, uint64_t start, std::vector<PackedSequenceRun> &runs) {
+    for (uint64_t p = 0; p < seq.size();) {
+        auto c = seq[p];
+        uint64_t e = p + 1;
+        if (sdglib::base_to_2bit(c) == 4) {
+            while (e < seq.size() and seq[e] == c) ++e;
+            runs.push_back({start + p, e - p, c});
+        } else if (c >= 'a') {
+            while (e < seq.size() and seq[e] >= 'a' and sdglib::base_to_2bit(seq[e]) != 4) ++e;
+            runs.push_back({start + p, e - p, 0});
+        }
+        p = e;
+    }
+}
+
+bool PackedNodeSequences::operator==(const PackedNodeSequences &o) const {
+    if (node_count != o.node_count) return false;
+    for (uint64_t n = 0; n < node_count; ++n)
+        if (node_size(n) != o.node_size(n) or sequence(n) != o.sequence(n)) return false;
+    return true;
+}
+
+char PackedNodeSequences::run_base(uint64_t n, uint64_t g, char b) const {
+    auto rbegin = runs_data() + node_runs[n].first;
+    auto rend = runs_data() + node_runs[n].second;
+    auto r = std::upper_bound(rbegin, rend, PackedSequenceRun{g, 0, 0});
+    if (r == rbegin or (r - 1)->start + (r - 1)->length <= g) return b;
+    --r;
+    return r->base == 0 ? b + ('a' - 'A') : r->base;
+}
+
+void PackedNodeSequences::window(sgNodeID_t n, uint64_t pos, uint64_t len, char *out) const {
+    static const char bases[4] = {'A', 'C', 'G', 'T'};
+    auto an = std::llabs(n);
+    //the window on the forward strand, reversed and complemented at the end for n<0
+    auto first = starts()[an] + (n >= 0 ? pos : sizes()[an] - pos - len);
+    auto packed = packed_bases();
+    for (uint64_t i = 0; i < len; ++i) out[i] = bases[(packed[(first + i) / 4] >> (2 * ((first + i) % 4))) & 3];
+    //runs are sorted by start, skip to the first one ending inside the window
+    auto runs_end = runs_data() + node_runs[an].second;
+    auto r = std::upper_bound(runs_data() + node_runs[an].first, runs_end, PackedSequenceRun{first, 0, 0});
+    if (r != runs_data() + node_runs[an].first and (r - 1)->start + (r - 1)->length > first) --r;
+    for (; r != runs_end and r->start < first + len; ++r) {
+        auto e = std::min(r->start + r->length, first + len);
+        for (auto g = std::max(r->start, first); g < e; ++g)
+            out[g - first] = (r->base == 0 ? out[g - first] + ('a' - 'A') : r->base);
+    }
+    if (n < 0) {
+        std::reverse(out, out + len);
+        for (uint64_t i = 0; i < len; ++i) out[i] = complement(out[i]);
+    }
+}
+
+std::string PackedNodeSequences::sequence(sgNodeID_t n) const {
+    std::string seq(node_size(n), ' ');
+    window(n, 0, seq.size(), &seq[0]);
+    return seq;
+}
+
+uint64_t PackedNodeSequences::hash(sgNodeID_t n) const {
+    n = std::llabs(n);
+    auto start = starts()[n];
+    auto h = XXH64(packed_bases() + start / 4, (sizes()[n] + 3) / 4, sizes()[n]);
+    for (auto r = runs_data() + node_runs[n].first; r != runs_data() + node_runs[n].second; ++r) {
+        uint64_t run[3] = {r->start - start, r->length, (uint64_t) r->base};
+        h = XXH64(run, sizeof(run), h);
+    }
+    return h;
+}
+
+uint64_t PackedNodeSequences::pack_at_end(const std::string &seq) {
+    auto start = packed_size * 4;
+    packed.resize(packed_size + sdglib::packed_2bit_size(seq.size()));
+    sdglib::pack_2bit(seq.data(), seq.size(), packed.data() + packed_size);
+    packed_size = packed.size();
+    find_runs(seq, start, runs);
+    run_count = runs.size();
+    return start;
+}
+
+uint64_t PackedNodeSequences::add(const std::string &seq) {
+    own();
+    auto first_run = runs.size();
+    starts_.emplace_back(pack_at_end(seq));
+    sizes_.emplace_back(seq.size());
+    node_runs.emplace_back(first_run, runs.size());
+    return node_count++;
+}
+
+void PackedNodeSequences::append(const std::vector<std::string> &sequences) {
+    own();
+    auto first = node_count;
+    node_count += sequences.size();
+    starts_.resize(node_count);
+    sizes_.resize(node_count);
+    auto next_start = packed_size * 4;
+    for (uint64_t n = first; n < node_count; ++n) {
+        starts_[n] = next_start;
+        sizes_[n] = sequences[n - first].size();
+        next_start += (sizes_[n] + 3) / 4 * 4;
+    }
+    packed_size = next_start / 4;
+    packed.resize(packed_size);
+    auto first_run = runs.size();
+    //Nodes start on byte boundaries, so they can be packed in parallel
+#pragma omp parallel
+    {
+        std::vector<PackedSequenceRun> local_runs;
+#pragma omp for schedule(dynamic,1000)
+        for (uint64_t n = first; n < node_count; ++n) {
+            const auto &seq = sequences[n - first];
+            sdglib::pack_2bit(seq.data(), seq.size(), packed.data() + starts_[n] / 4);
+            find_runs(seq, starts_[n], local_runs);
+        }
+#pragma omp critical(packed_node_sequences_runs)
+        runs.insert(runs.end(), local_runs.begin(), local_runs.end());
+    }
+    sdglib::sort(runs.begin() + first_run, runs.end());
+    run_count = runs.size();
+    index_runs(first);
+}
+
+void PackedNodeSequences::set(sgNodeID_t n, const std::string &seq) {
+    own();
+    garbage += (sizes_[n] + 3) / 4 * 4;
+    auto first_run = runs.size();
+    starts_[n] = pack_at_end(seq);
+    sizes_[n] = seq.size();
+    node_runs[n] = {first_run, runs.size()};
+    if (garbage > (1 << 20) and garbage > packed_size * 2) compact();
+}
+
+void PackedNodeSequences::resize(uint64_t count) {
+    own();
+    for (auto n = count; n < node_count; ++n) garbage += (sizes_[n] + 3) / 4 * 4;
+    starts_.resize(count, packed_size * 4);
+    sizes_.resize(count, 0);
+    node_runs.resize(count, {runs.size(), runs.size()});
+    node_count = count;
+}
+
+void PackedNodeSequences::clear() {
+    mapping.reset();
+    mapped_starts = mapped_sizes = nullptr;
+    mapped_packed = nullptr;
+    mapped_runs = nullptr;
+    std::vector<uint64_t>().swap(starts_);
+    std::vector<uint64_t>().swap(sizes_);
+    std::vector<uint8_t>().swap(packed);
+    std::vector<PackedSequenceRun>().swap(runs);
+    std::vector<std::pair<uint64_t, uint64_t>>().swap(node_runs);
+    node_count = packed_size = run_count = garbage = 0;
+}
+
+void PackedNodeSequences::index_runs(uint64_t first) {
+    node_runs.resize(node_count);
+    auto rbegin = runs_data();
+    auto rend = runs_data() + run_count;
+#pragma omp parallel for schedule(static,10000)
+    for (uint64_t n = first; n < node_count; ++n) {
+        auto b = std::lower_bound(rbegin, rend, PackedSequenceRun{starts()[n], 0, 0});
+        auto e = std::lower_bound(b, rend, PackedSequenceRun{starts()[n] + sizes()[n], 0, 0});
+        node_runs[n] = {(uint64_t) (b - rbegin), (uint64_t) (e - rbegin)};
+    }
+}
+
+void PackedNodeSequences::own() {
+    if (not mapping) return;
+    starts_.assign(mapped_starts, mapped_starts + node_count);
+    sizes_.assign(mapped_sizes, mapped_sizes + node_count);
+    packed.assign(mapped_packed, mapped_packed + packed_size);
+    runs.assign(mapped_runs, mapped_runs + run_count);
+    mapping.reset();
+    mapped_starts = mapped_sizes = nullptr;
+    mapped_packed = nullptr;
+    mapped_runs = nullptr;
+}
+
+void PackedNodeSequences::compact() {
+    std::vector<uint64_t> new_starts(node_count);
+    uint64_t next_start = 0;
+    for (uint64_t n = 0; n < node_count; ++n) {
+        new_starts[n] = next_start;
+        next_start += (sizes_[n] + 3) / 4 * 4;
+    }
+    std::vector<uint8_t> new_packed(next_start / 4);
+    std::vector<PackedSequenceRun> new_runs;
+    for (uint64_t n = 0; n < node_count; ++n) {
+        std::memcpy(new_packed.data() + new_starts[n] / 4, packed.data() + starts_[n] / 4, (sizes_[n] + 3) / 4);
+        auto first_run = new_runs.size();
+        for (auto r = node_runs[n].first; r < node_runs[n].second; ++r)
+            new_runs.push_back({runs[r].start - starts_[n] + new_starts[n], runs[r].length, runs[r].base});
+        node_runs[n] = {first_run, new_runs.size()};
+    }
+    std::swap(starts_, new_starts);
+    std::swap(packed, new_packed);
+    std::swap(runs, new_runs);
+    packed_size = packed.size();
+    run_count = runs.size();
+    garbage = 0;
+}
+
+void PackedNodeSequences::write(std::ofstream &output_file) const {
+    sdglib::write_aligned_flat_vector(output_file, starts(), node_count);
+    sdglib::write_aligned_flat_vector(output_file, sizes(), node_count);
+    sdglib::write_aligned_flat_vector(output_file, packed_bases(), packed_size);
+    sdglib::write_aligned_flat_vector(output_file, runs_data(), run_count);
+}
+
+void PackedNodeSequences::read(std::ifstream &input_file) {
+    clear();
+    sdglib::read_aligned_flat_vector(input_file, starts_);
+    sdglib::read_aligned_flat_vector(input_file, sizes_);
+    sdglib::read_aligned_flat_vector(input_file, packed);
+    sdglib::read_aligned_flat_vector(input_file, runs);
+    node_count = starts_.size();
+    packed_size = packed.size();
+    run_count = runs.size();
+    index_runs(0);
+}
+
+void PackedNodeSequences::read_mapped(std::ifstream &input_file, const std::shared_ptr<sdglib::MemoryMappedFile> &_mapping) {
+    clear();
+    mapped_starts = sdglib::map_aligned_flat_vector<uint64_t>(input_file, *_mapping, node_count);
+    mapped_sizes = sdglib::map_aligned_flat_vector<uint64_t>(input_file, *_mapping, node_count);
+    mapped_packed = sdglib::map_aligned_flat_vector<uint8_t>(input_file, *_mapping, packed_size);
+    mapped_runs = sdglib::map_aligned_flat_vector<PackedSequenceRun>(input_file, *_mapping, run_count);
+    mapping = _mapping;
+    index_runs(0);
+}
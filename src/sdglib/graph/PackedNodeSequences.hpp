@@ -0,0 +1,193 @@
+#ifndef BSG_PACKEDNODESEQUENCES_HPP
+#define BSG_PACKEDNODESEQUENCES_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdlib>
+#include <sdglib/types/GenericTypes.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+
+/**
+ * @brief A run of bases that can't be recovered from the 2-bit codes alone.
+ * If base is 0 the run is lowercase ACGT, otherwise all its bases are the literal character base (i.e. N).
+ */
+struct PackedSequenceRun {
+    uint64_t start; //offset in the arena
+    uint64_t length;
+    char base;
+
+    bool operator<(const PackedSequenceRun &o) const { return start < o.start; }
+};
+
+/**
+ * @brief Node sequences 2-bit packed in a single contiguous arena, this is how the graph keeps its nodes' sequences.
+ *
+ * Each node starts at a byte boundary of the arena, so nodes are packed and unpacked in parallel. Bases that are not
+ * uppercase ACGT are recorded as runs, so the original sequences are recovered exactly.
+ *
+ * Bases and windows are read in place in either orientation (negative ids read the reverse complement), and k-mers are
+ * rolled straight from the 2-bit codes. Strings are only built by sequence() and window().
+ *
+ * Added or replaced sequences are packed at the end of the arena, the space of replaced ones is reclaimed when it
+ * grows over half of the arena. The arena can be written to a file, and then read back or used in place from a memory
+ * mapping, a mapped arena is copied to memory the first time it is modified. Modifications are not thread safe.
+ */
+class PackedNodeSequences {
+public:
+    PackedNodeSequences() = default;
+
+    explicit PackedNodeSequences(const std::vector<std::string> &sequences) { append(sequences); }
+
+    bool operator==(const PackedNodeSequences &o) const;
+
+    uint64_t size() const { return node_count; }
+
+    uint64_t node_size(sgNodeID_t n) const { return sizes()[std::llabs(n)]; }
+
+    /**
+     * @brief Base at pos of node n, in n's orientation.
+     */
+    char base(sgNodeID_t n, uint64_t pos) const {
+        auto an = std::llabs(n);
+        auto g = starts()[an] + (n >= 0 ? pos : sizes()[an] - 1 - pos);
+        char b = "ACGT"[(packed_bases()[g / 4] >> (2 * (g % 4))) & 3];
+        if (node_runs[an].first != node_runs[an].second) b = run_base(an, g, b);
+        return n >= 0 ? b : complement(b);
+    }
+
+    /**
+     * @brief Writes the len bases of node n starting at pos, in n's orientation, to out (no terminator is added).
+     */
+    void window(sgNodeID_t n, uint64_t pos, uint64_t len, char *out) const;
+
+    /**
+     * @brief Unpacks the sequence of node n, the reverse complement for n<0.
+     */
+    std::string sequence(sgNodeID_t n) const;
+
+    /**
+     * @brief Calls emit(fw, rc, pos) for every k-mer without Ns on the forward strand of node n, fw is the k-mer
+     * starting at pos and rc its reverse complement, both encoded as in KMerFactory::roll_kmers().
+     */
+    template<typename KEY, typename EMITTER>
+    void roll_kmers(sgNodeID_t n, uint8_t k, EMITTER emit) const {
+        n = std::llabs(n);
+        const KEY mask = (2 * k >= 8 * sizeof(KEY)) ? ~((KEY) 0) : (((KEY) 1) << (2 * k)) - 1;
+        const auto first_offset = 2 * (k - 1);
+        const auto start = starts()[n];
+        const auto size = sizes()[n];
+        const auto bases = packed_bases();
+        //only literal runs (Ns) break k-mers, lowercase runs have the same codes
+        auto r = runs_data() + node_runs[n].first;
+        const auto rend = runs_data() + node_runs[n].second;
+        while (r != rend and r->base == 0) ++r;
+        KEY fw = 0, rc = 0;
+        uint64_t valid = 0;
+        for (uint64_t p = 0; p < size; ++p) {
+            auto g = start + p;
+            if (r != rend and g == r->start) {
+                p += r->length - 1;
+                valid = 0;
+                do ++r; while (r != rend and r->base == 0);
+                continue;
+            }
+            KEY c = (bases[g / 4] >> (2 * (g % 4))) & 3;
+            fw = ((fw << 2) | c) & mask;
+            rc = (rc >> 2) | ((3 - c) << first_offset);
+            if (++valid >= k) emit(fw, rc, p + 1 - k);
+        }
+    }
+
+    /**
+     * @brief Hash of the sequence of node n, equal for equal sequences wherever they are in the arena.
+     */
+    uint64_t hash(sgNodeID_t n) const;
+
+    /**
+     * @brief Adds a sequence as a new node at the end, returns its index.
+     */
+    uint64_t add(const std::string &seq);
+
+    /**
+     * @brief Adds the sequences as new nodes at the end, packing them in parallel.
+     */
+    void append(const std::vector<std::string> &sequences);
+
+    /**
+     * @brief Replaces the sequence of node n (n>=0).
+     */
+    void set(sgNodeID_t n, const std::string &seq);
+
+    /**
+     * @brief Keeps the first count nodes, or adds empty ones up to count.
+     */
+    void resize(uint64_t count);
+
+    void clear();
+
+    uint64_t size_in_bytes() const {
+        return node_count * (2 * sizeof(uint64_t) + sizeof(node_runs[0])) + packed_size + run_count * sizeof(PackedSequenceRun);
+    }
+
+    void write(std::ofstream &output_file) const;
+
+    void read(std::ifstream &input_file);
+
+    /**
+     * @brief Uses the arena in place from a mapping of the same file, input_file must be positioned as for read().
+     */
+    void read_mapped(std::ifstream &input_file, const std::shared_ptr<sdglib::MemoryMappedFile> &_mapping);
+
+    static char complement(char b) {
+        switch (b) {
+            case 'A': return 'T';
+            case 'C': return 'G';
+            case 'G': return 'C';
+            case 'T': return 'A';
+            case 'a': return 't';
+            case 'c': return 'g';
+            case 'g': return 'c';
+            case 't': return 'a';
+            default: return b;
+        }
+    }
+
+private:
+    const uint64_t * starts() const { return mapped_starts != nullptr ? mapped_starts : starts_.data(); }
+    const uint64_t * sizes() const { return mapped_sizes != nullptr ? mapped_sizes : sizes_.data(); }
+    const uint8_t * packed_bases() const { return mapped_packed != nullptr ? mapped_packed : packed.data(); }
+    const PackedSequenceRun * runs_data() const { return mapped_runs != nullptr ? mapped_runs : runs.data(); }
+
+    char run_base(uint64_t n, uint64_t g, char b) const;
+
+    //packs seq at the end of the arena and records its runs, returns its start
+    uint64_t pack_at_end(const std::string &seq);
+
+    //finds the runs of nodes from first on
+    void index_runs(uint64_t first);
+
+    //copies a mapped arena to memory before it is modified
+    void own();
+
+    void compact();
+
+    uint64_t node_count = 0;
+    uint64_t packed_size = 0;
+    uint64_t run_count = 0;
+    uint64_t garbage = 0; //bases of replaced sequences still in the arena
+    std::vector<uint64_t> starts_; //first base of each node in the arena, always a multiple of 4
+    std::vector<uint64_t> sizes_;
+    std::vector<uint8_t> packed;
+    std::vector<PackedSequenceRun> runs;
+    std::vector<std::pair<uint64_t, uint64_t>> node_runs; //[first,end) of each node's runs, not stored on disk
+
+    std::shared_ptr<sdglib::MemoryMappedFile> mapping;
+    const uint64_t *mapped_starts = nullptr;
+    const uint64_t *mapped_sizes = nullptr;
+    const uint8_t *mapped_packed = nullptr;
+    const PackedSequenceRun *mapped_runs = nullptr;
+};
+
+#endif //BSG_PACKEDNODESEQUENCES_HPP
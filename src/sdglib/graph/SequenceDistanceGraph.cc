@@ -15,11 +15,12 @@
 #include <tuple>
 #include <functional>
 #include <sdglib/utilities/io_helpers.hpp>
+#include <sdglib/graph/PackedNodeSequences.hpp>
 
-bool Node::is_canonical() {
-    for (size_t i=0,j=sequence.size()-1;i<j;++i,--j){
-        char f=sequence[i];
-        char r=sequence[j];
+bool SequenceDistanceGraph::is_canonical(const std::string &seq) {
+    for (size_t i=0,j=seq.size()-1;i<j;++i,--j){
+        char f=seq[i];
+        char r=seq[j];
         switch(r){
             case 'A':
                 r='T';
@@ -44,56 +45,12 @@ bool Node::is_canonical() {
     return true;
 };
 
-void Node::make_rc() {
-    std::string rseq;
-    rseq.resize(sequence.size());
-    for (size_t i=0,j=sequence.size()-1;i<sequence.size();++i,--j){
-        switch(sequence[j]){
-            case 'A':
-                rseq[i]='T';
-                break;
-            case 'C':
-                rseq[i]='G';
-                break;
-            case 'G':
-                rseq[i]='C';
-                break;
-            case 'T':
-                rseq[i]='A';
-                break;
-        }
-    }
-    std::swap(sequence,rseq);
-};
-
-std::string SequenceDistanceGraph::get_node_sequence(sgNodeID_t n) const {
-    if (n>0) return nodes[n].sequence;
-    n=-n;
-    std::string rseq;
-    rseq.resize(nodes[n].sequence.size());
-    for (size_t i=0,j=nodes[n].sequence.size()-1;i<nodes[n].sequence.size();++i,--j){
-        switch(nodes[n].sequence[j]){
-            case 'A':
-                rseq[i]='T';
-                break;
-            case 'C':
-                rseq[i]='G';
-                break;
-            case 'G':
-                rseq[i]='C';
-                break;
-            case 'T':
-                rseq[i]='A';
-                break;
-        }
-    }
+static std::string reverse_complement(const std::string &seq) {
+    std::string rseq(seq.rbegin(),seq.rend());
+    for (auto &b:rseq) b=PackedNodeSequences::complement(b);
     return rseq;
 }
 
-uint64_t SequenceDistanceGraph::get_node_size (sgNodeID_t n) const {
-    return nodes[llabs(n)].sequence.size();
-}
-
 bool SequenceDistanceGraph::is_sane() const {
     for (auto n=0;n<nodes.size();++n){
         for (auto l:links[n]){
@@ -110,18 +67,22 @@ bool SequenceDistanceGraph::is_sane() const {
     return true;
 }
 
-sgNodeID_t SequenceDistanceGraph::add_node(Node n) {
-    nodes.emplace_back(n);
+sgNodeID_t SequenceDistanceGraph::add_node(const std::string &seq, NodeStatus status) {
+    nodes.emplace_back(status);
+    node_sequences.add(seq);
     links.emplace_back();
     return (sgNodeID_t) nodes.size()-1;
 }
 
+void SequenceDistanceGraph::add_nodes(const std::vector<std::string> &seqs) {
+    nodes.resize(nodes.size()+seqs.size());
+    node_sequences.append(seqs);
+    links.resize(links.size()+seqs.size());
+}
+
 sgNodeID_t SequenceDistanceGraph::add_node(std::string seq) {
-    nodes.emplace_back(seq);
-    links.emplace_back();
-    if (nodes.back().is_canonical()) return (sgNodeID_t) nodes.size()-1;
-    nodes.back().make_rc();
-    return (sgNodeID_t) -( nodes.size()-1);
+    if (is_canonical(seq)) return add_node(seq,NodeStatus::Active);
+    return -add_node(reverse_complement(seq),NodeStatus::Active);
 }
 
 void SequenceDistanceGraph::remove_node(sgNodeID_t n) {
@@ -130,7 +91,7 @@ void SequenceDistanceGraph::remove_node(sgNodeID_t n) {
     for (auto &l:oldlinks) remove_link(l.source,l.dest);
     nodes[node].status=NodeStatus::Deleted;
     //TODO: this is a lazy solution
-    nodes[node].sequence.clear();
+    node_sequences.set(node,"");
     //TODO: remove read mappings
 }
 
@@ -142,6 +103,15 @@ size_t SequenceDistanceGraph::count_active_nodes() const {
     return t;
 }
 
+uint64_t SequenceDistanceGraph::content_hash() const {
+    std::vector<uint64_t> node_hashes(nodes.size());
+#pragma omp parallel for schedule(dynamic,1000)
+    for (sgNodeID_t n = 0; n < nodes.size(); ++n) {
+        node_hashes[n] = node_sequences.hash(n) * 31 + n;
+    }
+    return XXH64(node_hashes.data(), node_hashes.size() * sizeof(uint64_t), nodes.size());
+}
+
 bool Link::operator==(const Link a) const {
     if (a.source == source && a.dest == dest){
         return true;
@@ -205,39 +175,89 @@ void SequenceDistanceGraph::write(std::ofstream & output_file) {
 
     output_file.write((char *) &count,sizeof(count));
     sdglib::write_string(output_file, name);
-    for (auto &n:nodes){
-        output_file.write((char *) &n.status,sizeof(n.status));
-        count=n.sequence.size();
-        output_file.write((char *) &count,sizeof(count));
-        output_file.write((char *) n.sequence.data(),count);
-    }
+    std::vector<NodeStatus> status(nodes.size());
+    for (auto i=0;i<nodes.size();++i) status[i]=nodes[i].status;
+    sdglib::write_flat_vector(output_file, status);
+    node_sequences.write(output_file);
 
     sdglib::write_flat_vectorvector(output_file, links);
 }
 
-void SequenceDistanceGraph::read(std::ifstream & input_file) {
+void SequenceDistanceGraph::read(std::ifstream & input_file, sdgVersion_t version,
+                                 const std::shared_ptr<sdglib::MemoryMappedFile> &mapping) {
     uint64_t count;
     input_file.read((char *) &count,sizeof(count));
     sdglib::read_string(input_file, name);
     nodes.clear();
-    nodes.reserve(count);
-    uint64_t active=0;
-    for (auto i=0;i<count;++i){
-        uint64_t seqsize;
-        std::string seq;
-        NodeStatus status;
-        input_file.read((char *) &status,sizeof(status));
-        input_file.read((char *) &seqsize,sizeof(seqsize));
-        seq.resize(seqsize);
-        input_file.read((char *) seq.data(),seqsize);
-        nodes.emplace_back(seq);
-        nodes.back().status=status;
-        if (nodes.back().status==NodeStatus::Active) ++active;
+    node_sequences.clear();
+    if (version<0x0004) {
+        nodes.reserve(count);
+        std::vector<std::string> seqs(count);
+        for (auto i=0;i<count;++i){
+            uint64_t seqsize;
+            NodeStatus status;
+            input_file.read((char *) &status,sizeof(status));
+            input_file.read((char *) &seqsize,sizeof(seqsize));
+            seqs[i].resize(seqsize);
+            input_file.read((char *) seqs[i].data(),seqsize);
+            nodes.emplace_back(status);
+        }
+        node_sequences.append(seqs);
+    }
+    else {
+        std::vector<NodeStatus> status;
+        sdglib::read_flat_vector(input_file, status);
+        //a mapped arena is used in place, sequences are never unpacked on load
+        if (mapping) node_sequences.read_mapped(input_file, mapping);
+        else node_sequences.read(input_file);
+        if (status.size()!=count or node_sequences.size()!=count) throw std::runtime_error("Inconsistent node count reading graph "+name);
+        nodes.resize(count);
+        for (uint64_t i=0;i<count;++i) nodes[i].status=status[i];
     }
 
     sdglib::read_flat_vectorvector(input_file, links);
 }
 
+void SequenceDistanceGraph::write_delta(std::ofstream & output_file, const std::vector<uint64_t> &changed_nodes,
+                                        const std::vector<uint64_t> &changed_links) const {
+    uint64_t count=nodes.size();
+    output_file.write((char *) &count,sizeof(count));
+    sdglib::write_string(output_file, name);
+    sdglib::write_flat_vector(output_file, changed_nodes);
+    for (auto n:changed_nodes) {
+        output_file.write((char *) &nodes[n].status,sizeof(nodes[n].status));
+        sdglib::write_string(output_file, get_node_sequence(n));
+    }
+    count=links.size();
+    output_file.write((char *) &count,sizeof(count));
+    sdglib::write_flat_vector(output_file, changed_links);
+    for (auto n:changed_links) sdglib::write_flat_vector(output_file, links[n]);
+}
+
+void SequenceDistanceGraph::read_delta(std::ifstream & input_file) {
+    uint64_t count;
+    std::vector<uint64_t> changed;
+    input_file.read((char *) &count,sizeof(count));
+    sdglib::read_string(input_file, name);
+    nodes.resize(count);
+    node_sequences.resize(count);
+    sdglib::read_flat_vector(input_file, changed);
+    std::string seq;
+    for (auto n:changed) {
+        if (n>=nodes.size()) throw std::runtime_error("Graph delta has a node beyond the graph's end");
+        input_file.read((char *) &nodes[n].status,sizeof(nodes[n].status));
+        sdglib::read_string(input_file, seq);
+        node_sequences.set(n, seq);
+    }
+    input_file.read((char *) &count,sizeof(count));
+    links.resize(count);
+    sdglib::read_flat_vector(input_file, changed);
+    for (auto n:changed) {
+        if (n>=links.size()) throw std::runtime_error("Graph delta has links beyond the graph's end");
+        sdglib::read_flat_vector(input_file, links[n]);
+    }
+}
+
 std::string SequenceDistanceGraph::ls(int level, bool recursive) const {
     std::stringstream ss;
     std::string spacer(2 * level, ' ');
@@ -302,8 +322,9 @@ void SequenceDistanceGraph::load_from_bcalm(std::string filename,uint16_t k) {
     if (bcalmf.peek() == std::ifstream::traits_type::eof()) throw std::invalid_argument("Empty bcalm file");
     //sdglib::OutputLog()<<"Loading graph from bcalm, loading sequences..."<<std::endl;
     nodes.clear();
+    node_sequences.clear();
     links.clear();
-    add_node(Node("",NodeStatus::Deleted)); //an empty deleted node on 0, just to skip the space
+    add_node("",NodeStatus::Deleted); //an empty deleted node on 0, just to skip the space
 
     //First pass, insert the sequences
     std::vector<sgNodeID_t> node_ids;
@@ -364,8 +385,9 @@ void SequenceDistanceGraph::load_from_fasta(std::string filename) {
     oldnames_to_ids.clear();
     oldnames.push_back("");
     nodes.clear();
+    node_sequences.clear();
     links.clear();
-    add_node(Node("",NodeStatus::Deleted)); //an empty deleted node on 0, just to skip the space
+    add_node("",NodeStatus::Deleted); //an empty deleted node on 0, just to skip the space
     uint64_t rcnodes=0;
     while(!fastaf.eof()){
         std::getline(fastaf,line);
@@ -375,7 +397,7 @@ void SequenceDistanceGraph::load_from_fasta(std::string filename) {
                 //rough ansi C and C++ mix but it works
                 if (oldnames_to_ids.find(name) != oldnames_to_ids.end())
                     throw std::logic_error("sequence " + name + " is already defined");
-                oldnames_to_ids[name] = add_node(Node(seq));
+                oldnames_to_ids[name] = add_node(seq,NodeStatus::Active);
                 oldnames.push_back(name);
             }
 
@@ -456,7 +478,7 @@ void SequenceDistanceGraph::join_path(SequenceDistanceGraphPath p, bool consume_
     }
 
     if (!p.is_canonical()) p.reverse();
-    sgNodeID_t new_node=add_node(Node(p.sequence()));
+    sgNodeID_t new_node=add_node(p.sequence(),NodeStatus::Active);
     //TODO:check, this may have a problem with a circle
     for (auto l:get_bw_links(p.nodes.front())) add_link(new_node,l.dest,l.dist);
     for (auto l:get_fw_links(p.nodes.back())) add_link(-new_node,l.dest,l.dist);
@@ -505,7 +527,7 @@ void SequenceDistanceGraph::expand_node(sgNodeID_t nodeID, std::vector<std::vect
 
     //Create all extra copies of the node.
     for (auto in=0;in<new_links.size();++in){
-        auto new_node=add_node(Node(nodes[llabs(nodeID)].sequence));
+        auto new_node=add_node(get_node_sequence(llabs(nodeID)),NodeStatus::Active);
         for (auto l:new_links[in]) {
             add_link((l.source>0 ? new_node:-new_node),l.dest,l.dist);
         }
@@ -576,14 +598,14 @@ void SequenceDistanceGraph::print_bubbly_subgraph_stats(const std::vector<Sequen
     for (const auto &bp:bubbly_paths){
         total_size+=bp.total_size();
         SequenceDistanceGraphPath p1(*this),p2(*this);
-        original_sizes.push_back(nodes[llabs(bp.nodes.front())].sequence.size());
-        original_sizes.push_back(nodes[llabs(bp.nodes.back())].sequence.size());
-        solved_sizes.push_back(nodes[llabs(bp.nodes.front())].sequence.size());
+        original_sizes.push_back(get_node_size(bp.nodes.front()));
+        original_sizes.push_back(get_node_size(bp.nodes.back()));
+        solved_sizes.push_back(get_node_size(bp.nodes.front()));
         total_solved_size+=solved_sizes.back();
-        solved_sizes.push_back(nodes[llabs(bp.nodes.back())].sequence.size());
+        solved_sizes.push_back(get_node_size(bp.nodes.back()));
         total_solved_size+=solved_sizes.back();
         for (auto i=1; i<bp.nodes.size()-1; ++i){
-            original_sizes.push_back(nodes[llabs(bp.nodes[i])].sequence.size());
+            original_sizes.push_back(get_node_size(bp.nodes[i]));
             if (i%3==0){
                 p1.nodes.push_back(bp.nodes[i]);
                 p2.nodes.push_back(bp.nodes[i]);
@@ -628,10 +650,10 @@ void SequenceDistanceGraph::print_status() {
     auto &log_no_date=sdglib::OutputLog(sdglib::LogLevels::INFO,false);
     std::vector<uint64_t> node_sizes;
     uint64_t total_size=0;
-    for (auto n:nodes) {
-        if (n.status!=NodeStatus::Deleted) {
-            total_size += n.sequence.size();
-            node_sizes.push_back(n.sequence.size());
+    for (sgNodeID_t n=0;n<nodes.size();++n) {
+        if (nodes[n].status!=NodeStatus::Deleted) {
+            total_size += get_node_size(n);
+            node_sizes.push_back(get_node_size(n));
         }
     }
     std::sort(node_sizes.rbegin(),node_sizes.rend());
@@ -663,8 +685,9 @@ void SequenceDistanceGraph::load_from_gfa1(std::ifstream &gfaf, std::ifstream &f
     oldnames_to_ids.clear();
     oldnames.push_back("");
     nodes.clear();
+    node_sequences.clear();
     links.clear();
-    add_node(Node("",NodeStatus::Deleted)); //an empty deleted node on 0, just to skip the space
+    add_node("",NodeStatus::Deleted); //an empty deleted node on 0, just to skip the space
     sgNodeID_t nextid=1;
     uint64_t rcnodes=0;
     while(!fastaf.eof()){
@@ -675,14 +698,10 @@ void SequenceDistanceGraph::load_from_gfa1(std::ifstream &gfaf, std::ifstream &f
                 //rough ansi C and C++ mix but it works
                 if (oldnames_to_ids.find(name) != oldnames_to_ids.end())
                     throw std::logic_error("sequence " + name + " is already defined");
-                oldnames_to_ids[name] = add_node(Node(seq));
+                oldnames_to_ids[name] = add_node(seq);
                 oldnames.push_back(name);
-                //reverse seq if not canonical
-                if (!nodes.back().is_canonical()) {
-                    nodes.back().make_rc();
-                    oldnames_to_ids[name] = -oldnames_to_ids[name];
-                    ++rcnodes;
-                }
+                //the sequence was reversed if not canonical
+                if (oldnames_to_ids[name]<0) ++rcnodes;
             }
 
             // Clear the name and set name to the new name, this is a new sequence!
@@ -722,11 +741,11 @@ void SequenceDistanceGraph::load_from_gfa1(std::ifstream &gfaf, std::ifstream &f
                 // Check equal length seq and node length reported in gfa
                 if (oldnames_to_ids.find(gfa_source) != oldnames_to_ids.end()) {
                     if (std::stoi(gfa_length.substr(5)) !=
-                        nodes[std::abs(oldnames_to_ids[gfa_source])].sequence.length()) {
+                        get_node_size(oldnames_to_ids[gfa_source])) {
                         throw std::logic_error(
                                 "Different length in node and fasta for sequence: " + gfa_source + " -> gfa:" +
                                 gfa_length.substr(5) + ", fasta: " +
-                                std::to_string(nodes[oldnames_to_ids[gfa_source]].sequence.length()));
+                                std::to_string(get_node_size(oldnames_to_ids[gfa_source])));
                     }
                 }
             }
@@ -751,11 +770,11 @@ void SequenceDistanceGraph::load_from_gfa1(std::ifstream &gfaf, std::ifstream &f
             //std::cout<<"'"<<source<<"' '"<<gfa_sourcedir<<"' '"<<dest<<"' '"<<destdir<<"'"<<std::endl;
             if (gap_dist.find(gap_id) == gap_dist.end()) {
                 if (oldnames_to_ids.find(gfa_source) == oldnames_to_ids.end()) {
-                    oldnames_to_ids[gfa_source] = add_node(Node(""));
+                    oldnames_to_ids[gfa_source] = add_node("",NodeStatus::Active);
                     //std::cout<<"added source!" <<source<<std::endl;
                 }
                 if (oldnames_to_ids.find(gfa_dest) == oldnames_to_ids.end()) {
-                    oldnames_to_ids[gfa_dest] = add_node(Node(""));
+                    oldnames_to_ids[gfa_dest] = add_node("",NodeStatus::Active);
                     //std::cout<<"added dest! "<<dest<<std::endl;
                 }
             }
@@ -808,8 +827,9 @@ void SequenceDistanceGraph::load_from_gfa2(std::ifstream &gfaf, std::ifstream &f
     oldnames_to_ids.clear();
     oldnames.push_back("");
     nodes.clear();
+    node_sequences.clear();
     links.clear();
-    add_node(Node("",NodeStatus::Deleted)); //an empty deleted node on 0, just to skip the space
+    add_node("",NodeStatus::Deleted); //an empty deleted node on 0, just to skip the space
     sgNodeID_t nextid=1;
     uint64_t rcnodes=0;
     while(!fastaf.eof()){
@@ -820,14 +840,10 @@ void SequenceDistanceGraph::load_from_gfa2(std::ifstream &gfaf, std::ifstream &f
                 //rough ansi C and C++ mix but it works
                 if (oldnames_to_ids.find(name) != oldnames_to_ids.end())
                     throw std::logic_error("sequence " + name + " is already defined");
-                oldnames_to_ids[name] = add_node(Node(seq));
+                oldnames_to_ids[name] = add_node(seq);
                 oldnames.push_back(name);
-                //reverse seq if not canonical
-                if (!nodes.back().is_canonical()) {
-                    nodes.back().make_rc();
-                    oldnames_to_ids[name] = -oldnames_to_ids[name];
-                    ++rcnodes;
-                }
+                //the sequence was reversed if not canonical
+                if (oldnames_to_ids[name]<0) ++rcnodes;
             }
 
             // Clear the name and set name to the new name, this is a new sequence!
@@ -862,11 +878,11 @@ void SequenceDistanceGraph::load_from_gfa2(std::ifstream &gfaf, std::ifstream &f
             /*
             if (oldnames_to_ids.find(gfa_source) != oldnames_to_ids.end()) {
                 if (std::stoi(gfa_length.substr(5)) !=
-                    nodes[std::abs(oldnames_to_ids[gfa_source])].sequence.length()) {
+                    get_node_size(oldnames_to_ids[gfa_source])) {
                     throw std::logic_error(
                             "Different length in node and fasta for sequence: " + gfa_source + " -> gfa:" +
                             gfa_length.substr(5) + ", fasta: " +
-                            std::to_string(nodes[oldnames_to_ids[gfa_source]].sequence.length()));
+                            std::to_string(get_node_size(oldnames_to_ids[gfa_source])));
                 }
             }*/
 
@@ -888,11 +904,11 @@ void SequenceDistanceGraph::load_from_gfa2(std::ifstream &gfaf, std::ifstream &f
 
             //std::cout<<"'"<<source<<"' '"<<gfa_sourcedir<<"' '"<<dest<<"' '"<<destdir<<"'"<<std::endl;
             if (oldnames_to_ids.find(gfa_source) == oldnames_to_ids.end()) {
-                oldnames_to_ids[gfa_source] = add_node(Node(""));
+                oldnames_to_ids[gfa_source] = add_node("",NodeStatus::Active);
                 //std::cout<<"added source!" <<source<<std::endl;
             }
             if (oldnames_to_ids.find(gfa_dest) == oldnames_to_ids.end()) {
-                oldnames_to_ids[gfa_dest] = add_node(Node(""));
+                oldnames_to_ids[gfa_dest] = add_node("",NodeStatus::Active);
                 //std::cout<<"added dest! "<<dest<<std::endl;
             }
 
@@ -918,11 +934,11 @@ void SequenceDistanceGraph::load_from_gfa2(std::ifstream &gfaf, std::ifstream &f
 
             //std::cout<<"'"<<source<<"' '"<<gfa_sourcedir<<"' '"<<dest<<"' '"<<destdir<<"'"<<std::endl;
             if (oldnames_to_ids.find(gfa_source) == oldnames_to_ids.end()) {
-                oldnames_to_ids[gfa_source] = add_node(Node(""));
+                oldnames_to_ids[gfa_source] = add_node("",NodeStatus::Active);
                 //std::cout<<"added source!" <<source<<std::endl;
             }
             if (oldnames_to_ids.find(gfa_dest) == oldnames_to_ids.end()) {
-                oldnames_to_ids[gfa_dest] = add_node(Node(""));
+                oldnames_to_ids[gfa_dest] = add_node("",NodeStatus::Active);
                 //std::cout<<"added dest! "<<dest<<std::endl;
             }
 
@@ -15,6 +15,10 @@
 #include <iosfwd>
 #include <sdglib/indexers/UniqueKmerIndex.hpp>
 #include "DistanceGraph.hpp"
+#include <sdglib/Version.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+#include <sdglib/graph/PackedNodeSequences.hpp>
+#include <memory>
 
 class SequenceDistanceGraphPath;
 class SequenceSubGraph;
@@ -29,12 +33,12 @@ class SequenceDistanceGraph : public DistanceGraph {
 public:
 
     explicit SequenceDistanceGraph(WorkSpace & _ws):nodes(0),DistanceGraph(*this,"SDG"),ws(_ws) { //sdg gets initialised through LDG
-        add_node(Node("",NodeStatus::Deleted)); //an empty deleted node on 0, just to skip the space
+        add_node("",NodeStatus::Deleted); //an empty deleted node on 0, just to skip the space
     };
     SequenceDistanceGraph(const SequenceDistanceGraph &sg) = delete; // Avoid implicit generation of the copy constructor.
 
     bool operator==(const SequenceDistanceGraph &o) const {
-        return (nodes == o.nodes and links==o.links);
+        return (nodes == o.nodes and node_sequences == o.node_sequences and links==o.links);
     }
 
     friend std::ostream& operator<<(std::ostream &os, const SequenceDistanceGraph& sdg);
@@ -57,23 +61,50 @@ public:
     void load_from_fasta(std::string filename);
     //TODO: move to DistanceGraph
 
+    /**
+     * @brief Writes nodes and links, node sequences are written 2-bit packed (see PackedNodeSequences)
+     */
     void write(std::ofstream & output_file);
-    void read(std::ifstream & input_file);
+
+    /**
+     * @param version version of the file being read, files before 0x0004 have plain node sequences
+     * @param mapping if given, a mapping of the same file, node sequences are unpacked from it rather than read
+     */
+    void read(std::ifstream & input_file, sdgVersion_t version=SDG_VN,
+              const std::shared_ptr<sdglib::MemoryMappedFile> &mapping=nullptr);
+
+    /**
+     * @brief Writes the current node count, and the nodes and link vectors at the given indexes, as a delta that
+     * read_delta() applies on top of an older version of the graph
+     */
+    void write_delta(std::ofstream & output_file, const std::vector<uint64_t> &changed_nodes, const std::vector<uint64_t> &changed_links) const;
+
+    void read_delta(std::ifstream & input_file);
 
     //=== read operations ===
 
-    std::string get_node_sequence (sgNodeID_t n) const;
-    uint64_t get_node_size (sgNodeID_t n) const;
+    /**
+     * @brief Unpacks the sequence of node n, the reverse complement for n<0. Use node_sequences to read bases, windows
+     * or k-mers in place.
+     */
+    std::string get_node_sequence (sgNodeID_t n) const { return node_sequences.sequence(n); }
+    uint64_t get_node_size (sgNodeID_t n) const { return node_sequences.node_size(n); }
 
 
     //=== graph operations ===
     /**
-     * Adds a new node to the graph
-     * @param n Node object to add
+     * Adds a new node to the graph with seq as given (it is not made canonical)
+     * @param seq Sequence of the node
+     * @param status Status of the node
      * @return
      * Returns the ID of the added node
      */
-    sgNodeID_t add_node(Node n);
+    sgNodeID_t add_node(const std::string &seq, NodeStatus status);
+
+    /**
+     * Adds the sequences as new nodes (as given), packing them in parallel
+     */
+    void add_nodes(const std::vector<std::string> &seqs);
 
     /**
      * Adds a new node to the graph from a string
@@ -83,6 +114,12 @@ public:
      */
     sgNodeID_t add_node(std::string seq);
 
+    /**
+     * @brief Whether seq is not greater than its reverse complement (compared up to its middle), add_node() flips
+     * sequences that are not canonical.
+     */
+    static bool is_canonical(const std::string &seq);
+
 
     /**
      * Graph sanity check, makes sure the graph abides to the expected structure
@@ -155,11 +192,18 @@ public:
 
     size_t count_active_nodes() const;
 
+    /**
+     * @brief Hash of all node sequences, in node order.
+     * Indexes built from the graph's sequences store it to detect when they are stale.
+     */
+    uint64_t content_hash() const;
+
     void print_status();
 
     //=== internal variables ===
 
     std::vector<Node> nodes={};    /// Contains the actual nodes from the graph, nodes are generally accesed using its IDs on to this structure.
+    PackedNodeSequences node_sequences; /// The nodes' sequences, by ID, 2-bit packed.
     std::string filename,fasta_filename;    /// Name of the files containing the graph and the fasta.
     std::vector<std::string> oldnames;      /// Mapping structure IDs to input names
     std::unordered_map<std::string,sgNodeID_t> oldnames_to_ids; /// Mapping structure from input names -> IDs
@@ -31,14 +31,7 @@ std::string SequenceDistanceGraphPath::sequence() const {
     sgNodeID_t pnode = 0;
     // just iterate over every node in path - contig names are converted to ids at construction
     for (auto &n:nodes) {
-        std::string nseq;
-        if (n>0){
-            nseq = sg.nodes[n].sequence;
-        } else {
-            auto rcn = sg.nodes[-n];
-            rcn.make_rc();
-            nseq = rcn.sequence;
-        }
+        std::string nseq = sg.get_node_sequence(n);
         if (pnode !=0){
             //find link between pnode' output (+pnode) and n's sink (-n)
             auto l=sg.links[(pnode>0 ? pnode:-pnode)].begin();
@@ -123,7 +116,7 @@ size_t SequenceDistanceGraphPath::get_sequence_size_fast() const{
     // just iterate over every node in path - contig names are converted to ids at construction
     for (auto &n:nodes) {
         std::string nseq;
-        size+=sg.nodes[llabs(n)].sequence.size();
+        size+=sg.get_node_size(llabs(n));
         if (pnode !=0){
             //find link between pnode' output (+pnode) and n's sink (-n)
             auto l=sg.links[llabs(pnode)].begin();
@@ -33,8 +33,8 @@ void SequenceSubGraph::write_to_gfa(std::string filename) {
     }
 
     for (const auto &n:nodes_in_links){
-        fastaf<<">"<<sg.oldnames[n]<<std::endl<<sg.nodes[std::abs(n)].sequence<<std::endl;
-        gfaf<<"S\t"<<sg.oldnames[n]<<"\t*\tLN:i:"<<sg.nodes[std::abs(n)].sequence.length()<<"\tUR:Z:"<<fasta_filename<<std::endl;
+        fastaf<<">"<<sg.oldnames[n]<<std::endl<<sg.get_node_sequence(std::abs(n))<<std::endl;
+        gfaf<<"S\t"<<sg.oldnames[n]<<"\t*\tLN:i:"<<sg.get_node_size(std::abs(n))<<"\tUR:Z:"<<fasta_filename<<std::endl;
     }
 
     for (const auto &n:nodes) {
@@ -51,6 +51,6 @@ void SequenceSubGraph::write_to_gfa(std::string filename) {
 
 uint64_t SequenceSubGraph::total_size() const {
     uint64_t t=0;
-    for (auto &n:nodes) t+=sg.nodes[llabs(n)].sequence.size();
+    for (auto &n:nodes) t+=sg.get_node_size(llabs(n));
     return t;
 }
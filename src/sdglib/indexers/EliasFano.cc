@@ -0,0 +1,94 @@
+#include "EliasFano.hpp"
+#include <stdexcept>
+#include <sdglib/utilities/io_helpers.hpp>
+
+EliasFano::EliasFano(const std::vector<uint64_t> &values, uint64_t _universe) : count(values.size()), universe(_universe) {
+    if (universe == 0) universe = 1;
+    low_bits = (count > 0 and universe / count > 1) ? 63 - __builtin_clzll(universe / count) : 0;
+    uint64_t buckets = ((universe - 1) >> low_bits) + 1;
+    lower.resize((count * low_bits + 63) / 64 + 1, 0);
+    upper.resize((count + buckets + 63) / 64 + 1, 0);
+
+    uint64_t last = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        auto v = values[i];
+        if (v < last or v >= universe) throw std::runtime_error("EliasFano values must be non-decreasing and smaller than the universe");
+        last = v;
+        if (low_bits > 0) {
+            uint64_t low = v & ((1ULL << low_bits) - 1);
+            uint64_t bit = i * low_bits;
+            lower[bit / 64] |= low << (bit % 64);
+            if (bit % 64 + low_bits > 64) lower[bit / 64 + 1] |= low >> (64 - bit % 64);
+        }
+        uint64_t pos = (v >> low_bits) + i;
+        upper[pos / 64] |= 1ULL << (pos % 64);
+    }
+
+    //Samples for select: every sample_rate-th one, and every sample_rate-th zero (one zero closes each bucket)
+    uint64_t ones = 0, zeros = 0;
+    for (uint64_t pos = 0; pos < count + buckets; ++pos) {
+        if ((upper[pos / 64] >> (pos % 64)) & 1) {
+            if (ones % sample_rate == 0) select1_samples.push_back(pos);
+            ++ones;
+        } else {
+            if (zeros % sample_rate == 0) select0_samples.push_back(pos);
+            ++zeros;
+        }
+    }
+}
+
+uint64_t EliasFano::select(uint64_t i, bool ones) const {
+    const auto &samples = ones ? select1_samples : select0_samples;
+    uint64_t pos = samples[i / sample_rate];
+    uint64_t remaining = i % sample_rate;
+    uint64_t w = pos / 64;
+    uint64_t word = (ones ? upper[w] : ~upper[w]) & (~0ULL << (pos % 64));
+    while (true) {
+        uint64_t c = __builtin_popcountll(word);
+        if (remaining < c) {
+            for (; remaining > 0; --remaining) word &= word - 1;
+            return w * 64 + __builtin_ctzll(word);
+        }
+        remaining -= c;
+        ++w;
+        word = ones ? upper[w] : ~upper[w];
+    }
+}
+
+bool EliasFano::find(uint64_t value, uint64_t &index) const {
+    if (count == 0 or value >= universe) return false;
+    uint64_t high = value >> low_bits;
+    uint64_t low = low_bits == 0 ? 0 : value & ((1ULL << low_bits) - 1);
+    //Values with this high part sit between the zeros closing the previous bucket and this one
+    uint64_t i = high == 0 ? 0 : select(high - 1, false) - (high - 1);
+    uint64_t end = select(high, false) - high;
+    for (; i < end; ++i) {
+        auto l = get_low(i);
+        if (l == low) {
+            index = i;
+            return true;
+        }
+        if (l > low) return false;
+    }
+    return false;
+}
+
+void EliasFano::write(std::ofstream &output_file) const {
+    output_file.write((const char *) &count, sizeof(count));
+    output_file.write((const char *) &universe, sizeof(universe));
+    output_file.write((const char *) &low_bits, sizeof(low_bits));
+    sdglib::write_flat_vector(output_file, lower);
+    sdglib::write_flat_vector(output_file, upper);
+    sdglib::write_flat_vector(output_file, select1_samples);
+    sdglib::write_flat_vector(output_file, select0_samples);
+}
+
+void EliasFano::read(std::ifstream &input_file) {
+    input_file.read((char *) &count, sizeof(count));
+    input_file.read((char *) &universe, sizeof(universe));
+    input_file.read((char *) &low_bits, sizeof(low_bits));
+    sdglib::read_flat_vector(input_file, lower);
+    sdglib::read_flat_vector(input_file, upper);
+    sdglib::read_flat_vector(input_file, select1_samples);
+    sdglib::read_flat_vector(input_file, select0_samples);
+}
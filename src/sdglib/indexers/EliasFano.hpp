@@ -0,0 +1,66 @@
+#ifndef BSG_ELIASFANO_HPP
+#define BSG_ELIASFANO_HPP
+
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+/**
+ * @brief Elias-Fano encoding of a non-decreasing sequence of integers in [0, universe).
+ *
+ * Each value is split into low bits, stored packed, and high bits, stored in unary in a bitvector. This takes
+ * 2 + log2(universe/n) bits per value. Sampled select positions give constant time access to the i-th value
+ * and to the run of values sharing the high bits of a query, so find() only scans a couple of values on average.
+ */
+class EliasFano {
+public:
+    EliasFano() = default;
+
+    /**
+     * @param values non-decreasing values, all smaller than universe
+     */
+    EliasFano(const std::vector<uint64_t> &values, uint64_t universe);
+
+    uint64_t size() const { return count; }
+
+    uint64_t operator[](uint64_t i) const { return ((select(i, true) - i) << low_bits) | get_low(i); }
+
+    /**
+     * @brief Looks for value, if found sets index to the position of its first occurrence
+     */
+    bool find(uint64_t value, uint64_t &index) const;
+
+    uint64_t size_in_bytes() const {
+        return 8 * (lower.size() + upper.size() + select1_samples.size() + select0_samples.size());
+    }
+
+    void write(std::ofstream &output_file) const;
+    void read(std::ifstream &input_file);
+
+private:
+    static const uint64_t sample_rate = 256;
+
+    uint64_t get_low(uint64_t i) const {
+        if (low_bits == 0) return 0;
+        uint64_t bit = i * low_bits;
+        uint64_t w = bit / 64, shift = bit % 64;
+        uint64_t v = lower[w] >> shift;
+        if (shift + low_bits > 64) v |= lower[w + 1] << (64 - shift);
+        return v & ((1ULL << low_bits) - 1);
+    }
+
+    /**
+     * @brief position in upper of the i-th (0-based) set bit if ones, or unset bit otherwise
+     */
+    uint64_t select(uint64_t i, bool ones) const;
+
+    uint64_t count = 0;
+    uint64_t universe = 0;
+    uint8_t low_bits = 0;
+    std::vector<uint64_t> lower;
+    std::vector<uint64_t> upper;
+    std::vector<uint64_t> select1_samples; //position of every sample_rate-th set bit in upper
+    std::vector<uint64_t> select0_samples; //position of every sample_rate-th unset bit in upper
+};
+
+#endif //BSG_ELIASFANO_HPP
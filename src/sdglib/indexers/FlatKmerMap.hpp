@@ -0,0 +1,175 @@
+#ifndef BSG_FLATKMERMAP_HPP
+#define BSG_FLATKMERMAP_HPP
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <sdglib/utilities/omp_safe.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+
+/**
+ * @brief Key/value pair stored in a FlatKmerMap slot, with unordered_map-like member names.
+ */
+template <typename KT, typename VT>
+struct FlatKmerEntry {
+    KT first;
+    VT second;
+};
+
+/**
+ * @brief Open-addressing (linear probing) k-mer map with keys and values stored together in a flat table.
+ *
+ * The map is built once from a set of unique keys and is read-only afterwards. Lookups touch one or two cache lines
+ * instead of following bucket pointers. The table can be written to a file and then either read back or used
+ * directly from a read-only memory mapping.
+ *
+ * Keys are 2-bit encoded k-mers, so the all-ones key can never appear and marks empty slots.
+ */
+template <typename KT, typename VT>
+class FlatKmerMap {
+public:
+    using value_type = FlatKmerEntry<KT, VT>;
+    using const_iterator = const value_type *;
+
+    static KT empty_key() { return ~((KT) 0); }
+
+    FlatKmerMap() = default;
+
+    /**
+     * @brief Builds the table in parallel from (key, value) pairs, keys must be unique.
+     * @param load_factor maximum fraction of occupied slots, the capacity is the next power of 2 that satisfies it
+     */
+    template <typename PT>
+    void build(const std::vector<PT> &kvs, double load_factor = 0.7) {
+        mapping.reset();
+        mapped_table = nullptr;
+        capacity = 2;
+        while (capacity * load_factor < kvs.size()) capacity *= 2;
+        count = kvs.size();
+        table.clear();
+        table.resize(capacity, value_type{empty_key(), VT()});
+
+        //Order the entries by home slot, so each thread can fill its own section of the table
+        std::vector<std::pair<uint64_t, uint64_t>> homes(kvs.size());
+#pragma omp parallel for
+        for (uint64_t i = 0; i < kvs.size(); ++i) homes[i] = {slot_of(kvs[i].first), i};
+        sdglib::sort(homes.begin(), homes.end());
+
+        std::vector<uint64_t> spilled;
+#pragma omp parallel
+        {
+            uint64_t threads = omp_get_num_threads();
+            uint64_t t = omp_get_thread_num();
+            uint64_t slot_begin = capacity * t / threads;
+            uint64_t slot_end = capacity * (t + 1) / threads;
+            auto hi = std::lower_bound(homes.begin(), homes.end(), std::make_pair(slot_begin, (uint64_t) 0));
+            std::vector<uint64_t> local_spilled;
+            uint64_t next_free = slot_begin;
+            for (; hi != homes.end() and hi->first < slot_end; ++hi) {
+                if (next_free < hi->first) next_free = hi->first;
+                if (next_free < slot_end) {
+                    table[next_free].first = kvs[hi->second].first;
+                    table[next_free].second = kvs[hi->second].second;
+                    ++next_free;
+                }
+                else local_spilled.push_back(hi->second);
+            }
+#pragma omp critical(flatkmermap_spilled)
+            spilled.insert(spilled.end(), local_spilled.begin(), local_spilled.end());
+        }
+        //Entries that ran past the end of their thread's section are probed into place from their home slot
+        for (auto i: spilled) {
+            auto s = slot_of(kvs[i].first);
+            while (table[s].first != empty_key()) s = (s + 1) & (capacity - 1);
+            table[s].first = kvs[i].first;
+            table[s].second = kvs[i].second;
+        }
+    }
+
+    const_iterator find(const KT key) const {
+        auto t = data();
+        if (t == nullptr) return end();
+        auto s = slot_of(key);
+        while (true) {
+            if (t[s].first == key) return t + s;
+            if (t[s].first == empty_key()) return end();
+            s = (s + 1) & (capacity - 1);
+        }
+    }
+
+    const_iterator end() const { return data() + capacity; }
+
+    const_iterator cend() const { return end(); }
+
+    uint64_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    uint64_t get_capacity() const { return capacity; }
+
+    /**
+     * @brief Writes the table so it can be read back or used from a mapping.
+     */
+    void write(std::ofstream &output_file) const {
+        output_file.write((const char *) &count, sizeof(count));
+        uint64_t entry_size = sizeof(value_type);
+        output_file.write((const char *) &entry_size, sizeof(entry_size));
+        sdglib::write_aligned_flat_vector(output_file, data(), capacity);
+    }
+
+    void read(std::ifstream &input_file) {
+        mapping.reset();
+        mapped_table = nullptr;
+        read_header(input_file);
+        sdglib::read_aligned_flat_vector(input_file, table);
+        capacity = table.size();
+    }
+
+    /**
+     * @brief Uses the table in place from a mapping of the same file, input_file must be positioned as for read().
+     * The mapping is shared and kept open while the map (or any copy of it) exists.
+     */
+    void read_mapped(std::ifstream &input_file, const std::shared_ptr<sdglib::MemoryMappedFile> &_mapping) {
+        std::vector<value_type>().swap(table);
+        read_header(input_file);
+        mapped_table = sdglib::map_aligned_flat_vector<value_type>(input_file, *_mapping, capacity);
+        mapping = _mapping;
+    }
+
+private:
+    static uint64_t mix(uint64_t x) {
+        //murmur3 64-bit finalizer
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t mix(__uint128_t x) {
+        return mix((uint64_t) x ^ mix((uint64_t) (x >> 64)));
+    }
+
+    uint64_t slot_of(const KT key) const { return mix(key) & (capacity - 1); }
+
+    const value_type *data() const { return mapped_table != nullptr ? mapped_table : table.data(); }
+
+    void read_header(std::ifstream &input_file) {
+        uint64_t entry_size;
+        input_file.read((char *) &count, sizeof(count));
+        input_file.read((char *) &entry_size, sizeof(entry_size));
+        if (entry_size != sizeof(value_type)) throw std::runtime_error("Incompatible k-mer table entry size");
+    }
+
+    uint64_t capacity = 0;
+    uint64_t count = 0;
+    std::vector<value_type> table;
+    std::shared_ptr<sdglib::MemoryMappedFile> mapping;
+    const value_type *mapped_table = nullptr;
+};
+
+#endif //BSG_FLATKMERMAP_HPP
@@ -0,0 +1,38 @@
+#include "IndexCache.hpp"
+#include <sdglib/workspace/WorkSpace.hpp>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+
+std::string sdglib::index_cache_path(const SequenceDistanceGraph &sg, const std::string &index_name) {
+    const auto &dir = sg.ws.index_cache_dir;
+    if (dir.empty()) return "";
+    if (mkdir(dir.c_str(), 0755) != 0 and errno != EEXIST) {
+        sdglib::OutputLog(sdglib::LogLevels::WARN) << "Can't create index cache directory " << dir << ": " << std::strerror(errno) << std::endl;
+        return "";
+    }
+    return dir + "/" + index_name;
+}
+
+void sdglib::write_index_header(std::ofstream &ofs, SDG_FILETYPE type, uint64_t graph_hash) {
+    ofs.write((const char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
+    ofs.write((const char *) &SDG_VN, sizeof(SDG_VN));
+    ofs.write((const char *) &type, sizeof(type));
+    ofs.write((const char *) &graph_hash, sizeof(graph_hash));
+}
+
+uint64_t sdglib::read_index_header(std::ifstream &ifs, SDG_FILETYPE type, const std::string &filename) {
+    if (!ifs) throw std::runtime_error("Could not open " + filename);
+    sdgMagic_t magic;
+    sdgVersion_t version;
+    SDG_FILETYPE file_type;
+    uint64_t graph_hash;
+    ifs.read((char *) &magic, sizeof(magic));
+    ifs.read((char *) &version, sizeof(version));
+    ifs.read((char *) &file_type, sizeof(file_type));
+    ifs.read((char *) &graph_hash, sizeof(graph_hash));
+    if (!ifs or magic != SDG_MAGIC) throw std::runtime_error(filename + " appears to be corrupted");
+    if (version < SDG_VN) throw std::runtime_error("Incompatible version");
+    if (file_type != type) throw std::runtime_error("Incompatible file type");
+    return graph_hash;
+}
@@ -0,0 +1,65 @@
+#ifndef BSG_INDEXCACHE_HPP
+#define BSG_INDEXCACHE_HPP
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+#include <sdglib/Version.hpp>
+#include <sdglib/utilities/OutputLog.hpp>
+
+class SequenceDistanceGraph;
+
+namespace sdglib {
+
+    /**
+     * @brief Path for index_name in the graph's WorkSpace index_cache_dir, creating the directory if needed.
+     * Returns an empty string if the WorkSpace has no index_cache_dir, i.e. caching is disabled.
+     */
+    std::string index_cache_path(const SequenceDistanceGraph &sg, const std::string &index_name);
+
+    void write_index_header(std::ofstream &ofs, SDG_FILETYPE type, uint64_t graph_hash);
+
+    /**
+     * @brief Checks the magic number, version and type of an index file and returns the graph hash it was built on.
+     */
+    uint64_t read_index_header(std::ifstream &ifs, SDG_FILETYPE type, const std::string &filename);
+
+    /**
+     * @brief Returns load(path) if path holds an index built on a graph with graph_hash, otherwise returns build(),
+     * writing it to path first. If path is empty build() is returned without caching.
+     */
+    template<class IDX, typename LoadFn, typename BuildFn>
+    std::shared_ptr<IDX> load_or_build_cached_index(const std::string &path, uint64_t graph_hash, LoadFn load, BuildFn build) {
+        if (path.empty()) return build();
+        if (std::ifstream(path).good()) {
+            try {
+                auto index = load(path);
+                if (index->get_graph_hash() == graph_hash) {
+                    sdglib::OutputLog() << "Index loaded from " << path << std::endl;
+                    return index;
+                }
+                sdglib::OutputLog() << "Index at " << path << " is stale, rebuilding" << std::endl;
+            } catch (std::exception &e) {
+                sdglib::OutputLog(sdglib::LogLevels::WARN) << "Can't load index from " << path << " (" << e.what() << "), rebuilding" << std::endl;
+            }
+        }
+        auto index = build();
+        //Written to a temporary file of this process and renamed, so other processes never see a partial index.
+        //Failing to save only loses the cache, the index is still used.
+        auto tmp_path = path + ".tmp" + std::to_string(getpid());
+        try {
+            index->write(tmp_path);
+            if (std::rename(tmp_path.c_str(), path.c_str()) != 0) throw std::runtime_error("can't rename " + tmp_path);
+        } catch (std::exception &e) {
+            sdglib::OutputLog(sdglib::LogLevels::WARN) << "Can't save index to " << path << " (" << e.what() << ")" << std::endl;
+            std::remove(tmp_path.c_str());
+        }
+        return index;
+    }
+
+}
+
+#endif //BSG_INDEXCACHE_HPP
@@ -4,6 +4,7 @@
 
 #include "NKmerIndex.hpp"
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
+#include <sdglib/indexers/IndexCache.hpp>
 
 uint64_t filter_kmers(std::vector<kmerPos> &kmers, int max_kmer_repeat) {
     uint64_t total_kmers(0);
@@ -49,11 +50,12 @@ uint64_t filter_kmers(std::vector<kmerPos128> &kmers, int max_kmer_repeat) {
     return total_kmers;
 }
 
-NKmerIndex::NKmerIndex(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit) : k(k), bfilter(70*1024*1024), sg(_sg){
+NKmerIndex::NKmerIndex(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit, double bloom_fp_rate, bool prefix_buckets) : k(k), sg(_sg){
+    graph_hash = sg.content_hash();
     uint64_t total_length=0;
 #pragma omp parallel for reduction(+:total_length)
     for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-        total_length+=sg.nodes[n].sequence.size();
+        total_length+=sg.get_node_size(n);
     }
     assembly_kmers.reserve(total_length);
 #pragma omp parallel
@@ -65,9 +67,9 @@ NKmerIndex::NKmerIndex(const SequenceDistanceGraph &_sg, uint8_t k, int filter_l
         contig_kmers.reserve(10000000);
 #pragma omp for
         for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-            if (sg.nodes[n].sequence.size() >= k) {
+            if (sg.get_node_size(n) >= k) {
                 contig_kmers.clear();
-                skf.create_kmers(sg.nodes[n].sequence, contig_kmers);
+                skf.create_kmers(sg.node_sequences, n, contig_kmers);
                 int k_i(0);
                 for (const auto &kmer:contig_kmers) {
                     local_kmers.emplace_back(kmer.second, n, kmer.first ? k_i + 1 : -(k_i + 1));
@@ -95,10 +97,63 @@ NKmerIndex::NKmerIndex(const SequenceDistanceGraph &_sg, uint8_t k, int filter_l
 
     sdglib::sort(assembly_kmers.begin(),assembly_kmers.end(), kmerPos::byKmerContigOffset());
     auto total_kmers(filter_kmers(assembly_kmers, filter_limit));
+    bfilter = BloomFilter(total_kmers, bloom_fp_rate);
 #pragma omp parallel for
     for (uint64_t kidx = 0; kidx < assembly_kmers.size(); ++kidx) {
-        bfilter.add(assembly_kmers[kidx].kmer);
+        if (kidx == 0 or assembly_kmers[kidx].kmer != assembly_kmers[kidx - 1].kmer) bfilter.add(assembly_kmers[kidx].kmer);
     }
+    if (prefix_buckets) {
+        //Around 4 distinct k-mers per bucket, capped to keep the directory at 4^12 entries
+        prefix_bases = 1;
+        while (prefix_bases < k and prefix_bases < 12 and (1ULL << (2 * (prefix_bases + 1))) * 4 <= total_kmers) ++prefix_bases;
+        build_prefix_buckets();
+    }
+}
+
+NKmerIndex::NKmerIndex(const SequenceDistanceGraph &_sg, const std::string &filename) : sg(_sg) {
+    std::ifstream input_file(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(input_file, NKI_FT, filename);
+    input_file.read((char *) &k, sizeof(k));
+    input_file.read((char *) &prefix_bases, sizeof(prefix_bases));
+    mapping = std::make_shared<sdglib::MemoryMappedFile>(filename);
+    bfilter.read_mapped(input_file, mapping);
+    mapped_kmers = sdglib::map_aligned_flat_vector<kmerPos>(input_file, *mapping, mapped_kmer_count);
+    uint64_t offsets_count;
+    mapped_prefix_offsets = sdglib::map_aligned_flat_vector<uint64_t>(input_file, *mapping, offsets_count);
+    if (prefix_bases > 0 and offsets_count != (1ULL << (2 * prefix_bases)) + 1) throw std::runtime_error(filename + " has a corrupted prefix directory");
+    if (mapped_kmer_count == 0) mapped_kmers = nullptr;
+}
+
+std::shared_ptr<NKmerIndex> NKmerIndex::load_or_build(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit, double bloom_fp_rate, bool prefix_buckets) {
+    std::string name = "nkmerindex_k" + std::to_string(k) + "_f" + std::to_string(filter_limit) + "_fp" +
+                       std::to_string((int) std::round(bloom_fp_rate * 10000)) + (prefix_buckets ? "_pb" : "") + ".idx";
+    return sdglib::load_or_build_cached_index<NKmerIndex>(sdglib::index_cache_path(_sg, name), _sg.content_hash(),
+            [&](const std::string &filename) { return std::make_shared<NKmerIndex>(_sg, filename); },
+            [&]() { return std::make_shared<NKmerIndex>(_sg, k, filter_limit, bloom_fp_rate, prefix_buckets); });
+}
+
+void NKmerIndex::write(const std::string &filename) const {
+    std::ofstream output_file(filename, std::ios_base::binary);
+    if (!output_file) throw std::runtime_error("Could not open " + filename);
+    sdglib::write_index_header(output_file, NKI_FT, graph_hash);
+    output_file.write((const char *) &k, sizeof(k));
+    output_file.write((const char *) &prefix_bases, sizeof(prefix_bases));
+    bfilter.write(output_file);
+    sdglib::write_aligned_flat_vector(output_file, kmers(), kmer_count());
+    sdglib::write_aligned_flat_vector(output_file, offsets(), prefix_bases == 0 ? 0 : (1ULL << (2 * prefix_bases)) + 1);
+    output_file.close();
+    if (!output_file) throw std::runtime_error("Error writing " + filename);
+}
+
+void NKmerIndex::build_prefix_buckets() {
+    uint64_t buckets = 1ULL << (2 * prefix_bases);
+    auto shift = 2 * (k - prefix_bases);
+    prefix_offsets.resize(buckets + 1);
+#pragma omp parallel for
+    for (uint64_t p = 0; p < buckets; ++p) {
+        prefix_offsets[p] = std::lower_bound(assembly_kmers.cbegin(), assembly_kmers.cend(), ((uint64_t) p) << shift) - assembly_kmers.cbegin();
+    }
+    prefix_offsets[buckets] = assembly_kmers.size();
 }
 
 void NKmerIndex::get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
@@ -107,23 +162,24 @@ void NKmerIndex::get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t,
     for (auto i = 0; i < seq_kmers.size(); ++i) {
         matches[i].clear();
         auto first = find(seq_kmers[i].second);
-        for (auto it = first; it != assembly_kmers.end() && it->kmer == seq_kmers[i].second; ++it) {
+        for (auto it = first; it != end() && it->kmer == seq_kmers[i].second; ++it) {
             int32_t offset = it->offset; //so far, this is +1 and the sign indicates direction of kmer in contig
             sgNodeID_t node = it->contigID; //so far, this is always positive
             if (seq_kmers[i].first != (offset > 0)) { //match is on reverse
                 node = -node;
-                offset = ((int) sg.nodes[std::llabs(it->contigID)].sequence.size()) - std::abs(offset);
+                offset = ((int) sg.get_node_size(std::llabs(it->contigID))) - std::abs(offset);
             } else offset = std::abs(offset) - 1;
             matches[i].emplace_back(node, offset);
         }
     }
 }
 
-NKmerIndex128::NKmerIndex128(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit) : k(k), bfilter(70*1024*1024), sg(_sg){
+NKmerIndex128::NKmerIndex128(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit, double bloom_fp_rate, bool prefix_buckets) : k(k), sg(_sg){
+    graph_hash = sg.content_hash();
     uint64_t total_length=0;
 #pragma omp parallel for reduction(+:total_length)
     for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-        total_length+=sg.nodes[n].sequence.size();
+        total_length+=sg.get_node_size(n);
     }
     assembly_kmers.reserve(total_length);
 #pragma omp parallel
@@ -135,9 +191,9 @@ NKmerIndex128::NKmerIndex128(const SequenceDistanceGraph &_sg, uint8_t k, int fi
         contig_kmers.reserve(10000000);
 #pragma omp for
         for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-            if (sg.nodes[n].sequence.size() >= k) {
+            if (sg.get_node_size(n) >= k) {
                 contig_kmers.clear();
-                skf.create_kmers(sg.nodes[n].sequence, contig_kmers);
+                skf.create_kmers(sg.node_sequences, n, contig_kmers);
                 int k_i(0);
                 for (const auto &kmer:contig_kmers) {
                     local_kmers.emplace_back(kmer.second, n, kmer.first ? k_i + 1 : -(k_i + 1));
@@ -165,10 +221,63 @@ NKmerIndex128::NKmerIndex128(const SequenceDistanceGraph &_sg, uint8_t k, int fi
 
     sdglib::sort(assembly_kmers.begin(),assembly_kmers.end(), kmerPos128::byKmerContigOffset());
     auto total_kmers(filter_kmers(assembly_kmers, filter_limit));
+    bfilter = BloomFilter(total_kmers, bloom_fp_rate);
 #pragma omp parallel for
     for (uint64_t kidx = 0; kidx < assembly_kmers.size(); ++kidx) {
-        bfilter.add(assembly_kmers[kidx].kmer);
+        if (kidx == 0 or assembly_kmers[kidx].kmer != assembly_kmers[kidx - 1].kmer) bfilter.add(assembly_kmers[kidx].kmer);
+    }
+    if (prefix_buckets) {
+        //Around 4 distinct k-mers per bucket, capped to keep the directory at 4^12 entries
+        prefix_bases = 1;
+        while (prefix_bases < k and prefix_bases < 12 and (1ULL << (2 * (prefix_bases + 1))) * 4 <= total_kmers) ++prefix_bases;
+        build_prefix_buckets();
+    }
+}
+
+NKmerIndex128::NKmerIndex128(const SequenceDistanceGraph &_sg, const std::string &filename) : sg(_sg) {
+    std::ifstream input_file(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(input_file, NKI128_FT, filename);
+    input_file.read((char *) &k, sizeof(k));
+    input_file.read((char *) &prefix_bases, sizeof(prefix_bases));
+    mapping = std::make_shared<sdglib::MemoryMappedFile>(filename);
+    bfilter.read_mapped(input_file, mapping);
+    mapped_kmers = sdglib::map_aligned_flat_vector<kmerPos128>(input_file, *mapping, mapped_kmer_count);
+    uint64_t offsets_count;
+    mapped_prefix_offsets = sdglib::map_aligned_flat_vector<uint64_t>(input_file, *mapping, offsets_count);
+    if (prefix_bases > 0 and offsets_count != (1ULL << (2 * prefix_bases)) + 1) throw std::runtime_error(filename + " has a corrupted prefix directory");
+    if (mapped_kmer_count == 0) mapped_kmers = nullptr;
+}
+
+std::shared_ptr<NKmerIndex128> NKmerIndex128::load_or_build(const SequenceDistanceGraph &_sg, uint8_t k, int filter_limit, double bloom_fp_rate, bool prefix_buckets) {
+    std::string name = "nkmerindex128_k" + std::to_string(k) + "_f" + std::to_string(filter_limit) + "_fp" +
+                       std::to_string((int) std::round(bloom_fp_rate * 10000)) + (prefix_buckets ? "_pb" : "") + ".idx";
+    return sdglib::load_or_build_cached_index<NKmerIndex128>(sdglib::index_cache_path(_sg, name), _sg.content_hash(),
+            [&](const std::string &filename) { return std::make_shared<NKmerIndex128>(_sg, filename); },
+            [&]() { return std::make_shared<NKmerIndex128>(_sg, k, filter_limit, bloom_fp_rate, prefix_buckets); });
+}
+
+void NKmerIndex128::write(const std::string &filename) const {
+    std::ofstream output_file(filename, std::ios_base::binary);
+    if (!output_file) throw std::runtime_error("Could not open " + filename);
+    sdglib::write_index_header(output_file, NKI128_FT, graph_hash);
+    output_file.write((const char *) &k, sizeof(k));
+    output_file.write((const char *) &prefix_bases, sizeof(prefix_bases));
+    bfilter.write(output_file);
+    sdglib::write_aligned_flat_vector(output_file, kmers(), kmer_count());
+    sdglib::write_aligned_flat_vector(output_file, offsets(), prefix_bases == 0 ? 0 : (1ULL << (2 * prefix_bases)) + 1);
+    output_file.close();
+    if (!output_file) throw std::runtime_error("Error writing " + filename);
+}
+
+void NKmerIndex128::build_prefix_buckets() {
+    uint64_t buckets = 1ULL << (2 * prefix_bases);
+    auto shift = 2 * (k - prefix_bases);
+    prefix_offsets.resize(buckets + 1);
+#pragma omp parallel for
+    for (uint64_t p = 0; p < buckets; ++p) {
+        prefix_offsets[p] = std::lower_bound(assembly_kmers.cbegin(), assembly_kmers.cend(), ((__uint128_t) p) << shift) - assembly_kmers.cbegin();
     }
+    prefix_offsets[buckets] = assembly_kmers.size();
 }
 
 void NKmerIndex128::get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
@@ -177,12 +286,12 @@ void NKmerIndex128::get_all_kmer_matches(std::vector<std::vector<std::pair<int32
     for (auto i = 0; i < seq_kmers.size(); ++i) {
         matches[i].clear();
         auto first = find(seq_kmers[i].second);
-        for (auto it = first; it != assembly_kmers.end() && it->kmer == seq_kmers[i].second; ++it) {
+        for (auto it = first; it != end() && it->kmer == seq_kmers[i].second; ++it) {
             int32_t offset = it->offset; //so far, this is +1 and the sign indicates direction of kmer in contig
             sgNodeID_t node = it->contigID; //so far, this is always positive
             if (seq_kmers[i].first != (offset > 0)) { //match is on reverse
                 node = -node;
-                offset = ((int) sg.nodes[std::llabs(it->contigID)].sequence.size()) - std::abs(offset);
+                offset = ((int) sg.get_node_size(std::llabs(it->contigID))) - std::abs(offset);
             } else offset = std::abs(offset) - 1;
             matches[i].emplace_back(node, offset);
         }
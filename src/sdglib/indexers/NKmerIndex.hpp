@@ -5,38 +5,94 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <sdglib/utilities/omp_safe.hpp>
 #include <sdglib/types/KmerTypes.hpp>
 #include <sdglib/factories/KMerFactory.hpp>
 #include <sdglib/utilities/OutputLog.hpp>
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
 #include <sdglib/bloom/BloomFilter.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
 
 class SequenceDistanceGraph;
 
 class NKmerIndex {
     BloomFilter bfilter;
     std::vector<kmerPos> assembly_kmers;
+    std::vector<uint64_t> prefix_offsets; //prefix_offsets[p] is the first k-mer with prefix p, only used with prefix buckets
+    uint8_t prefix_bases=0;
     uint8_t k=0;
+    uint64_t graph_hash=0;
     const SequenceDistanceGraph &sg;
+
+    //Indexes loaded from disk use the k-mers and offsets in place from the file's mapping
+    std::shared_ptr<sdglib::MemoryMappedFile> mapping;
+    const kmerPos *mapped_kmers=nullptr;
+    uint64_t mapped_kmer_count=0;
+    const uint64_t *mapped_prefix_offsets=nullptr;
+
+    const kmerPos *kmers() const { return mapped_kmers != nullptr ? mapped_kmers : assembly_kmers.data(); }
+    uint64_t kmer_count() const { return mapped_kmers != nullptr ? mapped_kmer_count : assembly_kmers.size(); }
+    const uint64_t *offsets() const { return mapped_prefix_offsets != nullptr ? mapped_prefix_offsets : prefix_offsets.data(); }
+
+    void build_prefix_buckets();
 public:
-    using const_iterator = std::vector<kmerPos>::const_iterator;
+    using const_iterator = const kmerPos *;
+
+    /**
+     * @brief Indexes all k-mers in the graph's nodes appearing less than filter_limit times
+     * @param bloom_fp_rate target false positive rate for the bloom filter used before lookups, sized on the distinct k-mers
+     * @param prefix_buckets if true, find() only searches the k-mers sharing the query's prefix, using an offsets directory
+     */
+    explicit NKmerIndex(const SequenceDistanceGraph &_sg,uint8_t k=15, int filter_limit = 200, double bloom_fp_rate = 0.01, bool prefix_buckets = false);
+
+    /**
+     * @brief Opens an index saved with write(), memory mapping its contents
+     */
+    NKmerIndex(const SequenceDistanceGraph &_sg, const std::string &filename);
+
+    /**
+     * @brief Loads the index from the workspace's index cache if it was built with the same parameters on the current
+     * graph sequences, otherwise builds it and saves it in the cache. Without a cache directory it just builds the index.
+     */
+    static std::shared_ptr<NKmerIndex> load_or_build(const SequenceDistanceGraph &_sg, uint8_t k=15, int filter_limit = 200, double bloom_fp_rate = 0.01, bool prefix_buckets = false);
 
-    explicit NKmerIndex(const SequenceDistanceGraph &_sg,uint8_t k=15, int filter_limit = 200);
+    void write(const std::string &filename) const;
 
-    bool empty() const { return assembly_kmers.empty(); }
-    const_iterator begin() const {return assembly_kmers.cbegin();}
-    const_iterator end() const {return assembly_kmers.cend();}
+    /**
+     * @brief SequenceDistanceGraph::content_hash() of the graph the index was built on
+     */
+    uint64_t get_graph_hash() const { return graph_hash; }
+
+    uint8_t get_k() const { return k; }
+
+    bool empty() const { return kmer_count() == 0; }
+    const_iterator begin() const {return kmers();}
+    const_iterator end() const {return kmers() + kmer_count();}
 
     bool filter(const uint64_t kmer) const {
         return bfilter.contains(kmer);
     }
 
+    /**
+     * @brief Batched filter(), in_filter[i] is set to filter(kmers[i].second)
+     */
+    void filter(const std::vector<std::pair<bool, uint64_t>> &kmers, std::vector<bool> &in_filter) const {
+        bfilter.contains(kmers, in_filter);
+    }
+
     const_iterator find(const uint64_t kmer) const {
-        if (bfilter.contains(kmer)) { return std::lower_bound(assembly_kmers.cbegin(), assembly_kmers.cend(), kmer); }
-        return assembly_kmers.cend();
+        if (not bfilter.contains(kmer)) return end();
+        if (prefix_bases == 0) return std::lower_bound(begin(), end(), kmer);
+        uint64_t p = kmer >> (2 * (k - prefix_bases));
+        return std::lower_bound(begin() + offsets()[p], begin() + offsets()[p + 1], kmer);
     }
 
+    /**
+     * @brief Number of bases used for the prefix buckets, 0 if find() binary-searches the whole index
+     */
+    uint8_t get_prefix_bases() const { return prefix_bases; }
+
     void get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t, int32_t>>> & matches, std::vector<std::pair<bool, uint64_t>> & seq_kmers);
 
 };
@@ -45,26 +101,80 @@ public:
 class NKmerIndex128 {
     BloomFilter bfilter;
     std::vector<kmerPos128> assembly_kmers;
+    std::vector<uint64_t> prefix_offsets; //prefix_offsets[p] is the first k-mer with prefix p, only used with prefix buckets
+    uint8_t prefix_bases=0;
     uint8_t k=0;
+    uint64_t graph_hash=0;
     const SequenceDistanceGraph &sg;
+
+    //Indexes loaded from disk use the k-mers and offsets in place from the file's mapping
+    std::shared_ptr<sdglib::MemoryMappedFile> mapping;
+    const kmerPos128 *mapped_kmers=nullptr;
+    uint64_t mapped_kmer_count=0;
+    const uint64_t *mapped_prefix_offsets=nullptr;
+
+    const kmerPos128 *kmers() const { return mapped_kmers != nullptr ? mapped_kmers : assembly_kmers.data(); }
+    uint64_t kmer_count() const { return mapped_kmers != nullptr ? mapped_kmer_count : assembly_kmers.size(); }
+    const uint64_t *offsets() const { return mapped_prefix_offsets != nullptr ? mapped_prefix_offsets : prefix_offsets.data(); }
+
+    void build_prefix_buckets();
 public:
-    using const_iterator = std::vector<kmerPos128>::const_iterator;
+    using const_iterator = const kmerPos128 *;
+
+    /**
+     * @brief Indexes all k-mers in the graph's nodes appearing less than filter_limit times
+     * @param bloom_fp_rate target false positive rate for the bloom filter used before lookups, sized on the distinct k-mers
+     * @param prefix_buckets if true, find() only searches the k-mers sharing the query's prefix, using an offsets directory
+     */
+    explicit NKmerIndex128(const SequenceDistanceGraph &_sg,uint8_t k=63, int filter_limit = 200, double bloom_fp_rate = 0.01, bool prefix_buckets = false);
+
+    /**
+     * @brief Opens an index saved with write(), memory mapping its contents
+     */
+    NKmerIndex128(const SequenceDistanceGraph &_sg, const std::string &filename);
+
+    /**
+     * @brief Loads the index from the workspace's index cache if it was built with the same parameters on the current
+     * graph sequences, otherwise builds it and saves it in the cache. Without a cache directory it just builds the index.
+     */
+    static std::shared_ptr<NKmerIndex128> load_or_build(const SequenceDistanceGraph &_sg, uint8_t k=63, int filter_limit = 200, double bloom_fp_rate = 0.01, bool prefix_buckets = false);
 
-    explicit NKmerIndex128(const SequenceDistanceGraph &_sg,uint8_t k=63, int filter_limit = 200);
+    void write(const std::string &filename) const;
 
-    bool empty() const { return assembly_kmers.empty(); }
-    const_iterator begin() const {return assembly_kmers.cbegin();}
-    const_iterator end() const {return assembly_kmers.cend();}
+    /**
+     * @brief SequenceDistanceGraph::content_hash() of the graph the index was built on
+     */
+    uint64_t get_graph_hash() const { return graph_hash; }
+
+    uint8_t get_k() const { return k; }
+
+    bool empty() const { return kmer_count() == 0; }
+    const_iterator begin() const {return kmers();}
+    const_iterator end() const {return kmers() + kmer_count();}
 
     bool filter(const __uint128_t kmer) const {
         return bfilter.contains(kmer);
     }
 
+    /**
+     * @brief Batched filter(), in_filter[i] is set to filter(kmers[i].second)
+     */
+    void filter(const std::vector<std::pair<bool, __uint128_t>> &kmers, std::vector<bool> &in_filter) const {
+        bfilter.contains(kmers, in_filter);
+    }
+
     const_iterator find(const __uint128_t kmer) const {
-        if (bfilter.contains(kmer)) { return std::lower_bound(assembly_kmers.cbegin(), assembly_kmers.cend(), kmer); }
-        return assembly_kmers.cend();
+        if (not bfilter.contains(kmer)) return end();
+        if (prefix_bases == 0) return std::lower_bound(begin(), end(), kmer);
+        uint64_t p = kmer >> (2 * (k - prefix_bases));
+        return std::lower_bound(begin() + offsets()[p], begin() + offsets()[p + 1], kmer);
     }
 
+    /**
+     * @brief Number of bases used for the prefix buckets, 0 if find() binary-searches the whole index
+     */
+    uint8_t get_prefix_bases() const { return prefix_bases; }
+
     void get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t, int32_t>>> & matches, std::vector<std::pair<bool, __uint128_t>> & seq_kmers);
 
 };
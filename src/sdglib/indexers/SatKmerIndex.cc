@@ -4,64 +4,88 @@
 
 #include "SatKmerIndex.hpp"
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
+#include <sdglib/indexers/IndexCache.hpp>
+#include <sdglib/utilities/io_helpers.hpp>
 
 SatKmerIndex::SatKmerIndex(const SequenceDistanceGraph &sg, uint8_t k, uint8_t filter_limit)  : k(k) {
-    if (k > 15) {
+    if (k > 31) {
         throw std::runtime_error(
-                "You are trying to use K>15, which is not supported by this structure. "
-                "Please consider NKmerIndex or UniqueKmerIndex as alternatives");
+                "You are trying to use K>31, which is not supported by this structure. "
+                "Please consider NKmerIndex128 as an alternative");
     }
-    // this can be parallelised by contig by aggregating different k_usage vectors on the first step, second and third steps are trickier
-    // This two-pass approach could be easily adapted to a single memory block rather than vector of vectors
-    uint64_t filtered_kmers(0),total_kmers(0);
-    //---- First Step, count k-mer occupancy ----//
-    kmerEnd.resize(std::pow(4,k));
+    graph_hash = sg.content_hash();
+    //---- First Step, collect all graph k-mers ----//
     std::vector<kmerPos> all_kmers;
-    all_kmers.reserve(100000000);
-    std::vector<std::pair<bool,uint64_t > > contig_kmers;
-    contig_kmers.reserve(1000000); //1Mbp per contig to start with?
-    StringKMerFactory skf(k);
-    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-        if (sg.nodes[n].sequence.size() >= k) {
-            contig_kmers.clear();
-            skf.create_kmers(sg.nodes[n].sequence, contig_kmers);
-            int k_i(0);
-            for (const auto &kmer:contig_kmers) {
-                all_kmers.emplace_back(kmer.second, n, kmer.first ? k_i + 1 : -(k_i + 1));
-                k_i++;
+#pragma omp parallel
+    {
+        StringKMerFactory skf(k);
+        std::vector<kmerPos> local_kmers;
+        std::vector<std::pair<bool,uint64_t > > contig_kmers;
+        contig_kmers.reserve(1000000); //1Mbp per contig to start with?
+#pragma omp for schedule(dynamic,100)
+        for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
+            if (sg.get_node_size(n) >= k) {
+                contig_kmers.clear();
+                skf.create_kmers(sg.node_sequences, n, contig_kmers);
+                int k_i(0);
+                for (const auto &kmer:contig_kmers) {
+                    local_kmers.emplace_back(kmer.second, n, kmer.first ? k_i + 1 : -(k_i + 1));
+                    k_i++;
+                }
             }
-            total_kmers+=contig_kmers.size();
         }
+#pragma omp critical(satkmerindex_collect)
+        all_kmers.insert(all_kmers.end(), local_kmers.begin(), local_kmers.end());
     }
-    //---- Second Step, reserve space for each vector in structure (avoiding reallocations and such)----//
+    //---- Second Step, keep the k-mers under the filter limit and record where each one's positions end ----//
     sdglib::sort(all_kmers.begin(), all_kmers.end(), kmerPos::byKmerContigOffset());
-    auto witr = all_kmers.begin();
-    auto ritr = witr;
-    uint64_t ckmer(0);
+    std::vector<uint64_t> distinct_kmers, ends;
+    auto ritr = all_kmers.begin();
     for (; ritr != all_kmers.end();) {
-
-        while (ckmer != ritr->kmer) {
-            ++ckmer;
-            kmerEnd[ckmer]=kmerEnd[ckmer-1];
-        }
         auto bitr = ritr;
         while (ritr != all_kmers.end() and bitr->kmer == ritr->kmer) {
             ++ritr;
         }
         if (ritr - bitr < filter_limit) {
-            filtered_kmers+=1;
-            kmerEnd[ckmer] += ritr-bitr;
+            distinct_kmers.emplace_back(bitr->kmer);
             while (bitr != ritr) {
-                contig_offsets.emplace_back(bitr->contigID, bitr->offset, sg.nodes[llabs(bitr->contigID)].sequence.size() - std::abs(bitr->offset));
-                ++witr;
+                contig_offsets.emplace_back(bitr->contigID, bitr->offset, sg.get_node_size(llabs(bitr->contigID)) - std::abs(bitr->offset));
                 ++bitr;
             }
+            ends.emplace_back(contig_offsets.size());
         }
     }
-    while (ckmer < std::pow(4,k)) {
-        ++ckmer;
-        kmerEnd[ckmer] = kmerEnd[ckmer-1];
-    }
-    assert(kmerEnd[std::pow(4,k)-1] == contig_offsets.size());
     std::vector<kmerPos>().swap(all_kmers);
-}
\ No newline at end of file
+    //---- Third Step, encode the k-mers and the range ends ----//
+    kmers = EliasFano(distinct_kmers, 1ULL << (2 * k));
+    kmer_ends = EliasFano(ends, contig_offsets.size() + 1);
+}
+
+SatKmerIndex::SatKmerIndex(const std::string &filename) {
+    std::ifstream input_file(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(input_file, SKI_FT, filename);
+    input_file.read((char *) &k, sizeof(k));
+    kmers.read(input_file);
+    kmer_ends.read(input_file);
+    sdglib::read_flat_vector(input_file, contig_offsets);
+    if (!input_file) throw std::runtime_error("Error reading " + filename);
+}
+
+std::shared_ptr<SatKmerIndex> SatKmerIndex::load_or_build(const SequenceDistanceGraph &sg, uint8_t k, uint8_t filter_limit) {
+    std::string name = "satkmerindex_k" + std::to_string(k) + "_f" + std::to_string(filter_limit) + ".idx";
+    return sdglib::load_or_build_cached_index<SatKmerIndex>(sdglib::index_cache_path(sg, name), sg.content_hash(),
+            [&](const std::string &filename) { return std::make_shared<SatKmerIndex>(filename); },
+            [&]() { return std::make_shared<SatKmerIndex>(sg, k, filter_limit); });
+}
+
+void SatKmerIndex::write(const std::string &filename) const {
+    std::ofstream output_file(filename, std::ios_base::binary);
+    if (!output_file) throw std::runtime_error("Could not open " + filename);
+    sdglib::write_index_header(output_file, SKI_FT, graph_hash);
+    output_file.write((const char *) &k, sizeof(k));
+    kmers.write(output_file);
+    kmer_ends.write(output_file);
+    sdglib::write_flat_vector(output_file, contig_offsets);
+    output_file.close();
+    if (!output_file) throw std::runtime_error("Error writing " + filename);
+}
@@ -6,9 +6,12 @@
 
 #include <cassert>
 #include <vector>
+#include <memory>
+#include <string>
 #include <sdglib/utilities/omp_safe.hpp>
 #include <sdglib/types/KmerTypes.hpp>
 #include <sdglib/factories/KMerFactory.hpp>
+#include <sdglib/indexers/EliasFano.hpp>
 
 class SequenceDistanceGraph;
 struct ContigOffset {
@@ -22,9 +25,18 @@ struct ContigOffset {
     const bool operator==(const kmerPos &a) const { return std::tie(contigID, offset) == std::tie(a.contigID, a.offset);}
 };
 
+/**
+ * @brief Index of graph k-mers to their positions in contig_offsets.
+ *
+ * Only the k-mers present in the graph are stored, Elias-Fano encoded, together with the end of each k-mer's range
+ * in contig_offsets. The index takes a few bits per distinct graph k-mer rather than a 4^k offset table, so it can
+ * be used with any k up to 31.
+ */
 class SatKmerIndex {
-    std::vector<uint64_t> kmerEnd;
+    EliasFano kmers;        //distinct graph k-mers, sorted
+    EliasFano kmer_ends;    //kmer_ends[i] is the end of the range of kmers[i] in contig_offsets
     uint8_t k=0;
+    uint64_t graph_hash=0;
 public:
     std::vector<ContigOffset> contig_offsets;
     using const_iterator = std::vector<ContigOffset>::const_iterator;
@@ -32,6 +44,34 @@ public:
     SatKmerIndex(){};
     SatKmerIndex(const SequenceDistanceGraph &sg, uint8_t k=15, uint8_t filter_limit = 200);
 
-    uint64_t beginCO(uint64_t kmer) const { return (0ull==kmer) ? 0ull : kmerEnd[kmer-1];}
-    uint64_t endCO(uint64_t kmer) const { return kmerEnd[kmer]; }
+    /**
+     * @brief Loads an index saved with write()
+     */
+    explicit SatKmerIndex(const std::string &filename);
+
+    /**
+     * @brief Loads the index from the workspace's index cache if it was built with the same parameters on the current
+     * graph sequences, otherwise builds it and saves it in the cache.
+     */
+    static std::shared_ptr<SatKmerIndex> load_or_build(const SequenceDistanceGraph &sg, uint8_t k=15, uint8_t filter_limit = 200);
+
+    void write(const std::string &filename) const;
+
+    uint64_t get_graph_hash() const { return graph_hash; }
+
+    uint64_t beginCO(uint64_t kmer) const {
+        uint64_t i;
+        if (not kmers.find(kmer, i)) return 0;
+        return i == 0 ? 0 : kmer_ends[i - 1];
+    }
+
+    uint64_t endCO(uint64_t kmer) const {
+        uint64_t i;
+        if (not kmers.find(kmer, i)) return 0;
+        return kmer_ends[i];
+    }
+
+    uint64_t size_in_bytes() const {
+        return kmers.size_in_bytes() + kmer_ends.size_in_bytes() + contig_offsets.size() * sizeof(ContigOffset);
+    }
 };
@@ -4,31 +4,37 @@
 
 #include "UniqueKmerIndex.hpp"
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
+#include <sdglib/indexers/IndexCache.hpp>
 
 
 UniqueKmerIndex::UniqueKmerIndex(const SequenceDistanceGraph &sg, const uint8_t _k) : k(_k){
-    kmer_to_graphposition.clear();
+    graph_hash = sg.content_hash();
     std::vector<pair> kidxv;
     uint64_t total_k { 0 };
     total_kmers_per_node = std::vector<uint64_t>(sg.nodes.size(), 0);
     for (sgNodeID_t node = 0; node < sg.nodes.size(); node++) {
-        auto sgnode = sg.nodes[node];
-        if (sgnode.sequence.size() >= k) {
-            auto n = sgnode.sequence.size() + 1 - k;
+        if (sg.get_node_size(node) >= k) {
+            auto n = sg.get_node_size(node) + 1 - k;
             total_k += n;
             total_kmers_per_node[node] = n;
         }
     }
     kidxv.reserve(total_k);
-    FastaRecord r;
-    kmerPosFactory kcf({k});
-    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-        if (sg.nodes[n].sequence.size() >= k) {
-            r.id = n;
-            r.seq = sg.nodes[n].sequence;
-            kcf.setFileRecord(r);
-            kcf.next_element(kidxv);
+#pragma omp parallel
+    {
+        std::vector<pair> local_kidxv;
+        kmerPosFactory kcf({k});
+#pragma omp for schedule(dynamic,100)
+        for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
+            if (sg.get_node_size(n) >= k) kcf.node_kmers(sg.node_sequences, n, local_kidxv);
+            if (local_kidxv.size() > 10000000) {
+#pragma omp critical(push_kmers)
+                kidxv.insert(kidxv.end(), local_kidxv.begin(), local_kidxv.end());
+                local_kidxv.clear();
+            }
         }
+#pragma omp critical(push_kmers)
+        kidxv.insert(kidxv.end(), local_kidxv.begin(), local_kidxv.end());
     }
 
     sdglib::sort(kidxv.begin(),kidxv.end(),[](const pair & a, const pair & b){return a.first<b.first;});
@@ -45,40 +51,41 @@ UniqueKmerIndex::UniqueKmerIndex(const SequenceDistanceGraph &sg, const uint8_t
         ri=nri;
     }
     kidxv.resize(wi - kidxv.begin());
-    std::unordered_set<sgNodeID_t > seen_contigs;
-    seen_contigs.reserve(sg.nodes.size());
     unique_kmers_per_node = std::vector<uint64_t>(sg.nodes.size(), 0);
-    kmer_to_graphposition.reserve(kidxv.size());
     for (auto &kidx :kidxv) {
-        kmer_to_graphposition[kidx.first] = { kidx.second.node, kidx.second.pos };
         unique_kmers_per_node[std::abs(kidx.second.node)] += 1;
-        seen_contigs.insert(std::abs(kidx.second.node));
     }
+    kmer_to_graphposition.build(kidxv);
 }
 
 Unique63merIndex::Unique63merIndex(const SequenceDistanceGraph &sg, const uint8_t _k) : k(_k){
-    kmer_to_graphposition.clear();
+    graph_hash = sg.content_hash();
     std::vector<pair> kidxv;
     uint64_t total_k { 0 };
     total_kmers_per_node = std::vector<uint64_t>(sg.nodes.size(), 0);
     for (sgNodeID_t node = 0; node < sg.nodes.size(); node++) {
-        auto sgnode = sg.nodes[node];
-        if (sgnode.sequence.size() >= k) {
-            auto n = sgnode.sequence.size() + 1 - k;
+        if (sg.get_node_size(node) >= k) {
+            auto n = sg.get_node_size(node) + 1 - k;
             total_k += n;
             total_kmers_per_node[node] = n;
         }
     }
     kidxv.reserve(total_k);
-    FastaRecord r;
-    kmerPosFactory128 kcf({k});
-    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
-        if (sg.nodes[n].sequence.size() >= k) {
-            r.id = n;
-            r.seq = sg.nodes[n].sequence;
-            kcf.setFileRecord(r);
-            kcf.next_element(kidxv);
+#pragma omp parallel
+    {
+        std::vector<pair> local_kidxv;
+        kmerPosFactory128 kcf({k});
+#pragma omp for schedule(dynamic,100)
+        for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
+            if (sg.get_node_size(n) >= k) kcf.node_kmers(sg.node_sequences, n, local_kidxv);
+            if (local_kidxv.size() > 10000000) {
+#pragma omp critical(push_kmers)
+                kidxv.insert(kidxv.end(), local_kidxv.begin(), local_kidxv.end());
+                local_kidxv.clear();
+            }
         }
+#pragma omp critical(push_kmers)
+        kidxv.insert(kidxv.end(), local_kidxv.begin(), local_kidxv.end());
     }
 
     sdglib::sort(kidxv.begin(),kidxv.end(),[](const pair & a, const pair & b){return a.first<b.first;});
@@ -95,14 +102,72 @@ Unique63merIndex::Unique63merIndex(const SequenceDistanceGraph &sg, const uint8_
         ri=nri;
     }
     kidxv.resize(wi - kidxv.begin());
-
-    std::unordered_set<sgNodeID_t > seen_contigs;
-    seen_contigs.reserve(sg.nodes.size());
     unique_kmers_per_node = std::vector<uint64_t>(sg.nodes.size(), 0);
-    kmer_to_graphposition.reserve(kidxv.size());
     for (auto &kidx :kidxv) {
-        kmer_to_graphposition[kidx.first] = { kidx.second.node, kidx.second.pos };
         unique_kmers_per_node[std::abs(kidx.second.node)] += 1;
-        seen_contigs.insert(std::abs(kidx.second.node));
     }
-}
\ No newline at end of file
+    kmer_to_graphposition.build(kidxv);
+}
+UniqueKmerIndex::UniqueKmerIndex(const std::string &filename, bool mapped) {
+    std::ifstream input_file(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(input_file, UKI_FT, filename);
+
+    input_file.read((char *) &k, sizeof(k));
+    sdglib::read_flat_vector(input_file, unique_kmers_per_node);
+    sdglib::read_flat_vector(input_file, total_kmers_per_node);
+    if (mapped) kmer_to_graphposition.read_mapped(input_file, std::make_shared<sdglib::MemoryMappedFile>(filename));
+    else kmer_to_graphposition.read(input_file);
+    if (!input_file) throw std::runtime_error("Error reading " + filename);
+}
+
+std::shared_ptr<UniqueKmerIndex> UniqueKmerIndex::load_or_build(const SequenceDistanceGraph &sg, uint8_t k) {
+    std::string name = "uniquekmerindex_k" + std::to_string(k) + ".idx";
+    return sdglib::load_or_build_cached_index<UniqueKmerIndex>(sdglib::index_cache_path(sg, name), sg.content_hash(),
+            [&](const std::string &filename) { return std::make_shared<UniqueKmerIndex>(filename); },
+            [&]() { return std::make_shared<UniqueKmerIndex>(sg, k); });
+}
+
+void UniqueKmerIndex::write(const std::string &filename) const {
+    std::ofstream output_file(filename, std::ios_base::binary);
+    if (!output_file) throw std::runtime_error("Could not open " + filename);
+    sdglib::write_index_header(output_file, UKI_FT, graph_hash);
+
+    output_file.write((const char *) &k, sizeof(k));
+    sdglib::write_flat_vector(output_file, unique_kmers_per_node);
+    sdglib::write_flat_vector(output_file, total_kmers_per_node);
+    kmer_to_graphposition.write(output_file);
+    output_file.close();
+    if (!output_file) throw std::runtime_error("Error writing " + filename);
+}
+
+Unique63merIndex::Unique63merIndex(const std::string &filename, bool mapped) {
+    std::ifstream input_file(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(input_file, U63I_FT, filename);
+
+    input_file.read((char *) &k, sizeof(k));
+    sdglib::read_flat_vector(input_file, unique_kmers_per_node);
+    sdglib::read_flat_vector(input_file, total_kmers_per_node);
+    if (mapped) kmer_to_graphposition.read_mapped(input_file, std::make_shared<sdglib::MemoryMappedFile>(filename));
+    else kmer_to_graphposition.read(input_file);
+    if (!input_file) throw std::runtime_error("Error reading " + filename);
+}
+
+std::shared_ptr<Unique63merIndex> Unique63merIndex::load_or_build(const SequenceDistanceGraph &sg, uint8_t k) {
+    std::string name = "unique63merindex_k" + std::to_string(k) + ".idx";
+    return sdglib::load_or_build_cached_index<Unique63merIndex>(sdglib::index_cache_path(sg, name), sg.content_hash(),
+            [&](const std::string &filename) { return std::make_shared<Unique63merIndex>(filename); },
+            [&]() { return std::make_shared<Unique63merIndex>(sg, k); });
+}
+
+void Unique63merIndex::write(const std::string &filename) const {
+    std::ofstream output_file(filename, std::ios_base::binary);
+    if (!output_file) throw std::runtime_error("Could not open " + filename);
+    sdglib::write_index_header(output_file, U63I_FT, graph_hash);
+
+    output_file.write((const char *) &k, sizeof(k));
+    sdglib::write_flat_vector(output_file, unique_kmers_per_node);
+    sdglib::write_flat_vector(output_file, total_kmers_per_node);
+    kmer_to_graphposition.write(output_file);
+    output_file.close();
+    if (!output_file) throw std::runtime_error("Error writing " + filename);
+}
@@ -13,6 +13,8 @@
 #include <sdglib/readers/FileReader.hpp>
 #include <sdglib/factories/KmerPosFactory.hpp>
 #include <sdglib/utilities/io_helpers.hpp>
+#include <sdglib/indexers/FlatKmerMap.hpp>
+#include <sdglib/Version.hpp>
 
 class SequenceDistanceGraph;
 
@@ -23,11 +25,27 @@ class SequenceDistanceGraph;
  */
 class UniqueKmerIndex {
 public:
-    using Map = std::unordered_map<uint64_t, graphStrandPos>;
+    using Map = FlatKmerMap<uint64_t, graphStrandPos>;
     using pair = std::pair<uint64_t, graphStrandPos>;
-    using const_iterator = std::unordered_map<uint64_t, graphStrandPos>::const_iterator;
+    using const_iterator = Map::const_iterator;
     UniqueKmerIndex(const SequenceDistanceGraph &sg, uint8_t k=31);
 
+    /**
+     * @brief Loads an index saved with write()
+     * @param mapped if true the k-mer table is used directly from a read-only mapping of the file instead of read into memory
+     */
+    explicit UniqueKmerIndex(const std::string &filename, bool mapped=true);
+
+    /**
+     * @brief Loads the index from the workspace's index cache if it was built on the current graph sequences,
+     * otherwise builds it and saves it in the cache.
+     */
+    static std::shared_ptr<UniqueKmerIndex> load_or_build(const SequenceDistanceGraph &sg, uint8_t k=31);
+
+    void write(const std::string &filename) const;
+
+    uint64_t get_graph_hash() const { return graph_hash; }
+
     const_iterator find(const uint64_t hash) const {
         return kmer_to_graphposition.find(hash);
     };
@@ -76,6 +94,7 @@ public:
 private:
     Map kmer_to_graphposition;
     uint8_t k = 31;
+    uint64_t graph_hash = 0;
     std::vector<uint64_t> unique_kmers_per_node;
     std::vector<uint64_t> total_kmers_per_node;
 
@@ -89,12 +108,28 @@ private:
 
 class Unique63merIndex {
 public:
-    using Map = std::unordered_map<__uint128_t, graphStrandPos, int128_hash>;
+    using Map = FlatKmerMap<__uint128_t, graphStrandPos>;
     using pair = std::pair<__uint128_t, graphStrandPos>;
     using const_iterator = Map::const_iterator;
 
     Unique63merIndex(const SequenceDistanceGraph &sg, const uint8_t k=63);
 
+    /**
+     * @brief Loads an index saved with write()
+     * @param mapped if true the k-mer table is used directly from a read-only mapping of the file instead of read into memory
+     */
+    explicit Unique63merIndex(const std::string &filename, bool mapped=true);
+
+    /**
+     * @brief Loads the index from the workspace's index cache if it was built on the current graph sequences,
+     * otherwise builds it and saves it in the cache.
+     */
+    static std::shared_ptr<Unique63merIndex> load_or_build(const SequenceDistanceGraph &sg, uint8_t k=63);
+
+    void write(const std::string &filename) const;
+
+    uint64_t get_graph_hash() const { return graph_hash; }
+
     const_iterator find(const __uint128_t hash) const {
         return kmer_to_graphposition.find(hash);
     };
@@ -153,7 +188,8 @@ public:
 
 private:
     Map kmer_to_graphposition;
-    uint8_t k;
+    uint8_t k=63;
+    uint64_t graph_hash = 0;
     std::vector<uint64_t> unique_kmers_per_node;
     std::vector<uint64_t> total_kmers_per_node;
 
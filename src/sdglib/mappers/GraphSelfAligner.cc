@@ -6,14 +6,17 @@
 #include <sdglib/mappers/SequenceMapper.hpp>
 #include "GraphSelfAligner.hpp"
 #include <sdglib/views/NodeView.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
 
 void GraphSelfAligner::self_align() {
     matches.clear();
     matches.resize(dg.sdg.nodes.size());
     SequenceMapper sm(dg,k,max_kfreq);
     auto nvs=dg.get_all_nodeviews();
-#pragma omp parallel for  schedule(static,200)
-    for (auto i=0;i<nvs.size();++i){
+    sdglib::CostBalancedChunks chunks(0, nvs.size(), [&](uint64_t i){ return nvs[i].size(); });
+#pragma omp parallel for schedule(dynamic,1)
+    for (uint64_t chunk=0;chunk<chunks.size();++chunk)
+    for (auto i=chunks.begin(chunk);i<chunks.end(chunk);++i){
         auto &nv=nvs[i];
         for (auto &m:sm.map_sequence(nv.sequence().c_str(),nv.node_id())){
             if (llabs(m.node)!=nv.node_id()){
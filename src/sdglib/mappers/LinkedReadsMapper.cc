@@ -3,6 +3,7 @@
 //
 #include "LinkedReadsMapper.hpp"
 #include <iostream>
+#include <algorithm>
 #include <iomanip>
 #include <cassert>
 #include <atomic>
@@ -13,6 +14,7 @@
 #include <sdglib/utilities/omp_safe.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
 #include <sdglib/utilities/io_helpers.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
 #include <sdglib/datastores/ReadSequenceBuffer.hpp>
 
 const sdgVersion_t LinkedReadsMapper::min_compat = 0x0003;
@@ -45,7 +47,7 @@ void LinkedReadsMapper::write(std::ofstream &output_file) {
     //mappings
     sdglib::write_flat_vectorvector(output_file, reads_in_node);
 
-    sdglib::write_flat_vectorvector(output_file, tag_neighbours);
+    tag_neighbours.write(output_file);
 }
 
 void LinkedReadsMapper::read(std::ifstream &input_file) {
@@ -75,7 +77,8 @@ void LinkedReadsMapper::read(std::ifstream &input_file) {
 
     sdglib::read_flat_vectorvector(input_file, reads_in_node);
 
-    sdglib::read_flat_vectorvector(input_file, tag_neighbours);
+    if (version < 0x0006) tag_neighbours.read_nested(input_file);
+    else tag_neighbours.read(input_file);
 
     populate_orientation();
 
@@ -139,7 +142,7 @@ void LinkedReadsMapper::remap_all_reads() {
 }
 
 void LinkedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_remap) {
-    UniqueKmerIndex ukindex(ws.sdg);
+    auto ukindex = UniqueKmerIndex::load_or_build(ws.sdg);
     reads_in_node.resize(ws.sdg.nodes.size());
     read_to_node.resize(datastore.size()+1);
     if (not reads_to_remap.empty())
@@ -150,6 +153,7 @@ void LinkedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
      */
     uint64_t thread_mapped_count[omp_get_max_threads()],thread_total_count[omp_get_max_threads()],thread_multimap_count[omp_get_max_threads()];
     std::vector<ReadMapping> thread_mapping_results[omp_get_max_threads()];
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     sdglib::OutputLog(sdglib::LogLevels::DEBUG)<<"Private mapping initialised for "<<omp_get_max_threads()<<" threads"<<std::endl;
 #pragma omp parallel
     {
@@ -184,8 +188,8 @@ void LinkedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
                 skf.produce_all_kmers(seq,readkmers);
 
                 for (auto &rk:readkmers) {
-                    auto nk = ukindex.find(rk.kmer);
-                    if (ukindex.end()!=nk) {
+                    auto nk = ukindex->find(rk.kmer);
+                    if (ukindex->end()!=nk) {
                         //get the node just as node
                         sgNodeID_t nknode = llabs(nk->second.node); // nk->second is the graphStrandPosition node is the node id of that
                         //TODO: sort out the sign/orientation representation
@@ -260,7 +264,7 @@ void LinkedReadsMapper::path_reads(uint8_t k,int _filter) {
     read_paths.clear();
     read_paths.resize(datastore.size()+1);
     if (k<=31) {
-        NKmerIndex nki(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
+        auto nki = NKmerIndex::load_or_build(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
         sdglib::OutputLog() << "Index created!" << std::endl;
         //if (last_read==0) last_read=datastore.size();
 #pragma omp parallel shared(nki)
@@ -283,12 +287,12 @@ void LinkedReadsMapper::path_reads(uint8_t k,int _filter) {
                 rp.clear();
                 pme.set_read(seq);
                 for (auto rki = 0; rki < read_kmers.size(); ++rki) {
-                    auto kmatch = nki.find(read_kmers[rki].second);
-                    if (kmatch != nki.end() and kmatch->kmer == read_kmers[rki].second) {
+                    auto kmatch = nki->find(read_kmers[rki].second);
+                    if (kmatch != nki->end() and kmatch->kmer == read_kmers[rki].second) {
                         pme.reset();
 //                    std::cout<<std::endl<<"PME reset done"<<std::endl;
 //                    std::cout<<std::endl<<"read kmer is at "<<rki<<" in "<<(read_kmers[rki].first ? "FW":"REV")<<" orientation"<<std::endl;
-                        for (; kmatch != nki.end() and kmatch->kmer == read_kmers[rki].second; ++kmatch) {
+                        for (; kmatch != nki->end() and kmatch->kmer == read_kmers[rki].second; ++kmatch) {
 //                        std::cout<<" match to "<<kmatch->contigID<<":"<<kmatch->offset<<std::endl;
                             auto contig = kmatch->contigID;
                             int64_t pos = kmatch->offset - 1;
@@ -322,7 +326,7 @@ void LinkedReadsMapper::path_reads(uint8_t k,int _filter) {
         }
     }
     else if (k<64) {
-        NKmerIndex128 nki(ws.sdg,k,_filter);//TODO: hardcoded parameters!!
+        auto nki = NKmerIndex128::load_or_build(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
         sdglib::OutputLog()<<"Index created!"<<std::endl;
         //if (last_read==0) last_read=datastore.size();
 #pragma omp parallel shared(nki)
@@ -345,12 +349,12 @@ void LinkedReadsMapper::path_reads(uint8_t k,int _filter) {
                 rp.clear();
                 pme.set_read(seq);
                 for (auto rki=0;rki<read_kmers.size();++rki){
-                    auto kmatch=nki.find(read_kmers[rki].second);
-                    if (kmatch!=nki.end() and kmatch->kmer==read_kmers[rki].second){
+                    auto kmatch=nki->find(read_kmers[rki].second);
+                    if (kmatch!=nki->end() and kmatch->kmer==read_kmers[rki].second){
                         pme.reset();
 //                    std::cout<<std::endl<<"PME reset done"<<std::endl;
 //                    std::cout<<std::endl<<"read kmer is at "<<rki<<" in "<<(read_kmers[rki].first ? "FW":"REV")<<" orientation"<<std::endl;
-                        for (;kmatch!=nki.end() and kmatch->kmer==read_kmers[rki].second;++kmatch) {
+                        for (;kmatch!=nki->end() and kmatch->kmer==read_kmers[rki].second;++kmatch) {
 //                        std::cout<<" match to "<<kmatch->contigID<<":"<<kmatch->offset<<std::endl;
                             auto contig=kmatch->contigID;
                             int64_t pos=kmatch->offset-1;
@@ -407,7 +411,7 @@ void LinkedReadsMapper::path_reads(uint8_t k,int _filter) {
 }
 
 void LinkedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to_remap) {
-    Unique63merIndex ukindex(ws.sdg);
+    auto ukindex = Unique63merIndex::load_or_build(ws.sdg);
     reads_in_node.resize(ws.sdg.nodes.size());
     read_to_node.resize(datastore.size()+1);
     if (not reads_to_remap.empty())
@@ -418,6 +422,7 @@ void LinkedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to
      */
     uint64_t thread_mapped_count[omp_get_max_threads()],thread_total_count[omp_get_max_threads()],thread_multimap_count[omp_get_max_threads()];
     std::vector<ReadMapping> thread_mapping_results[omp_get_max_threads()];
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     sdglib::OutputLog(sdglib::LogLevels::DEBUG)<<"Private mapping initialised for "<<omp_get_max_threads()<<" threads"<<std::endl;
 #pragma omp parallel
     {
@@ -452,8 +457,8 @@ void LinkedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to
                 skf.produce_all_kmers(seq,readkmers);
 
                 for (auto &rk:readkmers) {
-                    auto nk = ukindex.find(rk.kmer);
-                    if (ukindex.end()!=nk) {
+                    auto nk = ukindex->find(rk.kmer);
+                    if (ukindex->end()!=nk) {
                         //get the node just as node
                         sgNodeID_t nknode = llabs(nk->second.node);
                         //TODO: sort out the sign/orientation representation
@@ -536,8 +541,7 @@ std::set<LinkedTag> LinkedReadsMapper::get_node_tags(sgNodeID_t n) {
 }
 
 void LinkedReadsMapper::compute_all_tag_neighbours(int min_size, float min_score, int min_mapped_reads_per_tag) {
-    //TODO: parallel for this needs to be done by tag, but tag start-end needs to be computed before
-
+    const uint64_t max_tag_nodes=500;
     //first - create start-end for tags that have > X reads
     std::vector<std::pair<uint64_t,uint64_t>> tag_start_end;
     LinkedTag current_tag=0;
@@ -557,51 +561,104 @@ void LinkedReadsMapper::compute_all_tag_neighbours(int min_size, float min_score
         tag_start_end.emplace_back(tag_firstpost,read_to_node.size());
     }
 
-    //scores[source][dest]= count of reads of source which have tags also present in dest
-    std::vector<std::unordered_map<sgNodeID_t,uint32_t>> scores(ws.sdg.nodes.size());
-    sdglib::OutputLog()<<"Counting into individual maps (parallel)..."<<std::endl;
-    {
-        //local tally
-        std::vector<std::unordered_map<sgNodeID_t,uint32_t>> local_scores(ws.sdg.nodes.size());
-        //map with counts of how many times the tag appears on every node
-        std::unordered_map<sgNodeID_t, uint32_t > node_readcount; //is it not easier to use a vector? - it is sparse
-        for(auto tidx=0;tidx<tag_start_end.size();++tidx){ //for each tag's reads
-            for(auto i=tag_start_end[tidx].first;i<tag_start_end[tidx].second;++i) {
-                if (read_to_node[i] != 0) {
-                    ++node_readcount[llabs(read_to_node[i])];
-                }
-            }
-            if (node_readcount.size()<500) { //tag has reads in less than 500 nodes
-                for (auto &n1:node_readcount) {
-                    if (ws.sdg.nodes[n1.first].sequence.size() >= min_size) {
-                        for (auto &n2:node_readcount) {
-                            if (ws.sdg.nodes[n2.first].sequence.size() >= min_size) {
-                                scores[n1.first][n2.first] += n1.second; //add the number of reads shared in this tag to the total score
-                            }
-                        }
+    //tag x node matrix: (node, reads) for each node of size >= min_size on tags with reads in < max_tag_nodes nodes
+    sdglib::OutputLog()<<"Building tag x node matrix for "<<tag_start_end.size()<<" tags..."<<std::endl;
+    const auto node_count=ws.sdg.nodes.size();
+    sdglib::CostBalancedChunks tag_chunks(0, tag_start_end.size(), [&](uint64_t t){ return tag_start_end[t].second-tag_start_end[t].first; });
+    std::vector<uint64_t> tag_offsets(tag_start_end.size()+1);
+    std::vector<std::pair<sgNodeID_t,uint32_t>> tag_nodes;
+    //two passes, the first one sizes the rows and the second one fills them
+    for (auto pass=0;pass<2;++pass) {
+#pragma omp parallel
+        {
+            std::vector<sgNodeID_t> nodes;
+#pragma omp for schedule(dynamic,1)
+            for (uint64_t chunk=0;chunk<tag_chunks.size();++chunk)
+            for (auto t=tag_chunks.begin(chunk);t<tag_chunks.end(chunk);++t) {
+                nodes.clear();
+                for (auto i=tag_start_end[t].first;i<tag_start_end[t].second;++i)
+                    if (read_to_node[i]!=0) nodes.emplace_back(llabs(read_to_node[i]));
+                std::sort(nodes.begin(),nodes.end());
+                uint64_t distinct_nodes=0;
+                for (uint64_t i=0;i<nodes.size();++i) if (i==0 or nodes[i]!=nodes[i-1]) ++distinct_nodes;
+                if (distinct_nodes>=max_tag_nodes) continue;
+                auto next=tag_offsets[t];
+                for (uint64_t i=0;i<nodes.size();) {
+                    auto j=i+1;
+                    while (j<nodes.size() and nodes[j]==nodes[i]) ++j;
+                    if (ws.sdg.get_node_size(nodes[i])>=min_size) {
+                        if (pass==0) ++tag_offsets[t+1];
+                        else tag_nodes[next++]={nodes[i],j-i};
                     }
+                    i=j;
                 }
             }
-            node_readcount.clear();
         }
-        {
-            for (auto n=0;n<local_scores.size();++n)
-                for (auto ns:local_scores[n])
-                    scores[n][ns.first]+=ns.second;
+        if (pass==0) {
+            for (uint64_t t=1;t<tag_offsets.size();++t) tag_offsets[t]+=tag_offsets[t-1];
+            tag_nodes.resize(tag_offsets.back());
         }
     }
 
-    sdglib::OutputLog()<<"... copying to result vector..."<<std::endl;
-    //now flatten the map into its first dimension.
-    tag_neighbours.clear();
-    tag_neighbours.resize(ws.sdg.nodes.size());
-    for (auto i=1;i<ws.sdg.nodes.size();++i){
-        for (auto &s:scores[i]) {
-            float tag_score = ((float) s.second) / scores[i][i];
-            if (tag_score >= min_score)
-                tag_neighbours[i].emplace_back(s.first, tag_score);
+    //transpose: (tag, reads of the node in the tag) for each node
+    std::vector<uint64_t> node_offsets(node_count+1);
+    for (const auto &tn:tag_nodes) ++node_offsets[tn.first+1];
+    for (uint64_t n=1;n<node_offsets.size();++n) node_offsets[n]+=node_offsets[n-1];
+    std::vector<std::pair<uint32_t,uint32_t>> node_tags(tag_nodes.size());
+    {
+        auto fill=node_offsets;
+        for (uint32_t t=0;t<tag_start_end.size();++t)
+            for (auto i=tag_offsets[t];i<tag_offsets[t+1];++i) node_tags[fill[tag_nodes[i].first]++]={t,tag_nodes[i].second};
+    }
+
+    //scores[source][dest]= count of reads of source which have tags also present in dest, one row at a time
+    sdglib::OutputLog()<<"Multiplying "<<tag_nodes.size()<<" tag-node entries (parallel)..."<<std::endl;
+    sdglib::CostBalancedChunks node_chunks(1, node_count, [&](uint64_t n){
+        uint64_t c=0;
+        for (auto i=node_offsets[n];i<node_offsets[n+1];++i) c+=tag_offsets[node_tags[i].first+1]-tag_offsets[node_tags[i].first];
+        return c;
+    });
+    std::vector<std::vector<TagNeighbour>> chunk_neighbours(node_chunks.size());
+    std::vector<uint64_t> neighbour_count(node_count+1);
+#pragma omp parallel
+    {
+        std::vector<uint32_t> scores(node_count);
+        std::vector<sgNodeID_t> touched;
+#pragma omp for schedule(dynamic,1)
+        for (uint64_t chunk=0;chunk<node_chunks.size();++chunk)
+        for (auto n=node_chunks.begin(chunk);n<node_chunks.end(chunk);++n) {
+            for (auto i=node_offsets[n];i<node_offsets[n+1];++i) {
+                const auto &nt=node_tags[i];
+                for (auto j=tag_offsets[nt.first];j<tag_offsets[nt.first+1];++j) {
+                    auto dest=tag_nodes[j].first;
+                    if (scores[dest]==0) touched.emplace_back(dest);
+                    scores[dest]+=nt.second; //add the number of reads shared in this tag to the total score
+                }
+            }
+            std::sort(touched.begin(),touched.end());
+            auto &out=chunk_neighbours[chunk];
+            auto before=out.size();
+            auto own_score=scores[n];
+            for (auto dest:touched) {
+                float tag_score = ((float) scores[dest]) / own_score;
+                if (tag_score >= min_score) out.emplace_back(dest, tag_score);
+                scores[dest]=0;
+            }
+            neighbour_count[n+1]=out.size()-before;
+            touched.clear();
         }
     }
+
+    sdglib::OutputLog()<<"... copying to result table..."<<std::endl;
+    tag_neighbours.clear();
+    tag_neighbours.offsets.swap(neighbour_count);
+    for (uint64_t n=1;n<tag_neighbours.offsets.size();++n) tag_neighbours.offsets[n]+=tag_neighbours.offsets[n-1];
+    tag_neighbours.entries.resize(tag_neighbours.offsets.back());
+    for (uint64_t chunk=0;chunk<node_chunks.size();++chunk) {
+        std::copy(chunk_neighbours[chunk].begin(),chunk_neighbours[chunk].end(),
+                  tag_neighbours.entries.begin()+tag_neighbours.offsets[node_chunks.begin(chunk)]);
+        std::vector<TagNeighbour>().swap(chunk_neighbours[chunk]);
+    }
     sdglib::OutputLog()<<"...DONE!"<<std::endl;
 }
 
@@ -617,26 +674,41 @@ LinkedReadsMapper& LinkedReadsMapper::operator=(const LinkedReadsMapper &other)
 
 void LinkedReadsMapper::write_tag_neighbours(std::string filename) {
     std::ofstream output_file(filename.c_str());
-    uint64_t count;
-    count =tag_neighbours.size();
-    output_file.write((const char *) &count,sizeof(count));
-    for (auto i=0;i<count;++i) {
-        uint64_t mcount=tag_neighbours[i].size();
-        output_file.write((const char *) &mcount,sizeof(mcount));
-        output_file.write((const char *) tag_neighbours[i].data(), sizeof(TagNeighbour) * mcount);
-    }
+    tag_neighbours.write(output_file);
 }
 
 void LinkedReadsMapper::read_tag_neighbours(std::string filename) {
     std::ifstream input_file(filename.c_str());
-    uint64_t count;
-    input_file.read(( char *) &count,sizeof(count));
-    tag_neighbours.resize(count);
-    for (auto i=0;i<count;++i) {
-        uint64_t mcount;
-        input_file.read(( char *) &mcount,sizeof(mcount));
-        tag_neighbours[i].resize(mcount);
-        input_file.read(( char *) tag_neighbours[i].data(), sizeof(TagNeighbour) * mcount);
+    tag_neighbours.read(input_file);
+}
+
+void TagNeighbourTable::clear() {
+    offsets.clear();
+    entries.clear();
+}
+
+void TagNeighbourTable::write(std::ofstream &output_file) const {
+    sdglib::write_flat_vector(output_file, offsets);
+    sdglib::write_flat_vector(output_file, entries);
+}
+
+void TagNeighbourTable::read(std::ifstream &input_file) {
+    sdglib::read_flat_vector(input_file, offsets);
+    sdglib::read_flat_vector(input_file, entries);
+    if (not offsets.empty() and offsets.back()!=entries.size())
+        throw std::runtime_error("Tag neighbours table offsets don't match its entries");
+}
+
+void TagNeighbourTable::read_nested(std::ifstream &input_file) {
+    std::vector<std::vector<TagNeighbour>> rows;
+    sdglib::read_flat_vectorvector(input_file, rows);
+    clear();
+    if (rows.empty()) return;
+    offsets.reserve(rows.size()+1);
+    offsets.emplace_back(0);
+    for (const auto &r:rows) {
+        entries.insert(entries.end(),r.begin(),r.end());
+        offsets.emplace_back(entries.size());
     }
 }
 
@@ -7,6 +7,8 @@
 #include <set>
 #include <unordered_set>
 #include <map>
+#include <vector>
+#include <fstream>
 #include <sdglib/types/MappingTypes.hpp>
 #include <sdglib/indexers/UniqueKmerIndex.hpp>
 #include <sdglib/Version.hpp>
@@ -26,6 +28,43 @@ public:
     float score; //breaking the latte principle
 };
 
+/**
+ * @brief Tag neighbours of every node, as compressed sparse rows.
+ *
+ * The neighbours of node n are entries[offsets[n]] to entries[offsets[n+1]-1], sorted by node. Rows are accessed as
+ * tag_neighbours[n], which can be iterated and has size() and empty(), like the vector of vectors it replaces.
+ */
+class TagNeighbourTable {
+public:
+    class Row {
+    public:
+        Row(const TagNeighbour *_first, const TagNeighbour *_last):first(_first),last(_last){};
+        const TagNeighbour *begin() const { return first; }
+        const TagNeighbour *end() const { return last; }
+        uint64_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+        const TagNeighbour &operator[](uint64_t i) const { return first[i]; }
+    private:
+        const TagNeighbour *first;
+        const TagNeighbour *last;
+    };
+
+    /** @brief Number of rows (nodes), 0 if the neighbours have not been computed */
+    uint64_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+    Row operator[](sgNodeID_t n) const { return Row(entries.data() + offsets[n], entries.data() + offsets[n + 1]); }
+
+    void clear();
+    void write(std::ofstream &output_file) const;
+    void read(std::ifstream &input_file);
+    /** @brief Reads the vector of vectors written before the table was stored as rows */
+    void read_nested(std::ifstream &input_file);
+    uint64_t memory_bytes() const { return offsets.capacity() * sizeof(uint64_t) + entries.capacity() * sizeof(TagNeighbour); }
+
+    std::vector<uint64_t> offsets;
+    std::vector<TagNeighbour> entries;
+};
+
 /**
  * @brief A mapper for linked reads from a LinkedReadsDatastore.
  *
@@ -107,7 +146,7 @@ public:
 
     /**
      * Creates a nieghbours matrix with all nodes where for each node the function finds all nodes that have tags that
-     * cover min_score of the total tags of each node.
+     * cover min_score of the total tags of each node. Tags mapping to 500 nodes or more are not used.
      *
      * Example:
      *      - node A has reads with tags 5, 5, 6, 7, 8
@@ -116,7 +155,10 @@ public:
      * Then B tags cover 3/6=0.5 of A reads, and A tags cover 2/5=0.4 of B reads.
      * If min_score=.5 then B is in A's neighbours, but A is not in B's
      *
-     * Results are stored in the tag_neighbours vector
+     * The tags' node counts are put in a sparse tag x node matrix, which is multiplied by its transpose in parallel by
+     * node, keeping only the neighbours above min_score as each node's row is completed.
+     *
+     * Results are stored in the tag_neighbours table
      * @param min_size
      * @param min_score
      * @param min_mapped_reads_per_tag
@@ -157,7 +199,7 @@ public:
      *  Completed using compute_all_tag_neighbours()
      *  tag_neighbours[nodeID] = [collection of 10 determined neighbours (see TagNeighbour) ...]
      */
-    std::vector<std::vector<TagNeighbour>> tag_neighbours; //not persisted yet!
+    TagNeighbourTable tag_neighbours;
     std::vector<ReadPath> read_paths;
 
     std::vector<std::vector<int64_t>> paths_in_node;
@@ -0,0 +1,131 @@
+#include "LongReadMappingStore.hpp"
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <stdexcept>
+#include <sdglib/indexers/IndexCache.hpp>
+#include <sdglib/utilities/OutputLog.hpp>
+
+void LongReadMappingStore::open(const std::string &filename) {
+    std::ifstream ifs(filename, std::ios_base::binary);
+    graph_hash = sdglib::read_index_header(ifs, LongMapStore_FT, filename);
+    mapped_file.open(filename);
+    mappings = sdglib::map_aligned_flat_vector<LongReadMapping>(ifs, mapped_file, mapping_count);
+    read_offsets = sdglib::map_aligned_flat_vector<uint64_t>(ifs, mapped_file, read_offsets_count);
+    node_offsets = sdglib::map_aligned_flat_vector<uint64_t>(ifs, mapped_file, node_offsets_count);
+    node_index = sdglib::map_aligned_flat_vector<uint64_t>(ifs, mapped_file, node_index_count);
+    if (read_offsets_count == 0 or node_offsets_count == 0 or read_offsets[read_offsets_count - 1] != mapping_count
+        or node_index_count != mapping_count)
+        throw std::runtime_error(filename + " appears to be corrupted");
+}
+
+std::vector<LongReadMapping> LongReadMappingStore::get_read_mappings(uint64_t read_id) const {
+    if (read_id + 1 >= read_offsets_count) return {};
+    return std::vector<LongReadMapping>(mappings + read_offsets[read_id], mappings + read_offsets[read_id + 1]);
+}
+
+std::vector<LongReadMapping> LongReadMappingStore::get_node_mappings(sgNodeID_t node) const {
+    std::vector<LongReadMapping> r;
+    uint64_t n = std::llabs(node);
+    if (n + 1 >= node_offsets_count) return r;
+    for (auto i = node_offsets[n]; i < node_offsets[n + 1]; ++i) r.emplace_back(mappings[node_index[i]]);
+    return r;
+}
+
+std::vector<uint64_t> LongReadMappingStore::get_node_reads(sgNodeID_t node) const {
+    std::vector<uint64_t> r;
+    uint64_t n = std::llabs(node);
+    if (n + 1 >= node_offsets_count) return r;
+    for (auto i = node_offsets[n]; i < node_offsets[n + 1]; ++i) {
+        auto rid = mappings[node_index[i]].read_id;
+        if (r.empty() or r.back() != rid) r.emplace_back(rid);
+    }
+    return r;
+}
+
+//Writes the count and padding of an array as write_aligned_flat_vector() does, the elements are written by the caller
+static void begin_aligned_array(std::ofstream &ofs, uint64_t count) {
+    static const char padding[64] = {0};
+    ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    ofs.write(padding, (64 - ((uint64_t) ofs.tellp()) % 64) % 64);
+}
+
+//Calls f(global mapping index, chunk) for consecutive chunks of at most chunk_size mappings from all runs
+static void for_each_run_chunk(const std::vector<std::string> &run_files, uint64_t chunk_size,
+                               const std::function<void(uint64_t, const std::vector<LongReadMapping> &)> &f) {
+    std::vector<LongReadMapping> chunk;
+    uint64_t first = 0;
+    for (const auto &rf: run_files) {
+        std::ifstream ifs(rf, std::ios_base::binary);
+        if (!ifs) throw std::runtime_error("Can't open mapping run " + rf);
+        while (true) {
+            chunk.resize(chunk_size);
+            ifs.read(reinterpret_cast<char *>(chunk.data()), chunk_size * sizeof(LongReadMapping));
+            chunk.resize(ifs.gcount() / sizeof(LongReadMapping));
+            if (chunk.empty()) break;
+            f(first, chunk);
+            first += chunk.size();
+        }
+    }
+}
+
+void LongReadMappingStore::write_from_runs(const std::string &filename, const std::vector<std::string> &run_files,
+                                           uint64_t read_count, uint64_t node_count, uint64_t graph_hash,
+                                           uint64_t memory_budget) {
+    auto chunk_size = std::max((uint64_t) 1, memory_budget / 4 / sizeof(LongReadMapping));
+    uint64_t total = 0;
+    for (const auto &rf: run_files) {
+        std::ifstream ifs(rf, std::ios_base::binary | std::ios_base::ate);
+        if (!ifs) throw std::runtime_error("Can't open mapping run " + rf);
+        total += (uint64_t) ifs.tellg() / sizeof(LongReadMapping);
+    }
+    sdglib::OutputLog() << "Merging " << total << " mappings from " << run_files.size() << " runs into " << filename << std::endl;
+    //Written to a temporary file and renamed, so an interrupted merge never leaves a partial store
+    std::ofstream ofs(filename + ".tmp", std::ios_base::binary);
+    sdglib::write_index_header(ofs, LongMapStore_FT, graph_hash);
+
+    //mappings, counting them per read and per node on the way
+    std::vector<uint64_t> read_offsets(read_count + 2), node_offsets(node_count + 1);
+    begin_aligned_array(ofs, total);
+    uint32_t last_read = 0;
+    for_each_run_chunk(run_files, chunk_size, [&](uint64_t, const std::vector<LongReadMapping> &chunk) {
+        for (const auto &m: chunk) {
+            if (m.read_id < last_read or m.read_id > read_count or std::llabs(m.node) >= node_count)
+                throw std::runtime_error("Mapping runs are not sorted or don't match the datastore and graph");
+            last_read = m.read_id;
+            ++read_offsets[m.read_id + 1];
+            ++node_offsets[std::llabs(m.node) + 1];
+        }
+        ofs.write(reinterpret_cast<const char *>(chunk.data()), chunk.size() * sizeof(LongReadMapping));
+    });
+    for (uint64_t i = 1; i < read_offsets.size(); ++i) read_offsets[i] += read_offsets[i - 1];
+    for (uint64_t i = 1; i < node_offsets.size(); ++i) node_offsets[i] += node_offsets[i - 1];
+    sdglib::write_aligned_flat_vector(ofs, read_offsets.data(), read_offsets.size());
+    sdglib::write_aligned_flat_vector(ofs, node_offsets.data(), node_offsets.size());
+
+    //by-node index, one pass over the runs for each range of nodes whose entries fit in the budget
+    begin_aligned_array(ofs, total);
+    auto max_entries = std::max((uint64_t) 1, memory_budget / 2 / sizeof(uint64_t));
+    std::vector<uint64_t> entries, fill;
+    for (uint64_t first_node = 0; first_node < node_count;) {
+        auto last_node = first_node + 1;
+        while (last_node < node_count and node_offsets[last_node + 1] - node_offsets[first_node] <= max_entries) ++last_node;
+        auto base = node_offsets[first_node];
+        entries.resize(node_offsets[last_node] - base);
+        if (not entries.empty()) {
+            fill.assign(node_offsets.begin() + first_node, node_offsets.begin() + last_node);
+            for_each_run_chunk(run_files, chunk_size, [&](uint64_t first, const std::vector<LongReadMapping> &chunk) {
+                for (uint64_t i = 0; i < chunk.size(); ++i) {
+                    uint64_t n = std::llabs(chunk[i].node);
+                    if (n >= first_node and n < last_node) entries[fill[n - first_node]++ - base] = first + i;
+                }
+            });
+            ofs.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(uint64_t));
+        }
+        first_node = last_node;
+    }
+    ofs.close();
+    if (!ofs or std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Error writing " + filename);
+}
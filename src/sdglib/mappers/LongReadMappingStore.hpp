@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sdglib/types/MappingTypes.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+
+/**
+ * @brief Read-only, memory-mapped store of long read mappings, indexed by read and by node.
+ *
+ * The file holds the mappings sorted as LongReadMappings (by read), the offsets of each read's mappings and, for each
+ * node, the indexes of the mappings to it in either orientation. Nothing is loaded: lookups go straight to the
+ * mapping, so a store can be much larger than memory. Stores are written by LongReadsMapper::map_reads_to_store().
+ */
+class LongReadMappingStore {
+public:
+    LongReadMappingStore() = default;
+    explicit LongReadMappingStore(const std::string &filename) { open(filename); }
+
+    void open(const std::string &filename);
+
+    uint64_t size() const { return mapping_count; }
+
+    const LongReadMapping &operator[](uint64_t i) const { return mappings[i]; }
+
+    const LongReadMapping *begin() const { return mappings; }
+    const LongReadMapping *end() const { return mappings + mapping_count; }
+
+    std::vector<LongReadMapping> get_read_mappings(uint64_t read_id) const;
+
+    /**
+     * @brief Mappings to node in either orientation, in read order
+     */
+    std::vector<LongReadMapping> get_node_mappings(sgNodeID_t node) const;
+
+    /**
+     * @brief Ids of the reads with mappings to node in either orientation, sorted and without repeats
+     */
+    std::vector<uint64_t> get_node_reads(sgNodeID_t node) const;
+
+    uint64_t get_graph_hash() const { return graph_hash; }
+
+    /**
+     * @brief Writes a store from runs of mappings, each sorted, with increasing read ids from one run to the next.
+     *
+     * Runs are read in chunks, and the by-node index is built in passes over node ranges, so at most about
+     * memory_budget bytes are used besides the per-read and per-node offsets.
+     * @param run_files files with the raw LongReadMapping records of each run
+     * @param read_count number of reads in the datastore, mappings have read ids up to read_count
+     * @param node_count number of nodes in the graph, mappings have node ids below node_count
+     * @param graph_hash content hash of the graph, to detect stale stores
+     */
+    static void write_from_runs(const std::string &filename, const std::vector<std::string> &run_files,
+                                uint64_t read_count, uint64_t node_count, uint64_t graph_hash, uint64_t memory_budget);
+
+private:
+    sdglib::MemoryMappedFile mapped_file;
+    uint64_t graph_hash = 0;
+    const LongReadMapping *mappings = nullptr;
+    uint64_t mapping_count = 0;
+    const uint64_t *read_offsets = nullptr;  //mappings of read r are [read_offsets[r], read_offsets[r+1])
+    uint64_t read_offsets_count = 0;
+    const uint64_t *node_offsets = nullptr;  //mappings to node n are node_index[node_offsets[n]...node_offsets[n+1]-1]
+    uint64_t node_offsets_count = 0;
+    const uint64_t *node_index = nullptr;
+    uint64_t node_index_count = 0;
+};
@@ -10,6 +10,8 @@
 #include <sstream>
 #include <sdglib/utilities/OutputLog.hpp>
 #include <sdglib/utilities/omp_safe.hpp>
+#include <sdglib/utilities/Metrics.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
 #include <sdglib/utilities/io_helpers.hpp>
 #include <sdglib/utilities/most_common_helper.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
@@ -145,15 +147,20 @@ const sdgVersion_t LongReadsMapper::min_compat = 0x0003;
 std::string LongReadsMapper::ls(int level,bool recursive) const {
     std::stringstream ss;
     std::string spacer(2 * level, ' ');
-    ss << spacer << "Long Reads Mapper: "<<mappings.size()<<" raw mappings" << std::endl;
+    ss << spacer << "Long Reads Mapper: "<<mapping_count()<<" raw mappings" << std::endl;
     return ss.str();
 }
 
 void LongReadsMapper::print_status() const {
-    sdglib::OutputLog()<<"Long read mappings: "<<mappings.size()<<" mappings."<<std::endl;
+    sdglib::OutputLog()<<"Long read mappings: "<<mapping_count()<<" mappings."<<std::endl;
+}
+
+uint64_t LongReadsMapper::mapping_count() const {
+    return store ? store->size() : mappings.size();
 }
 
 std::vector<LongReadMapping> LongReadsMapper::get_raw_mappings_from_read(uint64_t read_id) const {
+    if (store) return store->get_read_mappings(read_id);
     std::vector<LongReadMapping> r;
     if (first_mapping[read_id]!=-1) {
         for (auto i = first_mapping[read_id];i<mappings.size() and mappings[i].read_id==read_id;++i) r.emplace_back(mappings[i]);
@@ -191,18 +198,18 @@ void LongReadsMapper::get_all_kmer_matches(const NKmerIndex &assembly_kmers,
     if (matches.size() < read_kmers.size()) matches.resize(read_kmers.size());
     uint64_t no_match=0,single_match=0,multi_match=0; //DEBUG
     for (auto i=0;i<read_kmers.size();++i){
+        matches[i].clear(); //before the early exit, matches are reused across reads
         if (!kmer_in_asm[i]) {
             ++no_match;
             continue;
         }
-        matches[i].clear();
         auto first = assembly_kmers.find(read_kmers[i].second);
         for (auto it = first; it != assembly_kmers.end() && it->kmer == read_kmers[i].second; ++it) {
             int32_t offset=it->offset; //so far, this is +1 and the sign indicate direction of kmer in contig
             sgNodeID_t node=it->contigID; //so far, this is always positive
             if (read_kmers[i].first != (offset>0) ) {
                 node=-node;
-                offset=( (int) sg.nodes[std::llabs(it->contigID)].sequence.size() ) - std::abs(offset);
+                offset=( (int) sg.get_node_size(std::llabs(it->contigID)) ) - std::abs(offset);
             }
             else offset=std::abs(offset)-1;
             matches[i].emplace_back(node, offset);
@@ -215,103 +222,14 @@ void LongReadsMapper::get_all_kmer_matches(const NKmerIndex &assembly_kmers,
 //            <<multi_match<<" ("<< (multi_match*100/read_kmers.size()) << "%) multi match"<<std::endl;
 }
 
-void LongReadsMapper::count_candidates(std::vector<unsigned char> &candidate_counts,
-                                      std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                                  uint32_t read_kmers_size){
-    //beware you need the size! otherwise there is a size from the matches and not from the reads!
-    for (auto i=0;i<read_kmers_size;++i) {
-        for (auto m:matches[i]) {
-            uint32_t linear_node = (m.first>0) ? m.first : sg.nodes.size()+std::abs(m.first);
-            uint16_t count_so_far=candidate_counts[ linear_node ]+1;
-            candidate_counts[ linear_node ] = (count_so_far > UINT8_MAX) ? UINT8_MAX : count_so_far;
-        }
-    }
-}
-
 std::vector<LongReadMapping> LongReadsMapper::alignment_blocks(uint32_t readID,
-                                                              std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                                                              uint32_t read_kmers_size,
-                                                              const std::vector<unsigned char> &candidate_counts) {
-//    std::cout<<"Alignment block search starting with candidates:";
-//    for (auto c:candidates) std::cout<<" "<<c;
-//    std::cout<<std::endl;
-    std::vector<LongReadMapping> blocks;
-    //transform to matches per candidate;
-    std::unordered_map<int32_t , std::vector<std::pair<int32_t,int32_t>>> candidate_hits;
-    candidate_hits.reserve(matches.size()/2);
-    for (auto p=0;p<read_kmers_size;++p){
-        for (auto m:matches[p]) {
-            uint32_t linear_node = (m.first>0) ? m.first : sg.nodes.size()+std::abs(m.first);
-            if (candidate_counts[linear_node] > min_number_of_node_occurrences) {
-                candidate_hits[m.first].emplace_back(p,m.second);
-            }
-        }
-    }
-
-    for (auto &ch:candidate_hits){
-        int start_p=0;
-        int start_t=0;
-        int last_delta=0;
-        int last_t=-1000;
-        int last_p=-1000;
-        int chain=-1;
-        auto &chits=ch.second;
-        std::vector<bool> used(ch.second.size());
-        //std::sort(chits.begin(),chits.end());
-        //Filter hits on overused positions
-        for (auto starti=0 ; starti<chits.size() ; ++starti){
-            auto endi=starti;
-            while (endi<chits.size()-1 and chits[starti].first==chits[endi+1].first) ++endi;
-            bool discard=false;
-            if (endi>starti+max_hits_to_candidate) discard=true; //more than 5 hits to candidate ->discard
-            else {
-                for (auto x=starti;x<endi;++x) {
-                    if (chits[x+1].second-chits[x].second<max_jump) discard=true;
-                }
-            }
-            if (discard) for (auto x=starti;x<=endi;++x) used[x]=true;
-        }
+                                                              const std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
+                                                              uint32_t read_kmers_size) {
+    return chainer().alignment_blocks(readID, matches, read_kmers_size);
+}
 
-        for (auto starti=0 ; starti<chits.size() ; ++starti){
-            if (used[starti]) continue;
-            chain=1;
-            start_p=chits[starti].first;
-            start_t=chits[starti].second;
-            last_p=chits[starti].first;
-            last_t=chits[starti].second;
-            last_delta=last_t-last_p;
-            used[starti]=true;
-            //std::cout<<"New chain to "<<ch.first<<" started with "<<start_p<<"->"<<start_t<<std::endl;
-            for (auto i=starti+1;i<chits.size() and chits[i].first-last_p<=max_jump;++i){
-                auto &h=chits[i];
-                //if not in chain, continue;
-                if (used[i] or last_p > h.first or last_t > h.second or h.second-last_t > max_jump
-                    or llabs(last_delta-(h.second-h.first))>max_delta_change) {
-                    //std::cout<<" skipping "<<h.first<<"->"<<h.second<<std::endl;
-                    continue;
-                }
-                ++chain;
-                last_p=h.first;
-                last_t=h.second;
-                last_delta=last_t-last_p;
-                used[i]=true;
-                //if (start_p==61 and start_t==3621) std::cout<<" chain is now length "<<chain<<" after adding "<<h.first<<"->"<<h.second<<" (delta "<<h.first-h.second<<")"<<std::endl;
-            }
-            if (chain>=min_chain and last_p-start_p>=min_size) {
-                LongReadMapping b;
-                b.read_id=readID;
-                b.qStart=start_p;
-                b.qEnd=last_p;
-                b.node=ch.first;
-                b.nStart=start_t;
-                b.nEnd=last_t;
-                b.score=chain;
-                blocks.push_back(b);
-            }
-        }
-    }
-    std::sort(blocks.begin(),blocks.end());
-    return blocks;
+SparseChainer LongReadsMapper::chainer() const {
+    return SparseChainer(min_number_of_node_occurrences, max_hits_to_candidate, max_jump, max_delta_change, min_chain, min_size);
 }
 
 std::vector<LongReadMapping> LongReadsMapper::filter_blocks(std::vector<LongReadMapping> &blocks,
@@ -333,12 +251,19 @@ std::vector<LongReadMapping> LongReadsMapper::filter_blocks(std::vector<LongRead
 }
 
 void LongReadsMapper::map_reads(const std::unordered_set<uint32_t> &readIDs) {
+    SDG_SCOPED_TIMER(timer, "LongReadsMapper::map_reads");
     mappings.clear();
+    store.reset();
     std::shared_ptr<NKmerIndex> nkindex;
     std::shared_ptr<SatKmerIndex> skindex;
-    if (sat_kmer_index) skindex.reset(new SatKmerIndex(sg,k,max_index_freq));
-    else nkindex.reset(new NKmerIndex(sg,k,max_index_freq));
+    {
+        SDG_SCOPED_TIMER(index_timer, "LongReadsMapper::map_reads/index");
+        if (sat_kmer_index) skindex = SatKmerIndex::load_or_build(sg,k,max_index_freq);
+        else nkindex = NKmerIndex::load_or_build(sg,k,max_index_freq,0.01,prefix_bucket_index);
+    }
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     std::vector<std::vector<LongReadMapping>> thread_mappings(omp_get_max_threads());
+    sdglib::CostBalancedChunks chunks(1, datastore.size()+1, [&](uint64_t rid){ return datastore.read_to_fileRecord[rid].record_size; });
     uint32_t num_reads_done(0);
     uint64_t no_matches(0),single_matches(0),multi_matches(0);
 #pragma omp parallel
@@ -351,10 +276,14 @@ void LongReadsMapper::map_reads(const std::unordered_set<uint32_t> &readIDs) {
         std::vector<std::vector<std::pair<int32_t, int32_t>>> node_matches; //node, offset
         const char * query_sequence_ptr;
 
-        std::vector<unsigned char> candidate_counts(sg.nodes.size()*2);
+        auto read_chainer=chainer();
+        SDG_STAGE_CLOCK(kmerise_clock);
+        SDG_STAGE_CLOCK(lookup_clock);
+        SDG_STAGE_CLOCK(chain_clock);
 
-#pragma omp for schedule(static,1000) reduction(+:no_matches,single_matches,multi_matches,num_reads_done)
-        for (uint32_t readID = 1; readID <= datastore.size(); ++readID) {
+#pragma omp for schedule(dynamic,1) reduction(+:no_matches,single_matches,multi_matches,num_reads_done)
+        for (uint64_t chunk = 0; chunk < chunks.size(); ++chunk)
+        for (uint32_t readID = chunks.begin(chunk); readID < chunks.end(chunk); ++readID) {
             if (++num_reads_done%10000 == 0) {
                 sdglib::OutputLog() << "Thread #"<<omp_get_thread_num() <<" processing its read #" << num_reads_done << std::endl;
             }
@@ -364,33 +293,31 @@ void LongReadsMapper::map_reads(const std::unordered_set<uint32_t> &readIDs) {
             }
             if (datastore.read_to_fileRecord[readID].record_size< 2 * min_size ) continue;
             //========== 1. Get read sequence, kmerise, get all matches ==========
+            SDG_STAGE_START(kmerise_clock);
             query_sequence_ptr = sequenceGetter.get_read_sequence(readID);
             read_kmers.clear();
             skf.produce_all_kmers(query_sequence_ptr, read_kmers);
+            SDG_STAGE_STOP(kmerise_clock, 1);
 
             if ( read_kmers.size()< 2 * min_size) {
                 continue;
             }
 
+            SDG_STAGE_START(lookup_clock);
             if (sat_kmer_index) {
                 get_sat_kmer_matches(*skindex,node_matches, read_kmers);
             } else {
-                std::vector<bool> kmer_in_assembly(read_kmers.size());
-
-                for (uint64_t i = 0; i < read_kmers.size(); ++i) {
-                    kmer_in_assembly[i] = nkindex->filter(read_kmers[i].second);
-                }
+                std::vector<bool> kmer_in_assembly;
+                nkindex->filter(read_kmers, kmer_in_assembly);
                 get_all_kmer_matches(*nkindex, node_matches, read_kmers, kmer_in_assembly);
             }
 
-            //========== 2. Find match candidates in fixed windows ==========
-
-            count_candidates(candidate_counts, node_matches,read_kmers.size());
+            SDG_STAGE_STOP(lookup_clock, read_kmers.size());
 
-            //========== 3. Create alignment blocks from candidates ==========
-
-            auto blocks(alignment_blocks(readID,node_matches,read_kmers.size(), candidate_counts));
-            std::memset(candidate_counts.data(), 0, candidate_counts.size());
+            //========== 2. Find match candidates and create alignment blocks from them ==========
+            SDG_STAGE_START(chain_clock);
+            auto blocks(read_chainer.alignment_blocks(readID,node_matches,read_kmers.size()));
+            SDG_STAGE_STOP(chain_clock, 1);
 
             //========== 4. Construct mapping path ==========
             if (blocks.empty()) ++no_matches;
@@ -411,7 +338,14 @@ void LongReadsMapper::map_reads(const std::unordered_set<uint32_t> &readIDs) {
 
             private_results.insert(private_results.end(),fblocks.begin(),fblocks.end());
         }
+        SDG_STAGE_RECORD(kmerise_clock, "LongReadsMapper::map_reads/kmerise");
+        SDG_STAGE_RECORD(lookup_clock, "LongReadsMapper::map_reads/lookup");
+        SDG_STAGE_RECORD(chain_clock, "LongReadsMapper::map_reads/chain");
     }
+    SDG_TIMER_ITEMS(timer, no_matches+single_matches+multi_matches);
+    SDG_COUNTER_ADD("LongReadsMapper::map_reads/single_match", single_matches);
+    SDG_COUNTER_ADD("LongReadsMapper::map_reads/multi_match", multi_matches);
+    SDG_SCOPED_TIMER(merge_timer, "LongReadsMapper::map_reads/merge");
     //TODO: report read and win coverage by winners vs. by loosers
 //    sdglib::OutputLog()<<"Read window results:    "<<window_low_score<<" low score    "<<window_close_second<<" close second    "<<window_hit<<" hits"<<std::endl;
     sdglib::OutputLog()<<"Read results:    "<<no_matches<<" no match    "<<single_matches<<" single match    "<<multi_matches<<" multi matches"<<std::endl;
@@ -424,15 +358,18 @@ void LongReadsMapper::map_reads(const std::unordered_set<uint32_t> &readIDs) {
 
 void LongReadsMapper::map_reads_to_best_nodes(const std::unordered_set<uint32_t> &readIDs) {
     mappings.clear();
+    store.reset();
     std::shared_ptr<NKmerIndex> nkindex;
     std::shared_ptr<SatKmerIndex> skindex;
-    if (sat_kmer_index) skindex.reset(new SatKmerIndex(sg,k,max_index_freq));
-    else nkindex.reset(new NKmerIndex(sg,k,max_index_freq));
+    if (sat_kmer_index) skindex = SatKmerIndex::load_or_build(sg,k,max_index_freq);
+    else nkindex = NKmerIndex::load_or_build(sg,k,max_index_freq,0.01,prefix_bucket_index);
     sdglib::OutputLog() << "Index created" << std::endl;
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     std::vector<std::vector<LongReadMapping>> thread_mappings(omp_get_max_threads());
+    sdglib::CostBalancedChunks chunks(1, datastore.size()+1, [&](uint64_t rid){ return datastore.read_to_fileRecord[rid].record_size; });
     uint32_t num_reads_done(0);
     uint64_t no_matches(0),single_matches(0),multi_matches(0);
-#pragma omp parallel default(none) shared(thread_mappings,nkindex,skindex,no_matches,single_matches,multi_matches,num_reads_done,readIDs) shared(std::cout)
+#pragma omp parallel default(none) shared(thread_mappings,nkindex,skindex,no_matches,single_matches,multi_matches,num_reads_done,readIDs,chunks) shared(std::cout)
     {
         StreamKmerFactory skf(k);
         std::vector<std::pair<bool, uint64_t>> read_kmers;
@@ -442,13 +379,13 @@ void LongReadsMapper::map_reads_to_best_nodes(const std::unordered_set<uint32_t>
         std::vector<std::vector<std::pair<int32_t, int32_t>>> node_matches; //node, offset
         const char * query_sequence_ptr;
 
-        std::vector<unsigned char> candidate_counts(sg.nodes.size()*2);
         std::vector<chain> best_window_chain;
         auto t=std::chrono::high_resolution_clock::now();
         auto tkhits=t-t,tichain=t-t,techain=t-t,ttoal=t-t;
 
-#pragma omp for schedule(static,200) reduction(+:no_matches,single_matches,multi_matches,num_reads_done)
-        for (uint32_t readID = 1; readID <= datastore.size(); ++readID) {
+#pragma omp for schedule(dynamic,1) reduction(+:no_matches,single_matches,multi_matches,num_reads_done)
+        for (uint64_t chunk = 0; chunk < chunks.size(); ++chunk)
+        for (uint32_t readID = chunks.begin(chunk); readID < chunks.end(chunk); ++readID) {
         //for (uint32_t readID = 598822; readID < 598823; ++readID) {
         //for (uint32_t readID = 3024; readID < 3024; ++readID) {
 
@@ -478,11 +415,8 @@ void LongReadsMapper::map_reads_to_best_nodes(const std::unordered_set<uint32_t>
             if (sat_kmer_index) {
                 get_sat_kmer_matches(*skindex,node_matches, read_kmers);
             } else {
-                std::vector<bool> kmer_in_assembly(read_kmers.size());
-
-                for (uint64_t i = 0; i < read_kmers.size(); ++i) {
-                    kmer_in_assembly[i] = nkindex->filter(read_kmers[i].second);
-                }
+                std::vector<bool> kmer_in_assembly;
+                nkindex->filter(read_kmers, kmer_in_assembly);
                 get_all_kmer_matches(*nkindex, node_matches, read_kmers, kmer_in_assembly);
             }
 
@@ -533,27 +467,145 @@ std::vector<LongReadMapping> LongReadsMapper::map_sequence(const NKmerIndex &nki
     std::vector<std::vector<std::pair<int32_t, int32_t>>> node_matches; //node, offset
     read_kmers.clear();
 
-    std::vector<unsigned char> candidate_counts(sg.nodes.size()*2);
     skf.produce_all_kmers(query_sequence_ptr, read_kmers);
 
-    std::vector<bool> kmer_in_assembly(read_kmers.size());
-
-    for (uint64_t i = 0; i < read_kmers.size(); ++i) {
-        kmer_in_assembly[i] = nkindex.filter(read_kmers[i].second);
-    }
+    std::vector<bool> kmer_in_assembly;
+    nkindex.filter(read_kmers, kmer_in_assembly);
     get_all_kmer_matches(nkindex, node_matches, read_kmers, kmer_in_assembly);
 
-    //========== 2. Find match candidates in fixed windows ==========
+    //========== 2. Find match candidates and create alignment blocks from them ==========
+    return alignment_blocks(seq_id,node_matches,read_kmers.size());
 
-    count_candidates(candidate_counts, node_matches,read_kmers.size());
+}
 
-    //========== 3. Create alignment blocks from candidates ==========
+void LongReadsMapper::map_reads_to_store(const std::string &filename, uint64_t memory_budget) {
+    SDG_SCOPED_TIMER(timer, "LongReadsMapper::map_reads_to_store");
+    //a run started with other parameters or on another graph can't be resumed
+    std::ostringstream signature;
+    signature << "sdg long read mapping shards, graph " << sg.content_hash() << " reads " << datastore.size() << " k "
+              << (int) k << " max_index_freq " << max_index_freq << " min_size " << min_size << " min_chain "
+              << min_chain << " max_jump " << max_jump << " max_delta_change " << max_delta_change
+              << " max_hits_to_candidate " << max_hits_to_candidate << " min_number_of_node_occurrences "
+              << min_number_of_node_occurrences << " sat_kmer_index " << sat_kmer_index;
+    auto progress_filename = filename + ".progress";
+    std::vector<std::string> run_files;
+    uint64_t next_read = 1, mapped_reads = 0;
+    {
+        std::ifstream progress(progress_filename);
+        std::string line;
+        if (std::getline(progress, line)) {
+            if (line != signature.str())
+                throw std::runtime_error(progress_filename + " is from a run with other parameters or graph, remove it to start again");
+            uint64_t first, last, count;
+            while (progress >> first >> last >> count) {
+                run_files.emplace_back(filename + ".run" + std::to_string(run_files.size()));
+                next_read = last + 1;
+                mapped_reads += last - first + 1;
+            }
+            sdglib::OutputLog() << "Resuming mapping to " << filename << " from read " << next_read << ", "
+                                << run_files.size() << " shards already mapped" << std::endl;
+        }
+        else std::ofstream(progress_filename) << signature.str() << std::endl;
+    }
 
-    return alignment_blocks(seq_id,node_matches,read_kmers.size(), candidate_counts);
+    std::shared_ptr<NKmerIndex> nkindex;
+    std::shared_ptr<SatKmerIndex> skindex;
+    if (next_read <= datastore.size()) {
+        if (sat_kmer_index) skindex = SatKmerIndex::load_or_build(sg, k, max_index_freq);
+        else nkindex = NKmerIndex::load_or_build(sg, k, max_index_freq, 0.01, prefix_bucket_index);
+    }
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
+    const uint64_t batch_reads = 20 * omp_get_max_threads(); //enough reads to keep all threads busy
+    std::vector<LongReadMapping> shard_mappings;
+    while (next_read <= datastore.size()) {
+        //the shard grows a batch of reads at a time until its mappings take half of the budget
+        const uint64_t first_read = next_read;
+        shard_mappings.clear();
+        uint64_t batch_first = 0, batch_last = 0;
+#pragma omp parallel
+        {
+            StreamKmerFactory skf(k);
+            std::vector<std::pair<bool, uint64_t>> read_kmers;
+            std::vector<std::vector<std::pair<int32_t, int32_t>>> node_matches;
+            std::vector<bool> kmer_in_assembly;
+            ReadSequenceBuffer sequenceGetter(datastore);
+            auto read_chainer = chainer();
+            std::vector<LongReadMapping> private_results;
+            while (true) {
+#pragma omp single
+                {
+                    batch_first = next_read;
+                    if (shard_mappings.size() * sizeof(LongReadMapping) >= memory_budget / 2) batch_first = datastore.size() + 1;
+                    batch_last = std::min((uint64_t) datastore.size(), batch_first + batch_reads - 1);
+                    if (batch_first <= datastore.size()) next_read = batch_last + 1;
+                }
+                if (batch_first > datastore.size()) break;
+#pragma omp for schedule(dynamic,1)
+                for (uint64_t readID = batch_first; readID <= batch_last; ++readID) {
+                    if (datastore.read_to_fileRecord[readID].record_size < 2 * min_size) continue;
+                    read_kmers.clear();
+                    skf.produce_all_kmers(sequenceGetter.get_read_sequence(readID), read_kmers);
+                    if (read_kmers.size() < 2 * min_size) continue;
+                    if (sat_kmer_index) get_sat_kmer_matches(*skindex, node_matches, read_kmers);
+                    else {
+                        nkindex->filter(read_kmers, kmer_in_assembly);
+                        get_all_kmer_matches(*nkindex, node_matches, read_kmers, kmer_in_assembly);
+                    }
+                    auto blocks = read_chainer.alignment_blocks(readID, node_matches, read_kmers.size());
+                    private_results.insert(private_results.end(), blocks.begin(), blocks.end());
+                }
+#pragma omp critical(shard_mappings)
+                shard_mappings.insert(shard_mappings.end(), private_results.begin(), private_results.end());
+                private_results.clear();
+#pragma omp barrier
+            }
+        }
+        const uint64_t last_read = next_read - 1;
+        sdglib::sort(shard_mappings.begin(), shard_mappings.end());
+        run_files.emplace_back(filename + ".run" + std::to_string(run_files.size()));
+        {
+            std::ofstream run(run_files.back(), std::ios_base::binary);
+            run.write(reinterpret_cast<const char *>(shard_mappings.data()), shard_mappings.size() * sizeof(LongReadMapping));
+            run.close();
+            if (!run) throw std::runtime_error("Error writing " + run_files.back());
+        }
+        //the shard only counts as done once its run is complete on disk
+        std::ofstream(progress_filename, std::ios_base::app) << first_read << " " << last_read << " " << shard_mappings.size() << std::endl;
+        sdglib::OutputLog() << "Reads " << first_read << "-" << last_read << " mapped, " << shard_mappings.size()
+                            << " mappings written to " << run_files.back() << std::endl;
+        mapped_reads += last_read - first_read + 1;
+    }
+    shard_mappings.clear();
+    shard_mappings.shrink_to_fit();
+    nkindex.reset();
+    skindex.reset();
+    SDG_TIMER_ITEMS(timer, mapped_reads);
+
+    LongReadMappingStore::write_from_runs(filename, run_files, datastore.size(), sg.nodes.size(), sg.content_hash(), memory_budget);
+    for (const auto &rf: run_files) std::remove(rf.c_str());
+    std::remove(progress_filename.c_str());
+}
 
+void LongReadsMapper::load_store(const std::string &filename) {
+    auto new_store = std::make_shared<LongReadMappingStore>(filename);
+    if (new_store->get_graph_hash() != sg.content_hash())
+        sdglib::OutputLog(sdglib::LogLevels::WARN) << filename << " was mapped to a different graph" << std::endl;
+    mappings.clear();
+    mappings.shrink_to_fit();
+    store = new_store;
+    update_indexes();
 }
 
 void LongReadsMapper::update_indexes() {
+    if (store) {
+        //the store has its own read index, only the reads in each node are kept in memory
+        first_mapping.clear();
+        reads_in_node.clear();
+        reads_in_node.resize(sg.nodes.size());
+#pragma omp parallel for schedule(dynamic,10000)
+        for (sgNodeID_t n = 1; n < reads_in_node.size(); ++n) reads_in_node[n] = store->get_node_reads(n);
+        return;
+    }
     if (!std::is_sorted(mappings.begin(), mappings.end())) {
         sdglib::OutputLog() << "Sorting mappings" << std::endl;
         sdglib::sort(mappings.begin(), mappings.end());
@@ -592,6 +644,7 @@ void LongReadsMapper::read(std::ifstream &inf) {
     inf.read(reinterpret_cast<char *>(&max_delta_change), sizeof(max_delta_change));
 
     sdglib::read_flat_vector(inf, mappings);
+    store.reset();
 
     sdglib::OutputLog() << "Updating read mapping indexes!" << std::endl;
     update_indexes();
@@ -613,7 +666,13 @@ void LongReadsMapper::write(std::ofstream &ofs) {
     ofs.write(reinterpret_cast<const char *>(&max_jump), sizeof(max_jump));
     ofs.write(reinterpret_cast<const char *>(&max_delta_change), sizeof(max_delta_change));
 
-    sdglib::write_flat_vector(ofs, mappings);
+    if (store) {
+        //written as a flat vector, straight from the store
+        uint64_t count = store->size();
+        ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        ofs.write(reinterpret_cast<const char *>(store->begin()), sizeof(LongReadMapping) * count);
+    }
+    else sdglib::write_flat_vector(ofs, mappings);
     sdglib::OutputLog() << "Done!" << std::endl;
 }
 
@@ -633,8 +692,10 @@ LongReadsMapper& LongReadsMapper::operator=(const LongReadsMapper &other) {
     }
     if (&sg != &other.sg and &datastore != &other.datastore) { throw std::runtime_error("Can only LongReadsMappers from the same SequenceDistanceGraph and LongReadsDatastore"); }
     sat_kmer_index = other.sat_kmer_index;
+    prefix_bucket_index = other.prefix_bucket_index;
     k = other.k;
     mappings = other.mappings;
+    store = other.store;
     update_indexes();
     return *this;
 }
@@ -642,7 +703,10 @@ LongReadsMapper& LongReadsMapper::operator=(const LongReadsMapper &other) {
 std::vector<std::vector<LongReadMapping>> LongReadsMapper::filter_mappings_by_size_and_id(int64_t size, float id) const {
     std::vector<std::vector<LongReadMapping>> filtered_read_mappings;
     filtered_read_mappings.resize(datastore.size()+1);
-    for (auto &m:mappings){
+    auto begin = store ? store->begin() : mappings.data();
+    auto end = store ? store->end() : mappings.data() + mappings.size();
+    for (auto mi = begin; mi < end; ++mi){
+        auto &m = *mi;
         if (m.nEnd-m.nStart>=size and 100.0*m.score/(m.nEnd-m.nStart)>=id){
             filtered_read_mappings[m.read_id].emplace_back(m);
         }
@@ -846,16 +910,17 @@ std::vector<ReadCacheItem> LongReadsMapper::create_read_paths(const std::vector<
     
     // TODO: HACK! Move this to somewhere it makes more sense
     read_paths.resize(filtered_read_mappings.size());
-    
+
+    DistanceGraphCSR frozen_sg(sg);
 #pragma omp parallel for
     for (uint32_t rcp = 0; rcp < read_cache.size(); rcp++) {
-        read_paths[read_cache[rcp].id] = create_read_path(filtered_read_mappings[read_cache[rcp].id], read_path_params, false, read_cache[rcp].seq);
+        read_paths[read_cache[rcp].id] = create_read_path(filtered_read_mappings[read_cache[rcp].id], read_path_params, false, read_cache[rcp].seq, &frozen_sg);
     }
 
     return read_cache;
 }
 
-std::vector<sgNodeID_t> LongReadsMapper::create_read_path(const std::vector<LongReadMapping> mappings, const ReadPathParams &read_path_params, bool verbose, const std::string& read_seq) {
+std::vector<sgNodeID_t> LongReadsMapper::create_read_path(const std::vector<LongReadMapping> mappings, const ReadPathParams &read_path_params, bool verbose, const std::string& read_seq, const DistanceGraphCSR * frozen_sg) {
     uint64_t rid=0;
     if (!mappings.empty()) rid=mappings[0].read_id;
     std::vector<sgNodeID_t> read_path;
@@ -871,13 +936,20 @@ std::vector<sgNodeID_t> LongReadsMapper::create_read_path(const std::vector<Long
 
         //this checks the direct connection
         bool need_pathing = true;
-        for (const auto &l : sg.get_fw_links(m1.node)) {
-            if (l.dest == m2.node) need_pathing = false;
+        if (frozen_sg != nullptr) {
+            for (const auto &l : frozen_sg->get_fw_links(m1.node)) {
+                if (l.dest == m2.node) need_pathing = false;
+            }
+        }
+        else {
+            for (const auto &l : sg.get_fw_links(m1.node)) {
+                if (l.dest == m2.node) need_pathing = false;
+            }
         }
 
         int32_t ad;
         if (need_pathing){
-            ad = (m2.qStart-m2.nStart)-(m1.qEnd+sg.nodes[std::abs(m1.node)].sequence.size()-m1.nEnd);
+            ad = (m2.qStart-m2.nStart)-(m1.qEnd+sg.get_node_size(std::abs(m1.node))-m1.nEnd);
             auto pd = ad+read_path_params.default_overlap_distance*2; // default_overlap_distance
             auto max_path_size = std::max((int32_t)(pd*read_path_params.path_distance_multiplier),pd+read_path_params.min_path_distance); // path_distance_multiplier, min_path_distance
             if (max_path_size < 0) {
@@ -902,7 +974,8 @@ std::vector<sgNodeID_t> LongReadsMapper::create_read_path(const std::vector<Long
 
             bool found_in_map = place_in_map != all_paths_between.end();
             const std::vector<SequenceDistanceGraphPath>& paths = ( found_in_map ?
-                    place_in_map->second :
+                    place_in_map->second : frozen_sg != nullptr ?
+                    frozen_sg->find_all_paths_between(m1.node, m2.node, max_path_size, read_path_params.max_path_nodes, false) :
                     sg.find_all_paths_between(m1.node, m2.node, max_path_size, read_path_params.max_path_nodes, false));
 
             if (!found_in_map) {
@@ -928,7 +1001,7 @@ std::vector<sgNodeID_t> LongReadsMapper::create_read_path(const std::vector<Long
                 WorkSpace pws;
                 SequenceDistanceGraph psg(pws);
                 for (const auto &p : paths) {
-                    psg.add_node(Node(p.sequence()));
+                    psg.add_node(p.sequence(),NodeStatus::Active);
                 }
 
                 //Create, parametrise and index a mapper to the paths SG
@@ -1058,10 +1131,11 @@ datastore(ds),
 sg(o.sg),
 read_paths(o.read_paths),
 first_mapping(o.first_mapping),
+store(o.store),
 k(o.k)
 {}
 
 std::ostream &operator<<(std::ostream &os, const LongReadsMapper &lorm) {
-    os << "Long Reads Mapper: "<<lorm.mappings.size()<<" raw mappings";
+    os << "Long Reads Mapper: "<<lorm.mapping_count()<<" raw mappings";
     return os;
 }
@@ -13,6 +13,8 @@
 #include <sdglib/indexers/NKmerIndex.hpp>
 #include <sdglib/indexers/SatKmerIndex.hpp>
 #include <sdglib/types/MappingTypes.hpp>
+#include <sdglib/mappers/SparseChainer.hpp>
+#include <sdglib/mappers/LongReadMappingStore.hpp>
 #include <sdglib/utilities/hashing_helpers.hpp>
 #include <sdglib/Version.hpp>
 #include <sdglib/datastores/ReadSequenceBuffer.hpp>
@@ -20,6 +22,7 @@
 class LongReadsDatastore;
 
 class WorkSpace;
+class DistanceGraphCSR;
 struct ReadPathParams {
     int default_overlap_distance = 199;
     float path_distance_multiplier = 1.5;
@@ -167,33 +170,28 @@ public:
                               const std::vector<std::pair<bool, uint64_t>> &read_kmers,
                               const std::vector<bool> &kmer_in_asm);
 
-    /**
-     * Using the populated matches collection (see het_all_kmer_matches()) returns a collection of nodeIDs that have more than 50 matches with that particular read.
-     *
-     * @param matches matches vector
-     * @param read_kmers_size number of kmers in the read
-     * @return set of nodeIDs of nodes with more than 50 matches to the read
-     */
-    void
-    count_candidates(std::vector<unsigned char> &candidate_counts,
-                     std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                     uint32_t read_kmers_size);
-
     /**
      * This function will check for continuous blocks of alignments between the read and the window candidates produced by window_candidates() using the matches prudiced by get_allKmer_matches()
      * The result is a vector af LongReadMappings where each element describes a mapping of a block of the read to a block of a node (see struct LongReadMapping)
      *
      * Each LongReadMapping describes a chain of matching kmers in the read and the node where the matches advance at the same pace (within a jumping distance allowance)
      *
+     * Only nodes with more than min_number_of_node_occurrences matches are considered. This builds a SparseChainer for
+     * the call, use chainer() to get one to reuse across reads.
+     *
      * @param readID id of the analyzed read
      * @param matches matches collection produced by get_allKmer_matches()
      * @param read_kmers_size Number of kmers in the read
-     * @param candidates collection of candidate matches produced by window_candidates()
      * @return collection of readtonode mappings (LongReadMapping)
      */
     std::vector<LongReadMapping> alignment_blocks(uint32_t readID,
-                                                  std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                                                  uint32_t read_kmers_size, const std::vector<unsigned char> &candidate_counts);
+                                                  const std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
+                                                  uint32_t read_kmers_size);
+
+    /**
+     * @brief A SparseChainer with this mapper's chaining parameters
+     */
+    SparseChainer chainer() const;
 
     /**
      * Given a list of blocks the filter will discard overlapping blocks keeping those with the max span and score combination
@@ -221,6 +219,36 @@ public:
 
     void map_reads(const std::unordered_set<uint32_t> &readIDs = {});
 
+    /**
+     * Maps all reads as map_reads() does, but writes the mappings to a LongReadMappingStore file instead of keeping them.
+     *
+     * Reads are mapped in shards of consecutive ids, dynamically scheduled within each shard. Each finished shard is
+     * sorted and written to its own run file (filename.run<N>) and recorded in filename.progress, so calling this again
+     * with the same filename, graph and parameters after an interruption continues after the last finished shard.
+     * When all reads are mapped the runs are merged into the store and removed.
+     *
+     * Shards grow a batch of reads at a time until their mappings take about half of memory_budget, threads add each
+     * batch's mappings straight to the shard; the merge uses at most about memory_budget bytes. The k-mer index, one read per thread and the
+     * per-read and per-node offsets are not included in the budget. mappings and the indexes of this mapper are not
+     * changed, use load_store() to load the result.
+     *
+     * @param filename path of the store
+     * @param memory_budget bytes for mapping results while mapping and merging
+     */
+    void map_reads_to_store(const std::string &filename, uint64_t memory_budget = 1ULL << 30);
+
+    /**
+     * Attaches a store written by map_reads_to_store() in place of mappings, which is emptied. The store stays memory
+     * mapped and its mappings are read from it, only reads_in_node is rebuilt in memory.
+     * @param filename path of the store
+     */
+    void load_store(const std::string &filename);
+
+    /**
+     * @brief Number of mappings, in mappings or in the attached store
+     */
+    uint64_t mapping_count() const;
+
     /**
      * Function to map a read to the graph in 5 steps using the methods in this class
      *
@@ -306,7 +334,10 @@ public:
 
     std::vector<ReadCacheItem>create_read_paths(const std::vector<sgNodeID_t> &backbone, const std::vector<std::vector<LongReadMapping>> filtered_read_mappings, const ReadPathParams &read_path_params);
 
-    std::vector<sgNodeID_t> create_read_path(const std::vector<LongReadMapping> mappings, const ReadPathParams &read_path_params, bool verbose=false, const std::string& read_seq="");
+    /**
+     * @param frozen_sg optional frozen copy of sg's links, used for the graph traversals if provided
+     */
+    std::vector<sgNodeID_t> create_read_path(const std::vector<LongReadMapping> mappings, const ReadPathParams &read_path_params, bool verbose=false, const std::string& read_seq="", const DistanceGraphCSR * frozen_sg=nullptr);
 
 //    std::vector<sgNodeID_t> create_read_path_fast(uint32_t rid, bool verbose=false, const std::string read_seq="");
     /**
@@ -322,6 +353,7 @@ public:
      */
     std::vector<LongReadMapping> mappings;
     std::vector<int64_t> first_mapping; //index to the first mapping of the read. If no mappings, -1.
+    std::shared_ptr<LongReadMappingStore> store; /// Store attached by load_store(), used instead of mappings
 
     /**
      * This structure holds "all paths" between consecutive backbone anchors
@@ -345,6 +377,7 @@ public:
     static const sdgVersion_t min_compat;
 
     bool sat_kmer_index = false;
+    bool prefix_bucket_index = false;
 };
 
 
@@ -6,6 +6,7 @@
 #include "LongReadsRecruiter.hpp"
 #include "PerfectMatcher.hpp"
 #include <sdglib/indexers/NKmerIndex.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
 #include <atomic>
 
 std::vector<PerfectMatch> PerfectMatchesFilter::truncate_turnaround(const std::vector<PerfectMatch> &in) const {
@@ -476,6 +477,7 @@ void LongReadsRecruiter::perfect_mappings(uint16_t seed_size, uint64_t first_rea
     if (seed_size<k) seed_size=k;
     NKmerIndex nki(sdg,k,f);
     if (last_read==0) last_read=datastore.size();
+    sdglib::CostBalancedChunks chunks(first_read, last_read+1, [&](uint64_t rid){ return datastore.read_to_fileRecord[rid].record_size; });
 #pragma omp parallel shared(nki)
     {
         StreamKmerFactory skf(k);
@@ -483,8 +485,9 @@ void LongReadsRecruiter::perfect_mappings(uint16_t seed_size, uint64_t first_rea
         std::vector<std::vector<std::pair<int32_t,int32_t >>> kmer_matches; //TODO: type should be defined in the index class
         PerfectMatch pmatch(0,0,0);
         ReadSequenceBuffer sequence_reader(datastore);
-#pragma omp for
-        for (auto rid=first_read;rid<=last_read;++rid){
+#pragma omp for schedule(dynamic,1)
+        for (uint64_t chunk=0;chunk<chunks.size();++chunk)
+        for (auto rid=chunks.begin(chunk);rid<chunks.end(chunk);++rid){
             std::vector<PerfectMatch> private_read_perfect_matches;
             auto seq=sequence_reader.get_read_sequence(rid);
             read_kmers.clear();
@@ -544,6 +547,45 @@ void LongReadsRecruiter::map(uint16_t seed_size, uint64_t first_read, uint64_t l
     NKmerIndex nki(sdg,k,f);
     sdglib::OutputLog()<<"Index created!"<<std::endl;
     if (last_read==0) last_read=datastore.size();
+    map_range(nki, seed_size, first_read, last_read);
+}
+
+void LongReadsRecruiter::map_to_file(const std::string &filename, uint16_t seed_size, uint64_t memory_budget) {
+    if (seed_size<k) seed_size=k;
+    NKmerIndex nki(sdg,k,f);
+    sdglib::OutputLog()<<"Index created!"<<std::endl;
+    reset_recruitment();
+    //written in the layout of dump(), with empty node_reads, one read at a time as their shard is done
+    std::ofstream ofs(filename);
+    uint64_t count=node_reads.size();
+    ofs.write(reinterpret_cast<const char *>(&count),sizeof(count));
+    for (const auto &nr:node_reads) sdglib::write_flat_vector(ofs,nr);
+    count=read_perfect_matches.size();
+    ofs.write(reinterpret_cast<const char *>(&count),sizeof(count));
+    sdglib::write_flat_vector(ofs,read_perfect_matches[0]);
+    const uint64_t batch_reads=20*omp_get_max_threads(); //enough reads to keep all threads busy
+    uint64_t next_read=1;
+    while (next_read<=datastore.size()) {
+        //the shard grows a batch of reads at a time until its matches take the budget
+        auto first_read=next_read;
+        uint64_t shard_bytes=0;
+        while (next_read<=datastore.size() and shard_bytes<memory_budget) {
+            auto last_read=std::min((uint64_t) datastore.size(),next_read+batch_reads-1);
+            map_range(nki, seed_size, next_read, last_read);
+            for (auto rid=next_read;rid<=last_read;++rid) shard_bytes+=read_perfect_matches[rid].size()*sizeof(PerfectMatch);
+            next_read=last_read+1;
+        }
+        for (auto rid=first_read;rid<next_read;++rid) {
+            sdglib::write_flat_vector(ofs,read_perfect_matches[rid]);
+            std::vector<PerfectMatch>().swap(read_perfect_matches[rid]);
+        }
+        if (!ofs) throw std::runtime_error("Error writing " + filename);
+        sdglib::OutputLog()<<"Reads "<<first_read<<"-"<<next_read-1<<" mapped and written to "<<filename<<std::endl;
+    }
+}
+
+void LongReadsRecruiter::map_range(const NKmerIndex &nki, uint16_t seed_size, uint64_t first_read, uint64_t last_read) {
+    sdglib::CostBalancedChunks chunks(first_read, last_read+1, [&](uint64_t rid){ return datastore.read_to_fileRecord[rid].record_size; });
 #pragma omp parallel shared(nki)
     {
         StreamKmerFactory skf(k);
@@ -552,8 +594,9 @@ void LongReadsRecruiter::map(uint16_t seed_size, uint64_t first_read, uint64_t l
         PerfectMatchExtender pme(sdg,k);
         ReadSequenceBuffer sequence_reader(datastore);
         uint64_t private_mapped_reads=0;
-#pragma omp for
-        for (auto rid=first_read;rid<=last_read;++rid){
+#pragma omp for schedule(dynamic,1)
+        for (uint64_t chunk=0;chunk<chunks.size();++chunk)
+        for (auto rid=chunks.begin(chunk);rid<chunks.end(chunk);++rid){
             std::vector<PerfectMatch> private_read_perfect_matches;
             const auto seq=std::string(sequence_reader.get_read_sequence(rid));
             read_kmers.clear();
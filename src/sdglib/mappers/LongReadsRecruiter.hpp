@@ -8,6 +8,8 @@
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
 #include <sdglib/datastores/LongReadsDatastore.hpp>
 
+class NKmerIndex;
+
 //TODO: OMP
 //TODO: translate kmer positions on negative node to equivalent bp positions?
 //TODO: eliminate the need to use the SequenceMatch class
@@ -79,6 +81,11 @@ public:
     void perfect_mappings(uint16_t seed_size,uint64_t first_read=1,uint64_t last_read=0);
     std::vector<PerfectMatch> reverse_perfect_matches(const std::vector<PerfectMatch> &matches, uint64_t rsize=0);
     void map(uint16_t seed_size,uint64_t first_read=1,uint64_t last_read=0);
+    /**
+     * @brief Maps all reads as map() does, writing them to a file that load() reads instead of keeping them.
+     * Reads are mapped in shards whose matches take about memory_budget bytes, each written out and freed once done.
+     */
+    void map_to_file(const std::string &filename,uint16_t seed_size,uint64_t memory_budget=1ULL<<30);
     void recruit_reads(uint16_t seed_size,uint16_t seed_count,int64_t first_read=1,int64_t last_read=0);
     void recruit_threads();
     void reset_recruitment();
@@ -100,6 +107,9 @@ public:
     std::vector<std::vector<int64_t>> node_threads;
     std::vector<std::vector<int32_t>> node_paths;
     std::vector<std::vector<sgNodeID_t>> read_paths;
+
+private:
+    void map_range(const NKmerIndex &nki,uint16_t seed_size,uint64_t first_read,uint64_t last_read);
 };
 
 
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <atomic>
 #include <sdglib/utilities/omp_safe.hpp>
+#include <sdglib/utilities/Metrics.hpp>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -130,7 +131,12 @@ void PairedReadsMapper::remap_all_reads() {
 }
 
 void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_remap) {
-    UniqueKmerIndex ukindex(ws.sdg);
+    SDG_SCOPED_TIMER(timer, "PairedReadsMapper::map_reads");
+    std::shared_ptr<UniqueKmerIndex> ukindex;
+    {
+        SDG_SCOPED_TIMER(index_timer, "PairedReadsMapper::map_reads/index");
+        ukindex = UniqueKmerIndex::load_or_build(ws.sdg);
+    }
     const int k = 31;
     std::atomic<int64_t> nokmers(0);
     reads_in_node.resize(ws.sdg.nodes.size());
@@ -143,6 +149,7 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
      */
     uint64_t thread_mapped_count[omp_get_max_threads()],thread_total_count[omp_get_max_threads()],thread_multimap_count[omp_get_max_threads()];
     std::vector<ReadMapping> thread_mapping_results[omp_get_max_threads()];
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     sdglib::OutputLog(sdglib::LogLevels::DEBUG)<<"Private mapping initialised for "<<omp_get_max_threads()<<" threads"<<std::endl;
 #pragma omp parallel
     {
@@ -159,6 +166,8 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
         total_count=0;
         multimap_count=0;
         bool c ;
+        SDG_STAGE_CLOCK(kmerise_clock);
+        SDG_STAGE_CLOCK(lookup_clock);
         //std::cout<<omp_get_thread_num()<<std::endl;
 #pragma omp for
         for (uint64_t readID=1;readID<read_to_node.size();++readID) {
@@ -172,15 +181,18 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
                 mapping.rev = false;
                 mapping.unique_matches = 0;
                 //get all kmers from read
+                SDG_STAGE_START(kmerise_clock);
                 auto seq=blrs.get_read_sequence(readID);
                 readkmers.clear();
                 skf.produce_all_kmers(seq,readkmers);
+                SDG_STAGE_STOP(kmerise_clock, 1);
+                SDG_STAGE_START(lookup_clock);
                 if (readkmers.size()==0) {
                     ++nokmers;
                 }
                 for (auto &rk:readkmers) {
-                    auto nk = ukindex.find(rk.kmer);
-                    if (ukindex.end()!=nk) {
+                    auto nk = ukindex->find(rk.kmer);
+                    if (ukindex->end()!=nk) {
                         //get the node just as node
                         sgNodeID_t nknode = llabs(nk->second.node);
                         //TODO: sort out the sign/orientation representation
@@ -207,6 +219,7 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
                         }
                     }
                 }
+                SDG_STAGE_STOP(lookup_clock, readkmers.size());
                 if (mapping.node != 0 and mapping.unique_matches >= min_matches) {
                     //optimisation: just save the mapping in a thread private collection for now, have a single thread putting from that into de structure at the end
                     private_results.push_back(mapping);
@@ -216,7 +229,10 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
             auto tc = ++total_count;
             if (tc % 10000000 == 0) sdglib::OutputLog()<< mapped_count << " / " << tc <<" ("<<multimap_count<<" multi-mapped)"<< std::endl;
         }
+        SDG_STAGE_RECORD(kmerise_clock, "PairedReadsMapper::map_reads/kmerise");
+        SDG_STAGE_RECORD(lookup_clock, "PairedReadsMapper::map_reads/lookup");
     }
+    SDG_SCOPED_TIMER(merge_timer, "PairedReadsMapper::map_reads/merge");
     for (auto & tres:thread_mapping_results){
         //sdglib::OutputLog(sdglib::LogLevels::DEBUG)<<"mixing in "<<tres.size()<<" thread specific results"<<std::endl;
         for (auto &rm:tres){
@@ -234,6 +250,9 @@ void PairedReadsMapper::map_reads(const std::unordered_set<uint64_t> &reads_to_r
     }
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Reads without k-mers: "<<nokmers<<std::endl;
     sdglib::OutputLog(sdglib::LogLevels::INFO)<<"Reads mapped: "<<mapped_count<<" / "<<total_count<<" ("<<multimap_count<<" multi-mapped)"<<std::endl;
+    SDG_TIMER_ITEMS(timer, total_count);
+    SDG_COUNTER_ADD("PairedReadsMapper::map_reads/mapped", mapped_count);
+    SDG_COUNTER_ADD("PairedReadsMapper::map_reads/multimapped", multimap_count);
 #pragma omp parallel for
     for (sgNodeID_t n=1;n<reads_in_node.size();++n){
         std::sort(reads_in_node[n].begin(),reads_in_node[n].end());
@@ -249,7 +268,7 @@ void PairedReadsMapper::remap_all_reads63() {
 
 void PairedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to_remap) {
     const int k = 63;
-    Unique63merIndex ukindex(ws.sdg);
+    auto ukindex = Unique63merIndex::load_or_build(ws.sdg);
     std::atomic<int64_t> nokmers(0);
     reads_in_node.resize(ws.sdg.nodes.size());
     read_to_node.resize(datastore.size()+1);
@@ -261,6 +280,7 @@ void PairedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to
      */
     uint64_t thread_mapped_count[omp_get_max_threads()],thread_total_count[omp_get_max_threads()],thread_multimap_count[omp_get_max_threads()];
     std::vector<ReadMapping> thread_mapping_results[omp_get_max_threads()];
+    datastore.mapped_file.advise(sdglib::MemoryMappedFile::Sequential);
     sdglib::OutputLog(sdglib::LogLevels::DEBUG)<<"Private mapping initialised for "<<omp_get_max_threads()<<" threads"<<std::endl;
 #pragma omp parallel
     {
@@ -297,8 +317,8 @@ void PairedReadsMapper::map_reads63(const std::unordered_set<uint64_t> &reads_to
                     ++nokmers;
                 }
                 for (auto &rk:readkmers) {
-                    auto nk = ukindex.find(rk.kmer);
-                    if (ukindex.end()!=nk) {
+                    auto nk = ukindex->find(rk.kmer);
+                    if (ukindex->end()!=nk) {
                         //get the node just as node
                         sgNodeID_t nknode = llabs(nk->second.node);
                         //TODO: sort out the sign/orientation representation
@@ -372,7 +392,7 @@ void PairedReadsMapper::path_reads(uint8_t k,int _filter,bool fill_offsets) {
     read_paths.resize(datastore.size()+1);
     if (fill_offsets) read_path_offsets.resize(datastore.size()+1);
     if (k<=31) {
-        NKmerIndex nki(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
+        auto nki = NKmerIndex::load_or_build(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
         sdglib::OutputLog() << "64bit index created!" << std::endl;
         //if (last_read==0) last_read=datastore.size();
 #pragma omp parallel shared(nki)
@@ -397,12 +417,12 @@ void PairedReadsMapper::path_reads(uint8_t k,int _filter,bool fill_offsets) {
                 ro.clear();
                 pme.set_read(seq);
                 for (auto rki = 0; rki < read_kmers.size(); ++rki) {
-                    auto kmatch = nki.find(read_kmers[rki].second);
-                    if (kmatch != nki.end() and kmatch->kmer == read_kmers[rki].second) {
+                    auto kmatch = nki->find(read_kmers[rki].second);
+                    if (kmatch != nki->end() and kmatch->kmer == read_kmers[rki].second) {
                         pme.reset();
 //                    std::cout<<std::endl<<"PME reset done"<<std::endl;
 //                    std::cout<<std::endl<<"read kmer is at "<<rki<<" in "<<(read_kmers[rki].first ? "FW":"REV")<<" orientation"<<std::endl;
-                        for (; kmatch != nki.end() and kmatch->kmer == read_kmers[rki].second; ++kmatch) {
+                        for (; kmatch != nki->end() and kmatch->kmer == read_kmers[rki].second; ++kmatch) {
 //                            std::cout<<" match to "<<kmatch->contigID<<":"<<kmatch->offset<<std::endl;
                             auto contig = kmatch->contigID;
                             int64_t pos = kmatch->offset - 1;
@@ -447,7 +467,7 @@ void PairedReadsMapper::path_reads(uint8_t k,int _filter,bool fill_offsets) {
         }
     }
     else if (k<64) {
-        NKmerIndex128 nki(ws.sdg,k,_filter);//TODO: hardcoded parameters!!
+        auto nki = NKmerIndex128::load_or_build(ws.sdg, k, _filter);//TODO: hardcoded parameters!!
         sdglib::OutputLog()<<"Index created!"<<std::endl;
         //if (last_read==0) last_read=datastore.size();
 #pragma omp parallel shared(nki)
@@ -472,12 +492,12 @@ void PairedReadsMapper::path_reads(uint8_t k,int _filter,bool fill_offsets) {
                 ro.clear();
                 pme.set_read(seq);
                 for (auto rki=0;rki<read_kmers.size();++rki){
-                    auto kmatch=nki.find(read_kmers[rki].second);
-                    if (kmatch!=nki.end() and kmatch->kmer==read_kmers[rki].second){
+                    auto kmatch=nki->find(read_kmers[rki].second);
+                    if (kmatch!=nki->end() and kmatch->kmer==read_kmers[rki].second){
                         pme.reset();
 //                    std::cout<<std::endl<<"PME reset done"<<std::endl;
 //                    std::cout<<std::endl<<"read kmer is at "<<rki<<" in "<<(read_kmers[rki].first ? "FW":"REV")<<" orientation"<<std::endl;
-                        for (;kmatch!=nki.end() and kmatch->kmer==read_kmers[rki].second;++kmatch) {
+                        for (;kmatch!=nki->end() and kmatch->kmer==read_kmers[rki].second;++kmatch) {
 //                        std::cout<<" match to "<<kmatch->contigID<<":"<<kmatch->offset<<std::endl;
                             auto contig=kmatch->contigID;
                             int64_t pos=kmatch->offset-1;
@@ -545,7 +565,7 @@ bool inline are_complement(const char &A,const char &B){
 
 void PairedReadsMapper::path_reads63() {
     const int k = 63;
-    Unique63merIndex ukindex(ws.sdg);
+    auto ukindex = Unique63merIndex::load_or_build(ws.sdg);
     std::atomic<int64_t> nokmers(0);
     read_paths.clear();
     read_paths.resize(datastore.size()+1);
@@ -582,16 +602,16 @@ void PairedReadsMapper::path_reads63() {
             //lookup for kmer, but extend on current sequence until missmatch or end
             for (auto rki=0;rki<readkmers.size();++rki) {
                 auto &rk=readkmers[rki];
-                auto nk = ukindex.find(rk.kmer);
-                if (ukindex.end()!=nk) {
+                auto nk = ukindex->find(rk.kmer);
+                if (ukindex->end()!=nk) {
                     //get the node just as node
                     sgNodeID_t nknode = nk->second.node;
                     if (rk.contigID<0) nknode=-nknode;
                     if ( nknode>0 ) {
                         auto cpos = nk->second.pos + k;
                         while (rki < readkmers.size()
-                               and cpos < ws.sdg.nodes[nknode].sequence.size()
-                               and ws.sdg.nodes[nknode].sequence[cpos] == seq[rki + k]) {
+                               and cpos < ws.sdg.get_node_size(nknode)
+                               and ws.sdg.node_sequences.base(nknode,cpos) == seq[rki + k]) {
                             ++cpos, ++rki;
                         }
                     }
@@ -599,7 +619,7 @@ void PairedReadsMapper::path_reads63() {
                         int32_t cpos = nk->second.pos-1;
                         while (rki < readkmers.size()
                                and cpos >= 0
-                               and are_complement(ws.sdg.nodes[-nknode].sequence[cpos],seq[rki + k])) {
+                               and are_complement(ws.sdg.node_sequences.base(-nknode,cpos),seq[rki + k])) {
                             --cpos, ++rki;
                         }
                     }
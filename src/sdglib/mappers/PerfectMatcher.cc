@@ -9,19 +9,22 @@ bool inline are_complement(const char &A,const char &B){
     return (A=='A' and B=='T') or (A=='C' and B=='G') or (A=='G' and B=='C') or (A=='T' and B=='A');
 }
 
-void PerfectMatchPart::extend(const std::string & readseq,const std::string & nodeseq) {//this jsut grows until it can't and sets the flags.
+void PerfectMatchPart::extend(const std::string & readseq,const PackedNodeSequences & nodeseqs) {//this jsut grows until it can't and sets the flags.
     //while(i<size(read) and j<size(node) and read[i]==node[j]) ++i (consider RC, maybe just write the conditions appropriately?)
+    //node bases are read in place from the packed sequences, on the canonical orientation
     auto srp=read_position;
+    auto nid=llabs(node);
+    auto nsize=nodeseqs.node_size(nid);
     if (node>0){
-        while(read_position<readseq.size()-1 and node_position<nodeseq.size()-1 and nodeseq[node_position+1]==readseq[read_position+1]){
+        while(read_position<readseq.size()-1 and node_position<nsize-1 and nodeseqs.base(nid,node_position+1)==readseq[read_position+1]){
             ++node_position;
             ++read_position;
         }
-        completed_node = (node_position==nodeseq.size()-1);
+        completed_node = (node_position==nsize-1);
         completed_read = (read_position==readseq.size()-1);
     }
     else {
-        while(read_position<readseq.size()-1 and node_position>0 and are_complement(nodeseq[node_position-1],readseq[read_position+1])){
+        while(read_position<readseq.size()-1 and node_position>0 and are_complement(nodeseqs.base(nid,node_position-1),readseq[read_position+1])){
             --node_position;
             ++read_position;
         }
@@ -85,7 +88,7 @@ void PerfectMatchExtender::extend_fw(){
         //extend, if end of node add all nexts as unextended parts.
         if (matchparts[next].invalid) continue;
 //            std::cout<<"extending matchpart "<<next<<" to node "<<matchparts[next].node<<" with current readpos="<<matchparts[next].read_position<<" and nodepos="<<matchparts[next].node_position<<std::endl;
-        matchparts[next].extend(readseq,dg.sdg.nodes[llabs(matchparts[next].node)].sequence);
+        matchparts[next].extend(readseq,dg.sdg.node_sequences);
 //            std::cout<<" -> readpos="<<matchparts[next].read_position<<(matchparts[next].completed_read ? " (completed)":"")<<", nodepos="<<matchparts[next].node_position<<(matchparts[next].completed_node ? " (completed)":"")<<std::endl;
         if (matchparts[next].completed_node and not matchparts[next].completed_read){
             for (const auto & l: dg.get_nodeview(matchparts[next].node).next()){
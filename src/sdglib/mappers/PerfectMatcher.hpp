@@ -4,13 +4,14 @@
 
 #pragma once
 #include <sdglib/graph/DistanceGraph.hpp>
+#include <sdglib/graph/PackedNodeSequences.hpp>
 #include <sdglib/indexers/NKmerIndex.hpp>
 #include <memory>
 #include "LongReadsRecruiter.hpp"
 
 class PerfectMatchPart{
 public:
-    void extend(const std::string & readseq,const std::string & nodeseq);
+    void extend(const std::string & readseq,const PackedNodeSequences & nodeseqs);
 
 
     sgNodeID_t node;
@@ -60,7 +61,7 @@ public:
     PerfectMatcher(DistanceGraph &_dg,std::shared_ptr<NKmerIndex> _nki):dg(_dg),nki(_nki){};
 
     //Create with a graph and a pointer to the index.
-    PerfectMatcher(DistanceGraph &_dg,uint8_t _k, uint16_t _max_freq):dg(_dg),nki(std::make_shared<NKmerIndex>(dg.sdg,_k,_max_freq)){};
+    PerfectMatcher(DistanceGraph &_dg,uint8_t _k, uint16_t _max_freq):dg(_dg),nki(NKmerIndex::load_or_build(dg.sdg,_k,_max_freq)){};
 
     //set a sequence to map
     void set_sequence();
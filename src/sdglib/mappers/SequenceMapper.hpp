@@ -7,6 +7,7 @@
 #include <sdglib/indexers/NKmerIndex.hpp>
 #include <sdglib/indexers/SatKmerIndex.hpp>
 #include <sdglib/types/MappingTypes.hpp>
+#include <sdglib/mappers/SparseChainer.hpp>
 #include <memory>
 
 /**
@@ -85,36 +86,32 @@ public:
      */
     void get_all_kmer_matches(std::vector<std::vector<std::pair<int32_t, int32_t>>> & matches, std::vector<std::pair<bool, uint64_t>> & read_kmers);
 
-    /**
-     * Using the populated matches collection (see het_all_kmer_matches()) returns a collection of nodeIDs that have more than 50 matches with that particular read.
-     * TODO: parameter to check, the 50 in the filter, why is 50?.
-     * @param matches matches vector
-     * @param read_kmers_size number of kmers in the read
-     * @return set of nodeIDs of nodes with more than 50 matches to the read
-     */
-    void
-    count_candidates(std::vector<unsigned char> &candidate_counts,
-                     std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                     uint32_t read_kmers_size);
-
     /**
      * This function will check for continuous blocks of alignments between the read and the window candidates produced by window_candidates() using the matches prudiced by get_allKmer_matches()
      * The result is a vector af LongReadMappings where each element describes a mapping of a block of the read to a block of a node (see struct LongReadMapping)
      *
      * Each LongReadMapping describes a chain of matching kmers in the read and the node where the matches advance at the same pace (within a jumping distance allowance)
      *
+     * Only nodes with more than min_number_of_node_occurrences matches are considered. This builds a SparseChainer for
+     * the call, use chainer() to get one to reuse across reads.
+     *
      * @param readID id of the analyzed read
      * @param matches matches collection produced by get_allKmer_matches()
      * @param read_kmers_size Number of kmers in the read
-     * @param candidates collection of candidate matches produced by window_candidates()
      * @return collection of readtonode mappings (LongReadMapping)
      */
     std::vector<LongReadMapping> alignment_blocks(uint32_t readID,
-                                                  std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
-                                                  uint32_t read_kmers_size, const std::vector<unsigned char> &candidate_counts);
+                                                  const std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
+                                                  uint32_t read_kmers_size);
+
+    /**
+     * @brief A SparseChainer with this mapper's chaining parameters
+     */
+    SparseChainer chainer() const;
 
     std::shared_ptr<NKmerIndex> assembly_kmers;
     std::shared_ptr<SatKmerIndex> sat_assembly_kmers;
 
     bool sat_kmer_index = false;
+    bool prefix_bucket_index = false;
 };
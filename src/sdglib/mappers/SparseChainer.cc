@@ -0,0 +1,76 @@
+#include "SparseChainer.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+std::vector<LongReadMapping> SparseChainer::alignment_blocks(uint32_t readID,
+                                                             const std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
+                                                             uint32_t read_kmers_size) {
+    //beware you need the size! otherwise there is a size from the matches and not from the reads!
+    hits.clear();
+    for (int32_t p = 0; p < read_kmers_size; ++p)
+        for (const auto &m: matches[p]) hits.push_back({m.first, p, m.second});
+    //stable, so each node's hits stay in read order, and in index order within a read position
+    std::stable_sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) { return a.node < b.node; });
+
+    std::vector<LongReadMapping> blocks;
+    for (uint64_t first = 0; first < hits.size();) {
+        auto last = first + 1;
+        while (last < hits.size() and hits[last].node == hits[first].node) ++last;
+        //counts used to saturate at 255 when they were kept per node in a byte, keep the same cut-off
+        if (std::min(last - first, (uint64_t) UINT8_MAX) > min_node_hits) chain_node_hits(readID, first, last, blocks);
+        first = last;
+    }
+    std::sort(blocks.begin(), blocks.end());
+    return blocks;
+}
+
+void SparseChainer::chain_node_hits(uint32_t readID, uint64_t first, uint64_t last, std::vector<LongReadMapping> &blocks) {
+    used.assign(last - first, false);
+    //Filter hits on overused positions
+    for (auto starti = first; starti < last; ++starti) {
+        auto endi = starti;
+        while (endi < last - 1 and hits[starti].read_pos == hits[endi + 1].read_pos) ++endi;
+        bool discard = false;
+        if (endi > starti + max_hits_to_candidate) discard = true; //more than max_hits_to_candidate hits to candidate ->discard
+        else {
+            for (auto x = starti; x < endi; ++x) {
+                if (hits[x + 1].node_pos - hits[x].node_pos < max_jump) discard = true;
+            }
+        }
+        if (discard) for (auto x = starti; x <= endi; ++x) used[x - first] = true;
+    }
+
+    for (auto starti = first; starti < last; ++starti) {
+        if (used[starti - first]) continue;
+        int chain = 1;
+        auto start_p = hits[starti].read_pos;
+        auto start_t = hits[starti].node_pos;
+        auto last_p = start_p;
+        auto last_t = start_t;
+        auto last_delta = last_t - last_p;
+        used[starti - first] = true;
+        for (auto i = starti + 1; i < last and hits[i].read_pos - last_p <= max_jump; ++i) {
+            const auto &h = hits[i];
+            //if not in chain, continue;
+            if (used[i - first] or last_p > h.read_pos or last_t > h.node_pos or h.node_pos - last_t > max_jump
+                or std::abs(last_delta - (h.node_pos - h.read_pos)) > max_delta_change)
+                continue;
+            ++chain;
+            last_p = h.read_pos;
+            last_t = h.node_pos;
+            last_delta = last_t - last_p;
+            used[i - first] = true;
+        }
+        if (chain >= min_chain and last_p - start_p >= min_size) {
+            LongReadMapping b;
+            b.read_id = readID;
+            b.qStart = start_p;
+            b.qEnd = last_p;
+            b.node = hits[starti].node;
+            b.nStart = start_t;
+            b.nEnd = last_t;
+            b.score = chain;
+            blocks.push_back(b);
+        }
+    }
+}
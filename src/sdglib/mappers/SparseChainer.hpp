@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <sdglib/types/MappingTypes.hpp>
+
+/**
+ * @brief Chains the k-mer matches of a read into alignment blocks against the nodes with enough matches.
+ *
+ * The matches are flattened into (node, read position, node position) hits and stable sorted by node, so candidate
+ * counting and chaining only touch the nodes the read actually hits: the cost per read depends on its number of
+ * matches, not on the size of the graph. The hit list is kept between calls, use one SparseChainer per thread.
+ *
+ * Used by LongReadsMapper and SequenceMapper, the parameters have the same meaning as in those classes.
+ */
+class SparseChainer {
+public:
+    SparseChainer(int _min_node_hits, int _max_hits_to_candidate, int _max_jump, int _max_delta_change, int _min_chain,
+                  int _min_size) :
+            min_node_hits(_min_node_hits), max_hits_to_candidate(_max_hits_to_candidate), max_jump(_max_jump),
+            max_delta_change(_max_delta_change), min_chain(_min_chain), min_size(_min_size) {}
+
+    /**
+     * @brief Alignment blocks of the read against every node with more than min_node_hits matches
+     * @param readID id of the read, reported in the blocks
+     * @param matches (node, node position) matches for each k-mer of the read
+     * @param read_kmers_size number of k-mers in the read, matches past this are from previous reads and are ignored
+     * @return blocks sorted as LongReadMappings
+     */
+    std::vector<LongReadMapping> alignment_blocks(uint32_t readID,
+                                                  const std::vector<std::vector<std::pair<int32_t, int32_t>>> &matches,
+                                                  uint32_t read_kmers_size);
+
+    struct Hit {
+        int32_t node;
+        int32_t read_pos;
+        int32_t node_pos;
+    };
+
+private:
+    void chain_node_hits(uint32_t readID, uint64_t first, uint64_t last, std::vector<LongReadMapping> &blocks);
+
+    int min_node_hits;
+    int max_hits_to_candidate;
+    int max_jump;
+    int max_delta_change;
+    int min_chain;
+    int min_size;
+
+    std::vector<Hit> hits;
+    std::vector<bool> used;
+};
@@ -16,7 +16,7 @@ std::string CountFilter::get_pattern(NodeView nv) {
         auto kcf=nv.kmer_coverage(kcname,filter_count_name);
         std::vector<int> fkpos;
         for (auto i=0;i<kcf.size();++i) {
-            if (kcf[i]<=filter_count_max) fkpos.push_back(i);
+            if ((int64_t) kcf[i]<=filter_count_max) fkpos.push_back(i);
         }
         if (fkpos.empty()) patterns[llabs(nv.node_id())]="";
         else {
@@ -24,7 +24,7 @@ std::string CountFilter::get_pattern(NodeView nv) {
             for (auto cni=0;cni<value_count_names.size();++cni){
                 auto vcf=nv.kmer_coverage(kcname,value_count_names[cni]);
                 for (auto i:fkpos) {
-                    if (vcf[i]<value_count_mins[cni]) {
+                    if ((int64_t) vcf[i]<value_count_mins[cni]) {
                         p.append("0");
                         break;
                     }
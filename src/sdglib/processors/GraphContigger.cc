@@ -335,7 +335,7 @@ void GraphContigger::clip_tips(int tip_size, int rounds) {
 void GraphContigger::remove_small_unconnected(int min_size) {
     for (sgNodeID_t n = 1; n < ws.sdg.nodes.size(); ++n) {
         if (ws.sdg.nodes[n].status == NodeStatus::Deleted) continue;
-        if (ws.sdg.nodes[n].sequence.size() >= min_size) continue;
+        if (ws.sdg.get_node_size(n) >= min_size) continue;
         if (ws.sdg.get_fw_links(n).size()==0 and ws.sdg.get_bw_links(n).size()==0) ws.sdg.remove_node(n);
     }
 }
@@ -187,14 +187,14 @@ void GraphEditor::remove_small_components(int max_nodes, int max_size, int max_t
         if (c.size()>max_nodes) continue;
         uint64_t total=0;
         for (auto n:c) {
-            if (ws.sdg.nodes[llabs(n)].sequence.size()>max_size) total+=max_total;
-            total+=ws.sdg.nodes[llabs(n)].sequence.size();
+            if (ws.sdg.get_node_size(llabs(n))>max_size) total+=max_total;
+            total+=ws.sdg.get_node_size(llabs(n));
         }
         if (total>max_total) continue;
         else to_remove.insert(to_remove.end(),c.begin(),c.end());
     }
     uint64_t tbp=0;
-    for (auto n:to_remove) tbp+=ws.sdg.nodes[llabs(n)].sequence.size();
+    for (auto n:to_remove) tbp+=ws.sdg.get_node_size(llabs(n));
     std::cout<<"There are "<<to_remove.size()<<" nodes and "<<tbp<<"bp in small unconnected components"<<std::endl;
     for (auto n:to_remove) ws.sdg.remove_node(llabs(n));
 }
\ No newline at end of file
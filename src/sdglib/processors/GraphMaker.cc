@@ -4,27 +4,9 @@
 
 #include <sdglib/bloom/BloomFilter.hpp>
 #include <sdglib/batch_counter/BatchKmersCounter.hpp>
+#include <sdglib/batch_counter/MinimizerKmersCounter.hpp>
 #include "GraphMaker.hpp"
-
-struct sbcont {
-    unsigned int fA:1;
-    unsigned int fC:1;
-    unsigned int fG:1;
-    unsigned int fT:1;
-    unsigned int bA:1;
-    unsigned int bC:1;
-    unsigned int bG:1;
-    unsigned int bT:1;
-};
-
-struct fb {
-    unsigned int fw:4;
-    unsigned int bw:4;
-};
-union kcontext {
-    struct fb fb;
-    struct sbcont sbcont;
-};
+#include <sdglib/utilities/Metrics.hpp>
 
 std::string kmer_to_sequence(uint64_t kmer, uint8_t k) {
     std::string seq;
@@ -160,453 +142,293 @@ __uint128_t kmer_cannonical128(__uint128_t kmer, uint8_t k) {
     return (rkmer<kmer ? rkmer:kmer);
 }
 
-class klidxs128 {
-public:
-    klidxs128(__uint128_t _kmer, uint64_t _idx): kmer(_kmer), idx(_idx){};
-    __uint128_t kmer;
-    uint64_t idx;
-};
+/** Per k-mer width functions used by build_unitig_graph **/
+template<typename KMER> struct UnitigKmerOps;
 
-inline void get_fw_idxs128(std::vector<klidxs128> &out, const __uint128_t kmer, uint8_t k, const std::vector<__uint128_t> & kmerlist){
-    out.clear();
-    __uint128_t cnext;
-    //std::vector<__uint128_t>::const_iterator cnitr;
-    for (const __uint128_t &fnk:kmer_fw_neighbours128(kmer, k)) {
-        cnext=kmer_cannonical128(fnk,k);
-        auto cnitr=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext);
-        if (*cnitr==cnext)
-            out.emplace_back(fnk,cnitr-kmerlist.begin());
-    }
-}
+template<> struct UnitigKmerOps<uint64_t> {
+    typedef CStringKMerFactory OverlapFactory;
+    static std::array<uint64_t,4> fw_neighbours(uint64_t kmer, uint8_t k) { return kmer_fw_neighbours(kmer,k); }
+    static std::array<uint64_t,4> bw_neighbours(uint64_t kmer, uint8_t k) { return kmer_bw_neighbours(kmer,k); }
+    static uint64_t reverse(uint64_t kmer, uint8_t k) { return kmer_reverse(kmer,k); }
+    static uint64_t canonical(uint64_t kmer, uint8_t k) { return kmer_cannonical(kmer,k); }
+    static std::string to_sequence(uint64_t kmer, uint8_t k) { return kmer_to_sequence(kmer,k); }
+};
 
-class klidxs64 {
-public:
-    klidxs64(uint64_t _kmer, uint64_t _idx): kmer(_kmer), idx(_idx){};
-    uint64_t kmer;
-    uint64_t idx;
+template<> struct UnitigKmerOps<__uint128_t> {
+    typedef CStringKMerFactory128 OverlapFactory;
+    static std::array<__uint128_t,4> fw_neighbours(__uint128_t kmer, uint8_t k) { return kmer_fw_neighbours128(kmer,k); }
+    static std::array<__uint128_t,4> bw_neighbours(__uint128_t kmer, uint8_t k) { return kmer_bw_neighbours128(kmer,k); }
+    static __uint128_t reverse(__uint128_t kmer, uint8_t k) { return kmer_reverse128(kmer,k); }
+    static __uint128_t canonical(__uint128_t kmer, uint8_t k) { return kmer_cannonical128(kmer,k); }
+    static std::string to_sequence(__uint128_t kmer, uint8_t k) { return kmer_to_sequence128(kmer,k); }
 };
 
-inline void get_fw_idxs64(std::vector<klidxs64> &out, const uint64_t kmer, uint8_t k, const std::vector<uint64_t> & kmerlist){
-    out.clear();
-    uint64_t cnext;
-    //std::vector<__uint128_t>::const_iterator cnitr;
-    for (const uint64_t &fnk:kmer_fw_neighbours(kmer, k)) {
-        cnext=kmer_cannonical(fnk,k);
-        auto cnitr=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext);
-        if (*cnitr==cnext)
-            out.emplace_back(fnk,cnitr-kmerlist.begin());
-    }
-}
+static const uint64_t NO_NEXT=UINT64_MAX;
 
-template<class T>
-inline bool in_sorted_vector(const std::vector<T> &V,T VAL) {
-    auto itr=lower_bound(V.begin(),V.end(),VAL);
-    return itr!=V.end() and *itr==VAL;
+template<class KMER>
+inline uint64_t kmer_index(const std::vector<KMER> &kmerlist, KMER kmer) {
+    auto itr=std::lower_bound(kmerlist.begin(),kmerlist.end(),kmer);
+    return (itr!=kmerlist.end() and *itr==kmer) ? itr-kmerlist.begin() : NO_NEXT;
 }
 
-void GraphMaker::new_graph_from_kmerlist_trivial128(const std::vector<__uint128_t> & kmerlist,uint8_t k) {
-    //TODO: add a bloom filter to speed this up
-    sg.nodes.clear();
-    sg.links.clear();
-    sg.oldnames.clear();
-    sdglib::OutputLog()<<"Constructing Graph from "<<kmerlist.size()<<" "<<std::to_string(k)<<"-mers"<<std::endl;
-    std::string s;
-    s.reserve(1000000); //avoid contig-sequence growth
-    std::vector<bool> used_kmers(kmerlist.size());
-    std::vector<kcontext> kcontextlist(kmerlist.size());
-    std::vector<bool> is_end_fw(kmerlist.size());
-    std::vector<bool> is_end_bw(kmerlist.size());
-    sdglib::OutputLog()<<"Finding neighbours"<<std::endl;
-#pragma omp parallel for
-    for (uint64_t i=0;i<kmerlist.size();++i){
-        auto fns=kmer_fw_neighbours128(kmerlist[i], k);
-        auto &c=kcontextlist[i];
-        c.fb.fw=0;
-        c.fb.bw=0;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(fns[0],k))) c.sbcont.fA=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(fns[1],k))) c.sbcont.fC=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(fns[2],k))) c.sbcont.fG=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(fns[3],k))) c.sbcont.fT=1;
-        auto bns=kmer_bw_neighbours128(kmerlist[i], k);
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(bns[0],k))) c.sbcont.bA=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(bns[1],k))) c.sbcont.bC=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(bns[2],k))) c.sbcont.bG=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical128(bns[3],k))) c.sbcont.bT=1;
-    }
-    sdglib::OutputLog()<<"Marking ends"<<std::endl;
-#pragma omp parallel for
-    for (uint64_t i=0;i<kmerlist.size();++i) {
-        auto &c=kcontextlist[i];
-        if (c.fb.bw!=1 and c.fb.bw!=2 and c.fb.bw!=4 and c.fb.bw!=8 ) {
-            is_end_bw[i]=true;
-        } else {
-            int nn;
-            if (c.sbcont.bA) nn=0;
-            else if (c.sbcont.bC) nn=1;
-            else if (c.sbcont.bG) nn=2;
-            else if (c.sbcont.bT) nn=3;
-            auto next=kmer_bw_neighbours128(kmerlist[i],k)[nn];
-            auto cnext=kmer_cannonical128(next,k);
-            auto ni=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext)-kmerlist.begin();
-            auto &nc=kcontextlist[ni];
-            if (next==cnext and nc.fb.fw!=1 and nc.fb.fw!=2 and nc.fb.fw!=4 and nc.fb.fw!=8) is_end_bw[i]=true;
-            if (next!=cnext and nc.fb.bw!=1 and nc.fb.bw!=2 and nc.fb.bw!=4 and nc.fb.bw!=8) is_end_bw[i]=true;
+/**
+ * Unitig walker over a sorted list of canonical k-mers. An oriented k-mer is (idx<<1)|rev, rev meaning the reverse
+ * complement of kmerlist[idx]. Successors are resolved once for every k-mer, so walks never search the list.
+ */
+template<typename KMER>
+class UnitigWalker {
+    typedef UnitigKmerOps<KMER> ops;
+public:
+    UnitigWalker(const std::vector<KMER> &_kmerlist, uint8_t _k) : kmerlist(_kmerlist), k(_k),
+                                                                    next(2*kmerlist.size()), degrees(2*kmerlist.size()),
+                                                                    is_end(2*kmerlist.size()), owner(kmerlist.size(),0) {
+        sdglib::OutputLog()<<"Finding neighbours"<<std::endl;
+#pragma omp parallel for schedule(static,10000)
+        for (uint64_t i=0;i<kmerlist.size();++i){
+            //fw: the successors of the k-mer; bw: the successors of its reverse complement
+            for (auto rev: {0, 1}) {
+                auto o=(i<<1)|rev;
+                next[o]=NO_NEXT;
+                degrees[o]=0;
+                auto oriented=(rev ? ops::reverse(kmerlist[i],k) : kmerlist[i]);
+                for (auto &n:ops::fw_neighbours(oriented,k)) {
+                    auto cn=ops::canonical(n,k);
+                    auto ni=kmer_index(kmerlist,cn);
+                    if (ni==NO_NEXT) continue;
+                    ++degrees[o];
+                    next[o]=(ni<<1)|(n!=cn ? 1:0);
+                }
+                if (degrees[o]!=1) next[o]=NO_NEXT;
+            }
         }
-        if (c.fb.fw!=1 and c.fb.fw!=2 and c.fb.fw!=4 and c.fb.fw!=8 ) {
-            is_end_fw[i]=true;
-        } else {
-            int nn;
-            if (c.sbcont.fA) nn=0;
-            else if (c.sbcont.fC) nn=1;
-            else if (c.sbcont.fG) nn=2;
-            else if (c.sbcont.fT) nn=3;
-            auto next=kmer_fw_neighbours128(kmerlist[i],k)[nn];
-            auto cnext=kmer_cannonical128(next,k);
-            auto ni=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext)-kmerlist.begin();
-            auto &nc=kcontextlist[ni];
-            if (next==cnext and nc.fb.bw!=1 and nc.fb.bw!=2 and nc.fb.bw!=4 and nc.fb.bw!=8) is_end_fw[i]=true;
-            if (next!=cnext and nc.fb.fw!=1 and nc.fb.fw!=2 and nc.fb.fw!=4 and nc.fb.fw!=8) is_end_fw[i]=true;
+        sdglib::OutputLog()<<"Marking ends"<<std::endl;
+        //an oriented k-mer ends a unitig if it doesn't have a single successor, or its successor has other predecessors
+#pragma omp parallel for schedule(static,10000)
+        for (uint64_t o=0;o<next.size();++o) {
+            is_end[o]=(next[o]==NO_NEXT or degrees[next[o]^1]!=1);
         }
     }
-    sdglib::OutputLog()<<"Creating unitigs"<<std::endl;
 
-    for (uint64_t start_kmer_idx=0;start_kmer_idx<kmerlist.size();++start_kmer_idx) {
-        if (used_kmers[start_kmer_idx]) continue; //any kmer can only belong to one unitig.ww
-
-        //Check this k-mer is an end/junction
-        auto start_kmer = kmerlist[start_kmer_idx];
-
-
-        auto end_bw=is_end_bw[start_kmer_idx];
-        auto end_fw=is_end_fw[start_kmer_idx];
-
-        if (!end_bw and !end_fw) continue;
-
-        if (end_bw and end_fw) {
-            //kmer as unitig
-            s=kmer_to_sequence128(start_kmer, k);
-            used_kmers[start_kmer_idx] = true;
-        } else {
-            //unitig start on kmer
-            //make sure the unitig starts on FW
-
-            auto current_kmer = start_kmer;
-            auto current_idx = start_kmer_idx;
-            used_kmers[start_kmer_idx] = true;
-
-            if (end_fw) {
-                current_kmer = kmer_reverse128(start_kmer, k);
-                std::swap(end_fw,end_bw);
-            }
-
-            //Add kmer as unitig
-            s=kmer_to_sequence128(current_kmer, k);
+    uint64_t size() const { return kmerlist.size(); }
+
+    /** @brief True if kmer idx ends a unitig in any direction **/
+    bool is_unitig_end(uint64_t idx) const { return is_end[idx<<1] or is_end[(idx<<1)|1]; }
+
+    bool claimed(uint64_t idx) const { return __atomic_load_n(&owner[idx],__ATOMIC_RELAXED)!=0; }
+
+    /**
+     * Claims walker's k-mers starting from oriented k-mer start, appending bases to s until the unitig ends or the
+     * walk reaches a k-mer claimed by someone else. Returns the owner of that k-mer (0 if the unitig ended, walker
+     * itself on a loop back to the walk).
+     */
+    uint64_t walk(uint64_t start, uint64_t walker, std::string &s) {
+        static const char nucleotides[4] = {'A', 'C', 'G', 'T'};
+        auto current=start;
+        while (not is_end[current]) {
+            current=next[current];
+            auto other=claim(current>>1,walker);
+            if (other!=0) return other;
+            s.push_back(nucleotides[last_base(current)]);
+        }
+        return 0;
+    }
 
-            unsigned char nucleotides[4] = {'A', 'C', 'G', 'T'};
+    /** @brief Claims k-mer idx for walker, returns 0 on success or the k-mer's current owner **/
+    uint64_t claim(uint64_t idx, uint64_t walker) {
+        uint64_t expected=0;
+        if (__atomic_compare_exchange_n(&owner[idx],&expected,walker,false,__ATOMIC_RELAXED,__ATOMIC_RELAXED)) return 0;
+        return expected;
+    }
 
+    std::string oriented_sequence(uint64_t o) const {
+        return ops::to_sequence((o&1) ? ops::reverse(kmerlist[o>>1],k) : kmerlist[o>>1],k);
+    }
 
+    bool is_end_oriented(uint64_t o) const { return is_end[o]; }
 
-            //std::cout<<"Starting sequence construction at kmer "<<kmer_to_sequence128(current_kmer,k)<<std::endl;
-            while (!end_fw) {
-                //Add end nucleotide, update current_kmer;
-                //get_fw_idxs128(fwn, current_kmer, k, kmerlist);
-                auto c=kcontextlist[current_idx];
-                int nn;
-                if (kmer_cannonical128(current_kmer,k)==current_kmer) {
-                    if (c.sbcont.fA) nn = 0;
-                    else if (c.sbcont.fC) nn = 1;
-                    else if (c.sbcont.fG) nn = 2;
-                    else if (c.sbcont.fT) nn = 3;
-                }
-                else{
-                    if (c.sbcont.bA) nn = 3;
-                    else if (c.sbcont.bC) nn = 2;
-                    else if (c.sbcont.bG) nn = 1;
-                    else if (c.sbcont.bT) nn = 0;
-                }
-                current_kmer=kmer_fw_neighbours128(current_kmer,k)[nn];
-                auto ccurr=kmer_cannonical128(current_kmer,k);
-                current_idx=std::lower_bound(kmerlist.begin(),kmerlist.end(),ccurr)-kmerlist.begin();
-                if (used_kmers[current_idx]) break; //this should never happen, since these have ends.
-                used_kmers[current_idx]=true;
-                s.push_back(nucleotides[current_kmer % 4]);
-                if (ccurr==current_kmer) end_fw = is_end_fw[current_idx];
-                else end_fw = is_end_bw[current_idx];
-            }
-        }
-        sg.add_node(Node(s));
-        if (!sg.nodes.back().is_canonical()) sg.nodes.back().make_rc();//inefficient, but once in a node
-    }
-    sdglib::OutputLog()<<sg.nodes.size()<<" unitigs"<<std::endl;
-    //If there are any perfect circles, they won't have ends, so just pick any unused kmer and go fw till you find the same k-mer fw.
-    //(this is going to be even tricker to parallelise)
-    sdglib::OutputLog()<<"doing the circles now"<<std::endl;
-    for (uint64_t start_kmer_idx=0;start_kmer_idx<kmerlist.size();++start_kmer_idx) {
-        if (used_kmers[start_kmer_idx]) continue; //any kmer can only belong to one unitig.ww
-
-        //Check this k-mer is an end/junction
-        auto start_kmer = kmerlist[start_kmer_idx];
-        std::vector<klidxs128> fwn;
-        unsigned char nucleotides[4] = {'A', 'C', 'G', 'T'};
-        auto current_kmer = start_kmer;
-        used_kmers[start_kmer_idx] = true;
-        s=kmer_to_sequence128(current_kmer, k);
-
-        while (true) {
-            //Add end nucleotide, update current_kmer;
-            get_fw_idxs128(fwn, current_kmer, k, kmerlist);
-            current_kmer = fwn[0].kmer;
-            if (current_kmer==start_kmer) break;
-            used_kmers[fwn[0].idx] = true;
-            s.push_back(nucleotides[current_kmer % 4]);
-        }
-        sg.add_node(Node(s));
-        if (!sg.nodes.back().is_canonical()) sg.nodes.back().make_rc();//inefficient, but once in a node
+private:
+    uint8_t last_base(uint64_t o) const {
+        //the last base of a reverse complement is the complement of the first base
+        if (o&1) return 3-(uint8_t) ((kmerlist[o>>1]>>(2*(k-1)))&3);
+        return (uint8_t) (kmerlist[o>>1]&3);
     }
-    sdglib::OutputLog()<<sg.nodes.size()<<" unitigs"<<std::endl;
 
-    //save the (k-1)mer in (rev on first k-1 / fw on last k-1) or out ( fw on first k-1 / bw on last k-1)
-    std::vector<std::pair<__uint128_t,sgNodeID_t>> in, out;
-    in.reserve(2*sg.nodes.size());
-    out.reserve(2*sg.nodes.size());
-    CStringKMerFactory128 skf_ovl(k-1);
-    for (uint64_t nid=1;nid<sg.nodes.size();++nid){
-        std::vector<std::pair<__uint128_t,bool>> first,last;
-        skf_ovl.create_kmers_direction(first,sg.nodes[nid].sequence.substr(0,k-1).c_str());
-        if (first[0].second) out.emplace_back(first[0].first,nid);
-        else in.emplace_back(first[0].first,nid);
-        skf_ovl.create_kmers_direction(last,sg.nodes[nid].sequence.substr(sg.nodes[nid].sequence.size()-k+1,k-1).c_str());
-        if (last[0].second) in.emplace_back(last[0].first,-nid);
-        else out.emplace_back(last[0].first,-nid);
-    }
-    std::sort(in.begin(),in.end());
-    std::sort(out.begin(),out.end());
-    //connect out->in for all combinations on each kmer
-    uint64_t next_out_idx=0;
-    for(auto &i:in){
-        while(next_out_idx<out.size() and out[next_out_idx].first<i.first) ++next_out_idx;
-        for (auto oidx=next_out_idx;oidx<out.size() and out[oidx].first==i.first;++oidx) {
-            sg.add_link(i.second,out[oidx].second,-k+1); //no support, although we could add the DBG operation as such
+    const std::vector<KMER> &kmerlist;
+    uint8_t k;
+    std::vector<uint64_t> next;
+    std::vector<uint8_t> degrees;
+    std::vector<uint8_t> is_end; //not vector<bool>, it is written in parallel
+    std::vector<uint64_t> owner; //walker (start k-mer index + 1) that claimed each k-mer
+};
+
+inline std::string reverse_complement(const std::string &s) {
+    std::string r(s.rbegin(),s.rend());
+    for (auto &c:r) {
+        switch (c) {
+            case 'A': c='T'; break;
+            case 'C': c='G'; break;
+            case 'G': c='C'; break;
+            case 'T': c='A'; break;
         }
     }
-    sdglib::OutputLog()<<"Graph construction finished"<<std::endl;
+    return r;
 }
 
-void GraphMaker::new_graph_from_kmerlist_trivial64(const std::vector<__uint64_t> & kmerlist,uint8_t k) {
-    //TODO: add a bloom filter to speed this up
+/**
+ * Compacts a sorted list of canonical k-mers into unitigs on sg, linked by their k-1 overlaps.
+ *
+ * Walks start in parallel from every unitig end, claiming k-mers atomically. When the walks from both ends of a
+ * unitig meet, each stops at the other's k-mers and their halves are joined afterwards. Circles (unitigs without ends)
+ * are walked last from any unclaimed k-mer. Unitigs are sorted by sequence before being added, so node ids do not
+ * depend on thread scheduling.
+ */
+template<typename KMER>
+void build_unitig_graph(SequenceDistanceGraph &sg, const std::vector<KMER> & kmerlist, uint8_t k) {
+    SDG_SCOPED_TIMER(timer, "GraphMaker::build_unitig_graph");
+    SDG_TIMER_ITEMS(timer, kmerlist.size());
     sg.nodes.clear();
+    sg.node_sequences.clear();
     sg.links.clear();
     sg.oldnames.clear();
+    sg.add_node("",NodeStatus::Deleted); //an empty deleted node on 0, as in a new graph
     sdglib::OutputLog()<<"Constructing Graph from "<<kmerlist.size()<<" "<<std::to_string(k)<<"-mers"<<std::endl;
-    //for (auto &kmer:kmerlist) std::cout<<kmer_to_sequence(kmer,k)<<std::endl;
-    std::string s;
-    s.reserve(1000000); //avoid contig-sequence growth
-    std::vector<bool> used_kmers(kmerlist.size());
-    std::vector<kcontext> kcontextlist(kmerlist.size());
-    std::vector<bool> is_end_fw(kmerlist.size());
-    std::vector<bool> is_end_bw(kmerlist.size());
-    sdglib::OutputLog()<<"Finding neighbours"<<std::endl;
-#pragma omp parallel for
-    for (uint64_t i=0;i<kmerlist.size();++i){
-        auto fns=kmer_fw_neighbours(kmerlist[i], k);
-        auto &c=kcontextlist[i];
-        c.fb.fw=0;
-        c.fb.bw=0;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(fns[0],k))) c.sbcont.fA=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(fns[1],k))) c.sbcont.fC=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(fns[2],k))) c.sbcont.fG=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(fns[3],k))) c.sbcont.fT=1;
-        auto bns=kmer_bw_neighbours(kmerlist[i], k);
-        if (in_sorted_vector(kmerlist,kmer_cannonical(bns[0],k))) c.sbcont.bA=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(bns[1],k))) c.sbcont.bC=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(bns[2],k))) c.sbcont.bG=1;
-        if (in_sorted_vector(kmerlist,kmer_cannonical(bns[3],k))) c.sbcont.bT=1;
-    }
-    sdglib::OutputLog()<<"Marking ends"<<std::endl;
-#pragma omp parallel for
-    for (uint64_t i=0;i<kmerlist.size();++i) {
-        auto &c=kcontextlist[i];
-        if (c.fb.bw!=1 and c.fb.bw!=2 and c.fb.bw!=4 and c.fb.bw!=8 ) {
-            is_end_bw[i]=true;
-        } else {
-            int nn;
-            if (c.sbcont.bA) nn=0;
-            else if (c.sbcont.bC) nn=1;
-            else if (c.sbcont.bG) nn=2;
-            else if (c.sbcont.bT) nn=3;
-            auto next=kmer_bw_neighbours(kmerlist[i],k)[nn];
-            auto cnext=kmer_cannonical(next,k);
-            auto ni=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext)-kmerlist.begin();
-            auto &nc=kcontextlist[ni];
-            if (next==cnext and nc.fb.fw!=1 and nc.fb.fw!=2 and nc.fb.fw!=4 and nc.fb.fw!=8) is_end_bw[i]=true;
-            if (next!=cnext and nc.fb.bw!=1 and nc.fb.bw!=2 and nc.fb.bw!=4 and nc.fb.bw!=8) is_end_bw[i]=true;
+    UnitigWalker<KMER> walker(kmerlist,k);
+    sdglib::OutputLog()<<"Creating unitigs"<<std::endl;
+
+    std::vector<std::string> unitigs;
+    //halves of unitigs walked from both ends: (walker, walker it met), sequence
+    std::vector<std::pair<std::pair<uint64_t,uint64_t>,std::string>> halves;
+#pragma omp parallel
+    {
+        std::vector<std::string> thread_unitigs;
+        std::vector<std::pair<std::pair<uint64_t,uint64_t>,std::string>> thread_halves;
+#pragma omp for schedule(dynamic,10000)
+        for (uint64_t start_kmer_idx=0;start_kmer_idx<kmerlist.size();++start_kmer_idx) {
+            if (not walker.is_unitig_end(start_kmer_idx) or walker.claimed(start_kmer_idx)) continue;
+            auto wid=start_kmer_idx+1;
+            if (walker.claim(start_kmer_idx,wid)!=0) continue; //the walk from the other end got here first
+            //walk away from the end, starting on the orientation that has the unitig ahead
+            uint64_t start=(start_kmer_idx<<1);
+            if (walker.is_end_oriented(start) and not walker.is_end_oriented(start|1)) start|=1;
+            auto s=walker.oriented_sequence(start);
+            auto met=walker.walk(start,wid,s);
+            if (met==0 or met==wid) thread_unitigs.emplace_back(s);
+            else thread_halves.emplace_back(std::make_pair(wid,met),s);
         }
-        if (c.fb.fw!=1 and c.fb.fw!=2 and c.fb.fw!=4 and c.fb.fw!=8 ) {
-            is_end_fw[i]=true;
-        } else {
-            int nn;
-            if (c.sbcont.fA) nn=0;
-            else if (c.sbcont.fC) nn=1;
-            else if (c.sbcont.fG) nn=2;
-            else if (c.sbcont.fT) nn=3;
-            auto next=kmer_fw_neighbours(kmerlist[i],k)[nn];
-            auto cnext=kmer_cannonical(next,k);
-            auto ni=std::lower_bound(kmerlist.begin(),kmerlist.end(),cnext)-kmerlist.begin();
-            auto &nc=kcontextlist[ni];
-            if (next==cnext and nc.fb.bw!=1 and nc.fb.bw!=2 and nc.fb.bw!=4 and nc.fb.bw!=8) is_end_fw[i]=true;
-            if (next!=cnext and nc.fb.fw!=1 and nc.fb.fw!=2 and nc.fb.fw!=4 and nc.fb.fw!=8) is_end_fw[i]=true;
+#pragma omp critical(unitigs_collect)
+        {
+            unitigs.insert(unitigs.end(),thread_unitigs.begin(),thread_unitigs.end());
+            halves.insert(halves.end(),thread_halves.begin(),thread_halves.end());
         }
     }
-    uint64_t eb=0;
-    for (const auto &e:is_end_bw) if(e) ++eb;
-    uint64_t ef=0;
-    for (const auto &e:is_end_fw) if(e) ++ef;
-    sdglib::OutputLog()<<is_end_bw.size()<<" k-mers, with "<<eb<<" ends backward and "<<ef <<" ends forward"<<std::endl;
-    sdglib::OutputLog()<<"Creating unitigs"<<std::endl;
-
-    for (uint64_t start_kmer_idx=0;start_kmer_idx<kmerlist.size();++start_kmer_idx) {
-        if (used_kmers[start_kmer_idx]) continue; //any kmer can only belong to one unitig.ww
-
-        //Check this k-mer is an end/junction
-        auto start_kmer = kmerlist[start_kmer_idx];
-
-
-        auto end_bw=is_end_bw[start_kmer_idx];
-        auto end_fw=is_end_fw[start_kmer_idx];
-
-        if (!end_bw and !end_fw) continue;
-
-        if (end_bw and end_fw) {
-            //kmer as unitig
-            s=kmer_to_sequence(start_kmer, k);
-            used_kmers[start_kmer_idx] = true;
-        } else {
-            //unitig start on kmer
-            //make sure the unitig starts on FW
-
-            auto current_kmer = start_kmer;
-            auto current_idx = start_kmer_idx;
-            used_kmers[start_kmer_idx] = true;
-
-            if (end_fw) {
-                current_kmer = kmer_reverse(start_kmer, k);
-                std::swap(end_fw,end_bw);
-            }
-
-            //Add kmer as unitig
-            s=kmer_to_sequence(current_kmer, k);
-
-            unsigned char nucleotides[4] = {'A', 'C', 'G', 'T'};
-
-
-
-            //std::cout<<"Starting sequence construction at kmer "<<kmer_to_sequence128(current_kmer,k)<<std::endl;
-            while (!end_fw) {
-                //Add end nucleotide, update current_kmer;
-                //get_fw_idxs128(fwn, current_kmer, k, kmerlist);
-                auto c=kcontextlist[current_idx];
-                int nn;
-                if (kmer_cannonical(current_kmer,k)==current_kmer) {
-                    if (c.sbcont.fA) nn = 0;
-                    else if (c.sbcont.fC) nn = 1;
-                    else if (c.sbcont.fG) nn = 2;
-                    else if (c.sbcont.fT) nn = 3;
-                }
-                else{
-                    if (c.sbcont.bA) nn = 3;
-                    else if (c.sbcont.bC) nn = 2;
-                    else if (c.sbcont.bG) nn = 1;
-                    else if (c.sbcont.bT) nn = 0;
-                }
-                current_kmer=kmer_fw_neighbours(current_kmer,k)[nn];
-                auto ccurr=kmer_cannonical(current_kmer,k);
-                current_idx=std::lower_bound(kmerlist.begin(),kmerlist.end(),ccurr)-kmerlist.begin();
-                if (used_kmers[current_idx]) break; //this should never happen, since these have ends.
-                used_kmers[current_idx]=true;
-                s.push_back(nucleotides[current_kmer % 4]);
-                if (ccurr==current_kmer) end_fw = is_end_fw[current_idx];
-                else end_fw = is_end_bw[current_idx];
-            }
+    //join the halves that met: the second half is walked backwards, its first k-1 bases overlap the first half
+    std::sort(halves.begin(),halves.end());
+    for (auto &h:halves) {
+        if (h.first.first>h.first.second) continue;
+        auto other=std::lower_bound(halves.begin(),halves.end(),std::make_pair(std::make_pair(h.first.second,h.first.first),std::string()));
+        if (other==halves.end() or other->first!=std::make_pair(h.first.second,h.first.first)) {
+            unitigs.emplace_back(h.second);
+            continue;
         }
-        sg.add_node(Node(s));
-        if (!sg.nodes.back().is_canonical()) sg.nodes.back().make_rc();//inefficient, but once in a node
+        unitigs.emplace_back(h.second+reverse_complement(other->second).substr(k-1));
     }
-    sdglib::OutputLog()<<sg.nodes.size()<<" unitigs"<<std::endl;
-    uint64_t uk=0;
-    for (auto const & u:used_kmers) if(u) ++uk;
-    sdglib::OutputLog()<<uk<<"/"<<used_kmers.size()<<" kmers are used"<<std::endl;
-    //If there are any perfect circles, they won't have ends, so just pick any unused kmer and go fw till you find the same k-mer fw.
-    //(this is going to be even tricker to parallelise)
+    for (auto &h:halves) {
+        //halves whose partner is missing have been added already, the rest were joined from their first half
+        if (h.first.first<h.first.second) continue;
+        auto other=std::lower_bound(halves.begin(),halves.end(),std::make_pair(std::make_pair(h.first.second,h.first.first),std::string()));
+        if (other==halves.end() or other->first!=std::make_pair(h.first.second,h.first.first)) unitigs.emplace_back(h.second);
+    }
+    sdglib::OutputLog()<<unitigs.size()<<" unitigs"<<std::endl;
+
+    //If there are any perfect circles, they won't have ends, so just pick any unclaimed kmer and go fw till it comes back.
     sdglib::OutputLog()<<"doing the circles now"<<std::endl;
-    uint64_t cid=0;
+    uint64_t circles=0;
     for (uint64_t start_kmer_idx=0;start_kmer_idx<kmerlist.size();++start_kmer_idx) {
-        if (used_kmers[start_kmer_idx]) continue; //any kmer can only belong to one unitig.ww
-        std::cout<<"Circle #"<<cid++<<"started on kmer "<<start_kmer_idx<<": "<<kmer_to_sequence(kmerlist[start_kmer_idx],k)<<std::endl;
-        //Check this k-mer is an end/junction
-        auto start_kmer = kmerlist[start_kmer_idx];
-        std::vector<klidxs64> fwn;
-        unsigned char nucleotides[4] = {'A', 'C', 'G', 'T'};
-        auto current_kmer = start_kmer;
-        used_kmers[start_kmer_idx] = true;
-        s=kmer_to_sequence(current_kmer, k);
-
-        while (true) {
-            //Add end nucleotide, update current_kmer;
-            get_fw_idxs64(fwn, current_kmer, k, kmerlist);
-            current_kmer = fwn[0].kmer;
-            std::cout<<"Circle goes on to kmer "<<fwn[0].idx<<": "<<kmer_to_sequence(fwn[0].kmer,k)<<std::endl;
-            if (current_kmer==start_kmer) break;
-            if (used_kmers[fwn[0].idx]){
-                std::cout<<"ERROR: using a kmer that is already used, but i'm supposed to be on a circle"<<std::endl;
-                break;
-            }
-            used_kmers[fwn[0].idx] = true;
-            s.push_back(nucleotides[current_kmer % 4]);
-        }
-        sg.add_node(Node(s));
-        if (!sg.nodes.back().is_canonical()) sg.nodes.back().make_rc();//inefficient, but once in a node
+        if (walker.claimed(start_kmer_idx)) continue;
+        walker.claim(start_kmer_idx,start_kmer_idx+1);
+        auto s=walker.oriented_sequence(start_kmer_idx<<1);
+        walker.walk(start_kmer_idx<<1,start_kmer_idx+1,s);
+        unitigs.emplace_back(s);
+        ++circles;
     }
-    sdglib::OutputLog()<<sg.nodes.size()<<" unitigs"<<std::endl;
+    sdglib::OutputLog()<<circles<<" circles"<<std::endl;
+
+#pragma omp parallel for schedule(dynamic,10000)
+    for (uint64_t i=0;i<unitigs.size();++i) {
+        if (!SequenceDistanceGraph::is_canonical(unitigs[i])) unitigs[i]=reverse_complement(unitigs[i]);
+    }
+    sdglib::sort(unitigs.begin(),unitigs.end());
+    sg.add_nodes(unitigs);
+    std::vector<std::string>().swap(unitigs);
+    sdglib::OutputLog()<<sg.nodes.size()-1<<" unitigs"<<std::endl;
 
     //save the (k-1)mer in (rev on first k-1 / fw on last k-1) or out ( fw on first k-1 / bw on last k-1)
-    std::vector<std::pair<uint64_t,sgNodeID_t>> in, out;
-    in.reserve(2*sg.nodes.size());
-    out.reserve(2*sg.nodes.size());
-    CStringKMerFactory skf_ovl(k-1);
-    for (uint64_t nid=1;nid<sg.nodes.size();++nid){
-        std::vector<std::pair<uint64_t,bool>> first,last;
-        skf_ovl.create_kmers_direction(first,sg.nodes[nid].sequence.substr(0,k-1).c_str());
-        if (first[0].second) out.emplace_back(first[0].first,nid);
-        else in.emplace_back(first[0].first,nid);
-        skf_ovl.create_kmers_direction(last,sg.nodes[nid].sequence.substr(sg.nodes[nid].sequence.size()-k+1,k-1).c_str());
-        if (last[0].second) in.emplace_back(last[0].first,-nid);
-        else out.emplace_back(last[0].first,-nid);
+    //ends are (k-1-mer, is_out, node), sorted in parallel so links join consecutive entries
+    std::vector<std::tuple<KMER,bool,sgNodeID_t>> ends(2*(sg.nodes.size()-1));
+#pragma omp parallel
+    {
+        typename UnitigKmerOps<KMER>::OverlapFactory skf_ovl(k-1);
+        std::vector<std::pair<KMER,bool>> first,last;
+        std::vector<char> ovl(k,'\0'); //(k-1)-mer windows read from the packed sequences, null terminated
+#pragma omp for schedule(static,10000)
+        for (uint64_t nid=1;nid<sg.nodes.size();++nid){
+            first.clear();
+            last.clear();
+            sg.node_sequences.window(nid,0,k-1,ovl.data());
+            skf_ovl.create_kmers_direction(first,ovl.data());
+            ends[2*(nid-1)]=std::make_tuple(first[0].first,first[0].second,(sgNodeID_t) nid);
+            sg.node_sequences.window(nid,sg.get_node_size(nid)-k+1,k-1,ovl.data());
+            skf_ovl.create_kmers_direction(last,ovl.data());
+            ends[2*(nid-1)+1]=std::make_tuple(last[0].first,not last[0].second,(sgNodeID_t) -nid);
+        }
     }
-    std::sort(in.begin(),in.end());
-    std::sort(out.begin(),out.end());
-    //connect out->in for all combinations on each kmer
-    uint64_t next_out_idx=0;
-    for(auto &i:in){
-        while(next_out_idx<out.size() and out[next_out_idx].first<i.first) ++next_out_idx;
-        for (auto oidx=next_out_idx;oidx<out.size() and out[oidx].first==i.first;++oidx) {
-            sg.add_link(i.second,out[oidx].second,-k+1); //no support, although we could add the DBG operation as such
+    sdglib::sort(ends.begin(),ends.end());
+    //connect out->in for all combinations on each k-1-mer, groups are found in parallel
+    std::vector<std::pair<sgNodeID_t,sgNodeID_t>> new_links;
+#pragma omp parallel
+    {
+        std::vector<std::pair<sgNodeID_t,sgNodeID_t>> thread_links;
+#pragma omp for schedule(static,10000)
+        for (uint64_t g=0;g<ends.size();++g) {
+            if (g>0 and std::get<0>(ends[g-1])==std::get<0>(ends[g])) continue; //not the first of its group
+            auto gend=g;
+            while (gend<ends.size() and std::get<0>(ends[gend])==std::get<0>(ends[g])) ++gend;
+            for (auto i=g;i<gend;++i) {
+                if (std::get<1>(ends[i])) continue;
+                for (auto o=g;o<gend;++o) if (std::get<1>(ends[o])) thread_links.emplace_back(std::get<2>(ends[i]),std::get<2>(ends[o]));
+            }
         }
+#pragma omp critical(unitigs_links)
+        new_links.insert(new_links.end(),thread_links.begin(),thread_links.end());
     }
+    std::sort(new_links.begin(),new_links.end());
+    for (auto &l:new_links) sg.add_link(l.first,l.second,-k+1); //no support, although we could add the DBG operation as such
+    SDG_COUNTER_ADD("GraphMaker::build_unitig_graph/nodes", sg.nodes.size()-1);
     sdglib::OutputLog()<<"Graph construction finished"<<std::endl;
 }
 
-void GraphMaker::new_graph_from_paired_datastore(const PairedReadsDatastore& ds,  int k, int min_coverage, int num_batches) {
-    new_graph_from_kmerlist_trivial128(BatchKmersCounter::countKmersToList(ds, k, min_coverage, num_batches),k);
+void GraphMaker::new_graph_from_kmerlist_trivial128(const std::vector<__uint128_t> & kmerlist,uint8_t k) {
+    build_unitig_graph(sg,kmerlist,k);
 }
 
-void GraphMaker::new_graph_from_long_datastore(const LongReadsDatastore& ds,  int k, int min_coverage, int num_batches) {
-    new_graph_from_kmerlist_trivial128(BatchKmersCounter::countKmersToList(ds, k, min_coverage, num_batches),k);
+void GraphMaker::new_graph_from_kmerlist_trivial64(const std::vector<__uint64_t> & kmerlist,uint8_t k) {
+    build_unitig_graph(sg,kmerlist,k);
 }
 
-void GraphMaker::new_knodes_graph_from_long_datastore(const LongReadsDatastore& ds,  int k, int min_coverage, int max_coverage, int num_batches) {
+void GraphMaker::new_graph_from_paired_datastore(const PairedReadsDatastore& ds,  int k, int min_coverage, int num_batches, uint64_t max_memory) {
+    new_graph_from_kmerlist_trivial128(BatchKmersCounter::countKmersToList(ds, k, min_coverage, num_batches, max_memory),k);
+}
+
+void GraphMaker::new_graph_from_long_datastore(const LongReadsDatastore& ds,  int k, int min_coverage, int num_batches, uint64_t max_memory) {
+    new_graph_from_kmerlist_trivial128(BatchKmersCounter::countKmersToList(ds, k, min_coverage, num_batches, max_memory),k);
+}
+
+void GraphMaker::new_knodes_graph_from_long_datastore(const LongReadsDatastore& ds,  int k, int min_coverage, int max_coverage, int num_batches, uint64_t max_memory) {
     //new_graph_from_kmerlist_trivial128(BatchKmersCounter::countKmersToList(ds, k, min_coverage, num_batches),k);
-    auto kmer_list = BatchKmersCounter::buildKMerCount(k, ds, min_coverage, ".", ".", num_batches);
-    for (auto kp=kmer_list->kmers;kp<kmer_list->kmers+kmer_list->size;++kp){
-        if (kp->count>=min_coverage and kp->count<=max_coverage) sg.add_node(kmer_to_sequence128(kp->kdata,k));
-    }
+    MinimizerKmersCounter counter(k, ".", max_memory);
+    counter.add_reads(ds);
+    std::vector<__uint128_t> kmers;
+    counter.count_to<__uint128_t>(min_coverage, max_coverage, [](__uint128_t kmer, uint32_t count) { return kmer; },
+                                  [&](uint64_t n) { kmers.resize(n); return kmers.data(); });
+    for (auto &kmer: kmers) sg.add_node(kmer_to_sequence128(kmer,k));
 }
@@ -12,6 +12,7 @@
 #include <sdglib/graph/SequenceDistanceGraph.hpp>
 #include <sdglib/datastores/PairedReadsDatastore.hpp>
 #include <sdglib/datastores/LongReadsDatastore.hpp>
+#include <sdglib/batch_counter/MinimizerKmersCounter.hpp>
 
 /**
  * This kmer class can give possible neighbours FW and BW to help build a graph more easily.
@@ -48,9 +49,9 @@ public:
     GraphMaker(SequenceDistanceGraph & _sg): sg(_sg){};
     void new_graph_from_kmerlist_trivial64(const std::vector<__uint64_t> & kmerset,uint8_t k);
     void new_graph_from_kmerlist_trivial128(const std::vector<__uint128_t> & kmerset,uint8_t k);
-    void new_graph_from_paired_datastore(const PairedReadsDatastore & ds, int k, int min_coverage, int num_batches);
-    void new_graph_from_long_datastore(const LongReadsDatastore & ds, int k, int min_coverage, int num_batches);
-    void new_knodes_graph_from_long_datastore(const LongReadsDatastore & ds, int k, int min_coverage, int max_coverage, int num_batches);
+    void new_graph_from_paired_datastore(const PairedReadsDatastore & ds, int k, int min_coverage, int num_batches, uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
+    void new_graph_from_long_datastore(const LongReadsDatastore & ds, int k, int min_coverage, int num_batches, uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
+    void new_knodes_graph_from_long_datastore(const LongReadsDatastore & ds, int k, int min_coverage, int max_coverage, int num_batches, uint64_t max_memory = MinimizerKmersCounter::default_max_memory);
 
 //    //Minimum cleanup options
 
@@ -30,6 +30,7 @@ std::string kts(uint64_t kmer, uint8_t k) {
 }
 
 uint64_t GraphPatcher::find_tips_to_reconnect(int min_paths) {
+    ws.loaded(ws.paired_reads_datastores[0]);
     for (auto fnv:ws.sdg.get_all_nodeviews())
         for (auto nv: {fnv,fnv.rc()}) {
             if (nv.next().empty()) {
@@ -120,7 +121,15 @@ uint64_t GraphPatcher::patch_reconnection_groups() {
     return solved;
 }
 
+//The last k bases of node n, read in place from the graph's packed sequences
+static std::string last_bases(const SequenceDistanceGraph &sdg, sgNodeID_t n, uint64_t k) {
+    std::string s(k,' ');
+    sdg.node_sequences.window(n,sdg.get_node_size(n)-k,k,&s[0]);
+    return s;
+}
+
 void GraphPatcher::create_patch(std::vector<sgNodeID_t> reconnection_group) {
+    ws.loaded(ws.paired_reads_datastores[0]);
 
     //1) create a DBG wil ALL kmers from reads that have one of the last X kmers in the node and are pathed to it.
 
@@ -129,7 +138,7 @@ void GraphPatcher::create_patch(std::vector<sgNodeID_t> reconnection_group) {
     std::set<uint64_t>rids;
     //First get all the reads from the nodes that have a path forward (this should really use the offsets, but they're not saved yet?)
     for (auto nid:reconnection_group) {
-        auto last_node_kmer=sdglib::str_to_kmers(ws.sdg.get_node_sequence(nid).substr(ws.sdg.get_node_size(nid)-patch_K),patch_K).back().second;
+        auto last_node_kmer=sdglib::str_to_kmers(last_bases(ws.sdg,nid,patch_K),patch_K).back().second;
         for (auto rid:ws.paired_reads_datastores[0].mapper.paths_in_node[llabs(nid)]){
             if (nid<0) rid=-rid;
             if (rids.count(llabs(rid))==0){
@@ -192,7 +201,7 @@ void GraphPatcher::create_patch(std::vector<sgNodeID_t> reconnection_group) {
 
     //3) stride in this graph
     for (auto nid:reconnection_group) {
-        auto last_node_kmer = sdglib::str_to_kmers(ws.sdg.get_node_sequence(nid).substr(ws.sdg.get_node_size(nid) - patch_K), patch_K).back();
+        auto last_node_kmer = sdglib::str_to_kmers(last_bases(ws.sdg, nid, patch_K), patch_K).back();
         std::cout<<" Entering ro reconnect node "<<nid<<" lands on temp node "<<kmer_nodes[last_node_kmer.second]*(last_node_kmer.first? 1:-1)<<std::endl;
     }
 }
\ No newline at end of file
@@ -99,7 +99,7 @@ void LongReadHaplotypeMappingsFilter::score_window_winners(float weight, int k,
     uint64_t ni=0;
     for (auto &n:nodeset){
         nkmers.clear();
-        skf.produce_all_kmers(lorm.sg.nodes[n].sequence.c_str(),nkmers);
+        skf.produce_all_kmers(lorm.sg.node_sequences,n,nkmers);
         //std::sort(nkmers.begin(),nkmers.end());
         kmer_hits_by_node[ni].clear();
         kmer_hits_by_node[ni].resize(rkmers.size());
@@ -161,10 +161,10 @@ void LinkageMaker::report_selection() {
     uint64_t total_bp=0,total_count=0,selected_bp=0,selected_count=0;
     for (auto n=1;n<dg.sdg.nodes.size();++n) {
         if (dg.sdg.nodes[n].status == NodeStatus::Deleted) continue;
-        total_bp+=dg.sdg.nodes[n].sequence.size();
+        total_bp+=dg.sdg.get_node_size(n);
         ++total_count;
         if (selected_nodes[n]) {
-            selected_bp += dg.sdg.nodes[n].sequence.size();
+            selected_bp += dg.sdg.get_node_size(n);
             ++selected_count;
         }
     }
@@ -174,8 +174,8 @@ void LinkageMaker::report_selection() {
 void LinkageMaker::select_by_size( uint64_t min_size, uint64_t max_size) {
     for (auto n=1;n<dg.sdg.nodes.size();++n) {
         if (dg.sdg.nodes[n].status==NodeStatus::Deleted) continue;
-        if (dg.sdg.nodes[n].sequence.size() >= min_size and
-            (max_size==0 or dg.sdg.nodes[n].sequence.size() <= max_size))
+        if (dg.sdg.get_node_size(n) >= min_size and
+            (max_size==0 or dg.sdg.get_node_size(n) <= max_size))
             selected_nodes[n]=true;
     }
 }
@@ -212,6 +212,7 @@ DistanceGraph LinkageMaker::make_paired_linkage(int min_reads) {
     //use all libraries collect votes on each link
     auto rmi=0;
     for (auto &prds:dg.sdg.ws.paired_reads_datastores) {
+        dg.sdg.ws.loaded(prds);
         for (auto i = 1; i < prds.mapper.read_to_node.size(); i += 2) {
             sgNodeID_t n1 = prds.mapper.read_to_node[i];
             sgNodeID_t n2 = prds.mapper.read_to_node[i + 1];
@@ -250,7 +251,7 @@ DistanceGraph LinkageMaker::make_paired_linkage_pe(int min_reads) {
     std::map<std::pair<sgNodeID_t, sgNodeID_t>, uint64_t> lv;
     sdglib::OutputLog()<<"collecting link votes across all paired libraries"<<std::endl;
     //use all libraries collect votes on each link
-    auto &prds= dg.sdg.ws.paired_reads_datastores[0];
+    auto &prds= dg.sdg.ws.loaded(dg.sdg.ws.paired_reads_datastores[0]);
     for (auto i = 1; i < prds.mapper.read_to_node.size(); i += 2) {
         sgNodeID_t n1 = prds.mapper.read_to_node[i];
         sgNodeID_t n2 = prds.mapper.read_to_node[i + 1];
@@ -282,7 +283,7 @@ DistanceGraph LinkageMaker::make_paired_linkage_pe(int min_reads) {
     }
     return ldg;
 }
-void add_readkmer_nodes(std::vector<sgNodeID_t> & kmernodes, std::vector<std::pair<uint64_t,bool>> & readkmers, const std::unordered_map<uint64_t, graphStrandPos> & index, bool rev){
+void add_readkmer_nodes(std::vector<sgNodeID_t> & kmernodes, std::vector<std::pair<uint64_t,bool>> & readkmers, const UniqueKmerIndex::Map & index, bool rev){
     //TODO allow for a minimum of kmers to count the hit?
     if (not rev) {
         for (auto rki=readkmers.begin();rki<readkmers.end();++rki) {
@@ -311,6 +312,7 @@ std::map<std::pair<sgNodeID_t, sgNodeID_t>, uint64_t> LinkageMaker::shared_read_
     std::vector<std::pair<sgNodeID_t ,sgNodeID_t >> nodeproximity;
     //This actually works like a paired-read-to-path
     for (auto lib:libraries) {
+        dg.sdg.ws.loaded(dg.sdg.ws.paired_reads_datastores[lib]);
 #pragma omp parallel
         {
             CStringKMerFactory cskf(31);
@@ -393,7 +395,7 @@ std::vector<Link> LinkageMaker::mappings_to_multilinkage(const std::vector<LongR
     for (int i=0; i<lorm_mappings.size();++i){
         auto &m=lorm_mappings[i];
         if (not selected_nodes[llabs(m.node)]) continue;
-        auto ns= dg.sdg.nodes[llabs(m.node)].sequence.size();
+        auto ns= dg.sdg.get_node_size(llabs(m.node));
         if ( (i==0 and m.qStart<unmapped_end) or (i==lorm_mappings.size()-1 and m.qEnd+unmapped_end>=read_size) or total_bp[m.node]>=.7*ns) {
             //If a node has mode than one consecutive mapping, merge them.
             if (mfilt_total.size()>0 and mfilt_total.back().node==m.node and mfilt_total.back().nStart<m.nStart and mfilt_total.back().nEnd<m.nEnd and mfilt_total.back().nEnd<m.nStart+500) {
@@ -406,7 +408,7 @@ std::vector<Link> LinkageMaker::mappings_to_multilinkage(const std::vector<LongR
     //Now remove all mappings that do not cover 80% of the node
     for (int i=0; i<mfilt_total.size();++i){
         auto &m=mfilt_total[i];
-        auto ns= dg.sdg.nodes[llabs(m.node)].sequence.size();
+        auto ns= dg.sdg.get_node_size(llabs(m.node));
         if ( (i==0 and m.nEnd>.9*ns and m.qStart<unmapped_end) or (i==mfilt_total.size()-1 and m.nStart<.1*ns and m.qEnd+unmapped_end>read_size) or m.nEnd-m.nStart+1>=.8*ns) {
             mmergedfilt.push_back(m);
         }
@@ -415,7 +417,7 @@ std::vector<Link> LinkageMaker::mappings_to_multilinkage(const std::vector<LongR
     std::vector<std::pair<sgNodeID_t, std::pair<int32_t, int32_t>>> node_ends;
     for (auto &m:mmergedfilt) {
         node_ends.emplace_back(m.node, std::make_pair(m.qStart-m.nStart, m.qEnd +
-                                                                         dg.sdg.nodes[llabs(m.node)].sequence.size() - m.nEnd));
+                                                                         dg.sdg.get_node_size(llabs(m.node)) - m.nEnd));
     }
     //for every nodeA:
     for (int nA=0;nA+1<node_ends.size();++nA) {
@@ -532,12 +534,12 @@ DistanceGraph LinkageMaker::make_paired10x_multilinkage(const PairedReadsMapper
             d1=read_first_pos[rid1];
             n1=-n1;
         }
-        else d1=dg.sdg.nodes[n1].sequence.size()-read_first_pos[rid1];
+        else d1=dg.sdg.get_node_size(n1)-read_first_pos[rid1];
         if (fr==prm.read_direction_in_node[rid2]) {
             d2=read_first_pos[rid2];
             n2=-n2;
         }
-        else d2=dg.sdg.nodes[n2].sequence.size()-read_first_pos[rid2];
+        else d2=dg.sdg.get_node_size(n2)-read_first_pos[rid2];
 
         ldg.add_link(n1,n2,isize-d1-d2,{SupportType::PairedRead,prmidx,rid1});
         ++used;
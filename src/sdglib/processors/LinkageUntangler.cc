@@ -6,6 +6,7 @@
 #include "GraphMaker.hpp"
 #include "LinkageMaker.hpp"
 #include <atomic>
+#include <sdglib/utilities/Metrics.hpp>
 
 class KmerMapCreator : public  KMerFactory {
 public:
@@ -170,10 +171,10 @@ void LinkageUntangler::report_selection() {
     uint64_t total_bp=0,total_count=0,selected_bp=0,selected_count=0;
     for (auto n=1;n<dg.sdg.nodes.size();++n) {
         if (dg.sdg.nodes[n].status == NodeStatus::Deleted) continue;
-        total_bp+=dg.sdg.nodes[n].sequence.size();
+        total_bp+=dg.sdg.get_node_size(n);
         ++total_count;
         if (selected_nodes[n]) {
-            selected_bp += dg.sdg.nodes[n].sequence.size();
+            selected_bp += dg.sdg.get_node_size(n);
             ++selected_count;
         }
     }
@@ -184,8 +185,8 @@ void LinkageUntangler::select_by_size( uint64_t min_size, uint64_t max_size) {
     {
         for (auto n=1;n<dg.sdg.nodes.size();++n) {
             if (dg.sdg.nodes[n].status==NodeStatus::Deleted) continue;
-            if (dg.sdg.nodes[n].sequence.size() >= min_size and
-                (max_size==0 or dg.sdg.nodes[n].sequence.size() <= max_size))
+            if (dg.sdg.get_node_size(n) >= min_size and
+                (max_size==0 or dg.sdg.get_node_size(n) <= max_size))
                 selected_nodes[n]=true;
         }
     }
@@ -267,6 +268,8 @@ void LinkageUntangler::select_by_size( uint64_t min_size, uint64_t max_size) {
 //}
 
 void LinkageUntangler::select_linear_anchors(int min_links, int min_transitive_links) {
+    SDG_SCOPED_TIMER(timer, "LinkageUntangler::select_linear_anchors");
+    SDG_TIMER_ITEMS(timer, dg.sdg.nodes.size()-1);
     for (auto n=1;n<dg.sdg.nodes.size();++n){
         if (dg.sdg.nodes[n].status == NodeStatus::Deleted) continue;
         bool anchor=true;
@@ -298,6 +301,8 @@ void LinkageUntangler::select_linear_anchors(int min_links, int min_transitive_l
 }
 
 DistanceGraph LinkageUntangler::make_nextselected_linkage(int min_links) {
+    SDG_SCOPED_TIMER(timer, "LinkageUntangler::make_nextselected_linkage");
+    SDG_TIMER_ITEMS(timer, dg.sdg.nodes.size()-1);
     DistanceGraph ldg(dg.sdg);
     for (auto n=1;n<dg.sdg.nodes.size();++n) {
         if (dg.sdg.nodes[n].status == NodeStatus::Deleted or !selected_nodes[n]) continue;
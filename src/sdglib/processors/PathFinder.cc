@@ -4,6 +4,7 @@
 
 #include "PathFinder.hpp"
 #include <sdglib/views/NodeView.hpp>
+#include <stdexcept>
 
 PFScoredPath::PFScoredPath(const PathFinder &_pf, sgNodeID_t _from, sgNodeID_t _to):pf(_pf),path(_pf.ws.sdg),from(_from),to(_to){
 
@@ -103,13 +104,17 @@ void PathFinder::load_lrseqs(DistanceGraph &dg, const LongReadsRecruiter & lrr,
             if (tn.node == -n2) rstart = std::max(tn.end - ovl_extension, 0);
             if (tn.node == n2 and fstart != -1 and fstart < tn.start) {
                 //std::cout<<rid<<std::endl;std::flush(std::cout);
-                seqs.emplace_back(lrr.datastore.get_read_sequence(rid).substr(fstart, tn.start + 300 - fstart),
+                auto view = lrr.datastore.get_read_view(rid);
+                if ((uint64_t) fstart >= view.size) throw std::out_of_range("Thread of read " + std::to_string(rid) + " goes past its end");
+                seqs.emplace_back(std::string(view.seq + fstart, std::min((uint64_t) (tn.start + 300 - fstart), view.size - fstart)),
                                   PFSEType::PFLongRead, 0, rid);
                 fstart = -1;
             }
             if (tn.node == -n1 and rstart != -1 and rstart < tn.start) {
+                auto view = lrr.datastore.get_read_view(rid);
+                if ((uint64_t) rstart >= view.size) throw std::out_of_range("Thread of read " + std::to_string(rid) + " goes past its end");
                 seqs.emplace_back(
-                        sdglib::str_rc(lrr.datastore.get_read_sequence(rid).substr(rstart, tn.start + 300 - rstart)),
+                        sdglib::str_rc(std::string(view.seq + rstart, std::min((uint64_t) (tn.start + 300 - rstart), view.size - rstart))),
                                   PFSEType::PFLongRead, 0, rid);
                 rstart = -1;
             }
@@ -4,6 +4,8 @@
 
 #include <sdglib/views/NodeView.hpp>
 #include "Strider.hpp"
+#include <sdglib/utilities/Metrics.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
 
 const std::string Strider::logo="                    80CLfft11G\n                   01;;1111tf8\n                   0;:1CCCCCC0\n                    L:tCCCCCCC8\n                     CifCCCCCC8\n                      8GCCCCC0\n                   8888GLffLG8        088\n                80GGCCCL11111fG8     0LL0\n               0CCCCCCCL11111tLG  80GCG0\n                8GCCC00f111111tLC0GCCG8\n                 8GCC8G1111111tLCCCG8\n                  0CCf1111111CGCG8\n                   0Cf1iii11L\n                   G1CLt:,:;L0\n                   C:;i;,,,,,:iL8\n                   t,,,,,,,,,,ifC0\n      00          0:,,,,,i;:ifCCCC0\n    8L11L0888     G:,,,,i88G8 8CCCG\n  0t1tfCCCCCGGGGGGLf1;:C     8CCCC8\n 0i1C08 800GCCCCCCCCCG0      8CCCC0\n LG        88000GG08         0CCC0\n                              CCC8\n                              GCC8\n                             8fffL08\n                             0t1t1ttfC\n                              8800G08\n";
 
@@ -37,7 +39,7 @@ inline uint32_t get_votes(std::unordered_map<sgNodeID_t,uint32_t> votes, sgNodeI
 SequenceDistanceGraphPath Strider::stride_out(sgNodeID_t n) {
     SequenceDistanceGraphPath p(ws.sdg);
     std::unordered_map<sgNodeID_t,uint32_t> votes;
-    for (auto &p:ws.paired_reads_datastores[0].mapper.all_paths_fw(n)) {
+    for (auto &p:ws.loaded(ws.paired_reads_datastores[0]).mapper.all_paths_fw(n)) {
         for (auto &n:p) ++votes[n];
     }
 
@@ -173,17 +175,30 @@ SequenceDistanceGraphPath Strider::stride_out_in_order(sgNodeID_t n,bool use_pai
     return p;
 }
 
+//Whether the 30bp after the first base of n1 are the first 30bp of n2, read in place from the packed sequences
+static bool overlap_30(const SequenceDistanceGraph &sdg, sgNodeID_t n1, sgNodeID_t n2) {
+    auto l1=std::min<uint64_t>(30,sdg.get_node_size(n1)-1);
+    auto l2=std::min<uint64_t>(30,sdg.get_node_size(n2));
+    if (l1!=l2) return false;
+    char s1[30],s2[30];
+    sdg.node_sequences.window(n1,1,l1,s1);
+    sdg.node_sequences.window(n2,0,l2,s2);
+    return std::equal(s1,s1+l1,s2);
+}
+
 void Strider::join_stride_single_strict_from_all() {
+    SDG_SCOPED_TIMER(timer, "Strider::join_stride_single_strict_from_all");
+    SDG_TIMER_ITEMS(timer, ws.sdg.nodes.size()-1);
     std::cout<<std::endl<<logo<<std::endl;
     sdglib::OutputLog()<<"Gone striding..."<<std::endl;
 #pragma omp parallel for schedule(static,1000)
     for (auto nid=1;nid<ws.sdg.nodes.size();++nid) {
         auto fw=stride_single_strict(nid).nodes;
-        if (fw.size()>1 and not ws.sdg.are_connected(-fw[0],fw[1]) and ws.sdg.get_node_sequence(fw[0]).substr(1,30)==ws.sdg.get_node_sequence(fw[1]).substr(0,30))
+        if (fw.size()>1 and not ws.sdg.are_connected(-fw[0],fw[1]) and overlap_30(ws.sdg,fw[0],fw[1]))
 #pragma omp critical
             ws.sdg.add_link(-fw[0],fw[1],-30);
         auto bw=stride_single_strict(-nid).nodes;
-        if (bw.size()>1 and not ws.sdg.are_connected(-bw[0],bw[1]) and ws.sdg.get_node_sequence(bw[0]).substr(1,30)==ws.sdg.get_node_sequence(bw[1]).substr(0,30))
+        if (bw.size()>1 and not ws.sdg.are_connected(-bw[0],bw[1]) and overlap_30(ws.sdg,bw[0],bw[1]))
 #pragma omp critical
             ws.sdg.add_link(-bw[0],bw[1],-30);
     }
@@ -191,6 +206,7 @@ void Strider::join_stride_single_strict_from_all() {
 }
 
 void Strider::stride_from_anchors(uint32_t min_size, float min_kci, float max_kci) {
+    SDG_SCOPED_TIMER(timer, "Strider::stride_from_anchors");
     std::cout<<std::endl<<logo<<std::endl;
     sdglib::OutputLog()<<"Gone striding..."<<std::endl;
     routes_fw.clear();
@@ -201,8 +217,10 @@ void Strider::stride_from_anchors(uint32_t min_size, float min_kci, float max_kc
     is_anchor.resize(ws.sdg.nodes.size());
     if (min_size==0) min_size=1;//a min_size of 0 would get deleted nodes and such
     uint64_t anchors=0,found_fw=0,found_bw=0;
-#pragma omp parallel for reduction(+:anchors) reduction(+:found_fw) reduction(+:found_bw) schedule(static,1000)
-    for (auto nid=1;nid<ws.sdg.nodes.size();++nid) {
+    sdglib::CostBalancedChunks chunks(1, ws.sdg.nodes.size(), [&](uint64_t nid){ return ws.sdg.get_node_size(nid)<min_size ? 0:ws.sdg.get_node_size(nid); });
+#pragma omp parallel for reduction(+:anchors) reduction(+:found_fw) reduction(+:found_bw) schedule(dynamic,1)
+    for (uint64_t chunk=0;chunk<chunks.size();++chunk)
+    for (sgNodeID_t nid=chunks.begin(chunk);nid<chunks.end(chunk);++nid) {
         if (ws.sdg.get_node_size(nid)<min_size) continue;
         auto nv=ws.sdg.get_nodeview(nid);
         if ((min_kci>=0 and nv.kci()<min_kci) or (max_kci>=0 and nv.kci()>max_kci)) continue;
@@ -213,6 +231,8 @@ void Strider::stride_from_anchors(uint32_t min_size, float min_kci, float max_kc
         routes_bw[nid]=stride_out_in_order(-nid).nodes;
         if (routes_bw[nid].size()>1) ++found_bw;
     }
+    SDG_TIMER_ITEMS(timer, anchors);
+    SDG_COUNTER_ADD("Strider::stride_from_anchors/routes", found_fw+found_bw);
     sdglib::OutputLog()<<"Strider found "<<found_fw<<" forward and "<<found_bw<<" backward routes from "<< anchors << " anchors"<<std::endl;
 }
 
@@ -263,6 +283,7 @@ std::vector<Link> Strider::link_out_by_lr(sgNodeID_t n,int d, int min_reads, int
 }
 
 void Strider::link_from_anchors(uint32_t min_size, float min_kci, float max_kci, int d, int min_reads, int group_size, int small_node_size, float candidate_percentaje ,float first_percentaje) {
+    SDG_SCOPED_TIMER(timer, "Strider::link_from_anchors");
     std::cout<<std::endl<<logo<<std::endl;
     sdglib::OutputLog()<<"Gone linking..."<<std::endl;
     links_fw.clear();
@@ -273,8 +294,10 @@ void Strider::link_from_anchors(uint32_t min_size, float min_kci, float max_kci,
     is_anchor.resize(ws.sdg.nodes.size());
     if (min_size==0) min_size=1;//a min_size of 0 would get deleted nodes and such
     uint64_t anchors=0,found_fw=0,found_bw=0;
-#pragma omp parallel for reduction(+:anchors) reduction(+:found_fw) reduction(+:found_bw) schedule(static,1000)
-    for (auto nid=1;nid<ws.sdg.nodes.size();++nid) {
+    sdglib::CostBalancedChunks chunks(1, ws.sdg.nodes.size(), [&](uint64_t nid){ return ws.sdg.get_node_size(nid)<min_size ? 0:ws.sdg.get_node_size(nid); });
+#pragma omp parallel for reduction(+:anchors) reduction(+:found_fw) reduction(+:found_bw) schedule(dynamic,1)
+    for (uint64_t chunk=0;chunk<chunks.size();++chunk)
+    for (sgNodeID_t nid=chunks.begin(chunk);nid<chunks.end(chunk);++nid) {
         if (ws.sdg.get_node_size(nid)<min_size) continue;
         auto nv=ws.sdg.get_nodeview(nid);
         if ((min_kci>=0 and nv.kci()<min_kci) or (max_kci>=0 and nv.kci()>max_kci)) continue;
@@ -285,6 +308,8 @@ void Strider::link_from_anchors(uint32_t min_size, float min_kci, float max_kci,
         links_bw[nid]=link_out_by_lr(-nid, d, min_reads, group_size, small_node_size, candidate_percentaje, first_percentaje);
         if (!links_bw[nid].empty()) ++found_bw;
     }
+    SDG_TIMER_ITEMS(timer, anchors);
+    SDG_COUNTER_ADD("Strider::link_from_anchors/routes", found_fw+found_bw);
     sdglib::OutputLog()<<"Strider found "<<found_fw<<" forward and "<<found_bw<<" backward routes from "<< anchors << " anchors"<<std::endl;
 }
 
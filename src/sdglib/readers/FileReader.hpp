@@ -9,7 +9,11 @@
 #include <fstream>
 #include <iostream>
 #include <fcntl.h>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include <sdglib/readers/Common.hpp>
+#include <sdglib/utilities/omp_safe.hpp>
 #include <sdglib/utilities/OutputLog.hpp>
 #include "kseqcpp/kseq.hpp"
 
@@ -169,4 +173,326 @@ private:
     bool eof_flag;
 };
 
+/**
+ * @brief Reads a FASTQ or FASTA file in chunks of whole records, so the records can be parsed in parallel.
+ *
+ * Only next_chunk() has to be serialised, the sequences are then extracted from each chunk independently with
+ * next_sequence(). FASTQ records must have 4 lines (sequence and quality on a single line each), blank lines between
+ * records are skipped.
+ */
+class FastxChunkReader {
+public:
+    explicit FastxChunkReader(const std::string &filepath, bool _fastq=true, uint64_t _chunk_size=1<<22) : fastq(_fastq), chunk_size(_chunk_size) {
+        gz_file = gzopen(filepath.c_str(), "r");
+        if (gz_file == Z_NULL) {
+            sdglib::OutputLog(sdglib::LogLevels::WARN) << "Error opening " << filepath << ": " << std::strerror(errno) << std::endl;
+            throw std::runtime_error("Error opening " + filepath + ": " + std::strerror(errno));
+        }
+        gzbuffer(gz_file, 1 << 20);
+    }
+
+    ~FastxChunkReader() {
+        gzclose(gz_file);
+    }
+
+    /**
+     * @brief Whether a (possibly compressed) file starts with a FASTQ record rather than a FASTA one
+     */
+    static bool is_fastq(const std::string &filepath) {
+        auto f = gzopen(filepath.c_str(), "r");
+        if (f == Z_NULL) throw std::runtime_error("Error opening " + filepath + ": " + std::strerror(errno));
+        auto c = gzgetc(f);
+        gzclose(f);
+        return c != '>';
+    }
+
+    /**
+     * @brief Fills chunk with the next block of whole records
+     * @return false once the file is exhausted and chunk is empty
+     */
+    bool next_chunk(std::vector<char> &chunk) {
+        chunk.swap(carry);
+        carry.clear();
+        uint64_t cut = 0;
+        while (true) {
+            auto size = chunk.size();
+            chunk.resize(size + chunk_size);
+            auto r = gzread(gz_file, chunk.data() + size, chunk_size);
+            if (r < 0) throw std::runtime_error("Error decompressing input file");
+            chunk.resize(size + r);
+            if (r == 0) break;
+            cut = last_record_end(chunk);
+            if (cut > 0) break;
+        }
+        if (cut == 0) {
+            //end of file: the whole buffer is complete records, make sure the last line is terminated
+            if (not chunk.empty() and chunk.back() != '\n') chunk.push_back('\n');
+            return not chunk.empty();
+        }
+        carry.assign(chunk.begin() + cut, chunk.end());
+        chunk.resize(cut);
+        return true;
+    }
+
+    /**
+     * @brief Fills chunk with exactly the next records records, or with all the records left if there are fewer
+     * @return the number of records in chunk
+     */
+    uint64_t next_chunk(std::vector<char> &chunk, uint64_t records) {
+        chunk.swap(carry);
+        carry.clear();
+        uint64_t cut;
+        while ((cut = records_end(chunk, records)) == 0) {
+            auto size = chunk.size();
+            chunk.resize(size + chunk_size);
+            auto r = gzread(gz_file, chunk.data() + size, chunk_size);
+            if (r < 0) throw std::runtime_error("Error decompressing input file");
+            chunk.resize(size + r);
+            if (r == 0) break;
+        }
+        if (cut == 0) {
+            if (not chunk.empty() and chunk.back() != '\n') chunk.push_back('\n');
+            return count_records(chunk);
+        }
+        carry.assign(chunk.begin() + cut, chunk.end());
+        chunk.resize(cut);
+        return records;
+    }
+
+    /**
+     * @brief Number of records in a chunk of whole records
+     */
+    uint64_t count_records(const std::vector<char> &chunk) const {
+        uint64_t count = 0;
+        if (fastq) {
+            for (uint64_t p = fastq_record_end(chunk, 0); p > 0; p = fastq_record_end(chunk, p)) ++count;
+            return count;
+        }
+        for (uint64_t p = 0; p < chunk.size(); p = line_end(chunk, p) + 1) if (chunk[p] == '>') ++count;
+        return count;
+    }
+
+    /**
+     * @brief Extracts the sequence of the record starting at chunk[pos] and moves pos to the next record
+     * @return false if there are no more records in the chunk
+     */
+    bool next_sequence(const std::vector<char> &chunk, uint64_t &pos, std::string &seq) const {
+        return next_record(chunk, pos, nullptr, seq, fastq);
+    }
+
+    /**
+     * @brief As next_sequence(), also extracting the record's header line (without the '@' or '>') into name if
+     * given. FASTQ records are validated to have a quality line as long as their sequence.
+     */
+    static bool next_record(const std::vector<char> &chunk, uint64_t &pos, std::string *name, std::string &seq, bool fastq) {
+        seq.clear();
+        if (fastq) pos = skip_blank_lines(chunk, pos);
+        if (pos >= chunk.size()) return false;
+        if (chunk[pos] != (fastq ? '@' : '>')) throw std::runtime_error(std::string("Malformed record, not starting with ") + (fastq ? "'@'" : "'>'"));
+        auto e = line_end(chunk, pos);
+        if (name != nullptr) {
+            name->clear();
+            append_line(chunk, pos + 1, e, *name);
+        }
+        pos = e + 1;
+        if (fastq) {
+            e = line_end(chunk, pos);
+            append_line(chunk, pos, e, seq);
+            pos = e + 1;
+            if (pos >= chunk.size() or chunk[pos] != '+') throw std::runtime_error("Malformed FASTQ record, separator line not starting with '+'");
+            pos = line_end(chunk, pos) + 1;
+            e = line_end(chunk, pos);
+            if (e > pos and chunk[e - 1] == '\r') --e;
+            if (e - pos != seq.size()) throw std::runtime_error("Malformed FASTQ record, quality and sequence lengths differ");
+            pos = line_end(chunk, pos) + 1;
+        } else {
+            while (pos < chunk.size() and chunk[pos] != '>') {
+                auto e = line_end(chunk, pos);
+                append_line(chunk, pos, e, seq);
+                pos = e + 1;
+            }
+        }
+        return true;
+    }
+
+private:
+    static uint64_t line_end(const std::vector<char> &chunk, uint64_t pos) {
+        auto e = (const char *) memchr(chunk.data() + pos, '\n', chunk.size() - pos);
+        return e == nullptr ? chunk.size() : e - chunk.data();
+    }
+
+    static uint64_t skip_blank_lines(const std::vector<char> &chunk, uint64_t pos) {
+        while (pos < chunk.size() and (chunk[pos] == '\n' or chunk[pos] == '\r')) ++pos;
+        return pos;
+    }
+
+    //Offset just after the FASTQ record starting at pos (after any blank lines), 0 if it is not complete
+    static uint64_t fastq_record_end(const std::vector<char> &chunk, uint64_t pos) {
+        pos = skip_blank_lines(chunk, pos);
+        if (pos >= chunk.size()) return 0;
+        for (auto l = 0; l < 4; ++l) {
+            auto e = line_end(chunk, pos);
+            if (e == chunk.size()) return 0;
+            pos = e + 1;
+        }
+        return pos;
+    }
+
+    static void append_line(const std::vector<char> &chunk, uint64_t b, uint64_t e, std::string &seq) {
+        if (e > b and chunk[e - 1] == '\r') --e;
+        seq.append(chunk.data() + b, e - b);
+    }
+
+    //Offset just after the first records complete records in chunk, 0 if there are fewer
+    uint64_t records_end(const std::vector<char> &chunk, uint64_t records) const {
+        if (chunk.empty()) return 0;
+        uint64_t found = 0;
+        if (fastq) {
+            uint64_t end = 0;
+            while (found < records and (end = fastq_record_end(chunk, end)) > 0) ++found;
+            return found == records ? end : 0;
+        }
+        //a FASTA record is complete once the next one starts
+        for (uint64_t p = 0; p < chunk.size(); p = line_end(chunk, p) + 1) {
+            if (chunk[p] == '>' and found++ == records) return p;
+        }
+        return 0;
+    }
+
+    //Offset just after the last complete record in chunk, 0 if there is none
+    uint64_t last_record_end(const std::vector<char> &chunk) const {
+        if (fastq) {
+            //chunks always start on a record, so records are found by walking them from the start
+            uint64_t end = 0;
+            for (uint64_t p = fastq_record_end(chunk, 0); p > 0; p = fastq_record_end(chunk, p)) end = p;
+            return end;
+        }
+        //a FASTA record is complete once the next one starts
+        for (uint64_t p = chunk.size() - 1; p > 0; --p) {
+            if (chunk[p] == '>' and chunk[p - 1] == '\n') return p;
+        }
+        return 0;
+    }
+
+    gzFile gz_file;
+    bool fastq;
+    uint64_t chunk_size;
+    std::vector<char> carry;
+};
+
+/**
+ * @brief A block of whole records, with the same number of records from each of the files read together
+ */
+struct FastxBlock {
+    uint64_t index;                         /// position of the block in the input, from 0
+    uint64_t records;                       /// records per file
+    bool fastq;
+    std::vector<std::vector<char>> chunks;  /// raw records, one chunk per file
+
+    /**
+     * @brief Parses the record starting at chunks[file][pos] and moves pos to the next one, see FastxChunkReader::next_record()
+     */
+    bool next_record(uint64_t file, uint64_t &pos, std::string *name, std::string &seq) const {
+        return FastxChunkReader::next_record(chunks[file], pos, name, seq, fastq);
+    }
+};
+
+/**
+ * @brief Reads FASTQ or FASTA files through a bounded pipeline, so decompression, parsing and output overlap.
+ *
+ * One thread decompresses the files into blocks of whole records, taking the same number of records from every
+ * file given (i.e. the R1 and R2 of a paired library stay in sync). The blocks are parsed by process() on the other
+ * threads as they arrive, and passed to consume() one at a time, in input order. At most queue_size blocks are in
+ * flight, so memory use stays around queue_size * chunk_size bytes per file.
+ *
+ * process() and consume() run as OpenMP tasks. An exception in any of them stops the pipeline, and is rethrown as a
+ * std::runtime_error by run() once the blocks in flight are done.
+ */
+class FastxPipeline {
+public:
+    explicit FastxPipeline(const std::vector<std::string> &_filepaths, bool _fastq=true, uint64_t _chunk_size=1<<22,
+                           uint64_t _queue_size=0) : filepaths(_filepaths), fastq(_fastq), queue_size(_queue_size) {
+        for (const auto &f: filepaths) readers.emplace_back(new FastxChunkReader(f, fastq, _chunk_size));
+        if (queue_size == 0) queue_size = 2 * omp_get_max_threads() + 2;
+    }
+
+    /**
+     * @brief Runs the pipeline over the whole input.
+     * @param process void(const FastxBlock &, RESULT &), called in parallel, results are per-block scratch space
+     * @param consume void(const FastxBlock &, RESULT &), called in input order after the block's process()
+     */
+    template<class RESULT, class PROCESS, class CONSUME>
+    void run(PROCESS process, CONSUME consume) {
+        std::vector<FastxBlock> blocks(queue_size);
+        std::vector<RESULT> results(queue_size);
+        std::vector<char> slot_token(queue_size);
+        char consume_token;
+        std::atomic<bool> failed(false);
+        std::string error;
+        auto fail = [&](const std::exception &e) {
+#pragma omp critical(fastx_pipeline_error)
+            if (not failed) {
+                error = e.what();
+                failed = true;
+            }
+        };
+#pragma omp parallel
+#pragma omp single
+        {
+            for (uint64_t b = 0; not failed; ++b) {
+                auto s = b % queue_size;
+                auto block = &blocks[s];
+                auto result = &results[s];
+                auto slot = &slot_token[s];
+                //the slot is free once the block that was in it has been consumed. An undeferred task waits for its
+                //dependences (running other tasks meanwhile), so this waits on this slot only, as taskwait depend
+                //would, without needing OpenMP 5.0
+#pragma omp task if(0) depend(inout: slot[0])
+                {}
+                try {
+                    if (not read_block(*block)) break;
+                }
+                catch (const std::exception &e) {
+                    fail(e);
+                    break;
+                }
+                block->index = b;
+#pragma omp task firstprivate(block, result) depend(out: slot[0])
+                {
+                    if (not failed) try { process((const FastxBlock &) *block, *result); } catch (const std::exception &e) { fail(e); }
+                }
+#pragma omp task firstprivate(block, result) depend(inout: slot[0]) depend(inout: consume_token)
+                {
+                    if (not failed) try { consume((const FastxBlock &) *block, *result); } catch (const std::exception &e) { fail(e); }
+                }
+            }
+#pragma omp taskwait
+        }
+        if (failed) throw std::runtime_error(error);
+    }
+
+private:
+    bool read_block(FastxBlock &block) {
+        block.chunks.resize(readers.size());
+        block.fastq = fastq;
+        block.records = 0;
+        if (readers[0]->next_chunk(block.chunks[0])) block.records = readers[0]->count_records(block.chunks[0]);
+        for (uint64_t i = 1; i < readers.size(); ++i) {
+            //at the end of the first file, a single record left on any other is an error
+            auto expected = (block.records > 0 ? block.records : 1);
+            auto found = readers[i]->next_chunk(block.chunks[i], expected);
+            if (block.records > 0 and found < block.records)
+                throw std::runtime_error(filepaths[i] + " has fewer records than " + filepaths[0]);
+            if (block.records == 0 and found > 0)
+                throw std::runtime_error(filepaths[i] + " has more records than " + filepaths[0]);
+        }
+        return block.records > 0;
+    }
+
+    std::vector<std::string> filepaths;
+    std::vector<std::unique_ptr<FastxChunkReader>> readers;
+    bool fastq;
+    uint64_t queue_size;
+};
+
 #endif //SEQSORTER_FILEREADER_H
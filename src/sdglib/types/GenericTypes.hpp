@@ -30,28 +30,22 @@ public:
 };
 
 /**
- * The Node contains the sequence of a node and its status {Active, Deleted}
+ * The Node contains the status of a node {Active, Deleted}, its sequence is kept by the graph (see PackedNodeSequences)
  */
 class Node{
 public:
-    Node(const std::string &_seq, NodeStatus _status) : sequence(_seq), status(_status){};
-    Node(const std::string &_seq) : sequence(_seq),status(NodeStatus::Active){};
+    explicit Node(NodeStatus _status) : status(_status){};
     Node() = default;
     bool operator==(const Node &o) const {
-        return std::tie(status,sequence) == std::tie(o.status,o.sequence);
+        return status == o.status;
     }
 
-    bool is_canonical();
-    void make_rc();
-
     friend std::ostream &operator<<(std::ostream &os, const Node &node) {
-        os << "Node ";
-        if (node.status == NodeStatus::Deleted) os << "(deleted) ";
-        os << node.sequence.size() <<" bp";
+        os << "Node";
+        if (node.status == NodeStatus::Deleted) os << " (deleted)";
         return os;
     }
 
-    std::string sequence = "";
     NodeStatus status = NodeStatus::Active;
     Support support;
 };
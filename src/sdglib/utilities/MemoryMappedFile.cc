@@ -0,0 +1,68 @@
+#include "MemoryMappedFile.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+sdglib::MemoryMappedFile::MemoryMappedFile(const sdglib::MemoryMappedFile &other) {
+    if (other.is_open()) open(other.filename);
+}
+
+sdglib::MemoryMappedFile &sdglib::MemoryMappedFile::operator=(const sdglib::MemoryMappedFile &other) {
+    if (&other == this) return *this;
+    close();
+    if (other.is_open()) open(other.filename);
+    return *this;
+}
+
+void sdglib::MemoryMappedFile::open(const std::string &_filename) {
+    close();
+    filename = _filename;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Could not open " + filename + ": " + std::strerror(errno));
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + filename + ": " + std::strerror(errno));
+    }
+    mapped_size = sb.st_size;
+    if (mapped_size == 0) {
+        ::close(fd);
+        throw std::runtime_error(filename + " is empty");
+    }
+    auto m = mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); //the mapping keeps its own reference to the file
+    if (m == MAP_FAILED) {
+        mapped_size = 0;
+        throw std::runtime_error("Could not mmap " + filename + ": " + std::strerror(errno));
+    }
+    mapped = (char *) m;
+}
+
+void sdglib::MemoryMappedFile::close() {
+    if (mapped != nullptr) munmap(mapped, mapped_size);
+    mapped = nullptr;
+    mapped_size = 0;
+}
+
+void sdglib::MemoryMappedFile::advise(sdglib::MemoryMappedFile::AccessPattern pattern, size_t offset, size_t length) const {
+    if (mapped == nullptr or offset >= mapped_size) return;
+    //madvise needs a page-aligned start
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    auto start = offset - offset % page_size;
+    if (length == 0 or offset + length > mapped_size) length = mapped_size - offset;
+    length += offset - start;
+    int advice;
+    switch (pattern) {
+        case Sequential: advice = MADV_SEQUENTIAL; break;
+        case Random: advice = MADV_RANDOM; break;
+        case WillNeed: advice = MADV_WILLNEED; break;
+        default: advice = MADV_NORMAL;
+    }
+    madvise(mapped + start, length, advice);
+}
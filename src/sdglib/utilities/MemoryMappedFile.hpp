@@ -0,0 +1,86 @@
+#ifndef BSG_MEMORYMAPPEDFILE_HPP
+#define BSG_MEMORYMAPPEDFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+namespace sdglib {
+
+    /**
+     * @brief Read-only memory mapping of a whole file.
+     *
+     * Reading through data() is safe from any number of threads, as there is no shared file position.
+     * Copying a MemoryMappedFile maps the same file again, so datastores holding one can still be copied.
+     */
+    class MemoryMappedFile {
+    public:
+        enum AccessPattern {Normal, Sequential, Random, WillNeed};
+
+        MemoryMappedFile() = default;
+        explicit MemoryMappedFile(const std::string &_filename) { open(_filename); }
+        MemoryMappedFile(const MemoryMappedFile &other);
+        MemoryMappedFile &operator=(const MemoryMappedFile &other);
+        ~MemoryMappedFile() { close(); }
+
+        void open(const std::string &_filename);
+        void close();
+
+        /**
+         * @brief Passes an access pattern hint to the kernel (madvise) for a region, or the whole file if length is 0
+         */
+        void advise(AccessPattern pattern, size_t offset = 0, size_t length = 0) const;
+
+        bool is_open() const { return mapped != nullptr; }
+        const char *data() const { return mapped; }
+        size_t size() const { return mapped_size; }
+        const std::string &get_filename() const { return filename; }
+
+    private:
+        std::string filename;
+        char *mapped = nullptr;
+        size_t mapped_size = 0;
+    };
+
+    /**
+     * @brief Writes a count and then the elements, padded so the elements start at a 64-byte aligned file offset.
+     * The array can then be read with read_aligned_flat_vector() or used in place with map_aligned_flat_vector().
+     */
+    template<typename T>
+    inline void write_aligned_flat_vector(std::ofstream &ofs, const T *data, uint64_t count) {
+        static const char padding[64] = {0};
+        ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        ofs.write(padding, (64 - ((uint64_t) ofs.tellp()) % 64) % 64);
+        if (count > 0) ofs.write(reinterpret_cast<const char *>(data), sizeof(T) * count);
+    }
+
+    template<typename T, typename A>
+    inline void read_aligned_flat_vector(std::ifstream &ifs, std::vector<T, A> &v) {
+        uint64_t count;
+        ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+        ifs.seekg((64 - ((uint64_t) ifs.tellg()) % 64) % 64, std::ios_base::cur);
+        v.resize(count);
+        if (count > 0) ifs.read(reinterpret_cast<char *>(v.data()), sizeof(T) * count);
+    }
+
+    /**
+     * @brief Returns a pointer to an array written by write_aligned_flat_vector() inside a mapping of the same file.
+     * ifs must be positioned at the array and is moved past it, as if it had been read.
+     */
+    template<typename T>
+    inline const T *map_aligned_flat_vector(std::ifstream &ifs, const MemoryMappedFile &mapping, uint64_t &count) {
+        ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+        uint64_t offset = ifs.tellg();
+        offset += (64 - offset % 64) % 64;
+        if (!ifs or offset + sizeof(T) * count > mapping.size())
+            throw std::runtime_error(mapping.get_filename() + " is too short for its contents");
+        ifs.seekg(offset + sizeof(T) * count);
+        return reinterpret_cast<const T *>(mapping.data() + offset);
+    }
+
+}
+
+#endif //BSG_MEMORYMAPPEDFILE_HPP
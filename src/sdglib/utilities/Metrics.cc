@@ -0,0 +1,117 @@
+#include "Metrics.hpp"
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <sys/resource.h>
+
+namespace sdglib {
+
+    Metrics & metrics() {
+        static Metrics registry;
+        return registry;
+    }
+
+    uint64_t peak_rss_kb() {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; //bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+
+    double process_cpu_seconds() {
+        timespec ts;
+        if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    void Metrics::record_stage(const std::string &name, double wall_seconds, double cpu_seconds, uint64_t items) {
+        auto rss = peak_rss_kb();
+#pragma omp critical(sdg_metrics)
+        {
+            auto &s = stage_metrics[name];
+            ++s.calls;
+            s.wall_seconds += wall_seconds;
+            s.cpu_seconds += cpu_seconds;
+            s.items += items;
+            s.peak_rss_kb = rss;
+        }
+    }
+
+    void Metrics::record_thread_time(const std::string &name, double thread_seconds, uint64_t items) {
+#pragma omp critical(sdg_metrics)
+        {
+            auto &s = stage_metrics[name];
+            s.thread_seconds += thread_seconds;
+            s.items += items;
+        }
+    }
+
+    void Metrics::add_counter(const std::string &name, uint64_t value) {
+#pragma omp critical(sdg_metrics)
+        counter_values[name] += value;
+    }
+
+    void Metrics::set_gauge(const std::string &name, double value) {
+#pragma omp critical(sdg_metrics)
+        gauge_values[name] = value;
+    }
+
+    std::map<std::string, StageMetrics> Metrics::stages() const {
+        std::map<std::string, StageMetrics> r;
+#pragma omp critical(sdg_metrics)
+        r = stage_metrics;
+        return r;
+    }
+
+    std::map<std::string, uint64_t> Metrics::counters() const {
+        std::map<std::string, uint64_t> r;
+#pragma omp critical(sdg_metrics)
+        r = counter_values;
+        return r;
+    }
+
+    std::map<std::string, double> Metrics::gauges() const {
+        std::map<std::string, double> r;
+#pragma omp critical(sdg_metrics)
+        r = gauge_values;
+        return r;
+    }
+
+    void Metrics::clear() {
+#pragma omp critical(sdg_metrics)
+        {
+            stage_metrics.clear();
+            counter_values.clear();
+            gauge_values.clear();
+        }
+    }
+
+    std::vector<std::string> Metrics::report_lines() const {
+        std::vector<std::string> lines;
+        for (auto &s: stages()) {
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(3) << "stage " << s.first << ":";
+            if (s.second.calls) ss << " " << s.second.calls << " calls, wall " << s.second.wall_seconds << "s, cpu " << s.second.cpu_seconds << "s";
+            if (s.second.thread_seconds > 0) ss << (s.second.calls ? "," : "") << " thread " << s.second.thread_seconds << "s";
+            if (s.second.items) ss << ", " << s.second.items << " items";
+            if (s.second.peak_rss_kb) ss << ", peak RSS " << s.second.peak_rss_kb << " KB";
+            lines.emplace_back(ss.str());
+        }
+        for (auto &c: counters()) lines.emplace_back("counter " + c.first + ": " + std::to_string(c.second));
+        for (auto &g: gauges()) {
+            std::ostringstream ss;
+            ss << "gauge " << g.first << ": " << std::setprecision(12) << g.second;
+            lines.emplace_back(ss.str());
+        }
+        return lines;
+    }
+
+    std::string Metrics::report() const {
+        std::string r;
+        for (auto &l: report_lines()) r += l + "\n";
+        return r;
+    }
+}
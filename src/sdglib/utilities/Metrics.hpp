@@ -0,0 +1,152 @@
+#ifndef BSG_METRICS_HPP
+#define BSG_METRICS_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+namespace sdglib {
+
+    /**
+     * @brief Accumulated cost of a named stage.
+     * wall and cpu times come from timers around the whole stage (cpu is the process' time on all threads), thread
+     * time is the time each thread spent in a sub-stage inside a parallel region, added over all threads.
+     */
+    struct StageMetrics {
+        uint64_t calls=0;
+        double wall_seconds=0;
+        double cpu_seconds=0;
+        double thread_seconds=0;
+        uint64_t items=0;
+        uint64_t peak_rss_kb=0;     /// peak resident set size of the process at the end of the stage's last call
+    };
+
+    /**
+     * @brief Registry of stage timings, counters and gauges for the whole process, see metrics().
+     *
+     * Stages are recorded by ScopedTimer and StageClock through the SDG_* macros below, which are compiled out unless
+     * SDG_METRICS is defined (cmake -DBUILD_METRICS=ON, the default). The registry itself is always available, so
+     * reports and the Python interface work either way, they are just empty without SDG_METRICS.
+     */
+    class Metrics {
+    public:
+        void record_stage(const std::string &name, double wall_seconds, double cpu_seconds, uint64_t items);
+
+        void record_thread_time(const std::string &name, double thread_seconds, uint64_t items);
+
+        void add_counter(const std::string &name, uint64_t value);
+
+        void set_gauge(const std::string &name, double value);
+
+        std::map<std::string, StageMetrics> stages() const;
+        std::map<std::string, uint64_t> counters() const;
+        std::map<std::string, double> gauges() const;
+
+        void clear();
+
+        /**
+         * @brief One line per stage, counter and gauge, as written to the journal
+         */
+        std::vector<std::string> report_lines() const;
+
+        std::string report() const;
+
+    private:
+        std::map<std::string, StageMetrics> stage_metrics;
+        std::map<std::string, uint64_t> counter_values;
+        std::map<std::string, double> gauge_values;
+    };
+
+    Metrics & metrics();
+
+    /** @brief Peak resident set size of the process, in KB **/
+    uint64_t peak_rss_kb();
+
+    /** @brief CPU time used by the process so far, on all threads **/
+    double process_cpu_seconds();
+
+    /** @brief Heap bytes held by a vector (its capacity), including the vectors nested in it **/
+    template<class T>
+    uint64_t vector_bytes(const std::vector<T> &v) { return v.capacity() * sizeof(T); }
+
+    inline uint64_t vector_bytes(const std::vector<bool> &v) { return v.capacity() / 8; }
+
+    template<class T>
+    uint64_t vector_bytes(const std::vector<std::vector<T>> &v) {
+        uint64_t total = v.capacity() * sizeof(std::vector<T>);
+        for (const auto &i: v) total += vector_bytes(i);
+        return total;
+    }
+
+    /**
+     * @brief Records wall time, process CPU time, items and peak RSS for a stage from construction to destruction
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(std::string _name) : name(std::move(_name)), wall_start(std::chrono::steady_clock::now()),
+                                                   cpu_start(process_cpu_seconds()) {}
+
+        ~ScopedTimer() {
+            std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start;
+            metrics().record_stage(name, wall.count(), process_cpu_seconds() - cpu_start, items);
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        void add_items(uint64_t n) { items += n; }
+
+    private:
+        std::string name;
+        std::chrono::steady_clock::time_point wall_start;
+        double cpu_start;
+        uint64_t items=0;
+    };
+
+    /**
+     * @brief Per-thread accumulator for sub-stages inside parallel loops, started and stopped around each piece of
+     * work, and recorded once per thread when the loop is done
+     */
+    class StageClock {
+    public:
+        void start() { started = std::chrono::steady_clock::now(); }
+
+        void stop(uint64_t _items=0) {
+            total += std::chrono::steady_clock::now() - started;
+            items += _items;
+        }
+
+        void record(const std::string &name) const {
+            metrics().record_thread_time(name, std::chrono::duration<double>(total).count(), items);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::duration total{0};
+        uint64_t items=0;
+    };
+}
+
+#ifdef SDG_METRICS
+#define SDG_SCOPED_TIMER(var, name) sdglib::ScopedTimer var(name)
+#define SDG_TIMER_ITEMS(var, n) var.add_items(n)
+#define SDG_STAGE_CLOCK(var) sdglib::StageClock var
+#define SDG_STAGE_START(var) var.start()
+#define SDG_STAGE_STOP(var, n) var.stop(n)
+#define SDG_STAGE_RECORD(var, name) var.record(name)
+#define SDG_COUNTER_ADD(name, n) sdglib::metrics().add_counter(name, n)
+#define SDG_GAUGE_SET(name, v) sdglib::metrics().set_gauge(name, v)
+#else
+#define SDG_SCOPED_TIMER(var, name)
+#define SDG_TIMER_ITEMS(var, n)
+#define SDG_STAGE_CLOCK(var)
+#define SDG_STAGE_START(var)
+#define SDG_STAGE_STOP(var, n)
+#define SDG_STAGE_RECORD(var, name)
+#define SDG_COUNTER_ADD(name, n)
+#define SDG_GAUGE_SET(name, v)
+#endif
+
+#endif //BSG_METRICS_HPP
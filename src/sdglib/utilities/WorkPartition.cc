@@ -0,0 +1,30 @@
+#include "WorkPartition.hpp"
+#include <algorithm>
+#include <sdglib/utilities/omp_safe.hpp>
+
+namespace sdglib {
+
+    CostBalancedChunks::CostBalancedChunks(uint64_t first, uint64_t last, const std::function<uint64_t(uint64_t)> &cost,
+                                           uint64_t chunks_per_thread, int threads) {
+        if (first >= last) return;
+        if (threads <= 0) threads = omp_get_max_threads();
+        std::vector<uint64_t> costs(last - first);
+        uint64_t total = 0;
+        for (auto i = first; i < last; ++i) total += costs[i - first] = cost(i) + 1;
+        auto target = std::max((uint64_t) 1, total / (std::max((uint64_t) 1, chunks_per_thread) * threads));
+
+        Chunk c{first, first, 0};
+        for (auto i = first; i < last; ++i) {
+            //an item that would take the chunk past the target starts a new one
+            if (c.cost > 0 and c.cost + costs[i - first] > target) {
+                chunks.emplace_back(c);
+                c = {i, i, 0};
+            }
+            c.cost += costs[i - first];
+            c.last = i + 1;
+        }
+        chunks.emplace_back(c);
+        //stable, so chunks of the same cost keep their order and the partition is the same on every run
+        std::stable_sort(chunks.begin(), chunks.end(), [](const Chunk &a, const Chunk &b) { return a.cost > b.cost; });
+    }
+}
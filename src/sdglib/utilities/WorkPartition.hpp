@@ -0,0 +1,50 @@
+#ifndef BSG_WORKPARTITION_HPP
+#define BSG_WORKPARTITION_HPP
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace sdglib {
+
+    /**
+     * @brief Splits the items [first,last) into contiguous chunks of about the same total cost.
+     *
+     * Read and node costs vary by orders of magnitude, so equal item counts per thread leave a few threads working
+     * long after the rest. The chunks are sized to about 1/(chunks_per_thread*threads) of the total cost (an item
+     * costlier than that gets a chunk of its own) and ordered from most to least costly, so the long ones start
+     * first. Process them with schedule(dynamic,1):
+     *
+     *     sdglib::CostBalancedChunks chunks(1, ds.size()+1, [&](uint64_t rid){ return ds.read_to_fileRecord[rid].record_size; });
+     *     #pragma omp parallel for schedule(dynamic,1)
+     *     for (uint64_t ci = 0; ci < chunks.size(); ++ci)
+     *         for (auto rid = chunks.begin(ci); rid < chunks.end(ci); ++rid) ...
+     */
+    class CostBalancedChunks {
+    public:
+        /**
+         * @param cost cost of item i, in any unit (i.e. read or node size). Every item also counts 1, for its overhead
+         * @param chunks_per_thread chunks per thread when costs are even, more balance better, fewer less scheduling
+         */
+        CostBalancedChunks(uint64_t first, uint64_t last, const std::function<uint64_t(uint64_t)> &cost,
+                           uint64_t chunks_per_thread = 16, int threads = 0);
+
+        uint64_t size() const { return chunks.size(); }
+
+        uint64_t begin(uint64_t chunk) const { return chunks[chunk].first; }
+
+        uint64_t end(uint64_t chunk) const { return chunks[chunk].last; }
+
+        uint64_t cost(uint64_t chunk) const { return chunks[chunk].cost; }
+
+    private:
+        struct Chunk {
+            uint64_t first;
+            uint64_t last;
+            uint64_t cost;
+        };
+        std::vector<Chunk> chunks;
+    };
+}
+
+#endif //BSG_WORKPARTITION_HPP
@@ -0,0 +1,72 @@
+#include "packing_helpers.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SDG_X86_ENCODE
+#endif
+
+namespace sdglib {
+
+    static void encode_2bit_scalar(const char * seq, size_t len, uint8_t * codes) {
+        for (size_t i = 0; i < len; ++i) codes[i] = base_to_2bit(seq[i]);
+    }
+
+#ifdef SDG_X86_ENCODE
+    //A, C, G and T have distinct low nibbles (1, 3, 7 and 4), so a 16-entry shuffle on the low nibble gives both the
+    //lowercase letter the byte must be to be valid and its code. Anything that is not a/c/g/t once lowercased is 4.
+    __attribute__((target("ssse3")))
+    static void encode_2bit_ssse3(const char * seq, size_t len, uint8_t * codes) {
+        const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+        const __m128i lowercase = _mm_set1_epi8(0x20);
+        const __m128i invalid = _mm_set1_epi8(4);
+        const __m128i letters = _mm_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i values = _mm_setr_epi8(4, 0, 4, 1, 3, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i b = _mm_loadu_si128((const __m128i *) (seq + i));
+            __m128i nibble = _mm_and_si128(b, nibble_mask);
+            __m128i valid = _mm_cmpeq_epi8(_mm_or_si128(b, lowercase), _mm_shuffle_epi8(letters, nibble));
+            __m128i code = _mm_or_si128(_mm_and_si128(valid, _mm_shuffle_epi8(values, nibble)),
+                                        _mm_andnot_si128(valid, invalid));
+            _mm_storeu_si128((__m128i *) (codes + i), code);
+        }
+        encode_2bit_scalar(seq + i, len - i, codes + i);
+    }
+
+    __attribute__((target("avx2")))
+    static void encode_2bit_avx2(const char * seq, size_t len, uint8_t * codes) {
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+        const __m256i lowercase = _mm256_set1_epi8(0x20);
+        const __m256i invalid = _mm256_set1_epi8(4);
+        const __m256i letters = _mm256_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i values = _mm256_setr_epi8(4, 0, 4, 1, 3, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+                                                4, 0, 4, 1, 3, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4);
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            __m256i b = _mm256_loadu_si256((const __m256i *) (seq + i));
+            __m256i nibble = _mm256_and_si256(b, nibble_mask);
+            __m256i valid = _mm256_cmpeq_epi8(_mm256_or_si256(b, lowercase), _mm256_shuffle_epi8(letters, nibble));
+            __m256i code = _mm256_blendv_epi8(invalid, _mm256_shuffle_epi8(values, nibble), valid);
+            _mm256_storeu_si256((__m256i *) (codes + i), code);
+        }
+        encode_2bit_scalar(seq + i, len - i, codes + i);
+    }
+#endif
+
+    typedef void (*encode_2bit_function)(const char *, size_t, uint8_t *);
+
+    static encode_2bit_function select_encode_2bit() {
+#ifdef SDG_X86_ENCODE
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return encode_2bit_avx2;
+        if (__builtin_cpu_supports("ssse3")) return encode_2bit_ssse3;
+#endif
+        return encode_2bit_scalar;
+    }
+
+    void encode_2bit(const char * seq, size_t len, uint8_t * codes) {
+        static const encode_2bit_function encode = select_encode_2bit();
+        encode(seq, len, codes);
+    }
+
+}
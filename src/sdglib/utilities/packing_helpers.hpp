@@ -0,0 +1,69 @@
+#ifndef BSG_PACKING_HELPERS_HPP
+#define BSG_PACKING_HELPERS_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace sdglib {
+
+    /**
+     * @brief 2-bit code for a base: A=0, C=1, G=2, T=3 (case insensitive), anything else returns 4.
+     */
+    inline uint8_t base_to_2bit(char c) {
+        switch (c) {
+            case 'A': case 'a': return 0;
+            case 'C': case 'c': return 1;
+            case 'G': case 'g': return 2;
+            case 'T': case 't': return 3;
+            default: return 4;
+        }
+    }
+
+    /**
+     * @brief Writes the base_to_2bit() code of each of the len bases in seq to codes.
+     * Uses SSSE3/AVX2 shuffles when the CPU supports them (checked at runtime), with a scalar fallback otherwise.
+     */
+    void encode_2bit(const char * seq, size_t len, uint8_t * codes);
+
+    /**
+     * @brief Number of bytes needed to store len bases 2-bit packed.
+     */
+    inline size_t packed_2bit_size(size_t len) { return (len + 3) / 4; }
+
+    /**
+     * @brief Packs len bases from seq into out, 4 bases per byte, first base in the lowest bits.
+     * Non-ACGT bases are stored as A, callers need to record them separately (i.e. as N runs).
+     * out must have space for packed_2bit_size(len) bytes.
+     */
+    inline void pack_2bit(const char * seq, size_t len, uint8_t * out) {
+        size_t full = len / 4;
+        for (size_t b = 0; b < full; ++b, seq += 4) {
+            out[b] = (base_to_2bit(seq[0]) & 3) | ((base_to_2bit(seq[1]) & 3) << 2) |
+                     ((base_to_2bit(seq[2]) & 3) << 4) | ((base_to_2bit(seq[3]) & 3) << 6);
+        }
+        if (len % 4) {
+            uint8_t last = 0;
+            for (size_t i = 0; i < len % 4; ++i) last |= (base_to_2bit(seq[i]) & 3) << (2 * i);
+            out[full] = last;
+        }
+    }
+
+    /**
+     * @brief Unpacks len bases from a pack_2bit() buffer into out as uppercase ACGT, does not add a terminator.
+     */
+    inline void unpack_2bit(const uint8_t * in, size_t len, char * out) {
+        static const char bases[4] = {'A', 'C', 'G', 'T'};
+        size_t full = len / 4;
+        for (size_t b = 0; b < full; ++b, out += 4) {
+            auto v = in[b];
+            out[0] = bases[v & 3];
+            out[1] = bases[(v >> 2) & 3];
+            out[2] = bases[(v >> 4) & 3];
+            out[3] = bases[(v >> 6) & 3];
+        }
+        for (size_t i = 0; i < len % 4; ++i) out[i] = bases[(in[full] >> (2 * i)) & 3];
+    }
+
+}
+
+#endif //BSG_PACKING_HELPERS_HPP
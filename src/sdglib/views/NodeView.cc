@@ -63,17 +63,19 @@ std::vector<NodeView> NodeView::parallels() const {
     return pars;
 }
 
-std::vector<uint16_t> NodeView::kmer_coverage(std::string kcovds_name, std::string kcovds_count_name) const {
-    return dg->sdg.ws.get_kmer_counter(kcovds_name).project_count(kcovds_count_name,sequence());
+std::vector<uint32_t> NodeView::kmer_coverage(std::string kcovds_name, std::string kcovds_count_name) const {
+    return dg->sdg.ws.get_kmer_counter(kcovds_name).project_node_count(kcovds_count_name,id);
 }
 
-std::vector<uint16_t> NodeView::kmer_coverage(int kcovds_idx, int kcovds_count_idx) const {
-    return dg->sdg.ws.kmer_counters[kcovds_count_idx].project_count(kcovds_count_idx,sequence());
+std::vector<uint32_t> NodeView::kmer_coverage(int kcovds_idx, int kcovds_count_idx) const {
+    return dg->sdg.ws.loaded(dg->sdg.ws.kmer_counters[kcovds_idx]).project_node_count(kcovds_count_idx,id);
 }
 
 float NodeView::kci() {
-    if (dg->sdg.ws.kmer_counters.empty() or dg->sdg.ws.kmer_counters[0].counts.size()<2) return -1;
-    return dg->sdg.ws.kmer_counters[0].kci(llabs(id));
+    if (dg->sdg.ws.kmer_counters.empty()) return -1;
+    auto &kc=dg->sdg.ws.loaded(dg->sdg.ws.kmer_counters[0]);
+    if (kc.counts.size()<2) return -1;
+    return kc.kci(llabs(id));
 }
 
 std::vector<seqID_t> NodeView::get_paired_reads(std::string datastore_name) const {
@@ -175,7 +177,9 @@ std::vector<std::pair<int,sgNodeID_t>> NodeView::fw_neighbours_by_distance(int m
 std::vector<uint64_t> NodeView::get_kmers(int K){
     std::vector<uint64_t> node_kmers;
     auto kf = StringKMerFactory(K);
-    kf.create_kmers(sequence(), node_kmers);
+    //canonical k-mers of the reverse complement are the forward ones reversed
+    kf.create_kmers(dg->sdg.node_sequences, llabs(id), node_kmers);
+    if (id<0) std::reverse(node_kmers.begin(),node_kmers.end());
     return node_kmers;
 };
 
@@ -67,7 +67,7 @@ public:
      * @param kcovds_count_name Name of the count object in the KmersCounter
      * @return A vector with the kmer coverage count for each kmer in the node
      */
-    std::vector<uint16_t> kmer_coverage(std::string kcovds_name,std::string kcovds_count_name) const;
+    std::vector<uint32_t> kmer_coverage(std::string kcovds_name,std::string kcovds_count_name) const;
 
     /**
      * @brief Coverage of each kmer in the node
@@ -75,7 +75,7 @@ public:
      * @param kcovds_count_idx Index of the count object in the KmersCounter
      * @return A vector with the kmer coverage count for each kmer in this node
      */
-    std::vector<uint16_t> kmer_coverage(int kcovds_idx,int kcovds_count_idx) const;
+    std::vector<uint32_t> kmer_coverage(int kcovds_idx,int kcovds_count_idx) const;
 
     float kci();
     /**
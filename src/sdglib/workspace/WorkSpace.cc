@@ -4,25 +4,153 @@
 
 #include "WorkSpace.hpp"
 #include <sstream>
+#include <cstring>
+#include <sys/stat.h>
+#include <map>
+#include <cstdio>
+#include <sdglib/utilities/Metrics.hpp>
 
 
 const sdgVersion_t WorkSpace::min_compat = 0x0003;
 
-void WorkSpace::dump_to_disk(std::string filename) {
-    sdglib::OutputLog()<<"Dumping workspace to "<<filename<<std::endl;
-    std::ofstream of(filename);
+//FNV-1a over 64-bit words, the last word padded with zeroes
+static uint64_t section_checksum(const char *data, uint64_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint64_t i = 0; i < length; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, std::min((uint64_t) 8, length - i));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-    //Magic number
-    of.write((char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
-    of.write((char *) &SDG_VN, sizeof(SDG_VN));
-    SDG_FILETYPE type(WS_FT);
-    of.write((char *) &type, sizeof(type));
+static bool same_file(const std::string &a, const std::string &b) {
+    struct stat sa, sb;
+    if (stat(a.c_str(), &sa) != 0 or stat(b.c_str(), &sb) != 0) return false;
+    return sa.st_dev == sb.st_dev and sa.st_ino == sb.st_ino;
+}
+
+/**
+ * Output buffer that computes section_checksum() of what is written through it, without writing anything.
+ * Positions count from 0 as in a 64-byte aligned section, so a component's checksum is the same as its section's.
+ */
+class ChecksumStreamBuf : public std::streambuf {
+public:
+    uint64_t checksum() const {
+        return word_bytes == 0 ? hash : (hash ^ word) * 0x100000001b3ULL;
+    }
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        std::streamsize i = 0;
+        while (i < n and word_bytes != 0) add(s[i++]);
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            hash = (hash ^ w) * 0x100000001b3ULL;
+            written += 8;
+        }
+        while (i < n) add(s[i++]);
+        return n;
+    }
 
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) add((char) c);
+        return traits_type::not_eof(c);
+    }
 
-    uint64_t count;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (off == 0 and dir == std::ios_base::cur) return pos_type(written);
+        return pos_type(off_type(-1));
+    }
 
-    //dump operations
-    count = journal.size();
+private:
+    void add(char c) {
+        word |= ((uint64_t) (uint8_t) c) << (8 * word_bytes);
+        ++written;
+        if (++word_bytes == 8) {
+            hash = (hash ^ word) * 0x100000001b3ULL;
+            word = 0;
+            word_bytes = 0;
+        }
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t word = 0;
+    uint64_t word_bytes = 0;
+    uint64_t written = 0;
+};
+
+//Checksum of what write(std::ofstream &) writes
+template<class WRITER>
+static uint64_t serialized_checksum(WRITER write) {
+    ChecksumStreamBuf buf;
+    std::ofstream of;
+    of.std::ios::rdbuf(&buf);
+    write(of);
+    return buf.checksum();
+}
+
+static void graph_hashes(const SequenceDistanceGraph &sg, std::vector<uint64_t> &node_hashes, std::vector<uint64_t> &link_hashes) {
+    node_hashes.resize(sg.nodes.size());
+    link_hashes.resize(sg.links.size());
+#pragma omp parallel for schedule(static,10000)
+    for (uint64_t n = 0; n < node_hashes.size(); ++n)
+        node_hashes[n] = sg.node_sequences.hash(n) * 31 + (uint64_t) sg.nodes[n].status;
+#pragma omp parallel for schedule(static,10000)
+    for (uint64_t n = 0; n < link_hashes.size(); ++n)
+        link_hashes[n] = section_checksum((const char *) sg.links[n].data(), sg.links[n].size() * sizeof(Link));
+}
+
+static const uint64_t directory_offset_position = sizeof(sdgMagic_t) + sizeof(sdgVersion_t) + sizeof(SDG_FILETYPE);
+
+//Pads of to the next 64-byte boundary and returns a section starting there
+static WorkSpaceSection begin_section(std::ofstream &of, WorkSpaceSectionType type, const std::string &name) {
+    static const char padding[64] = {0};
+    of.write(padding, (64 - ((uint64_t) of.tellp()) % 64) % 64);
+    return WorkSpaceSection{(uint64_t) of.tellp(), 0, type, name, 0};
+}
+
+//Writes the directory at the current position, and its offset at the start of the file
+static void write_directory(std::ofstream &of, const std::vector<WorkSpaceSection> &sections) {
+    uint64_t directory_offset = of.tellp();
+    uint64_t count = sections.size();
+    of.write((char *) &count, sizeof(count));
+    for (const auto &s: sections) {
+        of.write((char *) &s.offset, sizeof(s.offset));
+        of.write((char *) &s.length, sizeof(s.length));
+        of.write((char *) &s.type, sizeof(s.type));
+        sdglib::write_string(of, s.name);
+        of.write((char *) &s.checksum, sizeof(s.checksum));
+    }
+    of.seekp(directory_offset_position);
+    of.write((char *) &directory_offset, sizeof(directory_offset));
+}
+
+//Fills in the checksums of sections[indexes] from the file as written so far
+static void checksum_sections(std::ofstream &of, const std::string &filename, std::vector<WorkSpaceSection> &sections,
+                              const std::vector<uint64_t> &indexes) {
+    of.flush();
+    sdglib::MemoryMappedFile written(filename);
+#pragma omp parallel for schedule(dynamic,1)
+    for (uint64_t i = 0; i < indexes.size(); ++i) {
+        auto &s = sections[indexes[i]];
+        s.checksum = section_checksum(written.data() + s.offset, s.length);
+    }
+}
+
+void WorkSpace::record_saved_state(const KmerCounter &kc) {
+    auto checksum = serialized_checksum([&](std::ofstream &of) { kc.write_counts(of); });
+#pragma omp critical(workspace_saved_state)
+    saved_counts_checksums[&kc] = checksum;
+}
+
+void WorkSpace::record_saved_state(const SequenceDistanceGraph &sg) {
+    graph_hashes(sg, saved_node_hashes, saved_link_hashes);
+}
+
+void WorkSpace::write_journal(std::ofstream &of) const {
+    uint64_t count = journal.size();
     of.write((char *) &count, sizeof(count));
     for (const auto &j:journal){
         sdglib::write_string(of,j.name);
@@ -35,46 +163,228 @@ void WorkSpace::dump_to_disk(std::string filename) {
             sdglib::write_string(of, e.detail);
         }
     }
+}
 
-    //dump main graph
-    sdg.write(of);
+void WorkSpace::read_journal(std::ifstream &wsfile) {
+    uint64_t count,count2;
+    wsfile.read((char *) &count, sizeof(count));
+    journal.resize(count);
+    for (auto i=0; i < count; i++) {
+        auto &j = journal[i];
+        sdglib::read_string(wsfile,j.name);
+        sdglib::read_string(wsfile,j.detail);
+        sdglib::read_string(wsfile,j.tool);
+        wsfile.read((char *) &j.timestamp, sizeof(j.timestamp));
 
-    count = distance_graphs.size();
-    of.write((char *) &count, sizeof(count));
-    for (auto i=0; i < count; ++i) {
-        distance_graphs[i].write(of);
+        wsfile.read((char *) &count2, sizeof(count2));
+        j.entries.resize(count2);
+        for (auto e = 0; e < count2; ++e){
+            sdglib::read_string(wsfile,j.entries[e].detail);
+        }
     }
+}
+
+void WorkSpace::dump_to_disk(std::string filename) {
+    sdglib::OutputLog()<<"Dumping workspace to "<<filename<<std::endl;
+    if (index_cache_dir.empty()) index_cache_dir = filename + ".indexes";
+    //pending sections are copied from their file, which can't be the one being overwritten
+    if (not pending.empty() and same_file(filename, source_filename)) load_all();
+    std::ofstream of(filename);
+
+    //Magic number
+    of.write((char *) &SDG_MAGIC, sizeof(SDG_MAGIC));
+    of.write((char *) &SDG_VN, sizeof(SDG_VN));
+    SDG_FILETYPE type(WS_FT);
+    of.write((char *) &type, sizeof(type));
+    //the directory goes at the end, its offset is filled in once it is written
+    uint64_t directory_offset = 0;
+    of.write((char *) &directory_offset, sizeof(directory_offset));
+
+    std::vector<WorkSpaceSection> new_sections;
+    std::vector<uint64_t> to_checksum;
+    std::vector<std::pair<const void *, uint64_t>> copied;
+    auto write_section = [&](WorkSpaceSectionType section_type, const std::string &name, const void *component,
+                             const std::function<void()> &write) {
+        auto section = begin_section(of, section_type, name);
+        auto p = pending.find(component);
+        if (p != pending.end()) {
+            of.write(source_mapping->data() + p->second.section.offset, p->second.section.length);
+            section.checksum = p->second.section.checksum;
+            copied.emplace_back(component, new_sections.size());
+        }
+        else {
+            write();
+            to_checksum.emplace_back(new_sections.size());
+        }
+        section.length = (uint64_t) of.tellp() - section.offset;
+        new_sections.emplace_back(section);
+    };
+
+    write_section(WorkSpaceSectionType::Journal, "journal", &journal, [&]{ write_journal(of); });
+
+    //dump main graph
+    write_section(WorkSpaceSectionType::Graph, sdg.name, &sdg, [&]{ sdg.write(of); });
+
+    for (auto &dg: distance_graphs)
+        write_section(WorkSpaceSectionType::DistanceGraph, dg.name, &dg, [&]{ dg.write(of); });
 
     //paired read datastores
-    count=paired_reads_datastores.size();
-    of.write((char *) &count,sizeof(count));
-    for (auto i=0;i<count;++i){
-        paired_reads_datastores[i].write(of);
-    }
+    for (auto &ds: paired_reads_datastores)
+        write_section(WorkSpaceSectionType::PairedReads, ds.name, &ds, [&]{ ds.write(of); });
 
     //linker read datastores
-    count=linked_reads_datastores.size();
-    of.write((char *) &count,sizeof(count));
-    for (auto i=0;i<count;++i){
-        linked_reads_datastores[i].write(of);
-    }
+    for (auto &ds: linked_reads_datastores)
+        write_section(WorkSpaceSectionType::LinkedReads, ds.name, &ds, [&]{ ds.write(of); });
 
     //long read datastores
-    count=long_reads_datastores.size();
-    of.write((char *) &count,sizeof(count));
-    for (auto i=0;i<count;++i){
-        long_reads_datastores[i].write(of);
-    }
+    for (auto &ds: long_reads_datastores)
+        write_section(WorkSpaceSectionType::LongReads, ds.name, &ds, [&]{ ds.write(of); });
+
+    // Kmer counts
+    for (auto &kc: kmer_counters)
+        write_section(WorkSpaceSectionType::KmerCounter, kc.name, &kc, [&]{ kc.write(of); });
+
+    checksum_sections(of, filename, new_sections, to_checksum);
+    write_directory(of, new_sections);
+    of.close();
+    if (!of) throw std::runtime_error("Error writing " + filename);
+
+    //this is now the current file, pending components are read from their copy in it
+    sections = new_sections;
+    if (not copied.empty()) {
+        source_mapping = std::make_shared<sdglib::MemoryMappedFile>(filename);
+        for (const auto &c: copied) pending[c.first].section = sections[c.second];
+    }
+    source_filename = filename;
+    record_saved_state(sdg);
+    for (const auto &kc: kmer_counters) if (is_loaded(&kc)) record_saved_state(kc);
+}
 
-    // Kmer counts, keep these ones at the end of the workspace to make the workspaces editable by exteding the final part of the file
-    count = kmer_counters.size();
-    of.write((char *) &count,sizeof(count));
-    for (auto i = 0; i < count; i++) {
-        kmer_counters[i].write(of);
-    }
+void WorkSpace::checkpoint(std::string filename) {
+    if (sections.empty() or not same_file(filename, source_filename)) {
+        dump_to_disk(filename);
+        return;
+    }
+    //components are matched to the directory sections by type and order, as dump_to_disk() writes them
+    std::map<WorkSpaceSectionType, std::vector<uint64_t>> file_sections;
+    for (uint64_t i = 0; i < sections.size(); ++i) file_sections[sections[i].type].emplace_back(i);
+    auto matches = [&](WorkSpaceSectionType type, const std::vector<std::string> &names) {
+        const auto &fs = file_sections[type];
+        if (fs.size() > names.size()) return false;
+        for (uint64_t i = 0; i < fs.size(); ++i) if (sections[fs[i]].name != names[i]) return false;
+        return true;
+    };
+    if (file_sections[WorkSpaceSectionType::Journal].size() != 1 or file_sections[WorkSpaceSectionType::Graph].size() != 1
+        or not matches(WorkSpaceSectionType::DistanceGraph, list_distance_graphs())
+        or not matches(WorkSpaceSectionType::PairedReads, list_paired_reads_datastores())
+        or not matches(WorkSpaceSectionType::LinkedReads, list_linked_reads_datastores())
+        or not matches(WorkSpaceSectionType::LongReads, list_long_reads_datastores())
+        or not matches(WorkSpaceSectionType::KmerCounter, list_kmer_counters())) {
+        sdglib::OutputLog() << "WorkSpace contents don't match " << filename << ", writing it in full" << std::endl;
+        dump_to_disk(filename);
+        return;
+    }
+
+    sdglib::OutputLog() << "Checkpointing workspace to " << filename << std::endl;
+    auto &op = add_operation("Checkpoint", "WorkSpace::checkpoint", "changes appended to " + filename);
+    std::ofstream of(filename, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    of.seekp(0, std::ios_base::end);
+    auto new_sections = sections;
+    std::vector<uint64_t> to_checksum;
+    //replaces is the index of the section being superseded, or -1 for new components
+    auto append_section = [&](WorkSpaceSectionType section_type, const std::string &name, int64_t replaces,
+                              const std::function<void()> &write) {
+        auto section = begin_section(of, section_type, name);
+        write();
+        section.length = (uint64_t) of.tellp() - section.offset;
+        if (replaces >= 0) new_sections[replaces] = section;
+        else new_sections.emplace_back(section);
+        to_checksum.emplace_back(replaces >= 0 ? replaces : new_sections.size() - 1);
+    };
+    auto replaced_section = [&](WorkSpaceSectionType type, uint64_t i) -> int64_t {
+        const auto &fs = file_sections[type];
+        return i < fs.size() ? fs[i] : -1;
+    };
+    //components still pending haven't changed, the rest are compared with their section's checksum
+    auto append_if_changed = [&](WorkSpaceSectionType type, const std::string &name, const void *component, uint64_t i,
+                                 const std::function<void(std::ofstream &)> &write) {
+        if (not is_loaded(component)) return;
+        auto replaces = replaced_section(type, i);
+        if (replaces >= 0 and serialized_checksum(write) == sections[replaces].checksum) return;
+        append_section(type, name, replaces, [&]{ write(of); });
+        op.addEntry(std::string(replaces >= 0 ? "updated " : "added ") + name);
+    };
+
+    //graph changes go as a delta of the nodes and link vectors that changed
+    std::vector<uint64_t> node_hashes, link_hashes, changed_nodes, changed_links;
+    graph_hashes(sdg, node_hashes, link_hashes);
+    for (uint64_t n = 0; n < node_hashes.size(); ++n)
+        if (n >= saved_node_hashes.size() or node_hashes[n] != saved_node_hashes[n]) changed_nodes.emplace_back(n);
+    for (uint64_t n = 0; n < link_hashes.size(); ++n)
+        if (n >= saved_link_hashes.size() or link_hashes[n] != saved_link_hashes[n]) changed_links.emplace_back(n);
+    if (not changed_nodes.empty() or not changed_links.empty() or node_hashes.size() != saved_node_hashes.size()
+        or link_hashes.size() != saved_link_hashes.size() or sdg.name != sections[file_sections[WorkSpaceSectionType::Graph][0]].name) {
+        append_section(WorkSpaceSectionType::GraphDelta, sdg.name, -1, [&]{ sdg.write_delta(of, changed_nodes, changed_links); });
+        op.addEntry("graph delta with " + std::to_string(changed_nodes.size()) + " nodes and "
+                    + std::to_string(changed_links.size()) + " link sets");
+    }
+
+    for (uint64_t i = 0; i < distance_graphs.size(); ++i) {
+        auto &dg = distance_graphs[i];
+        append_if_changed(WorkSpaceSectionType::DistanceGraph, dg.name, &dg, i, [&](std::ofstream &f) { dg.write(f); });
+    }
+    for (uint64_t i = 0; i < paired_reads_datastores.size(); ++i) {
+        auto &ds = paired_reads_datastores[i];
+        append_if_changed(WorkSpaceSectionType::PairedReads, ds.name, &ds, i, [&](std::ofstream &f) { ds.write(f); });
+    }
+    for (uint64_t i = 0; i < linked_reads_datastores.size(); ++i) {
+        auto &ds = linked_reads_datastores[i];
+        append_if_changed(WorkSpaceSectionType::LinkedReads, ds.name, &ds, i, [&](std::ofstream &f) { ds.write(f); });
+    }
+    for (uint64_t i = 0; i < long_reads_datastores.size(); ++i) {
+        auto &ds = long_reads_datastores[i];
+        append_if_changed(WorkSpaceSectionType::LongReads, ds.name, &ds, i, [&](std::ofstream &f) { ds.write(f); });
+    }
+    //the KmerCounter section only points to its counts file, so it's the counts that get compared
+    std::vector<uint64_t> counts_checksums(kmer_counters.size());
+    for (uint64_t i = 0; i < kmer_counters.size(); ++i) {
+        auto &kc = kmer_counters[i];
+        if (not is_loaded(&kc)) continue;
+        counts_checksums[i] = serialized_checksum([&](std::ofstream &f) { kc.write_counts(f); });
+        auto replaces = replaced_section(WorkSpaceSectionType::KmerCounter, i);
+        if (replaces >= 0 and saved_counts_checksums.count(&kc) and saved_counts_checksums[&kc] == counts_checksums[i]) continue;
+        append_section(WorkSpaceSectionType::KmerCounter, kc.name, replaces, [&]{ kc.write(of); });
+        op.addEntry(std::string(replaces >= 0 ? "updated " : "added ") + kc.name);
+    }
+
+    //the journal, with this checkpoint, goes last
+    append_section(WorkSpaceSectionType::Journal, "journal", file_sections[WorkSpaceSectionType::Journal][0],
+                   [&]{ write_journal(of); });
+
+    checksum_sections(of, filename, new_sections, to_checksum);
+    of.seekp(0, std::ios_base::end);
+    write_directory(of, new_sections);
+    of.close();
+    if (!of) throw std::runtime_error("Error writing " + filename);
+    sdglib::OutputLog() << "Checkpoint appended " << to_checksum.size() << " sections to " << filename << std::endl;
+
+    sections = new_sections;
+    saved_node_hashes.swap(node_hashes);
+    saved_link_hashes.swap(link_hashes);
+    for (uint64_t i = 0; i < kmer_counters.size(); ++i)
+        if (is_loaded(&kmer_counters[i])) saved_counts_checksums[&kmer_counters[i]] = counts_checksums[i];
+}
+
+void WorkSpace::compact(std::string filename) {
+    if (index_cache_dir.empty()) index_cache_dir = filename + ".indexes";
+    auto compacted_filename = filename + ".compacting";
+    dump_to_disk(compacted_filename);
+    if (std::rename(compacted_filename.c_str(), filename.c_str()) != 0)
+        throw std::runtime_error("Error renaming " + compacted_filename + " to " + filename);
+    source_filename = filename;
 }
 
-void WorkSpace::load_from_disk(std::string filename, bool log_only) {
+void WorkSpace::load_from_disk(std::string filename, bool log_only, bool lazy) {
     std::ifstream wsfile(filename);
     if (!wsfile.good()) {
         std::cerr << filename << " opening error: " << strerror(errno) << std::endl;
@@ -101,31 +411,24 @@ void WorkSpace::load_from_disk(std::string filename, bool log_only) {
         throw std::runtime_error("File type supplied: " + std::to_string(type) + " is not compatible with WS_FT");
     }
 
-
-    uint64_t count,count2;
-
-    //read operations
-    wsfile.read((char *) &count, sizeof(count));
-    journal.resize(count);
-    for (auto i=0; i < count; i++) {
-        auto &j = journal[i];
-        sdglib::read_string(wsfile,j.name);
-        sdglib::read_string(wsfile,j.detail);
-        sdglib::read_string(wsfile,j.tool);
-        wsfile.read((char *) &j.timestamp, sizeof(j.timestamp));
-
-        wsfile.read((char *) &count2, sizeof(count2));
-        j.entries.resize(count2);
-        for (auto e = 0; e < count2; ++e){
-            sdglib::read_string(wsfile,j.entries[e].detail);
-        }
+    if (version >= sections_version) {
+        load_sections(filename, log_only, lazy);
+        return;
     }
 
+    //read operations
+    read_journal(wsfile);
 
     if (log_only) return;
+    if (index_cache_dir.empty()) index_cache_dir = filename + ".indexes";
+    load_sequential(wsfile, version);
+}
+
+void WorkSpace::load_sequential(std::ifstream &wsfile, sdgVersion_t version) {
+    uint64_t count;
 
     //graph
-    sdg.read(wsfile);
+    sdg.read(wsfile, version);
     sdglib::OutputLog() <<"Loaded graph with "<<sdg.nodes.size()-1<<" nodes" <<std::endl;
 
     //distance graphs
@@ -166,33 +469,171 @@ void WorkSpace::load_from_disk(std::string filename, bool log_only) {
     for (auto i = 0; i < count; i++) {
         kmer_counters.emplace_back(*this,wsfile);
     }
+}
+
+void WorkSpace::load_sections(const std::string &filename, bool log_only, bool lazy) {
+    auto mapping = std::make_shared<sdglib::MemoryMappedFile>(filename);
+    std::ifstream wsfile(filename);
+    sdgVersion_t version;
+    uint64_t directory_offset, count;
+    wsfile.seekg(sizeof(sdgMagic_t));
+    wsfile.read((char *) &version, sizeof(version));
+    wsfile.seekg(sizeof(SDG_FILETYPE), std::ios_base::cur);
+    wsfile.read((char *) &directory_offset, sizeof(directory_offset));
+    if (!wsfile or directory_offset >= mapping->size()) throw std::runtime_error(filename + " has no valid section directory");
+
+    //==== Section directory ====
+    wsfile.seekg(directory_offset);
+    wsfile.read((char *) &count, sizeof(count));
+    sections.resize(count);
+    for (auto &s: sections) {
+        wsfile.read((char *) &s.offset, sizeof(s.offset));
+        wsfile.read((char *) &s.length, sizeof(s.length));
+        wsfile.read((char *) &s.type, sizeof(s.type));
+        sdglib::read_string(wsfile, s.name);
+        wsfile.read((char *) &s.checksum, sizeof(s.checksum));
+        if (!wsfile or s.offset + s.length > directory_offset) throw std::runtime_error(filename + " has a corrupted section directory");
+    }
+    source_filename = filename;
+    source_mapping = mapping;
+
+    for (const auto &s: sections) {
+        if (s.type != WorkSpaceSectionType::Journal) continue;
+        check_section(s);
+        wsfile.seekg(s.offset);
+        read_journal(wsfile);
+    }
+    if (log_only) return;
+    if (index_cache_dir.empty()) index_cache_dir = filename + ".indexes";
+
+    //the graph is always loaded, everything else waits in its section until needed
+    //pending sections point into the component vectors, which must not reallocate
+    auto check_room = [](size_t size) {
+        if (size >= MAX_WORKSPACE_VECTOR_SIZE)
+            throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
+    };
+    for (const auto &s: sections) {
+        switch (s.type) {
+            case WorkSpaceSectionType::Journal:
+                break;
+            case WorkSpaceSectionType::Graph:
+                check_section(s);
+                wsfile.seekg(s.offset);
+                sdg.read(wsfile, version, mapping);
+                sdglib::OutputLog() <<"Loaded graph with "<<sdg.nodes.size()-1<<" nodes" <<std::endl;
+                break;
+            case WorkSpaceSectionType::GraphDelta:
+                check_section(s);
+                wsfile.seekg(s.offset);
+                sdg.read_delta(wsfile);
+                break;
+            case WorkSpaceSectionType::DistanceGraph:
+                check_room(distance_graphs.size());
+                distance_graphs.emplace_back(sdg, s.name);
+                add_pending(distance_graphs.back(), s);
+                break;
+            case WorkSpaceSectionType::PairedReads:
+                check_room(paired_reads_datastores.size());
+                paired_reads_datastores.emplace_back(*this);
+                paired_reads_datastores.back().name = s.name;
+                add_pending(paired_reads_datastores.back(), s);
+                break;
+            case WorkSpaceSectionType::LinkedReads:
+                check_room(linked_reads_datastores.size());
+                linked_reads_datastores.emplace_back(*this);
+                linked_reads_datastores.back().name = s.name;
+                add_pending(linked_reads_datastores.back(), s);
+                break;
+            case WorkSpaceSectionType::LongReads:
+                check_room(long_reads_datastores.size());
+                long_reads_datastores.emplace_back(*this);
+                long_reads_datastores.back().name = s.name;
+                add_pending(long_reads_datastores.back(), s);
+                break;
+            case WorkSpaceSectionType::KmerCounter:
+                check_room(kmer_counters.size());
+                kmer_counters.emplace_back(*this);
+                kmer_counters.back().name = s.name;
+                add_pending(kmer_counters.back(), s);
+                break;
+            default:
+                sdglib::OutputLog() << "WARNING: skipping section " << s.name << " of unknown type" << std::endl;
+        }
+    }
+    record_saved_state(sdg);
+    if (not lazy) load_all();
+}
+
+void WorkSpace::check_section(const WorkSpaceSection &section) const {
+    if (section_checksum(source_mapping->data() + section.offset, section.length) != section.checksum)
+        throw std::runtime_error("Checksum mismatch on section " + section.name + " of " + source_filename);
+}
+
+void WorkSpace::load_pending_section(const void *component) {
+    std::string error;
+#pragma omp critical(workspace_pending_sections)
+    {
+        auto p = pending.find(component);
+        if (p != pending.end()) {
+            sdglib::OutputLog() << "Loading " << p->second.section.name << " from " << source_filename << std::endl;
+            try {
+                check_section(p->second.section);
+                std::ifstream wsfile(source_filename);
+                wsfile.seekg(p->second.section.offset);
+                p->second.read(wsfile);
+            }
+            catch (const std::exception &e) {
+                error = e.what();
+            }
+            pending.erase(p);
+            pending_sections.store(pending.size(), std::memory_order_release);
+        }
+    }
+    if (not error.empty()) throw std::runtime_error(error);
+}
 
+void WorkSpace::load_all() {
+    std::vector<std::pair<uint64_t, const void *>> to_load;
+#pragma omp critical(workspace_pending_sections)
+    for (const auto &p: pending) to_load.emplace_back(p.second.section.offset, p.first);
+    std::sort(to_load.begin(), to_load.end());
+    for (const auto &c: to_load) load_pending_section(c.second);
+    source_mapping.reset();
+}
+
+bool WorkSpace::is_loaded(const void *component) const {
+    bool found;
+#pragma omp critical(workspace_pending_sections)
+    found = pending.count(component) > 0;
+    return not found;
 }
 
 std::string WorkSpace::ls(int level,bool recursive) const {
     std::stringstream ss;
     std::string spacer(2*level,' ');
+    //components still waiting in their section are listed by name only
+    std::string pending_spacer(2*level+4,' ');
     ss<<spacer<<"SDG Workspace"<<std::endl;
     if (recursive) ss<<sdg.ls(level+1,true);
     ss<<spacer<<"  Distance Graphs: "<<distance_graphs.size()<<std::endl;
     if (recursive){
-        for (auto &d:distance_graphs) ss<<d.ls(level+1,true);
+        for (auto &d:distance_graphs) if (is_loaded(&d)) ss<<d.ls(level+1,true); else ss<<pending_spacer<<d.name<<" (not loaded)"<<std::endl;
     }
     ss<<spacer<<"  Paired Read Datastores: "<<paired_reads_datastores.size()<<std::endl;
     if (recursive){
-        for (auto &d:paired_reads_datastores) ss<<d.ls(level+2,true);
+        for (auto &d:paired_reads_datastores) if (is_loaded(&d)) ss<<d.ls(level+2,true); else ss<<pending_spacer<<d.name<<" (not loaded)"<<std::endl;
     }
     ss<<spacer<<"  Linked Read Datastores: "<<linked_reads_datastores.size()<<std::endl;
     if (recursive){
-        for (auto &d:linked_reads_datastores) ss<<d.ls(level+2,true);
+        for (auto &d:linked_reads_datastores) if (is_loaded(&d)) ss<<d.ls(level+2,true); else ss<<pending_spacer<<d.name<<" (not loaded)"<<std::endl;
     }
     ss<<spacer<<"  Long Read Datastores: "<<long_reads_datastores.size()<<std::endl;
     if (recursive){
-        for (auto &d:long_reads_datastores) ss<<d.ls(level+2,true);
+        for (auto &d:long_reads_datastores) if (is_loaded(&d)) ss<<d.ls(level+2,true); else ss<<pending_spacer<<d.name<<" (not loaded)"<<std::endl;
     }
-    ss<<spacer<<"  Kmer Count Datastores: "<<paired_reads_datastores.size()<<std::endl;
+    ss<<spacer<<"  Kmer Count Datastores: "<<kmer_counters.size()<<std::endl;
     if (recursive){
-        for (auto &d:kmer_counters) ss<<d.ls(level+2,true);
+        for (auto &d:kmer_counters) if (is_loaded(&d)) ss<<d.ls(level+2,true); else ss<<pending_spacer<<d.name<<" (not loaded)"<<std::endl;
     }
     return ss.str();
 }
@@ -207,18 +648,18 @@ void WorkSpace::status() {
     //PR datastores and mappings
     sdglib::OutputLog()<<"Workspace contains "<< paired_reads_datastores.size() << " paired reads datastores" <<std::endl;
     for (auto di=0;di<paired_reads_datastores.size();++di){
-        paired_reads_datastores[di].print_status();
+        loaded(paired_reads_datastores[di]).print_status();
 
     }
     //10x datastores and mappings
     sdglib::OutputLog()<<"Workspace contains "<< linked_reads_datastores.size() << " linked reads datastores" <<std::endl;
     for (auto di=0;di<linked_reads_datastores.size();++di){
-        linked_reads_datastores[di].print_status();
+        loaded(linked_reads_datastores[di]).print_status();
     }
     //LR datastores and mappings
     sdglib::OutputLog()<<"Workspace contains "<< long_reads_datastores.size() << " long reads datastores" <<std::endl;
     for (auto di=0;di<long_reads_datastores.size();++di){
-        long_reads_datastores[di].print_status();
+        loaded(long_reads_datastores[di]).print_status();
     }
 
 }
@@ -230,14 +671,15 @@ std::vector<sgNodeID_t> WorkSpace::select_from_all_nodes(uint32_t min_size, uint
                       min_tags << "-" << max_tags << " tags " << min_ci << "-" << max_ci << " CI"<<std::endl;
     uint64_t tnodes=0,tbp=0;
     nodes.reserve(sdg.nodes.size());
+    if (!linked_reads_datastores.empty()) loaded(linked_reads_datastores[0]);
 #pragma omp parallel
     {
         std::vector<sgNodeID_t> thread_nodes;
         uint64_t ttbp=0;
 #pragma omp for schedule(static, 100)
         for (auto n=1;n<sdg.nodes.size();++n) {
-            if (sdg.nodes[n].sequence.size() < min_size) continue;
-            if (sdg.nodes[n].sequence.size() > max_size) continue;
+            if (sdg.get_node_size(n) < min_size) continue;
+            if (sdg.get_node_size(n) > max_size) continue;
             if (!linked_reads_datastores.empty()) {
                 auto ntags = linked_reads_datastores[0].mapper.get_node_tags(n);
                 if (ntags.size() < min_tags or ntags.size() > max_tags) continue;
@@ -245,7 +687,7 @@ std::vector<sgNodeID_t> WorkSpace::select_from_all_nodes(uint32_t min_size, uint
             ++tnodes;
             thread_nodes.emplace_back(n);
 
-            ttbp += sdg.nodes[n].sequence.size();
+            ttbp += sdg.get_node_size(n);
         }
 
 #pragma omp critical(collect_selected_nodes)
@@ -264,6 +706,7 @@ void WorkSpace::remap_all() {
     auto op = add_operation("Mapping", "WorkSpace::remap_all", "remapping all reads");
     //auto pri=0;
     for (auto &ds:paired_reads_datastores) {
+        loaded(ds);
         sdglib::OutputLog()<<"Mapping reads from paired library..."<<std::endl;
         ds.mapper.remap_all_reads();
         ds.print_status();
@@ -279,6 +722,7 @@ void WorkSpace::remap_all() {
         sdglib::OutputLog()<<"Mapping reads from paired library DONE."<<std::endl;
     }
     for (auto &ds:linked_reads_datastores) {
+        loaded(ds);
         sdglib::OutputLog()<<"Mapping reads from linked library..."<<std::endl;
         ds.mapper.remap_all_reads();
         op.addEntry("reads from "+ds.filename+" re-mapped to current graph");
@@ -290,6 +734,7 @@ void WorkSpace::remap_all63() {
     sdglib::OutputLog()<<"Mapping reads..."<<std::endl;
     auto op = add_operation("Mapping", "WorkSpace::remap_all63", "remapping all reads");
     for (auto &ds:paired_reads_datastores) {
+        loaded(ds);
         sdglib::OutputLog()<<"Mapping reads from paired library..."<<std::endl;
         ds.mapper.remap_all_reads63();
         ds.print_status();
@@ -297,6 +742,7 @@ void WorkSpace::remap_all63() {
         sdglib::OutputLog()<<"Mapping reads from paired library DONE."<<std::endl;
     }
     for (auto &ds:linked_reads_datastores) {
+        loaded(ds);
         sdglib::OutputLog()<<"Mapping reads from linked library..."<<std::endl;
         ds.mapper.remap_all_reads63();
         op.addEntry("reads from "+ds.filename+" re-mapped to current graph");
@@ -305,7 +751,7 @@ void WorkSpace::remap_all63() {
 }
 
 PairedReadsDatastore &WorkSpace::add_paired_reads_datastore(const std::string &filename, const std::string &name) {
-    if (paired_reads_datastores.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (paired_reads_datastores.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_paired_reads_datastores()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -315,7 +761,7 @@ PairedReadsDatastore &WorkSpace::add_paired_reads_datastore(const std::string &f
 }
 
 LinkedReadsDatastore &WorkSpace::add_linked_reads_datastore(const std::string &filename, const std::string &name) {
-    if (linked_reads_datastores.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (linked_reads_datastores.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_linked_reads_datastores()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -325,7 +771,7 @@ LinkedReadsDatastore &WorkSpace::add_linked_reads_datastore(const std::string &f
 }
 
 LongReadsDatastore &WorkSpace::add_long_reads_datastore(const std::string &filename, const std::string &name) {
-    if (long_reads_datastores.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (long_reads_datastores.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_long_reads_datastores()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -335,7 +781,7 @@ LongReadsDatastore &WorkSpace::add_long_reads_datastore(const std::string &filen
 }
 
 DistanceGraph &WorkSpace::add_distance_graph(const DistanceGraph &dg, const std::string &name) {
-    if (distance_graphs.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (distance_graphs.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_distance_graphs()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -349,8 +795,52 @@ JournalOperation &WorkSpace::add_operation(const std::string &name, const std::s
     return journal.back();
 }
 
+static uint64_t read_paths_bytes(const std::vector<ReadPath> &read_paths) {
+    uint64_t total = sdglib::vector_bytes(read_paths);
+    for (const auto &rp: read_paths) total += sdglib::vector_bytes(rp.path);
+    return total;
+}
+
+std::map<std::string, uint64_t> WorkSpace::memory_usage() const {
+    std::map<std::string, uint64_t> usage;
+    uint64_t sdg_bytes = sdglib::vector_bytes(sdg.nodes) + sdglib::vector_bytes(sdg.links) + sdglib::vector_bytes(sdg.oldnames);
+    sdg_bytes += sdg.node_sequences.size_in_bytes();
+    usage["sdg"] = sdg_bytes;
+    for (const auto &dg: distance_graphs) usage["distance_graph/" + dg.name] = sdglib::vector_bytes(dg.links);
+    for (const auto &ds: paired_reads_datastores) {
+        const auto &m = ds.mapper;
+        usage["paired_reads/" + ds.name] = sdglib::vector_bytes(ds.read_length) + sdglib::vector_bytes(ds.n_runs)
+                                           + sdglib::vector_bytes(m.reads_in_node) + sdglib::vector_bytes(m.read_to_node)
+                                           + sdglib::vector_bytes(m.read_direction_in_node) + read_paths_bytes(m.read_paths)
+                                           + sdglib::vector_bytes(m.read_path_offsets) + sdglib::vector_bytes(m.paths_in_node);
+    }
+    for (const auto &ds: linked_reads_datastores) {
+        const auto &m = ds.mapper;
+        usage["linked_reads/" + ds.name] = ds.size() / 2 * sizeof(uint32_t) + sdglib::vector_bytes(m.reads_in_node)
+                                           + sdglib::vector_bytes(m.read_to_node) + sdglib::vector_bytes(m.read_direction_in_node)
+                                           + m.tag_neighbours.memory_bytes() + read_paths_bytes(m.read_paths)
+                                           + sdglib::vector_bytes(m.paths_in_node);
+    }
+    for (const auto &ds: long_reads_datastores) {
+        const auto &m = ds.mapper;
+        usage["long_reads/" + ds.name] = sdglib::vector_bytes(ds.read_to_fileRecord) + sdglib::vector_bytes(m.mappings)
+                                         + sdglib::vector_bytes(m.first_mapping) + sdglib::vector_bytes(m.read_paths)
+                                         + sdglib::vector_bytes(m.reads_in_node);
+    }
+    for (const auto &kc: kmer_counters) usage["kmer_counter/" + kc.name] = kc.memory_bytes();
+    return usage;
+}
+
+JournalOperation &WorkSpace::journal_metrics(const std::string &detail) {
+    for (const auto &u: memory_usage()) sdglib::metrics().set_gauge("memory/" + u.first, u.second);
+    auto lines = sdglib::metrics().report_lines();
+    auto &op = add_operation("Metrics", "WorkSpace::journal_metrics", detail);
+    for (const auto &l: lines) op.addEntry(l);
+    return op;
+}
+
 KmerCounter &WorkSpace::add_kmer_counter(const std::string &filename, const std::string &name) {
-    if (kmer_counters.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (kmer_counters.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_kmer_counters()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -361,7 +851,7 @@ KmerCounter &WorkSpace::add_kmer_counter(const std::string &filename, const std:
 }
 
 KmerCounter &WorkSpace::add_kmer_counter(const std::string &name, const uint8_t k, KmerCountMode count_mode) {
-    if (kmer_counters.size() > MAX_WORKSPACE_VECTOR_SIZE) {
+    if (kmer_counters.size() >= MAX_WORKSPACE_VECTOR_SIZE) {
         throw std::runtime_error("Maximum items exceeded, please increase MAX_WORKSPACE_VECTOR_SIZE compile option to add more items");
     }
     for (auto n:list_kmer_counters()) if (n==name) throw std::runtime_error("Name is already in use");
@@ -373,21 +863,21 @@ KmerCounter &WorkSpace::add_kmer_counter(const std::string &name, const uint8_t
 
 PairedReadsDatastore &WorkSpace::get_paired_reads_datastore(const std::string &name) {
     for (auto &ds : paired_reads_datastores){
-        if (ds.name == name) return ds;
+        if (ds.name == name) return loaded(ds);
     }
     throw std::runtime_error("There are no PairedReadsDatastore named: " + name);
 }
 
 LinkedReadsDatastore &WorkSpace::get_linked_reads_datastore(const std::string &name) {
     for (auto &ds : linked_reads_datastores){
-        if (ds.name == name) return ds;
+        if (ds.name == name) return loaded(ds);
     }
     throw std::runtime_error("There are no LinkedReadsDatastore named: " + name);
 }
 
 LongReadsDatastore &WorkSpace::get_long_reads_datastore(const std::string &name) {
     for (auto &ds : long_reads_datastores){
-        if (ds.name == name) return ds;
+        if (ds.name == name) return loaded(ds);
     }
     throw std::runtime_error("There are no LongReadsDatastore named: " + name);
 
@@ -395,24 +885,26 @@ LongReadsDatastore &WorkSpace::get_long_reads_datastore(const std::string &name)
 
 DistanceGraph &WorkSpace::get_distance_graph(const std::string &name) {
     for (auto &ds : distance_graphs){
-        if (ds.name == name) return ds;
+        if (ds.name == name) return loaded(ds);
     }
     throw std::runtime_error("There are no DistanceGraphs named: " + name);
 }
 
 KmerCounter &WorkSpace::get_kmer_counter(const std::string &name) {
     for (auto &ds : kmer_counters) {
-        if (ds.name == name) return ds;
+        if (ds.name == name) return loaded(ds);
     }
     throw std::runtime_error("Couldn't find a KmerCounter named: " + name);
 }
 
-WorkSpace::WorkSpace(const std::string &filename) : sdg(*this) {
+WorkSpace::WorkSpace(const std::string &filename, bool lazy) : sdg(*this) {
+    //components are tracked by address until loaded, so the vectors must not reallocate
+    distance_graphs.reserve(MAX_WORKSPACE_VECTOR_SIZE);
     linked_reads_datastores.reserve(MAX_WORKSPACE_VECTOR_SIZE);
     paired_reads_datastores.reserve(MAX_WORKSPACE_VECTOR_SIZE);
     long_reads_datastores.reserve(MAX_WORKSPACE_VECTOR_SIZE);
     kmer_counters.reserve(MAX_WORKSPACE_VECTOR_SIZE);
-    if (filename!="") load_from_disk(filename);
+    if (filename!="") load_from_disk(filename,false,lazy);
 }
 
 std::vector<std::string> WorkSpace::list_distance_graphs() {
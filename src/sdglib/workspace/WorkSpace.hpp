@@ -17,6 +17,26 @@
 #include <sdglib/indexers/UniqueKmerIndex.hpp>
 #include <sdglib/workspace/Journal.hpp>
 #include <sdglib/datastores/KmerCounter.hpp>
+#include <sdglib/utilities/MemoryMappedFile.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <map>
+
+enum class WorkSpaceSectionType : uint8_t {Journal, Graph, DistanceGraph, PairedReads, LinkedReads, LongReads, KmerCounter, GraphDelta};
+
+/**
+ * @brief Entry of the section directory at the end of a WorkSpace file.
+ * Sections start at 64-byte aligned offsets, so they can be copied verbatim between files.
+ */
+struct WorkSpaceSection {
+    uint64_t offset;
+    uint64_t length;
+    WorkSpaceSectionType type;
+    std::string name;
+    uint64_t checksum;
+};
 
 /**
  * The WorkSpace holds the information regarding a project in memory and can be written to a file for checkpointing purposes
@@ -29,7 +49,11 @@
  */
 class WorkSpace {
 public:
-    explicit WorkSpace(const std::string & filename="");
+    /**
+     * @param filename WorkSpace file to load, if not empty
+     * @param lazy if true, only the journal and graph are loaded, everything else is loaded on first access (see loaded())
+     */
+    explicit WorkSpace(const std::string & filename="", bool lazy=false);
     WorkSpace(const WorkSpace& that) = delete; //we definitely do not want copy constructors here, thank you
     void status();
 
@@ -47,6 +71,9 @@ public:
 
     /**
      * @brief Writes a disk version of the information held by that can be used in the future, it can be used as a form of checkpoint
+     *
+     * Every component is written as a section, listed in a directory at the end of the file with its offset, length,
+     * type, name and checksum. Components that haven't been loaded yet are copied verbatim from their original file.
      * @param filename Path to the file to write to disk
      */
     void dump_to_disk(std::string filename);
@@ -56,11 +83,64 @@ public:
      * Load the workspace information from disk for further analysis
      * @param filename Path to the file to load from disk
      * @param log_only Only loads the Journal information
+     * @param lazy Only loads the Journal and graph, everything else is read from its section on first access. Files
+     * written before section directories existed are always fully loaded.
+     */
+    void load_from_disk(std::string filename,bool log_only=false,bool lazy=false);
+
+    /**
+     * @brief Saves the WorkSpace to the file it was loaded from or last saved to, appending only what changed.
+     *
+     * Changes to the graph's nodes and links are appended as a delta, changed or new distance graphs, datastores and
+     * KmerCounters as new sections that replace the old ones in the directory. The superseded bytes stay in the file
+     * until compact() is called. The checkpoint is recorded in the journal.
+     * If filename is any other file, this is just dump_to_disk().
+     * @param filename Path to the file to write to disk
+     */
+    void checkpoint(std::string filename);
+
+    /**
+     * @brief Rewrites filename as dump_to_disk() would, folding back graph deltas and dropping superseded sections
+     * @param filename Path to the file to write to disk
+     */
+    void compact(std::string filename);
+
+    /**
+     * @brief Returns component (any datastore, DistanceGraph or KmerCounter of this WorkSpace), reading it from
+     * its section of the WorkSpace file first if it hasn't been loaded yet.
+     *
+     * Code that accesses the component vectors directly should go through this, as a lazily loaded WorkSpace only
+     * has names in them until then.
+     */
+    template<class T>
+    T & loaded(T & component) {
+        if (pending_sections.load(std::memory_order_acquire) > 0) load_pending_section(&component);
+        return component;
+    }
+
+    /**
+     * @brief Loads every component that hasn't been loaded yet
      */
-    void load_from_disk(std::string filename,bool log_only=false);
+    void load_all();
+
+    bool is_loaded(const void * component) const;
 
     JournalOperation &add_operation(const std::string &name, const std::string &tool, const std::string &detail);
 
+    /**
+     * @brief Approximate heap bytes used by each loaded component: the graph, distance graphs, datastores (with their
+     * mappings) and KmerCounters. Memory-mapped read files are not included.
+     * @return component ("sdg", "paired_reads/<name>", "kmer_counter/<name>", ...) -> bytes
+     */
+    std::map<std::string, uint64_t> memory_usage() const;
+
+    /**
+     * @brief Records memory_usage() as "memory/<component>" gauges and adds a journal operation with one entry per
+     * stage, counter and gauge in sdglib::metrics()
+     * @param detail detail of the journal operation, i.e. what was run
+     */
+    JournalOperation &journal_metrics(const std::string &detail="");
+
 
     /**
      * @brief
@@ -186,5 +266,50 @@ public:
 
     std::vector<JournalOperation> journal;
 
+    /**
+     * Directory where k-mer indexes built from the graph are cached between runs, empty disables caching.
+     * Set to "<workspace file>.indexes" when the WorkSpace is loaded from or dumped to disk, if not set before.
+     */
+    std::string index_cache_dir;
+
+    std::vector<WorkSpaceSection> sections; /// Section directory of the file last loaded or dumped
+
     static const sdgVersion_t min_compat;
+    static const sdgVersion_t sections_version = 0x0005; /// First version with a section directory
+
+private:
+    struct PendingSection {
+        WorkSpaceSection section;
+        std::function<void(std::ifstream &)> read;
+    };
+
+    void record_saved_state(const KmerCounter &kc);
+    void record_saved_state(const SequenceDistanceGraph &sg);
+    template<class T>
+    void record_saved_state(const T &component) {} //other components are compared with their section checksum
+
+    void write_journal(std::ofstream &of) const;
+    void read_journal(std::ifstream &wsfile);
+    void load_sequential(std::ifstream &wsfile, sdgVersion_t version);
+    void load_sections(const std::string &filename, bool log_only, bool lazy);
+    void check_section(const WorkSpaceSection &section) const;
+    void load_pending_section(const void * component);
+
+    template<class T>
+    void add_pending(T & component, const WorkSpaceSection &section) {
+        pending[&component] = {section, [this, &component](std::ifstream &f) {
+            component.read(f);
+            record_saved_state(component);
+        }};
+        pending_sections.store(pending.size(), std::memory_order_release);
+    }
+
+    std::string source_filename;                               /// File the pending sections are read from
+    std::shared_ptr<sdglib::MemoryMappedFile> source_mapping;
+    std::unordered_map<const void *, PendingSection> pending;  /// Components not yet loaded
+    std::atomic<uint64_t> pending_sections{0};
+
+    //state of the components as saved on the current file, used by checkpoint() to find what changed
+    std::unordered_map<const void *, uint64_t> saved_counts_checksums;
+    std::vector<uint64_t> saved_node_hashes, saved_link_hashes;
 };
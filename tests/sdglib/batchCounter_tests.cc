@@ -4,7 +4,9 @@
 
 #include <catch.hpp>
 #include <unordered_map>
+#include <map>
 #include <sdglib/batch_counter/BatchKmersCounter.hpp>
+#include <sdglib/batch_counter/MinimizerKmersCounter.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
 #include <cstring>
 
@@ -105,4 +107,70 @@ TEST_CASE("Counts 60-mers correctly from PairedReadDatastore, using batches") {
     ::unlink("small_K.freqs");
     ::unlink("pe.prseq");
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("Minimizer-partitioned counter matches a direct count") {
+    {
+        std::string r1_filepath("../tests/datasets/workspace/pe/pe_R1.fastq");
+        std::string r2_filepath("../tests/datasets/workspace/pe/pe_R2.fastq");
+        std::string prds_output_path("pe_minimizer.prseq");
+        PairedReadsDatastore::build_from_fastq(prds_output_path, r1_filepath, r2_filepath, prds_output_path, 0, 350);
+    }
+    WorkSpace ws;
+    const PairedReadsDatastore ds(ws, "pe_minimizer.prseq");
+
+    for (auto k: {21, 31, 60}) {
+        std::map<__uint128_t, uint32_t> expected;
+        StreamKmerFactory128 skf(k);
+        ReadSequenceBuffer rsb(ds);
+        std::vector<__uint128_t> kmers;
+        for (uint64_t rid = 1; rid <= ds.size(); ++rid) {
+            kmers.clear();
+            skf.produce_all_kmers(rsb.get_read_sequence(rid), kmers);
+            for (auto &kmer: kmers) ++expected[kmer];
+        }
+        std::vector<std::pair<__uint128_t, uint32_t>> expected_counts(expected.begin(), expected.end());
+
+        //a single bucket, a few buckets with a short minimizer and the automatic choice
+        for (auto buckets: {1, 7, 0}) {
+            MinimizerKmersCounter counter(k, ".", 1ULL << 30, buckets, buckets == 7 ? 5 : 11);
+            counter.add_reads(ds);
+            counter.count(1);
+            REQUIRE(counter.kmer_counts == expected_counts);
+        }
+        //a budget too small for the single bucket splits it when counting
+        MinimizerKmersCounter small_counter(k, ".", 1 << 16, 1);
+        small_counter.add_reads(ds);
+        small_counter.count(1);
+        REQUIRE(small_counter.kmer_counts == expected_counts);
+
+        MinimizerKmersCounter counter(k);
+        counter.add_reads(ds);
+        counter.count(3);
+        uint64_t over2 = 0;
+        for (auto &kc: expected_counts) if (kc.second >= 3) ++over2;
+        REQUIRE(counter.kmer_counts.size() == over2);
+
+        //counting straight into a caller's container, keeping a range of counts
+        MinimizerKmersCounter range_counter(k, ".", 1 << 20, 7);
+        range_counter.add_reads(ds);
+        std::vector<__uint128_t> range_kmers, expected_kmers;
+        range_counter.count_to<__uint128_t>(2, 4, [](__uint128_t kmer, uint32_t count) { return kmer; },
+                                            [&](uint64_t n) { range_kmers.resize(n); return range_kmers.data(); });
+        for (auto &kc: expected_counts) if (kc.second >= 2 and kc.second <= 4) expected_kmers.emplace_back(kc.first);
+        REQUIRE(range_kmers == expected_kmers);
+
+        //two counters binning into the same directory keep their own buckets
+        MinimizerKmersCounter counter_a(k, ".", 1ULL << 30, 7), counter_b(k, ".", 1ULL << 30, 7);
+        counter_a.add_reads(ds);
+        counter_b.add_reads(ds);
+        counter_a.count(1);
+        counter_b.count(1);
+        REQUIRE(counter_a.kmer_counts == expected_counts);
+        REQUIRE(counter_b.kmer_counts == expected_counts);
+    }
+    //write errors in the parallel binning are reported, not terminating the process
+    MinimizerKmersCounter bad_counter(21, "no_such_dir_for_buckets", 1ULL << 30, 7);
+    REQUIRE_THROWS(bad_counter.add_reads(ds));
+    ::unlink("pe_minimizer.prseq");
+}
@@ -5,6 +5,10 @@
 #include <catch.hpp>
 #include <sdglib/readers/FileReader.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
+#include <sdglib/graph/PackedNodeSequences.hpp>
+#include <sdglib/factories/KMerFactory.hpp>
+#include <sdglib/factories/KmerPosFactory.hpp>
+#include <map>
 #include <random>
 
 TEST_CASE("Workspace create, read, write") {
@@ -54,6 +58,115 @@ TEST_CASE("Workspace create, read, write") {
     ::unlink("kctest.count");
 }
 
+TEST_CASE("Workspace sections load lazily") {
+    std::string r1_filepath("../tests/datasets/workspace/pe/pe_R1.fastq");
+    std::string r2_filepath("../tests/datasets/workspace/pe/pe_R2.fastq");
+    std::string prds_output_path("pe_lazy.prseq");
+    PairedReadsDatastore::build_from_fastq(prds_output_path, r1_filepath, r2_filepath, prds_output_path);
+    {
+        WorkSpace out;
+        out.sdg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+        out.add_paired_reads_datastore(prds_output_path, "pe");
+        out.add_kmer_counter("kclazy", 31).add_count("pe", out.paired_reads_datastores[0]);
+        out.add_distance_graph(DistanceGraph(out.sdg), "dg");
+        out.add_operation("test", "test", "test");
+        out.dump_to_disk("lazy.sdgws");
+        REQUIRE(out.sections.size() == 5);
+        for (auto &s: out.sections) REQUIRE(s.offset % 64 == 0);
+    }
+    WorkSpace full("lazy.sdgws");
+    WorkSpace lazy("lazy.sdgws", true);
+    REQUIRE(lazy.journal == full.journal);
+    REQUIRE(lazy.sdg == full.sdg);
+    REQUIRE(lazy.list_paired_reads_datastores() == std::vector<std::string>{"pe"});
+    REQUIRE(lazy.list_kmer_counters() == std::vector<std::string>{"kclazy"});
+    REQUIRE_FALSE(lazy.is_loaded(&lazy.paired_reads_datastores[0]));
+    REQUIRE_FALSE(lazy.is_loaded(&lazy.kmer_counters[0]));
+    REQUIRE(lazy.ls().find("pe (not loaded)") != std::string::npos);
+
+    //dumping copies the sections not loaded yet
+    lazy.dump_to_disk("lazy_copy.sdgws");
+    REQUIRE_FALSE(lazy.is_loaded(&lazy.paired_reads_datastores[0]));
+
+    REQUIRE(lazy.get_kmer_counter("kclazy") == full.kmer_counters[0]);
+    REQUIRE(lazy.is_loaded(&lazy.kmer_counters[0]));
+    auto &ds = lazy.get_paired_reads_datastore("pe");
+    REQUIRE(ds.size() == full.paired_reads_datastores[0].size());
+    REQUIRE(ds.mapper.read_to_node == full.paired_reads_datastores[0].mapper.read_to_node);
+    REQUIRE(lazy.get_distance_graph("dg").name == "dg");
+
+    WorkSpace copy("lazy_copy.sdgws");
+    REQUIRE(copy.kmer_counters == full.kmer_counters);
+    REQUIRE(copy.paired_reads_datastores[0].name == "pe");
+    REQUIRE(copy.paired_reads_datastores[0].size() == full.paired_reads_datastores[0].size());
+
+    //a corrupted section is detected when it gets loaded
+    {
+        std::fstream f("lazy_copy.sdgws", std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(copy.sections[3].offset + 2);
+        f.put('X');
+    }
+    WorkSpace corrupted("lazy_copy.sdgws", true);
+    REQUIRE_THROWS(corrupted.get_paired_reads_datastore("pe"));
+
+    ::unlink("pe_lazy.prseq");
+    ::unlink("lazy.sdgws");
+    ::unlink("lazy_copy.sdgws");
+    ::unlink("kclazy.sdgkc");
+}
+
+TEST_CASE("Workspace checkpoints append changes and compact") {
+    {
+        WorkSpace out;
+        out.sdg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+        out.add_distance_graph(DistanceGraph(out.sdg), "dg");
+        out.dump_to_disk("checkpoint.sdgws");
+    }
+    auto size_of = [](const std::string &filename) {
+        std::ifstream f(filename, std::ios::binary | std::ios::ate);
+        return (uint64_t) f.tellg();
+    };
+    auto dumped_size = size_of("checkpoint.sdgws");
+
+    WorkSpace ws("checkpoint.sdgws", true);
+    //nothing changed, only the journal gets appended
+    ws.checkpoint("checkpoint.sdgws");
+    REQUIRE(ws.sections.size() == 3);
+    auto n2 = ws.sdg.add_node("ACGTACGTACGTACGTACGTACGTACGTACGTACGT");
+    auto n3 = ws.sdg.add_node("TTTTACGTACGTACGTACGTACGTACGTACGTACGTAAAA");
+    ws.sdg.add_link(1, n2, 10);
+    ws.sdg.add_link(-n2, n3, 10);
+    ws.sdg.remove_node(n3);
+    ws.add_distance_graph(DistanceGraph(ws.sdg), "dg2").add_link(-1, n2, 5);
+    ws.checkpoint("checkpoint.sdgws");
+    REQUIRE(size_of("checkpoint.sdgws") > dumped_size);
+    REQUIRE(ws.sections.size() == 5);
+    REQUIRE(ws.sections[3].type == WorkSpaceSectionType::GraphDelta);
+    REQUIRE(ws.journal.back().name == "Checkpoint");
+
+    WorkSpace reloaded("checkpoint.sdgws");
+    REQUIRE(reloaded.sdg == ws.sdg);
+    REQUIRE(reloaded.journal == ws.journal);
+    REQUIRE(reloaded.list_distance_graphs() == std::vector<std::string>{"dg", "dg2"});
+    REQUIRE(reloaded.get_distance_graph("dg2").links == ws.get_distance_graph("dg2").links);
+
+    //a distance graph that changes replaces its section
+    ws.get_distance_graph("dg").add_link(1, n2, 7);
+    ws.checkpoint("checkpoint.sdgws");
+    REQUIRE(ws.sections.size() == 5);
+    WorkSpace reloaded2("checkpoint.sdgws", true);
+    REQUIRE(reloaded2.get_distance_graph("dg").links == ws.get_distance_graph("dg").links);
+
+    ws.compact("checkpoint.sdgws");
+    for (const auto &s: ws.sections) REQUIRE(s.type != WorkSpaceSectionType::GraphDelta);
+    WorkSpace compacted("checkpoint.sdgws");
+    REQUIRE(compacted.sdg == ws.sdg);
+    REQUIRE(compacted.get_distance_graph("dg").links == ws.get_distance_graph("dg").links);
+    REQUIRE(compacted.get_distance_graph("dg2").links == ws.get_distance_graph("dg2").links);
+
+    ::unlink("checkpoint.sdgws");
+}
+
 TEST_CASE("Long reads datastore create, read, write") {
     {
         std::string lr_filepath("../tests/datasets/workspace/long_reads/long_reads.fastq");
@@ -77,6 +190,13 @@ TEST_CASE("Long reads datastore create, read, write") {
 
     REQUIRE(ds300 == read300);
 
+    //reads fetched concurrently through the mapping are the same as sequentially
+    std::vector<std::string> sequential_reads(ds.size()+1), concurrent_reads(ds.size()+1);
+    for (auto rid=1;rid<=ds.size();++rid) sequential_reads[rid]=bufferedSequenceGetter.get_read_sequence(rid);
+#pragma omp parallel for
+    for (auto rid=1;rid<=ds.size();++rid) concurrent_reads[rid]=ds.get_read_sequence(rid);
+    REQUIRE(sequential_reads == concurrent_reads);
+
     ::unlink("long_reads.loseq");
 }
 
@@ -178,6 +298,49 @@ TEST_CASE("PE reads datastore create, read, write") {
     ::unlink("pe.prseq");
 }
 
+TEST_CASE("PE reads datastore packed reads match the input") {
+    std::string r1_filepath("../tests/datasets/workspace/pe/pe_R1.fastq");
+    std::string r2_filepath("../tests/datasets/workspace/pe/pe_R2.fastq");
+    PairedReadsDatastore::build_from_fastq("pe_packed.prseq", r1_filepath, r2_filepath, "pe_packed", 0, 250);
+
+    WorkSpace ws;
+    PairedReadsDatastore ds(ws,"pe_packed.prseq");
+    REQUIRE(ds.packed);
+    ReadSequenceBuffer bufferedSequenceGetter(ds, 128*1024,ds.readsize*2+2);
+
+    //packed reads come back truncated to readsize, uppercase and with anything but ACGT as N
+    auto expected_sequence=[](std::string s){
+        if (s.size()>250) s.resize(250);
+        for (auto &c:s) {
+            c=toupper(c);
+            if (c!='A' and c!='C' and c!='G' and c!='T') c='N';
+        }
+        return s;
+    };
+    FastqReader<FastqRecord> r1({0}, r1_filepath), r2({0}, r2_filepath);
+    FastqRecord rec1, rec2;
+    uint64_t rid=1, mismatches=0, with_n=0;
+    std::vector<char> decode_buffer(ds.readsize+1);
+    while (r1.next_record(rec1) and r2.next_record(rec2)) {
+        auto e1=expected_sequence(rec1.seq);
+        auto e2=expected_sequence(rec2.seq);
+        if (e1.find('N')!=std::string::npos) ++with_n;
+        if (ds.get_read_sequence(rid)!=e1 or std::string(bufferedSequenceGetter.get_read_sequence(rid))!=e1) ++mismatches;
+        if (ds.get_read_sequence(rid+1)!=e2 or std::string(bufferedSequenceGetter.get_read_sequence(rid+1))!=e2) ++mismatches;
+        auto view=ds.get_read_view(rid+1,decode_buffer.data());
+        if (std::string(view.seq,view.size)!=e2 or view.seq[view.size]!='\0') ++mismatches;
+        rid+=2;
+    }
+    REQUIRE(rid-1==ds.size());
+    REQUIRE(with_n>0);
+    REQUIRE(mismatches==0);
+    REQUIRE(ds.get_read_sequence(-1)==sdglib::str_rc(ds.get_read_sequence(1)));
+    ::unlink("pe_packed.prseq");
+
+    //lengths past 15 bits would clash with the N runs flag
+    REQUIRE_THROWS(PairedReadsDatastore::build_from_fastq("pe_long.prseq", r1_filepath, r2_filepath, "pe_long", 0, 0x8000));
+}
+
 TEST_CASE("Fastq file reader") {
     FastqReader<FastqRecord> fastqReader({0}, "../tests/datasets/test.fastq");
     FastqRecord read;
@@ -206,6 +369,115 @@ TEST_CASE("Fasta file reader") {
     REQUIRE(num_reads==3);
 }
 
+TEST_CASE("Fastx chunk reader matches the record readers") {
+    //tiny chunks force records to be split across reads and carried to the next chunk
+    for (auto chunk_size: {50, 1000, 1<<22}) {
+        std::vector<std::string> expected, found;
+        FastqReader<FastqRecord> fastqReader({0}, "../tests/datasets/test.fastq");
+        FastqRecord read;
+        while (fastqReader.next_record(read)) expected.emplace_back(read.seq);
+        FastaReader<FastaRecord> fastaReader({0}, "../tests/datasets/test.fasta");
+        FastaRecord reada;
+        while (fastaReader.next_record(reada)) expected.emplace_back(reada.seq);
+
+        for (auto fastq: {true, false}) {
+            FastxChunkReader reader(fastq ? "../tests/datasets/test.fastq" : "../tests/datasets/test.fasta", fastq, chunk_size);
+            std::vector<char> chunk;
+            std::string seq;
+            while (reader.next_chunk(chunk)) {
+                uint64_t pos = 0;
+                while (reader.next_sequence(chunk, pos, seq)) found.emplace_back(seq);
+            }
+        }
+        REQUIRE(found.size() == 13);
+        REQUIRE(found == expected);
+    }
+
+    //blank lines between FASTQ records are skipped, empty reads are still records
+    {
+        std::ofstream f("blank_lines.fastq");
+        f << "@e\n\n+\n\n\n@r1\nACGT\n+\nIIII\n\n\n@r2\nGG\n+\nII\n@r3\nTTA\n+\nIII\n\n";
+    }
+    for (auto chunk_size: {5, 1000}) {
+        FastxChunkReader reader("blank_lines.fastq", true, chunk_size);
+        std::vector<char> chunk;
+        std::vector<std::string> found;
+        std::string seq;
+        uint64_t records = 0;
+        while (reader.next_chunk(chunk)) {
+            records += reader.count_records(chunk);
+            uint64_t pos = 0;
+            while (reader.next_sequence(chunk, pos, seq)) found.emplace_back(seq);
+        }
+        REQUIRE(records == 4);
+        REQUIRE(found == std::vector<std::string>({"", "ACGT", "GG", "TTA"}));
+    }
+    ::unlink("blank_lines.fastq");
+}
+
+TEST_CASE("Fastx pipeline parses blocks in parallel and consumes them in order") {
+    std::vector<std::string> expected;
+    FastqReader<FastqRecord> fastqReader({0}, "../tests/datasets/workspace/pe/pe_R1.fastq");
+    FastqRecord read;
+    while (fastqReader.next_record(read)) expected.emplace_back(read.seq);
+    //the same reads, gzipped
+    {
+        std::ifstream in("../tests/datasets/workspace/pe/pe_R1.fastq");
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        auto gz = gzopen("pipeline_R1.fastq.gz", "wb");
+        gzwrite(gz, content.data(), content.size());
+        gzclose(gz);
+    }
+
+    //and with blank lines between some records and at the end
+    {
+        std::ifstream in("../tests/datasets/workspace/pe/pe_R1.fastq");
+        std::ofstream out("pipeline_blank_R1.fastq");
+        std::string line;
+        for (uint64_t l = 1; std::getline(in, line); ++l) {
+            out << line << "\n";
+            if (l % 28 == 0) out << "\n";
+        }
+        out << "\n\n";
+    }
+
+    for (auto chunk_size: {100, 10000, 1<<22}) {
+        //a small queue makes the reader wait for blocks to be consumed
+        FastxPipeline pipeline({"pipeline_blank_R1.fastq", "pipeline_R1.fastq.gz"}, true, chunk_size, 2);
+        std::vector<std::string> found1, found2;
+        uint64_t next_block = 0;
+        pipeline.run<std::vector<std::string>>([](const FastxBlock &fb, std::vector<std::string> &seqs) {
+            seqs.resize(2 * fb.records);
+            uint64_t pos1 = 0, pos2 = 0;
+            for (uint64_t i = 0; i < fb.records; ++i) {
+                fb.next_record(0, pos1, nullptr, seqs[2 * i]);
+                fb.next_record(1, pos2, nullptr, seqs[2 * i + 1]);
+            }
+        }, [&](const FastxBlock &fb, std::vector<std::string> &seqs) {
+            REQUIRE(fb.index == next_block++);
+            for (uint64_t i = 0; i < seqs.size(); i += 2) {
+                found1.emplace_back(seqs[i]);
+                found2.emplace_back(seqs[i + 1]);
+            }
+        });
+        REQUIRE(found1 == expected);
+        REQUIRE(found2 == expected);
+    }
+
+    //files read together must have the same number of records
+    FastxPipeline mismatched({"../tests/datasets/workspace/pe/pe_R1.fastq", "../tests/datasets/test.fastq"}, true, 1000);
+    REQUIRE_THROWS(mismatched.run<int>([](const FastxBlock &, int &) {}, [](const FastxBlock &, int &) {}));
+    //and errors while parsing stop the pipeline
+    FastxPipeline fasta_as_fastq({"../tests/datasets/test.fasta"}, true, 1000);
+    REQUIRE_THROWS(fasta_as_fastq.run<int>([](const FastxBlock &fb, int &) {
+        std::string seq;
+        uint64_t pos = 0;
+        while (fb.next_record(0, pos, nullptr, seq));
+    }, [](const FastxBlock &, int &) {}));
+    ::unlink("pipeline_R1.fastq.gz");
+    ::unlink("pipeline_blank_R1.fastq");
+}
+
 TEST_CASE("Load GFA") {
     sdglib::OutputLogLevel = sdglib::DEBUG;
     WorkSpace ws;
@@ -220,4 +492,211 @@ TEST_CASE("Load GFA2") {
     SequenceDistanceGraph sg(ws);
     sg.load_from_gfa("../tests/datasets/graph/test_gfa2.gfa");
     REQUIRE(sg.nodes.size() > 1);
-}
\ No newline at end of file
+}
+TEST_CASE("DistanceGraphCSR freeze and thaw") {
+    WorkSpace ws;
+    SequenceDistanceGraph sg(ws);
+    for (auto i = 0; i < 6; ++i) sg.add_node(std::string(100 + i, "ACGT"[i % 4]), NodeStatus::Active);
+    sg.add_link(-1, 2, 150, Support(SupportType::PairedRead, 3, 42));
+    sg.add_link(-2, 3, 0);
+    sg.add_link(-3, 4, -10);
+    sg.add_link(4, 5, 20);
+    sg.add_link(-5, 5, 20);
+    sg.add_link(6, 6, 20);
+    DistanceGraphCSR csr(sg);
+    DistanceGraph thawed(sg, "thawed");
+    csr.thaw(thawed);
+
+    uint64_t total_links = 0;
+    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
+        for (auto end: {n, -n}) {
+            auto fwl = sg.get_fw_links(end);
+            auto span = csr.get_fw_links(end);
+            REQUIRE(span.size() == fwl.size());
+            for (uint64_t i = 0; i < fwl.size(); ++i) {
+                auto l = csr.get_link(end, span[i]);
+                REQUIRE(std::tie(l.source, l.dest, l.dist) == std::tie(fwl[i].source, fwl[i].dest, fwl[i].dist));
+                REQUIRE(l.support == fwl[i].support);
+            }
+            total_links += fwl.size();
+            auto tfwl = thawed.get_fw_links(end);
+            REQUIRE(tfwl.size() == fwl.size());
+            for (uint64_t i = 0; i < fwl.size(); ++i) REQUIRE(tfwl[i].dest == fwl[i].dest);
+        }
+    }
+    REQUIRE(total_links > 0);
+    REQUIRE(csr.get_fw_links(sg.nodes.size() + 10).empty());
+    REQUIRE(csr.get_all_lines(1) == thawed.get_all_lines(1));
+    auto paths = csr.find_all_paths_between(1, 4, 1000000, 20, false);
+    REQUIRE(paths.size() == 1);
+    REQUIRE(paths[0].nodes == sg.find_all_paths_between(1, 4, 1000000, 20, false)[0].nodes);
+}
+
+TEST_CASE("PackedNodeSequences round trip and persistence") {
+    std::mt19937_64 rng(11);
+    const std::string alphabet = "ACGTACGTACGTACGTacgtNNR";
+    std::vector<std::string> sequences;
+    sequences.emplace_back("");
+    for (auto len: {1, 3, 4, 5, 17, 64, 300, 1001}) {
+        std::string seq;
+        while (seq.size() < len) seq.append(1 + rng() % 7, alphabet[rng() % alphabet.size()]);
+        seq.resize(len);
+        sequences.emplace_back(seq);
+    }
+    PackedNodeSequences packed(sequences);
+    REQUIRE(packed.size() == sequences.size());
+    for (sgNodeID_t n = 0; n < sequences.size(); ++n) {
+        REQUIRE(packed.node_size(n) == sequences[n].size());
+        REQUIRE(packed.sequence(n) == sequences[n]);
+    }
+
+    {
+        std::ofstream ofs("packed_nodes.bin", std::ios_base::binary);
+        ofs.write("x", 1);
+        packed.write(ofs);
+    }
+    PackedNodeSequences loaded, mapped;
+    std::ifstream ifs("packed_nodes.bin", std::ios_base::binary);
+    ifs.seekg(1);
+    loaded.read(ifs);
+    ifs.seekg(1);
+    mapped.read_mapped(ifs, std::make_shared<sdglib::MemoryMappedFile>("packed_nodes.bin"));
+    for (sgNodeID_t n = 1; n < sequences.size(); ++n) {
+        REQUIRE(loaded.sequence(n) == sequences[n]);
+        REQUIRE(mapped.sequence(n) == sequences[n]);
+        REQUIRE(mapped.hash(n) == packed.hash(n));
+    }
+    //a mapped arena is copied to memory when modified
+    mapped.set(3, "ACGTN");
+    mapped.add("ttGCA");
+    REQUIRE(mapped.sequence(3) == "ACGTN");
+    REQUIRE(mapped.sequence(sequences.size()) == "ttGCA");
+    REQUIRE(mapped.sequence(4) == sequences[4]);
+    ::unlink("packed_nodes.bin");
+}
+
+TEST_CASE("PackedNodeSequences reads bases, windows and k-mers in place") {
+    std::mt19937_64 rng(13);
+    const std::string alphabet = "ACGTACGTACGTACGTacgtNN";
+    auto rc = [](std::string s) {
+        std::reverse(s.begin(), s.end());
+        for (auto &b: s) b = PackedNodeSequences::complement(b);
+        return s;
+    };
+    std::vector<std::string> sequences{""};
+    PackedNodeSequences packed;
+    packed.add("");
+    for (auto i = 0; i < 200; ++i) {
+        std::string seq;
+        auto len = 1 + rng() % 400;
+        while (seq.size() < len) seq.append(1 + rng() % (i % 2 ? 3 : 40), alphabet[rng() % alphabet.size()]);
+        seq.resize(len);
+        sequences.emplace_back(seq);
+        packed.add(seq);
+    }
+    //replaced sequences are packed at the end, and the arena is compacted as they pile up
+    for (auto i = 0; i < 5000; ++i) {
+        auto n = 1 + rng() % (sequences.size() - 1);
+        std::string seq(1 + rng() % 1000, 'A');
+        for (auto &b: seq) b = alphabet[rng() % alphabet.size()];
+        sequences[n] = seq;
+        packed.set(n, seq);
+    }
+    packed.resize(sequences.size() + 2);
+    sequences.resize(sequences.size() + 2);
+    REQUIRE(packed == PackedNodeSequences(sequences));
+
+    StringKMerFactory skf(15);
+    StringKMerFactoryNC skfnc(15);
+    kmerPosFactory kpf(15);
+    FastaRecord r;
+    for (sgNodeID_t n = 1; n < sequences.size(); ++n) {
+        auto &fw = sequences[n];
+        auto bw = rc(fw);
+        REQUIRE(packed.sequence(n) == fw);
+        REQUIRE(packed.sequence(-n) == bw);
+        for (uint64_t p = 0; p < fw.size(); p += 7) {
+            REQUIRE(packed.base(n, p) == fw[p]);
+            REQUIRE(packed.base(-n, p) == bw[p]);
+        }
+        if (fw.size() > 20) {
+            char w[20];
+            packed.window(n, 3, 20, w);
+            REQUIRE(std::string(w, 20) == fw.substr(3, 20));
+            packed.window(-n, fw.size() - 20, 20, w);
+            REQUIRE(std::string(w, 20) == bw.substr(fw.size() - 20, 20));
+        }
+        REQUIRE(packed.hash(n) == PackedNodeSequences(std::vector<std::string>{fw}).hash(0));
+
+        //k-mers rolled from the packed sequence are the ones the factories produce from the string
+        std::vector<std::pair<bool, uint64_t>> skmers, pkmers;
+        skf.create_kmers(fw, skmers);
+        skf.create_kmers(packed, n, pkmers);
+        REQUIRE(skmers == pkmers);
+        std::vector<uint64_t> snc, pnc;
+        skfnc.create_kmers(fw, snc);
+        skfnc.create_kmers(packed, n, pnc);
+        REQUIRE(snc == pnc);
+        std::vector<std::pair<uint64_t, graphStrandPos>> sposk, pposk;
+        r.id = n;
+        r.seq = fw;
+        kpf.setFileRecord(r);
+        kpf.next_element(sposk);
+        kpf.node_kmers(packed, n, pposk);
+        REQUIRE(sposk == pposk);
+    }
+}
+
+TEST_CASE("Linked reads are looked up and kmerised by tag through the tag index") {
+    LinkedReadsDatastore::build_from_fastq("tags.lseq", "tags.lseq", "../tests/datasets/workspace/10x/10x_R1.fastq",
+                                           "../tests/datasets/workspace/10x/10x_R2.fastq", LinkedReadsFormat::raw);
+    WorkSpace ws;
+    ws.linked_reads_datastores.emplace_back(ws, "tags.lseq");
+    auto &ds = ws.linked_reads_datastores.back();
+
+    std::map<LinkedTag, std::vector<uint64_t>> tag_reads;
+    for (uint64_t rid = 1; rid <= ds.size(); ++rid) tag_reads[ds.get_read_tag(rid)].emplace_back(rid);
+    REQUIRE(tag_reads.size() > 10);
+    for (const auto &tr: tag_reads) {
+        REQUIRE(ds.get_tag_reads(tr.first) == tr.second);
+        REQUIRE(ds.get_tag_read_range(tr.first).size() == tr.second.size());
+        //neighbouring tags that are not in the datastore
+        if (tag_reads.count(tr.first + 1) == 0) REQUIRE(ds.get_tag_read_range(tr.first + 1).empty());
+    }
+
+    std::vector<std::set<LinkedTag>> tag_sets(3);
+    uint64_t i = 0;
+    for (const auto &tr: tag_reads) {
+        if (tr.first == 0) continue;
+        tag_sets[i % 3].insert(tr.first);
+        if (i % 2) tag_sets[(i + 1) % 3].insert(tr.first);
+        ++i;
+    }
+    tag_sets.emplace_back();
+    auto kmer_sets = ds.get_tag_sets_kmers(31, 2, tag_sets);
+    REQUIRE(kmer_sets.size() == tag_sets.size());
+    ReadSequenceBuffer blrsg(ds);
+    for (uint64_t s = 0; s < tag_sets.size(); ++s) REQUIRE(kmer_sets[s] == ds.get_tags_kmers(31, 2, tag_sets[s], blrsg));
+    REQUIRE(not kmer_sets[0].empty());
+    REQUIRE(kmer_sets.back().empty());
+    //batches of a single set, or a few, give the same k-mers
+    REQUIRE(ds.get_tag_sets_kmers(31, 2, tag_sets, 1) == kmer_sets);
+    REQUIRE(ds.get_tag_sets_kmers(31, 2, tag_sets, ds.size() / 4) == kmer_sets);
+
+    //a selection is written with its own tag index
+    {
+        std::ofstream sel("tags_sel.lseq");
+        ds.write_selection(sel, tag_sets[0]);
+    }
+    LinkedReadsDatastore sel(ws, "tags_sel.lseq");
+    REQUIRE(sel.size() > 0);
+    for (auto t: tag_sets[0]) {
+        auto reads = sel.get_tag_reads(t);
+        REQUIRE(reads.size() == tag_reads[t].size());
+        for (uint64_t r = 0; r < reads.size(); ++r)
+            REQUIRE(sel.get_read_sequence(reads[r]) == ds.get_read_sequence(tag_reads[t][r]));
+    }
+    REQUIRE(sel.get_tag_reads(*tag_sets[1].begin()).size() == (tag_sets[0].count(*tag_sets[1].begin()) ? tag_reads[*tag_sets[1].begin()].size() : 0));
+    ::unlink("tags.lseq");
+    ::unlink("tags_sel.lseq");
+}
@@ -5,7 +5,10 @@
 #include <catch.hpp>
 #include <sdglib/indexers/UniqueKmerIndex.hpp>
 #include <sdglib/indexers/NKmerIndex.hpp>
+#include <sdglib/indexers/IndexCache.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
+#include <random>
+#include <chrono>
 
 TEST_CASE("UniqueKmerIndex create and lookup") {
     unsigned int K(15);
@@ -48,6 +51,47 @@ TEST_CASE("UniqueKmerIndex63 create and lookup") {
     REQUIRE(ukm.find(readkmers[0].kmer) != ukm.end()); // FINDS PRESENT KMERS
 }
 
+TEST_CASE("UniqueKmerIndex write and load") {
+    WorkSpace ws;
+    SequenceDistanceGraph sg(ws);
+    sg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+    UniqueKmerIndex ukm(sg, 31);
+    Unique63merIndex u63m(sg);
+    ukm.write("ukindex.idx");
+    u63m.write("u63index.idx");
+
+    for (auto mapped: {false, true}) {
+        UniqueKmerIndex loaded("ukindex.idx", mapped);
+        Unique63merIndex loaded63("u63index.idx", mapped);
+        REQUIRE(loaded.get_k() == 31);
+        REQUIRE(loaded.getMap().size() == ukm.getMap().size());
+        REQUIRE(loaded63.getMap().size() == u63m.getMap().size());
+
+        StreamKmerIDXFactory skf(31);
+        StreamKmerIDXFactory128 skf63(63);
+        uint64_t mismatches = 0, found = 0;
+        for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) {
+            std::vector<KmerIDX> kmers;
+            std::vector<KmerIDX128> kmers63;
+            skf.produce_all_kmers(sg.get_node_sequence(n).c_str(), kmers);
+            skf63.produce_all_kmers(sg.get_node_sequence(n).c_str(), kmers63);
+            for (const auto &km: kmers) {
+                auto a = ukm.find(km.kmer);
+                auto b = loaded.find(km.kmer);
+                if ((a == ukm.end()) != (b == loaded.end()) or (b != loaded.end() and not (a->second == b->second))) ++mismatches;
+                if (b != loaded.end()) ++found;
+            }
+            for (const auto &km: kmers63) {
+                auto a = u63m.find(km.kmer);
+                auto b = loaded63.find(km.kmer);
+                if ((a == u63m.end()) != (b == loaded63.end()) or (b != loaded63.end() and not (a->second == b->second))) ++mismatches;
+            }
+        }
+        REQUIRE(mismatches == 0);
+        REQUIRE(found == ukm.getMap().size());
+    }
+}
+
 TEST_CASE("NKmerIndex create and lookup") {
     const uint8_t k = 15;
 
@@ -90,4 +134,165 @@ TEST_CASE("SatKmerIndex create and lookup") {
     readkmers.clear();
     skf.produce_all_kmers(seqPresent.data(),readkmers);
     REQUIRE(assembly_kmers.beginCO(readkmers[0]) < assembly_kmers.endCO(readkmers[0])); // FINDS PRESENT KMERS
-}
\ No newline at end of file
+}
+
+TEST_CASE("SatKmerIndex with large k matches NKmerIndex") {
+    const uint8_t k = 21;
+
+    WorkSpace ws;
+    SequenceDistanceGraph sg(ws);
+    sg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+    SatKmerIndex sat(sg, k);
+    NKmerIndex nki(sg, k);
+
+    StreamKmerFactory skf(k);
+    std::vector<std::pair<bool, uint64_t>> kmers;
+    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) skf.produce_all_kmers(sg.get_node_sequence(n).c_str(), kmers);
+    for (uint64_t i = 0; i < 10000; ++i) kmers.emplace_back(true, (i * 2654435761ULL) & ((1ULL << (2 * k)) - 1));
+
+    uint64_t mismatches = 0, found = 0;
+    for (const auto &km: kmers) {
+        auto nit = nki.find(km.second);
+        for (auto i = sat.beginCO(km.second); i < sat.endCO(km.second); ++i, ++nit) {
+            if (nit == nki.end() or nit->kmer != km.second or nit->contigID != sat.contig_offsets[i].contigID or
+                nit->offset != sat.contig_offsets[i].offset) ++mismatches;
+            ++found;
+        }
+        if (nit != nki.end() and nit->kmer == km.second) ++mismatches; // SAME NUMBER OF POSITIONS
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(found > 0);
+
+    sat.write("satkmerindex_k21.idx");
+    SatKmerIndex loaded("satkmerindex_k21.idx");
+    for (uint64_t i = 0; i < kmers.size(); i += 101) {
+        REQUIRE(loaded.beginCO(kmers[i].second) == sat.beginCO(kmers[i].second));
+        REQUIRE(loaded.endCO(kmers[i].second) == sat.endCO(kmers[i].second));
+    }
+}
+TEST_CASE("BloomFilter no false negatives and bounded false positives") {
+    const uint64_t n = 100000;
+    BloomFilter bf(n, 0.01);
+
+    std::vector<std::pair<bool, uint64_t>> present, absent;
+    for (uint64_t i = 0; i < n; ++i) {
+        present.emplace_back(true, i * 2654435761ULL);
+        absent.emplace_back(true, i * 2654435761ULL + 1);
+    }
+#pragma omp parallel for
+    for (uint64_t i = 0; i < n; ++i) bf.add(present[i].second);
+
+    std::vector<bool> in_filter;
+    bf.contains(present, in_filter);
+    REQUIRE(std::count(in_filter.begin(), in_filter.end(), true) == n); // NO FALSE NEGATIVES
+    for (uint64_t i = 0; i < n; i += 997) REQUIRE(bf.contains(present[i].second));
+
+    bf.contains(absent, in_filter);
+    REQUIRE(std::count(in_filter.begin(), in_filter.end(), true) < n * 0.02); // FP RATE CLOSE TO TARGET
+
+    __uint128_t big_kmer = ((__uint128_t) 12345 << 64) + 678;
+    bf.add(big_kmer);
+    REQUIRE(bf.contains(big_kmer));
+}
+
+TEST_CASE("NKmerIndex prefix buckets match binary search") {
+    const uint8_t k = 15;
+
+    WorkSpace ws;
+    SequenceDistanceGraph sg(ws);
+    sg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+    NKmerIndex plain(sg, k);
+    NKmerIndex bucketed(sg, k, 200, 0.01, true);
+    REQUIRE(plain.get_prefix_bases() == 0);
+    REQUIRE(bucketed.get_prefix_bases() > 0);
+
+    StreamKmerFactory skf(k);
+    std::vector<std::pair<bool, uint64_t>> kmers;
+    for (sgNodeID_t n = 1; n < sg.nodes.size(); ++n) skf.produce_all_kmers(sg.get_node_sequence(n).c_str(), kmers);
+    for (uint64_t i = 0; i < 10000; ++i) kmers.emplace_back(true, (i * 2654435761ULL) & ((1ULL << (2 * k)) - 1));
+
+    uint64_t mismatches = 0, found = 0;
+    for (const auto &km: kmers) {
+        auto pit = plain.find(km.second);
+        auto bit = bucketed.find(km.second);
+        if (pit - plain.begin() != bit - bucketed.begin()) ++mismatches;
+        if (bit != bucketed.end() and bit->kmer == km.second) ++found;
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(found > 0);
+}
+
+TEST_CASE("NKmerIndex lookup latency benchmark", "[.][benchmark]") {
+    //Graph size can be set with SDG_BENCH_GRAPH_BP, i.e. SDG_BENCH_GRAPH_BP=1000000000 for a 1Gbp graph
+    uint64_t graph_bp = 10000000;
+    if (getenv("SDG_BENCH_GRAPH_BP")) graph_bp = std::stoull(getenv("SDG_BENCH_GRAPH_BP"));
+    const uint8_t k = 15;
+    const uint64_t node_size = 100000, queries = 10000000;
+
+    WorkSpace ws;
+    SequenceDistanceGraph sg(ws);
+    std::mt19937_64 rng(42);
+    std::string seq(node_size, 'A');
+    for (uint64_t bp = 0; bp < graph_bp; bp += node_size) {
+        for (auto &c: seq) c = "ACGT"[rng() % 4];
+        sg.add_node(seq);
+    }
+
+    std::vector<uint64_t> query_kmers;
+    query_kmers.reserve(queries);
+    StreamKmerFactory skf(k);
+    std::vector<std::pair<bool, uint64_t>> node_kmers;
+    while (query_kmers.size() < queries) {
+        node_kmers.clear();
+        skf.produce_all_kmers(sg.get_node_sequence(1 + rng() % (sg.nodes.size() - 1)).c_str(), node_kmers);
+        for (auto i = 0; i < 1000; ++i) query_kmers.push_back(node_kmers[rng() % node_kmers.size()].second);
+    }
+
+    for (auto buckets: {false, true}) {
+        NKmerIndex nki(sg, k, 200, 0.01, buckets);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t hits = 0;
+        for (const auto &km: query_kmers) {
+            auto it = nki.find(km);
+            if (it != nki.end() and it->kmer == km) ++hits;
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << graph_bp << "bp graph, " << (buckets ? "prefix buckets (" + std::to_string(nki.get_prefix_bases()) + " bases)" : "binary search")
+                  << ": " << double(ns) / query_kmers.size() << " ns/lookup, " << hits << " hits" << std::endl;
+    }
+}
+
+TEST_CASE("NKmerIndex load_or_build uses the workspace index cache") {
+    WorkSpace ws;
+    ws.sdg.load_from_gfa("../tests/datasets/graph/tgraph.gfa");
+    ws.index_cache_dir = "nkindex_cache";
+
+    auto built = NKmerIndex::load_or_build(ws.sdg, 15, 200, 0.01, true);
+    auto cached_filename = sdglib::index_cache_path(ws.sdg, "nkmerindex_k15_f200_fp100_pb.idx");
+    REQUIRE(std::ifstream(cached_filename).good());
+
+    auto loaded = NKmerIndex::load_or_build(ws.sdg, 15, 200, 0.01, true);
+    REQUIRE(loaded->get_graph_hash() == built->get_graph_hash());
+    REQUIRE(loaded->get_prefix_bases() == built->get_prefix_bases());
+    REQUIRE(loaded->end() - loaded->begin() == built->end() - built->begin());
+    REQUIRE(std::equal(built->begin(), built->end(), loaded->begin()));
+    uint64_t mismatches = 0;
+    for (auto it = built->begin(); it != built->end(); ++it) {
+        if (loaded->find(it->kmer) - loaded->begin() != built->find(it->kmer) - built->begin()) ++mismatches;
+    }
+    REQUIRE(mismatches == 0);
+
+    //Changing the graph makes the cached index stale, so it gets rebuilt
+    ws.sdg.add_node("CTTGCGGGTTTCCAGGAACTGGCTGTCCTCGGCGTTCAGCG");
+    auto rebuilt = NKmerIndex::load_or_build(ws.sdg, 15, 200, 0.01, true);
+    REQUIRE(rebuilt->get_graph_hash() == ws.sdg.content_hash());
+    REQUIRE(rebuilt->get_graph_hash() != built->get_graph_hash());
+    REQUIRE(NKmerIndex(ws.sdg, cached_filename).get_graph_hash() == ws.sdg.content_hash());
+
+    //An index cache that can't be written to only loses the cache
+    { std::ofstream("nkindex_not_a_dir"); }
+    ws.index_cache_dir = "nkindex_not_a_dir";
+    auto uncached = NKmerIndex::load_or_build(ws.sdg, 15, 200, 0.01, true);
+    REQUIRE(uncached->get_graph_hash() == ws.sdg.content_hash());
+    ::unlink("nkindex_not_a_dir");
+}
@@ -4,6 +4,8 @@
 
 #include <catch.hpp>
 #include <sdglib/factories/KMerIDXFactory.hpp>
+#include <sdglib/factories/KMerFactory.hpp>
+#include <random>
 
 TEST_CASE("StreamKmerIDXFactory generates all kmers") {
     unsigned int K(15);
@@ -14,4 +16,81 @@ TEST_CASE("StreamKmerIDXFactory generates all kmers") {
     skf.produce_all_kmers(sequence.data(), kmers);
 
     REQUIRE(kmers.size() == sequence.size()-K+1);
-}
\ No newline at end of file
+}
+//Per-base reference, as the factories produced k-mers before the bulk encoding
+class ReferenceKmerFactory : public KMerFactory {
+public:
+    explicit ReferenceKmerFactory(uint8_t k) : KMerFactory(k) {}
+    void produce_all_kmers(const char * s, std::vector<std::pair<bool, uint64_t>> &mers) {
+        last_unknown=0;
+        fkmer=0;
+        rkmer=0;
+        for (; *s!='\0' and *s!='\n'; ++s) {
+            fillKBuf(*s, fkmer, rkmer, last_unknown);
+            if (last_unknown >= K) {
+                if (fkmer <= rkmer) mers.emplace_back(true,fkmer);
+                else mers.emplace_back(false,rkmer);
+            }
+        }
+    }
+};
+
+class ReferenceKmerFactory128 : public KMerFactory128 {
+public:
+    explicit ReferenceKmerFactory128(uint8_t k) : KMerFactory128(k) {}
+    void produce_all_kmers(const char * s, std::vector<std::pair<bool, __uint128_t>> &mers) {
+        last_unknown=0;
+        fkmer=0;
+        rkmer=0;
+        for (; *s!='\0' and *s!='\n'; ++s) {
+            fillKBuf(*s, fkmer, rkmer, last_unknown);
+            if (last_unknown >= K) {
+                if (fkmer <= rkmer) mers.emplace_back(true,fkmer);
+                else mers.emplace_back(false,rkmer);
+            }
+        }
+    }
+};
+
+TEST_CASE("Bulk k-mer production matches per-base rolling") {
+    std::vector<char> all_bytes;
+    for (int c = 1; c < 256; ++c) all_bytes.push_back(c);
+    std::vector<uint8_t> codes(all_bytes.size());
+    sdglib::encode_2bit(all_bytes.data(), all_bytes.size(), codes.data());
+    for (size_t i = 0; i < all_bytes.size(); ++i) REQUIRE(codes[i] == sdglib::base_to_2bit(all_bytes[i]));
+
+    std::mt19937_64 rng(7);
+    const std::string alphabet = "ACGTACGTACGTacgtNnX";
+    std::vector<std::string> sequences;
+    for (auto len: {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 150, 1000}) {
+        std::string seq;
+        for (int i = 0; i < len; ++i) seq.push_back(alphabet[rng() % alphabet.size()]);
+        sequences.push_back(seq);
+        for (auto &c: seq) if (c == 'N' or c == 'n' or c == 'X') c = 'A';
+        sequences.push_back(seq);
+    }
+
+    for (uint8_t k: {5, 15, 31}) {
+        StreamKmerFactory skf(k);
+        StringKMerFactory stringkf(k);
+        ReferenceKmerFactory ref(k);
+        for (const auto &seq: sequences) {
+            std::vector<std::pair<bool, uint64_t>> expected, streamed, stringed;
+            ref.produce_all_kmers(seq.c_str(), expected);
+            skf.produce_all_kmers((seq + "\nACGT").c_str(), streamed);
+            stringkf.create_kmers(seq, stringed);
+            REQUIRE(streamed == expected);
+            REQUIRE(stringed == expected);
+        }
+    }
+    for (uint8_t k: {31, 63}) {
+        StreamKmerFactory128 skf(k);
+        ReferenceKmerFactory128 ref(k);
+        for (const auto &seq: sequences) {
+            std::vector<std::pair<bool, __uint128_t>> expected, streamed;
+            ref.produce_all_kmers(seq.c_str(), expected);
+            skf.produce_all_kmers(seq.c_str(), streamed);
+            REQUIRE(streamed == expected);
+        }
+    }
+}
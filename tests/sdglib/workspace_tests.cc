@@ -4,6 +4,15 @@
 
 #include <catch.hpp>
 #include <sdglib/workspace/WorkSpace.hpp>
+#include <sdglib/readers/FileReader.hpp>
+#include <sdglib/processors/GraphMaker.hpp>
+#include <sdglib/mappers/LongReadsRecruiter.hpp>
+#include <sdglib/utilities/Metrics.hpp>
+#include <sdglib/utilities/WorkPartition.hpp>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <sys/stat.h>
 
 TEST_CASE("Test log/journal"){
     WorkSpace ws;
@@ -17,4 +26,506 @@ TEST_CASE("Test log/journal"){
     REQUIRE(ws2.journal == ws.journal);
 
     ::unlink("journal_test.ws");
-}
\ No newline at end of file
+}
+TEST_CASE("KmerCounter counts reads without locks, with wide counts past 16 bits") {
+    WorkSpace ws;
+    FastaReader<FastaRecord> fastaReader({0}, "../tests/datasets/test.fasta");
+    FastaRecord contig;
+    while (fastaReader.next_record(contig)) ws.sdg.add_node(contig.seq, NodeStatus::Active);
+    auto &kc = ws.add_kmer_counter("kc", 31);
+
+    //count the reads directly against the index
+    kc.add_count("reads", {"../tests/datasets/test.fastq"});
+    std::vector<uint16_t> expected(kc.kindex.size());
+    FastqReader<FastqRecord> fastqReader({0}, "../tests/datasets/test.fastq");
+    FastqRecord read;
+    std::vector<uint64_t> rkmers;
+    StringKMerFactory skf(31);
+    while (fastqReader.next_record(read)) {
+        rkmers.clear();
+        skf.create_kmers(read.seq, rkmers);
+        for (auto &kmer: rkmers) {
+            auto it = std::lower_bound(kc.kindex.begin(), kc.kindex.end(), kmer);
+            if (it != kc.kindex.end() and *it == kmer) ++expected[it - kc.kindex.begin()];
+        }
+    }
+    REQUIRE(kc.get_count_by_name("reads") == expected);
+
+    //a 40bp read repeated 70000 times: 10 k-mers over the 16-bit limit
+    auto repeat = ws.sdg.get_node_sequence(1).substr(0, 40);
+    {
+        std::ofstream rf("kc_repeat.fastq");
+        for (auto i = 0; i < 70000; ++i) rf << "@r" << i << "\n" << repeat << "\n+\n" << std::string(40, '#') << "\n";
+    }
+    kc.add_count("narrow", {"kc_repeat.fastq"});
+    kc.add_count("wide", {"kc_repeat.fastq"}, true, true);
+    rkmers.clear();
+    skf.create_kmers(repeat, rkmers);
+    REQUIRE(rkmers.size() == 10);
+    for (auto &kmer: rkmers) {
+        auto kidx = kc.find_kmer(kmer);
+        REQUIRE(kidx != -1);
+        REQUIRE(kc.get_count(2, kidx) == UINT16_MAX);
+        REQUIRE(kc.counts[3][kidx] == UINT16_MAX);
+        REQUIRE(kc.get_count(3, kidx) == 70000);
+    }
+    REQUIRE(kc.find_kmer(0) == -1);
+    //projections and spectra read the wide counts too
+    REQUIRE(kc.project_count("wide", repeat) == std::vector<uint32_t>(10, 70000));
+    REQUIRE(kc.project_count("narrow", repeat) == std::vector<uint32_t>(10, UINT16_MAX));
+    kc.compute_node_summaries(true);
+    auto node_wide = kc.project_node_count("wide", 1);
+    REQUIRE(std::vector<uint32_t>(node_wide.begin(), node_wide.begin() + 10) == std::vector<uint32_t>(10, 70000));
+    REQUIRE(kc.count_spectra("wide", 100000)[70000] == 10);
+    REQUIRE(kc.count_spectra("narrow", 100000)[UINT16_MAX] == 10);
+
+    {
+        std::ofstream cf("kc_wide.sdgkc");
+        kc.write_counts(cf);
+    }
+    KmerCounter kc2(ws, "kc_wide.sdgkc");
+    REQUIRE(kc2 == kc);
+    REQUIRE(kc2.get_count(3, kc2.find_kmer(rkmers[0])) == 70000);
+}
+
+TEST_CASE("KmerCounter node summaries give the same KCIs and projections as lookups") {
+    WorkSpace ws;
+    FastaReader<FastaRecord> fastaReader({0}, "../tests/datasets/test.fasta");
+    FastaRecord contig;
+    while (fastaReader.next_record(contig)) ws.sdg.add_node(contig.seq, NodeStatus::Active);
+    auto &kc = ws.add_kmer_counter("kc", 31);
+    kc.add_count("reads", {"../tests/datasets/test.fastq"});
+    kc.set_kci_peak(2);
+    std::vector<float> kcis;
+    for (sgNodeID_t n = 1; n < ws.sdg.nodes.size(); ++n) kcis.emplace_back(kc.kci(n));
+
+    kc.compute_node_summaries(true);
+    REQUIRE(kc.has_node_summaries());
+    for (sgNodeID_t n = 1; n < ws.sdg.nodes.size(); ++n) {
+        REQUIRE(kc.kci(n) == kcis[n - 1]);
+        REQUIRE(kc.kci(-n) == kcis[n - 1]);
+        auto fw = kc.project_count("reads", ws.sdg.get_node_sequence(n));
+        auto bw = kc.project_count("reads", ws.sdg.get_node_sequence(-n));
+        REQUIRE(kc.project_node_count("reads", n) == fw);
+        REQUIRE(kc.project_node_count("reads", -n) == bw);
+        auto &ns = kc.node_summary(1, n);
+        REQUIRE(ns.kmers == fw.size());
+        REQUIRE(ns.q25 <= ns.median);
+        REQUIRE(ns.median <= ns.q75);
+    }
+    REQUIRE_THROWS(kc.node_summary(2, 1));
+
+    //summaries are stored with the counts
+    {
+        std::ofstream cf("kc_summaries.sdgkc");
+        kc.write_counts(cf);
+    }
+    KmerCounter kc2(ws, "kc_summaries.sdgkc");
+    kc2.set_kci_peak(2);
+    for (sgNodeID_t n = 1; n < ws.sdg.nodes.size(); ++n) {
+        REQUIRE(kc2.node_summary(1, n) == kc.node_summary(1, n));
+        REQUIRE(kc2.project_node_count("reads", -n) == kc.project_node_count("reads", -n));
+    }
+    kc.update_graph_counts();
+    REQUIRE_FALSE(kc.has_node_summaries());
+    ::unlink("kc_summaries.sdgkc");
+}
+
+TEST_CASE("KmerCounter index is updated incrementally after graph changes") {
+    LongReadsDatastore::build_from_fastq("kc_update.loseq", "kc_update.loseq", "../tests/datasets/workspace/long_reads/long_reads.fastq");
+    WorkSpace ws;
+    LongReadsDatastore ds(ws, "kc_update.loseq");
+    ReadSequenceBuffer rsb(ds);
+    std::vector<std::string> reads;
+    for (auto rid = 1; rid <= 4; ++rid) reads.emplace_back(rsb.get_read_sequence(rid));
+    for (auto i = 0; i < 3; ++i) ws.sdg.add_node(reads[i].substr(100, 2000), NodeStatus::Active);
+    auto &kc = ws.add_kmer_counter("kc", 31);
+    kc.add_count("lr", ds);
+    REQUIRE(kc.update_index() == 0);
+    //summaries without a track keep the one update_index() needs
+    REQUIRE(kc.has_coverage_track());
+    kc.compute_node_summaries();
+    REQUIRE(kc.has_node_summaries());
+    REQUIRE(kc.has_coverage_track());
+
+    //copies keep the read counts
+    KmerCounter copy(ws);
+    copy = kc;
+    REQUIRE(copy == kc);
+
+    //a new node, a deleted node and a changed node
+    auto lr_before = kc.get_count_by_name("lr");
+    auto kindex_before = kc.kindex;
+    ws.sdg.add_node(reads[3].substr(500, 1500), NodeStatus::Active);
+    ws.sdg.remove_node(1);
+    ws.sdg.node_sequences.set(2, reads[1].substr(1000, 2000));
+    auto added = kc.update_index();
+    REQUIRE(added > 0);
+    REQUIRE(kc.kindex.size() == kindex_before.size() + added);
+    REQUIRE(kc.kmers_pending_recount("lr") == added);
+    REQUIRE_THROWS(kc.kmers_pending_recount("nope"));
+    REQUIRE_THROWS(kc.recount_new_kmers("sdg", ds));
+    for (uint64_t i = 0; i < kindex_before.size(); ++i)
+        REQUIRE(kc.get_count_by_name("lr")[kc.find_kmer(kindex_before[i])] == lr_before[i]);
+
+    //graph counts match a fresh index, k-mers only in deleted nodes stay with 0
+    KmerCounter fresh(ws, "fresh", 31);
+    fresh.add_count("lr", ds);
+    kc.recount_new_kmers("lr", ds);
+    REQUIRE(kc.kmers_pending_recount("lr") == 0);
+    for (uint64_t i = 0; i < kc.kindex.size(); ++i) {
+        auto fi = fresh.find_kmer(kc.kindex[i]);
+        REQUIRE(kc.counts[0][i] == (fi == -1 ? 0 : fresh.counts[0][fi]));
+        if (fi != -1) REQUIRE(kc.counts[1][i] == fresh.counts[1][fi]);
+    }
+    for (sgNodeID_t n = 2; n < ws.sdg.nodes.size(); ++n)
+        REQUIRE(kc.project_node_count("lr", n) == fresh.project_count("lr", ws.sdg.get_node_sequence(n)));
+
+    //node state is stored with the counts
+    {
+        std::ofstream cf("kc_update.sdgkc");
+        kc.write_counts(cf);
+    }
+    KmerCounter kc2(ws, "kc_update.sdgkc");
+    REQUIRE(kc2.update_index() == 0);
+    REQUIRE(kc2 == kc);
+    ::unlink("kc_update.sdgkc");
+    ::unlink("kc_update.loseq");
+}
+
+TEST_CASE("Stage metrics and component memory are written to the journal") {
+    LongReadsDatastore::build_from_fastq("metrics.loseq", "metrics.loseq", "../tests/datasets/workspace/long_reads/long_reads.fastq");
+    WorkSpace ws;
+    LongReadsDatastore ds(ws, "metrics.loseq");
+    ReadSequenceBuffer rsb(ds);
+    ws.sdg.add_node(std::string(rsb.get_read_sequence(1)).substr(100, 2000), NodeStatus::Active);
+    sdglib::metrics().clear();
+    auto &kc = ws.add_kmer_counter("kc", 31);
+    kc.add_count("lr", ds);
+#ifdef SDG_METRICS
+    auto stages = sdglib::metrics().stages();
+    REQUIRE(stages.count("KmerCounter::add_count") == 1);
+    REQUIRE(stages["KmerCounter::add_count"].calls == 1);
+    REQUIRE(stages["KmerCounter::add_count"].items == ds.size());
+    REQUIRE(stages["KmerCounter::add_count"].peak_rss_kb > 0);
+#endif
+    auto usage = ws.memory_usage();
+    REQUIRE(usage["kmer_counter/kc"] >= kc.kindex.size() * (sizeof(uint64_t) + sizeof(uint16_t)));
+    REQUIRE(usage["sdg"] >= 2000 / 4); //the 2000bp node, 2-bit packed
+
+    auto &op = ws.journal_metrics("test");
+    REQUIRE(op.name == "Metrics");
+    REQUIRE(&op == &ws.journal.back());
+    std::set<std::string> entries;
+    for (auto &e: op.entries) entries.insert(e.detail.substr(0, e.detail.find(": ")));
+    REQUIRE(entries.count("gauge memory/kmer_counter/kc") == 1);
+#ifdef SDG_METRICS
+    REQUIRE(entries.count("stage KmerCounter::add_count") == 1);
+#endif
+    REQUIRE(sdglib::metrics().gauges()["memory/sdg"] == usage["sdg"]);
+    ::unlink("metrics.loseq");
+}
+
+TEST_CASE("Long read candidates are chained sparsely") {
+    //a chain to 5, too few hits to 3, and too many hits per position to a node with an id past any real graph
+    SparseChainer chainer(50, 4, 500, 60, 50, 100);
+    std::vector<std::vector<std::pair<int32_t, int32_t>>> matches(401);
+    for (auto p = 0; p < 200; ++p) matches[p].emplace_back(5, p + 100);
+    for (auto p = 0; p < 30; ++p) matches[p].emplace_back(-3, p);
+    for (auto p = 200; p < 300; ++p) for (auto i = 0; i < 6; ++i) matches[p].emplace_back(20000000, 1000 * i + p);
+    //matches past the read's k-mers are leftovers from longer reads
+    for (auto p = 300; p <= 400; ++p) matches[p].emplace_back(7, p);
+    auto blocks = chainer.alignment_blocks(1, matches, 300);
+    REQUIRE(blocks.size() == 1);
+    REQUIRE(blocks[0] == LongReadMapping(5, 1, 100, 299, 0, 199, 200));
+    REQUIRE(chainer.alignment_blocks(2, matches, 401).size() == 2);
+
+    LongReadsDatastore::build_from_fastq("sparse_chain.loseq", "sparse_chain.loseq", "../tests/datasets/workspace/long_reads/long_reads.fastq");
+    WorkSpace ws;
+    auto &ds = ws.add_long_reads_datastore("sparse_chain.loseq");
+    ReadSequenceBuffer rsb(ds);
+    for (auto rid = 1; rid <= 3; ++rid) ws.sdg.add_node(std::string(rsb.get_read_sequence(rid)).substr(100, 3000), NodeStatus::Active);
+    ds.mapper.map_reads();
+    for (auto rid = 1; rid <= 3; ++rid) {
+        auto mappings = ds.mapper.get_raw_mappings_from_read(rid);
+        REQUIRE(std::count_if(mappings.begin(), mappings.end(), [&](const LongReadMapping &m) { return m.node == rid and m.qStart <= 200; }) >= 1);
+    }
+    ::unlink("sparse_chain.loseq");
+}
+
+TEST_CASE("Long reads are mapped to a resumable on-disk store") {
+    LongReadsDatastore::build_from_fastq("lr_store.loseq", "lr_store.loseq", "../tests/datasets/workspace/long_reads/long_reads.fastq");
+    WorkSpace ws;
+    auto &ds = ws.add_long_reads_datastore("lr_store.loseq");
+    ReadSequenceBuffer rsb(ds);
+    for (auto rid = 1; rid <= 5; ++rid) ws.sdg.add_node(std::string(rsb.get_read_sequence(rid)).substr(100, 3000), NodeStatus::Active);
+    ds.mapper.map_reads();
+    auto expected = ds.mapper.mappings;
+    REQUIRE(not expected.empty());
+
+    //a store that can't be renamed into place fails after all shards are done, and is merged again on the next call
+    ::mkdir("lr.lrstore", 0755);
+    REQUIRE_THROWS(ds.mapper.map_reads_to_store("lr.lrstore", 64));
+    REQUIRE(std::ifstream("lr.lrstore.progress").good());
+    REQUIRE(std::ifstream("lr.lrstore.run1").good());
+    ::rmdir("lr.lrstore");
+    ds.mapper.map_reads_to_store("lr.lrstore", 64);
+    REQUIRE(not std::ifstream("lr.lrstore.progress").good());
+    REQUIRE(not std::ifstream("lr.lrstore.run0").good());
+
+    LongReadMappingStore store("lr.lrstore");
+    REQUIRE(store.get_graph_hash() == ws.sdg.content_hash());
+    REQUIRE(std::vector<LongReadMapping>(store.begin(), store.end()) == expected);
+    for (auto rid = 1; rid <= ds.size(); ++rid) REQUIRE(store.get_read_mappings(rid) == ds.mapper.get_raw_mappings_from_read(rid));
+    for (auto nid = 1; nid < ws.sdg.nodes.size(); ++nid) {
+        REQUIRE(store.get_node_reads(nid) == ds.mapper.reads_in_node[nid]);
+        for (const auto &m: store.get_node_mappings(-nid)) REQUIRE(llabs(m.node) == nid);
+    }
+    //an attached store is read in place, with the same lookups as the mappings
+    auto expected_reads_in_node = ds.mapper.reads_in_node;
+    std::vector<std::vector<LongReadMapping>> expected_read_mappings;
+    for (auto rid = 0; rid <= ds.size(); ++rid) expected_read_mappings.emplace_back(ds.mapper.get_raw_mappings_from_read(rid));
+    ds.mapper.load_store("lr.lrstore");
+    REQUIRE(ds.mapper.mappings.empty());
+    REQUIRE(ds.mapper.mapping_count() == expected.size());
+    REQUIRE(ds.mapper.reads_in_node == expected_reads_in_node);
+    for (auto rid = 1; rid <= ds.size(); ++rid) REQUIRE(ds.mapper.get_raw_mappings_from_read(rid) == expected_read_mappings[rid]);
+
+    //progress from another graph is not resumed
+    std::ofstream("lr2.lrstore.progress") << "sdg long read mapping shards, graph 0" << std::endl;
+    REQUIRE_THROWS(ds.mapper.map_reads_to_store("lr2.lrstore"));
+    ::unlink("lr2.lrstore.progress");
+    ::unlink("lr.lrstore");
+    ::unlink("lr.lrstore.tmp");
+    ::unlink("lr_store.loseq");
+}
+
+TEST_CASE("Long read perfect matches are mapped to a file in shards") {
+    LongReadsDatastore::build_from_fastq("lrr_file.loseq", "lrr_file.loseq", "../tests/datasets/workspace/long_reads/long_reads.fastq");
+    WorkSpace ws;
+    auto &ds = ws.add_long_reads_datastore("lrr_file.loseq");
+    ReadSequenceBuffer rsb(ds);
+    for (auto rid = 1; rid <= 5; ++rid) ws.sdg.add_node(std::string(rsb.get_read_sequence(rid)).substr(100, 3000), NodeStatus::Active);
+    LongReadsRecruiter lrr(ws.sdg, ds, 25, 50);
+    lrr.map(31);
+    auto expected = lrr.read_perfect_matches;
+    REQUIRE(not expected[1].empty());
+
+    //a tiny budget writes every batch of reads as its own shard
+    LongReadsRecruiter file_lrr(ws.sdg, ds, 25, 50);
+    file_lrr.map_to_file("lrr_file.dump", 31, 64);
+    for (const auto &rpm: file_lrr.read_perfect_matches) REQUIRE(rpm.empty());
+    file_lrr.load("lrr_file.dump");
+    REQUIRE(file_lrr.read_perfect_matches.size() == expected.size());
+    for (auto rid = 0; rid < expected.size(); ++rid) {
+        const auto &rpm = file_lrr.read_perfect_matches[rid];
+        REQUIRE(rpm.size() == expected[rid].size());
+        REQUIRE(std::equal(rpm.begin(), rpm.end(), expected[rid].begin(), [](const PerfectMatch &a, const PerfectMatch &b) {
+            return a.node == b.node and a.node_position == b.node_position and a.read_position == b.read_position and a.size == b.size;
+        }));
+    }
+    REQUIRE(file_lrr.node_reads.size() == ws.sdg.nodes.size());
+    ::unlink("lrr_file.dump");
+    ::unlink("lrr_file.loseq");
+}
+
+TEST_CASE("Unitigs from k-mer lists are compacted in parallel") {
+    const uint8_t k = 31;
+    std::mt19937 rng(13);
+    auto random_sequence = [&](uint64_t size) {
+        std::string s(size, 'A');
+        for (auto &c: s) c = "ACGT"[rng() % 4];
+        return s;
+    };
+    auto canonical = [](const std::string &s) {
+        std::string r(s.rbegin(), s.rend());
+        for (auto &b: r) b = PackedNodeSequences::complement(b);
+        return SequenceDistanceGraph::is_canonical(s) ? s : r;
+    };
+    //many linear unitigs, so walks from both ends of a unitig meet, a branch and a circle
+    std::vector<std::string> sequences;
+    std::set<std::string> expected;
+    for (auto i = 0; i < 3000; ++i) {
+        sequences.emplace_back(random_sequence(150 + rng() % 100));
+        expected.insert(canonical(sequences.back()));
+    }
+    auto trunk = random_sequence(80), b1 = random_sequence(60), b2 = random_sequence(60);
+    sequences.emplace_back(trunk + b1);
+    sequences.emplace_back(trunk + b2);
+    expected.insert(canonical(trunk));
+    expected.insert(canonical(trunk.substr(80 - k + 1) + b1));
+    expected.insert(canonical(trunk.substr(80 - k + 1) + b2));
+    auto circle = random_sequence(70);
+    sequences.emplace_back(circle + circle.substr(0, k - 1));
+
+    std::vector<uint64_t> kmers;
+    std::vector<__uint128_t> kmers128;
+    StringKMerFactory skf(k);
+    StringKMerFactory128 skf128(k);
+    for (auto &s: sequences) {
+        skf.create_kmers(s, kmers);
+        skf128.create_kmers(s, kmers128);
+    }
+    std::sort(kmers.begin(), kmers.end());
+    kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+    std::sort(kmers128.begin(), kmers128.end());
+    kmers128.erase(std::unique(kmers128.begin(), kmers128.end()), kmers128.end());
+
+    WorkSpace ws64, ws128;
+    auto &sg64 = ws64.sdg, &sg128 = ws128.sdg;
+    GraphMaker(sg64).new_graph_from_kmerlist_trivial64(kmers, k);
+    GraphMaker(sg128).new_graph_from_kmerlist_trivial128(kmers128, k);
+
+    REQUIRE(sg64.nodes[0].status == NodeStatus::Deleted);
+    REQUIRE(sg64.nodes.size() == expected.size() + 2);
+    std::set<std::string> found;
+    sgNodeID_t circle_node = 0;
+    for (sgNodeID_t n = 1; n < sg64.nodes.size(); ++n) {
+        REQUIRE(sg64.get_node_sequence(n) == sg128.get_node_sequence(n));
+        if (sg64.get_node_size(n) == 70 + k - 1) circle_node = n;
+        else found.insert(sg64.get_node_sequence(n));
+    }
+    REQUIRE(found == expected);
+    //the circle's sequence starts anywhere, but its ends link to each other
+    REQUIRE(circle_node != 0);
+    REQUIRE(sg64.get_fw_links(circle_node).size() == 1);
+    REQUIRE(std::abs(sg64.get_fw_links(circle_node)[0].dest) == circle_node);
+
+    uint64_t link_count = 0, link_count128 = 0;
+    for (sgNodeID_t n = 1; n < sg64.nodes.size(); ++n) {
+        link_count += sg64.links[n].size();
+        link_count128 += sg128.links[n].size();
+    }
+    REQUIRE(link_count == 2 * 2 + 2); //two links from the trunk to the branches, plus the circle on itself
+    REQUIRE(link_count128 == link_count);
+    sgNodeID_t trunk_node = 0;
+    for (sgNodeID_t n = 1; n < sg64.nodes.size(); ++n) if (sg64.get_node_sequence(n) == canonical(trunk)) trunk_node = n;
+    REQUIRE(trunk_node != 0);
+    REQUIRE(sg64.get_fw_links(trunk_node).size() + sg64.get_bw_links(trunk_node).size() == 2);
+}
+
+TEST_CASE("Read ranges are split into chunks of balanced cost") {
+    //heavy-tailed sizes: mostly short reads and a few very long ones
+    std::vector<uint64_t> sizes(10001, 1000);
+    for (uint64_t i = 1; i < sizes.size(); i += 997) sizes[i] = 2000000;
+    uint64_t total = 0;
+    for (uint64_t i = 1; i < sizes.size(); ++i) total += sizes[i] + 1;
+
+    sdglib::CostBalancedChunks chunks(1, sizes.size(), [&](uint64_t i) { return sizes[i]; }, 4, 8);
+    auto target = total / 32;
+    std::vector<int> seen(sizes.size());
+    for (uint64_t c = 0; c < chunks.size(); ++c) {
+        uint64_t cost = 0;
+        for (auto i = chunks.begin(c); i < chunks.end(c); ++i) {
+            ++seen[i];
+            cost += sizes[i] + 1;
+        }
+        REQUIRE(chunks.end(c) > chunks.begin(c));
+        REQUIRE(cost == chunks.cost(c));
+        //only a single item can go over the target
+        REQUIRE((cost <= target or chunks.end(c) - chunks.begin(c) == 1));
+        if (c > 0) REQUIRE(chunks.cost(c - 1) >= chunks.cost(c));
+    }
+    REQUIRE(seen[0] == 0);
+    REQUIRE(std::count(seen.begin() + 1, seen.end(), 1) == sizes.size() - 1);
+    //the long reads are first, each on its own
+    for (uint64_t c = 0; c < 11; ++c) REQUIRE(sizes[chunks.begin(c)] == 2000000);
+
+    REQUIRE(sdglib::CostBalancedChunks(5, 5, [](uint64_t) { return 1; }).size() == 0);
+}
+
+TEST_CASE("Tag neighbours are computed from the sparse tag x node matrix and persisted") {
+    //60 tags (in UCDavis format, the tag is in the read name) with 2 to 6 pairs each
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> base(0, 3), size(30, 130), tag_pairs(2, 6);
+    {
+        std::ofstream r1("tn_R1.fastq"), r2("tn_R2.fastq");
+        for (auto t = 0; t < 60; ++t) {
+            std::string tag;
+            for (auto i = 0; i < 16; ++i) tag += "ACGT"[base(gen)];
+            for (auto p = tag_pairs(gen); p > 0; --p) {
+                std::string s1, s2;
+                for (auto i = 0; i < 100; ++i) s1 += "ACGT"[base(gen)];
+                for (auto i = 0; i < 100; ++i) s2 += "ACGT"[base(gen)];
+                r1 << "@" << tag << "_" << p << "\n" << s1 << "\n+\n" << std::string(100, 'I') << "\n";
+                r2 << "@" << tag << "_" << p << "\n" << s2 << "\n+\n" << std::string(100, 'I') << "\n";
+            }
+        }
+    }
+    LinkedReadsDatastore::build_from_fastq("tn.lseq", "tn.lseq", "tn_R1.fastq", "tn_R2.fastq", LinkedReadsFormat::UCDavis);
+    WorkSpace ws;
+    for (auto n = 0; n < 40; ++n) {
+        std::string seq;
+        for (auto i = size(gen); i > 0; --i) seq += "ACGT"[base(gen)];
+        ws.sdg.add_node(seq);
+    }
+    ws.linked_reads_datastores.emplace_back(ws, "tn.lseq");
+    auto &ds = ws.linked_reads_datastores.back();
+    auto &m = ds.mapper;
+    //each pair of a tag lands on the next node, so tags have several reads on a node followed by other nodes
+    std::uniform_int_distribution<int> mapped(0, 4);
+    m.read_to_node.assign(ds.size() + 1, 0);
+    uint64_t tag_read = 0, repeated_then_other = 0;
+    std::map<sgNodeID_t, int> tag_node_reads;
+    for (uint64_t r = 1; r <= ds.size() + 1; ++r) {
+        if (r > ds.size() or (r > 1 and ds.get_read_tag(r) != ds.get_read_tag(r - 1))) {
+            if (tag_node_reads.size() > 1 and tag_node_reads.begin()->second > 1) ++repeated_then_other;
+            tag_read = 0;
+            tag_node_reads.clear();
+            if (r > ds.size()) break;
+        }
+        sgNodeID_t n = (ds.get_read_tag(r) % 37 + tag_read++ / 2) % 40 + 1;
+        if (mapped(gen)) {
+            m.read_to_node[r] = (r % 3 ? n : -n);
+            ++tag_node_reads[n];
+        }
+    }
+    REQUIRE(repeated_then_other > 20);
+    m.compute_all_tag_neighbours(60, 0.1);
+
+    //scores as they were computed with one map per node
+    std::vector<std::map<sgNodeID_t, uint32_t>> scores(ws.sdg.nodes.size());
+    for (uint64_t first = 1; first <= ds.size();) {
+        auto last = first;
+        std::map<sgNodeID_t, uint32_t> counts;
+        while (last <= ds.size() and ds.get_read_tag(last) == ds.get_read_tag(first)) {
+            if (m.read_to_node[last] != 0) ++counts[llabs(m.read_to_node[last])];
+            ++last;
+        }
+        uint64_t mapped_reads = 0;
+        for (auto &c: counts) mapped_reads += c.second;
+        if (ds.get_read_tag(first) != 0 and mapped_reads >= 2)
+            for (auto &n1: counts)
+                for (auto &n2: counts)
+                    if (ws.sdg.get_node_size(n1.first) >= 60 and ws.sdg.get_node_size(n2.first) >= 60)
+                        scores[n1.first][n2.first] += n1.second;
+        first = last;
+    }
+    REQUIRE(m.tag_neighbours.size() == ws.sdg.nodes.size());
+    uint64_t neighbours = 0;
+    for (sgNodeID_t n = 1; n < ws.sdg.nodes.size(); ++n) {
+        std::vector<std::pair<sgNodeID_t, float>> expected, found;
+        for (auto &s: scores[n]) {
+            float tag_score = ((float) s.second) / scores[n][n];
+            if (tag_score >= 0.1) expected.emplace_back(s.first, tag_score);
+        }
+        for (auto &tn: m.tag_neighbours[n]) found.emplace_back(tn.node, tn.score);
+        REQUIRE(found == expected);
+        neighbours += found.size();
+    }
+    REQUIRE(neighbours > ws.sdg.nodes.size());
+
+    ws.dump_to_disk("tn.sdgws");
+    WorkSpace in("tn.sdgws");
+    const auto &itn = in.linked_reads_datastores[0].mapper.tag_neighbours;
+    REQUIRE(itn.offsets == m.tag_neighbours.offsets);
+    REQUIRE(itn.entries.size() == m.tag_neighbours.entries.size());
+    for (uint64_t i = 0; i < itn.entries.size(); ++i) {
+        REQUIRE(itn.entries[i].node == m.tag_neighbours.entries[i].node);
+        REQUIRE(itn.entries[i].score == m.tag_neighbours.entries[i].score);
+    }
+    ::unlink("tn_R1.fastq");
+    ::unlink("tn_R2.fastq");
+    ::unlink("tn.lseq");
+    ::unlink("tn.sdgws");
+}